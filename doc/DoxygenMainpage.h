@@ -18,6 +18,17 @@ namespace ThreadInstrument {
    An important characteristic of the library is that its <b>activities only take place if the invocations
    to it are compiled with the macro \c THREADINSTRUMENT defined.</b> If the macro is not defined, the library
    does not do anything, having thus no overhead.
+
+   When the macro is defined, the recording can also be controlled at runtime. Every activity and log event
+   belongs to one of ::NCategories categories, which can be provided to beginActivity(), endActivity() and log()
+   as their first argument by means of a Category object, and to the macros ::THREADINSTRUMENT_PROF_IN,
+   ::THREADINSTRUMENT_TIMED_LOG_IN and ::THREADINSTRUMENT_LOG_IN. Otherwise the ::DefaultCategory is used.
+   The categories are enabled and disabled by means of enableCategory() and setEnabledCategories(), or when the program starts by
+   the environment variable \c THREADINSTRUMENT_CATEGORIES, which provides the mask of categories enabled, by default all of them.
+   Besides, toggleCategoriesOnSignal(int signum) makes the signal \c signum, by default \c SIGUSR2, alternatively disable
+   all the categories and restore them. The category is checked inline before calling the library, so the activities and events of
+   disabled categories only cost a test of a bit of a global mask. The activities that are running when the enabled categories
+   change are not measured.
    
    
    @section ProfilingDetail Profiling facility
@@ -28,29 +39,62 @@ namespace ThreadInstrument {
    - beginActivity(int activity) or beginActivity(const char *activity), which records the beginnig of an activity.
    - endActivity(int activity) or endActivity(const char *activity), which indicates the thread has finished the activity specified.
    
-   There is also a helper macro ::THREADINSTRUMENT_PROF that allows to profile a set of statements naming the activity with a C string. This macro is also faster that using the beginActivity() and endActivity() functions based on a C string.
+   There is also a helper macro ::THREADINSTRUMENT_PROF that allows to profile a set of statements naming the activity with a C string. This macro is also faster that using the beginActivity() and endActivity() functions based on a C string, as it relies on ::THREADINSTRUMENT_EVENT, which provides the integer associated to a C string. When the name is a string literal or another array of constant characters, each use of the macro looks up its integer only the first time, so that afterwards it just reads it, while the names given by pointers or by buffers built at runtime are looked up as by the functions. Thus <tt>beginActivity(THREADINSTRUMENT_EVENT("name"))</tt> is almost as fast as using an integer event.
    
-   Different threads can safely report the same activities during the same period of time, the associated reports being independently kept. Activities can also be nested, that is, an activity \a A can run inside an activity \a B. Recursivity, however, is not allowed. Thus a thread should not start the profiling of a new activity \a A until the previous one of the same kind \a A run by that thread has finished.
+   Different threads can safely report the same activities during the same period of time, the associated reports being independently kept. Activities can also be nested, that is, an activity \a A can run inside an activity \a B. Recursivity is also allowed, that is, a thread can start an activity \a A while another instance of \a A run by that thread has not finished. In this case every instance is counted as an invocation, but the time of the activity is only measured for the outermost one, so that it is not counted several times.
+
+   By default the time reported for an activity includes that of the activities nested in it. Calling enableNestedProfiling(bool enable) makes each thread keep a stack of the activities it is running, which requires the activities to be ended in the reverse order of their beginning. This allows to measure in EventData::exclusiveTime the time spent in each activity outside the activities nested in it, and to aggregate the activity by call path, that is, by the sequence of nested activities that led to each activity. The call paths are kept per thread in a calling-context tree whose data is provided as a ::CallPath2DataMap_t, which associates each path, represented as a ::CallPath_t vector of event numbers from the outermost to the innermost one, with its CallPathData, by means of getCallPaths(unsigned n) for the n-th thread and getAllCallPaths() for all the threads. dumpCallPaths() prints them as an indented tree.
+
+   Activities that take place very often can be sampled by means of setSampling(int event, unsigned period), so that only about one of each \c period invocations of the activity is timed. The invocations timed are chosen at random, spreading them over the execution while avoiding any periodicity of the application. The invocations not sampled only update EventData::invocations, which remains exact, while EventData::time is extrapolated from the EventData::samples timed, EventData::timeError providing the standard error of this estimation. The same function makes the log keep only about one of each \c period entries of \c event.
+
+   Besides the total time, EventData provides the minimum, maximum, mean and standard deviation of the durations of the outermost invocations of each activity. The tail of the distribution can be studied by means of enableHistograms(bool enable), which makes each thread record the durations of each activity in a LatencyHistogram whose buckets grow logarithmically with relative width 1/LatencyHistogram::NSubBuckets. The histograms take a fixed amount of memory, allocated the first time each activity is timed, so that recording a duration only increments a counter. They are merged with the rest of the EventData by getAllActivity(), LatencyHistogram::percentile() provides the percentiles of the durations, and dumpActivity() prints the distribution of the activities with histograms.
+
+   The reasons of the performance of the activities can be analyzed in Linux by means of enablePerfCounters(bool enable), which makes each thread count during the outermost invocations timed of its activities the cycles, instructions, last level cache misses and branch misses (see ::PerfCounter). Each thread opens a group of counters with \c perf_event_open the first time it begins an activity after they are enabled, and reads them from user space by means of \c rdpmc when the kernel allows it, so that no system call is needed. If the kernel multiplexes the counters because there are more than the hardware supports, each reading is scaled by the time the counter was enabled over the time it actually counted. The counts are reported in EventData::counters, and dumpActivity() prints the IPC and the events per invocation counted of each activity. The counters may not be available in virtual machines or if \c /proc/sys/kernel/perf_event_paranoid forbids them, which enablePerfCounters() reports returning false; perfCounterAvailable() tells which events can be counted.
 
    At any point during the program the user can request the information on the events recorded. 
    This is provided by means of a ::Int2EventDataMap_t object that associates
    the event numbers to objects of the class EventData that hold the information
    associated to the event. Two functions can provide this information:
-   - getActivity(unsigned n), which returns the event data for the n-th thread as a ::Int2EventDataMap_t.
+   - getActivity(unsigned n), which returns the event data for the n-th thread as a ::Int2EventDataMap_t. This map is a copy of the statistics built when the function is invoked.
    - getAllActivity(), which returns a ::Int2EventDataMap_t that summarizes the data for each event across all the threads.
    
+   The statistics can be requested while the threads are running, for example by a thread that monitors the application periodically. Only the thread that owns the statistics modifies them, protecting the statistics of each activity with a sequence lock, so that the other threads obtain a consistent copy of them without slowing down the owner. The clearing of the statistics of other threads is thus performed by each thread when it begins its next activity, the statistics being reported as empty meanwhile.
+
+   The statistics can also be monitored from outside the process by means of startLiveMetrics(const std::string& name, double period, unsigned max_entries), which starts a background thread that every \c period seconds publishes the statistics of each activity of each thread in a POSIX shared memory segment, named by default \c /threadinstrument.<pid>. The layout of the segment, described in \c thread_instrument/live_metrics.h, is protected by a sequence counter, so that external readers obtain consistent copies of it without taking locks nor stalling the process. The \c liveMetrics application prints the metrics of a process given its pid or the name of its segment, either once or periodically. stopLiveMetrics() performs a final update and removes the segment, which also happens automatically at program exit.
+
    Other functions provided by this module of the library are:
    - nThreadsWithActivity() indicates how many threads have recorded some event.
    - getMyThreadNumber() returns the thread index for the calling thread.
+   - setThreadName(const std::string& name) and setThreadRole(const std::string& role, int index) identify the calling thread. The role describes the kind of thread, such as the pool it belongs to, and the index its position among the threads of its role, for example the value of \c omp_get_thread_num(). Since the thread numbers depend on the order in which the threads first use the library, which may change from run to run, the dumps list the threads ordered by role and index and label them by their name or by their role and index (e.g. \c worker.3), so that the profiles of the same worker can be compared across runs. getThreadsInfo() provides this ordering and dumpThreadsActivity(std::ostream& s) prints the activity of each thread following it.
    - dumpActivity(const Int2EventDataMap_t& m, const std::string *names, std::ostream& s) prints the data stored in a ::Int2EventDataMap_t. The second argument is optional, and it allows to provide a string to describe each event, so that <tt>names[i]</tt> is the name of the <tt>i</tt>-th event. If the pointer is <tt>nullptr</tt>, the library tries to find a C string associated to the internal event number. If such string is not found, the event number will be used to describe the event. The third argument is also optional and defaults to std::cout.
    - dumpActivity(const Int2EventDataMap_t& m, const std::string *names, const std::string& filename) does the same, but printing to the file \c filename.
+   - dumpActivityCSV(const Int2EventDataMap_t& m, const std::string *names, std::ostream& s) and dumpActivityJSON(const Int2EventDataMap_t& m, const std::string *names, std::ostream& s) print the same data in CSV and JSON formats respectively, with a record per activity that contains all the fields of its EventData and the percentiles of its histogram, the values not measured being empty or \c null. Both functions have versions that write the file \c filename.
    - clearAllActivity() clears all the profiling data kept by the library except the number of known threads.
+   - clearActivity(unsigned n) clears the profiling data of the n-th thread.
+   - reclaimExitedThreads(bool enable) makes each thread that exits add its statistics to a global record reported by getAllActivity() and getAllCallPaths() and leave its data to be reused by the threads created later, which bounds the memory and the number of threads known in applications that create many short-lived threads.
+
+   The \c compareProfiles application compares the CSV reports of one or more baseline runs, given with \c -b, with those of one or more candidate runs. For each activity it compares the mean across the runs of its time, its invocations and, if histograms were recorded, its mean duration and its percentiles 50, 90 and 99. A time that grows more than a threshold (\c -t, 5% by default) is a regression when either side has a single run, or when a one-sided Welch's t-test finds it significant at the level given by \c -a (0.05 by default) if both sides have several runs. The application returns a failure exit status when it finds regressions, so that it can gate the performance in continuous integration.
+
+   The activity of entities that are not threads of the process, such as the streams of a GPU, can be recorded in lanes created by createLane(const std::string& name, const std::string& role, int index), whose role is \c device by default. A lane receives a number from the same sequence as the threads and is reported as one of them by getActivity(), getAllActivity(), getThreadsInfo() and the dumps of the log, so that pictureTime and the Chrome traces show it as another row next to the threads that launch its work. beginLaneActivity(unsigned lane, int activity, std::int64_t ns) and endLaneActivity(unsigned lane, int activity, std::int64_t ns), or laneActivity(unsigned lane, int activity, std::int64_t begin_ns, std::int64_t end_ns) for operations reported once they finish, record the activities with moments provided by the application in the nanoseconds of syncClockTime(). The clock of a device is usually translated by means of setLaneClockOffset(unsigned lane, std::int64_t ns), for example reading the device clock right after syncClockTime(). Any thread can record the activity of a lane, the moments of each lane being expected in chronological order. The activities are also logged as \c THREADINSTRUMENT_TIMED_LOG does, which shows the overlap between the host and the devices and the periods in which the devices are idle. For example, the kernels of a CUDA stream can be reported from the activity records of CUPTI:
+   @code
+   // Once per stream, where cupti_now was obtained by cuptiGetTimestamp
+   const unsigned lane = ThreadInstrument::createLane("gpu0.stream" + std::to_string(stream_id));
+   ThreadInstrument::setLaneClockOffset(lane, ThreadInstrument::syncClockTime() - cupti_now);
+   ...
+   // For each CUpti_ActivityKernel record of the stream
+   ThreadInstrument::laneActivity(lane, record->name, record->start, record->end);
+   @endcode
+
+   Internally each thread keeps the data of the activities numbered below \c THREADINSTRUMENT_MAX_DENSE_EVENT (1024 by default) in a dense array indexed by the activity number, while the other activities are kept in a \c std::map. Since the numbers provided by getEventNumber() are consecutive integers starting at 0, activities named by strings always benefit from the faster dense table. The limit is set when the library is compiled, a value 0 disabling the dense table.
    
    
    @section LoggingDetail Logging facility
    
-   Logging is also based on events specified as integers or C strings. The library has a commong log repository
-   for all the threads so that the ordering among them is correctly kept. Entries are made invoking any of
+   Logging is also based on events specified as integers or C strings. Each thread stores its entries in its own
+   log, so that logging does not require synchronization among threads, and the logs of all the threads are merged
+   according to the moment of each entry when they are dumped, so that the ordering among them is correctly kept.
+   This is why the moment of each entry is taken even for untimed entries, although it is only printed for timed ones.
+   Entries are made invoking any of
      - log(int event, int data, bool timed) or log(const char *event, int data, bool timed)
      - log(int event, void *data, bool timed) or log(const char * event, void *data, bool timed)
    
@@ -67,14 +111,68 @@ namespace ThreadInstrument {
    The log is kept in memory and it can be printed either by
     - calling dumpLog(std::ostream& s), whose argument is optional and defauls to std::cerr.
     - calling dumpLog(const std::string& filename, std::ios_base::openmode mode)
-    - or by sending a signal \c SIGUSR1 to the process.
+    - or by sending a signal \c SIGUSR1 to the process. This dump is skipped if the signal arrives while the log is being dumped or cleared.
 
    In all the cases, printing is destructive, that is, the printed entries are deleted from the log.
-   
+
+   The log can also be dumped in a compact binary format by means of dumpLogBinary(int fd) or 
+   dumpLogBinary(const std::string& filename, bool append). The binary log, whose layout is described 
+   in \c thread_instrument/binary_log.h, contains the names of the events registered with getEventNumber(), 
+   the threads known and fixed-size records with the thread number, the moment in nanoseconds, the event and the data of each entry.
+   Since it is streamed to the output without formatting the entries, it is much faster to generate than the text log.
+   The \c binLogToText application converts binary logs into text logs, and \c pictureTime accepts them directly.
+   The names and roles of the threads are also stored, so that \c pictureTime groups the rows of the threads by role and labels them with them, while
+   the text logs list them in comments at their beginning.
+
+   The binary logs also identify the process that generated them by its rank in its parallel job, the name of its host,
+   the moment in which it started and the offset of its clock with respect to a reference clock, so that the logs of the
+   processes of a distributed job can be analyzed together. The rank is taken from the variables set by the usual MPI launchers
+   and by Slurm, or it can be provided by setProcessInfo(int rank, const std::string& host). The offset is estimated by
+   synchronizeClock(const std::function<std::int64_t()>& reference_time, unsigned rounds), whose argument must return the syncClockTime() of the reference process.
+   For example, with MPI, if the process 0 replies to each message of the other processes with its syncClockTime(), they can use
+   \code
+   ThreadInstrument::synchronizeClock([] {
+     std::int64_t t;
+     MPI_Send(&t, 0, MPI_INT64_T, 0, 0, MPI_COMM_WORLD);
+     MPI_Recv(&t, 1, MPI_INT64_T, 0, 0, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+     return t;
+   });
+   \endcode
+   The \c mergeBinLogs application reads the logs of the processes in parallel and merges them into a single one in chronological order
+   in the reference clock, numbering the threads of each process after those of the processes with a lower rank.
+
+   Large logs are better analyzed with standard trace viewers such as \c chrome://tracing or Perfetto. dumpLogChromeTrace(std::ostream& s) and
+   dumpLogChromeTrace(const std::string& filename) dump the log in the Chrome Trace Event JSON format, streaming it as the entries are merged.
+   Each thread is a track of the trace, the entries with data 0 and 1, such as those of the ::THREADINSTRUMENT_TIMED_LOG and ::THREADINSTRUMENT_LOG macros,
+   are the beginning and the end of possibly nested slices, and the rest of the entries are instantaneous events whose argument \c data is the data logged or, if the event has a printer registered
+   with registerLogPrinter(int event, LogPrinter_t printer), the string it builds. The writer, which is provided in \c thread_instrument/chrome_trace.h, can also be used by other tools.
+
+   Long runs can avoid keeping the whole log in memory by means of startLogFlusher(const std::string& filename, double period, unsigned max_filled_chunks),
+   which starts a background thread that every \c period seconds appends the entries logged to \c filename in binary format,
+   deleting them from the log. The flush is anticipated when the threads fill \c max_filled_chunks chunks of entries, which bounds
+   the memory used. stopLogFlusher() performs a final flush and stops the thread, which also happens automatically at program exit.
+
+   Alternatively, flightRecorder(unsigned nlogs) turns the log of each thread into a ring that only keeps its \c nlogs most recent entries,
+   so that the memory used and the cost of the dumps do not grow with the length of the run. The ring can be dumped at any moment, even
+   from signal handlers, by dumpFlightRecorder(int fd), which does not consume it, and installFlightRecorderHandler(const std::string& filename, bool crashes)
+   makes the process dump it to \c filename when it receives \c SIGUSR1, replacing the handler of registerInspector(), and optionally when it crashes,
+   so that the last activity of each thread before the failure can be analyzed with \c pictureTime.
+
+   memoryUsage() reports the bytes used by the logs, the activity statistics and the registry of threads and event names, both in total and for each thread,
+   together with the log entries pending of each thread. setMemoryBudget(std::size_t bytes), or the environment variable \c THREADINSTRUMENT_MEMORY_BUDGET,
+   limits this memory, so that the log entries that would need new storage beyond the budget are discarded and counted in MemoryUsage::droppedLogEntries
+   instead of exhausting the memory of the process.
+
    In order to facilitate printing the information associated to each event type, users can register printers that transform the events into std::string. Two kinds of printers are supported:
     - a generic printer of type ::AllLogPrinter_t, which allows to print any event associated to the program, can be registered by means of registerLogPrinter(AllLogPrinter_t printer). The library provides two printers of this kind: ::defaultPrinter and ::pictureTimePrinter,
         which is designed to generate logs from the \c pictureTime application and supports the ::THREADINSTRUMENT_TIMED_LOG log entries. Both printers try to associate events to C string event names. If the event numbers logged are not associated to C strings, a label based on the event number is used.
     - specific functions of type ::LogPrinter_t to print the data associated to a given \c event type. They are registered by the function registerLogPrinter(int event, LogPrinter_t printer).
+
+   The data of an entry can also be a typed payload, that is, an object of a trivially copyable class of up to ::LogPayloadSize bytes,
+   which is copied into the entry by <tt>log(int event, const T& payload, bool is_timed)</tt>, so that it need not be kept alive until the log is dumped.
+   The payloads of each event are printed by a ::LogFormatter_t registered by <tt>registerLogFormatter<T>(int event, LogFormatter_t<T> formatter)</tt>,
+   which writes the representation of the payload in a buffer provided by the library, so that neither logging nor printing the entries allocates memory.
+   The binary logs keep the payloads, which are accessible by means of BinaryLogReader::payload().
    
    As mentioned above, the log system allows to run an arbitrary function when the process receives a \c SIGUSR1 signal.
    This function is registered by means of registerInspector() and it is responsible for doing whatever the
@@ -82,17 +180,55 @@ namespace ThreadInstrument {
  
    Other functions provided by this module of the library are:
    - clearLog() clears the logged data
+   - reserveLog(std::size_t nlogs) preallocates storage for \c nlogs entries. The logs are stored in chunks of entries taken from a pool that is reused after the entries are dumped or cleared, so that once enough storage has been reserved, logging does not allocate memory.
    - logLimit(unsigned nlogs) indicates that only the \c nlogs most recent entries must be printed by the dumpLog() functions. The discarded entries are deleted in the next invocation to dumpLog().
    
+   \section Runtimes Automatic instrumentation of OpenMP and TBB
+
+   The library \c thread_instrument_ompt, built when the OMPT interface header \c omp-tools.h is found, is an OMPT tool that
+   records the activity of the OpenMP runtimes that support OMPT, such as LLVM's \c libomp, which can also run the programs compiled by GCC.
+   The activities, whose names are given in \c thread_instrument/ompt_tool.h, are the idle time of the worker threads, the parallel regions,
+   the implicit and explicit tasks, the barriers and taskwaits, the time waiting in them, and the worksharing constructs.
+   Under ::enableNestedProfiling the call paths thus show what each thread was doing in each parallel region.
+   The program must call some function of that header, such as ThreadInstrument::OMPT::active(), so that the tool is linked.
+   The statically scheduled loops of the programs compiled by GCC do not call the runtime, so they are not recorded as loops.
+
+   For TBB, \c thread_instrument/tbb_observer.h provides ThreadInstrument::TBB::Observer, a \c tbb::task_scheduler_observer
+   that records as an activity the time each worker spends in the global arena or in a given \c tbb::task_arena, and ThreadInstrument::TBB::task(),
+   which wraps the bodies of the parallel algorithms and task groups so that each execution is recorded as an activity.
+   Under ::enableNestedProfiling the exclusive time of the arena activity is the time the workers spend looking for work or waiting.
+   Neither OMPT nor TBB report the steals of work, which are thus not recorded.
+
    \section Miscelanea Miscelanea
-   
+
    All the library functions that use C strings to represent events rely on the thread-safe function
    getEventNumber(const char *event), which associates a unique int to each different provided string.
    The string associated to an integer event can be retrieved using getEventName(int event). 
    
    It must be noted that logging based on C strings implies a somewhat larger performance penalty 
-   than using integers, as a map must be checked to translate the strings into integers.
-   
+   than using integers, as the strings must be translated into integers. The translation is kept in a
+   registry that is queried without locks, and each thread caches the numbers associated to the addresses
+   of the strings it uses, so that string literals are usually translated by comparing them with the cached name.
+   getEventName() finds the name of a number in constant time.
+   
+   @anchor Timestamps
+   The library stores the moments of the activities and the log entries as raw ticks of a clock, which are only
+   converted into seconds when they are reported. The clock used can be chosen when the library is compiled by
+   means of the CMake variable \c THREADINSTRUMENT_CLOCK, or at runtime by means of the environment variable of
+   the same name, which takes precedence. The options are
+   - \c chrono, the default, uses ThreadInstrument::clock_t.
+   - \c tsc reads the time stamp counter of x86 processors, which is much cheaper. Its frequency is measured
+     during 10 ms when the program starts. This option assumes that the counter is invariant and synchronized among the cores, as in modern processors.
+   - \c coarse uses \c CLOCK_MONOTONIC_COARSE in Linux, which is cheap but has a resolution of some milliseconds.
+
+   The binary logs store the ticks of the clock along with their frequency.
+
+   The overhead of the library can be measured with the \c bench_suite program of the tests, which the target \c benchmark runs
+   writing its results to \c benchmark.csv. It measures the nanoseconds per pair of beginning and end of an activity, per untimed and timed log entry,
+   per entry dumped by dumpLog() and dumpLogBinary() and per invocation of getAllActivity(), sweeping the number of threads, the number of
+   activities, their nesting depth, the use of nested profiling and the naming of the events by integers, strings or ::THREADINSTRUMENT_EVENT.
+   Each measurement is compared with the same code without the invocations of the library and is printed as a CSV line.
+
    \c pictureTime is an application that reads a log generated by ThreadInstrument in which
     - each entry must mark either the beginning or the end of an activity.
     - beginnings are marked with <tt>data=0</tt> and ends with <tt>data=1</tt>.
@@ -100,7 +236,7 @@ namespace ThreadInstrument {
     - the output must be printed using the pictureTimePrinter generic printer
    
    in which the first three points are automatically provided by the ::THREADINSTRUMENT_TIMED_LOG macro.
-   From this log, the application generates a graphical representation that shows what was each thread doing in each moment. The application has many flags to control the graph that are displayed when it is run without arguments. The output currently supported is a LaTeX file that relies on the \c tikz-timing package to draw the graph.
+   From this log, the application generates a graphical representation that shows what was each thread doing in each moment. The application has many flags to control the graph that are displayed when it is run without arguments. The default output is a LaTeX file that relies on the \c tikz-timing package to draw the graph. With the flag \c -j the application instead streams a trace in the Chrome Trace Event JSON format, in which the activities of each thread can be nested, which is more suitable for long traces with many threads. For LaTeX graphs of traces with many activities, the flag <tt>-b bins</tt> divides the timeline of each thread in \c bins intervals of the same length that are depicted by the activity that occupies most of each one of them, or with \c -u by the fraction of time in which the thread is busy, so that the size of the graph depends on the number of bins rather than on the number of activities. The options <tt>--from time</tt> and <tt>--to time</tt> restrict the output to a window of the times of the logs, the activities that overlap its limits being clipped, and <tt>--threads</tt> restricts it to a list of threads such as <tt>0-7,12</tt>, numbered as in the \c -j traces. The events out of them are dropped while the logs are read, so that the memory used depends on the size of the window. For binary logs, the first use of a window builds a sidecar time index, stored with the name of the log followed by \c .tidx, that allows later runs to skip the parts of the log that do not influence the window. The flag <tt>-a text</tt> or <tt>-a json</tt> replaces the graph by a report that can be compared between runs. It estimates the critical path of the execution walking back from the activity that ends last, taking as predecessor of each activity the one of any thread that ends last before it begins. It also shows for each activity its load imbalance, i.e., the maximum time spent on it by a thread divided by the mean among the threads, and its phases, i.e., the maximal lapses in which some thread runs it, together with the time the threads wait at the end of each phase for the slowest one, which is usually spent in a barrier. The parallel phases with the largest waiting time and the busy and idle time of each thread are listed as well. Large logs are read quickly because the application maps them in memory and parses them in parallel, as well as the different files it is given.
    */
 }
 
@@ -0,0 +1,345 @@
+/*
+ ThreadInstrument: Library to monitor thread activity
+ Copyright (C) 2012-2022 Basilio B. Fraguela. Universidade da Coruna
+
+ Distributed under the MIT License. (See accompanying file LICENSE)
+*/
+
+///
+/// \file     binary_log.h
+/// \brief    Layout of the binary logs generated by ::dumpLogBinary and helper to read them
+/// \author   Basilio B. Fraguela <basilio.fraguela@udc.es>
+///
+
+#ifndef THREAD_INSTRUMENT_BINARY_LOG_H
+#define THREAD_INSTRUMENT_BINARY_LOG_H
+
+#include <sys/types.h>
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+#include <string>
+
+/* A binary log is a BinaryLogFileHeader followed by a sequence of sections. Each section
+ starts with a BinaryLogSectionHeader that indicates its kind, the number of items it contains
+ and its size in bytes, so that readers can skip the sections they do not know.
+ The sections are
+ - BinaryLogEventNames: each item is a BinaryLogName followed by the length_ characters of the name (no final 0)
+ - BinaryLogThreads: each item is a BinaryLogThread
+ - BinaryLogEvents: each item is a BinaryLogRecord of BinaryLogFileHeader::recordSize_ bytes.
+   The records of each thread appear in chronological order.
+ - BinaryLogPayloads: the payloads of the records flagged with ::BinaryLogPayload of the next
+   ::BinaryLogEvents section, one after the other. count_ is the number of payloads.
+ - BinaryLogProcesses: each item is a BinaryLogProcess followed by the hostLength_ characters of the name
+   of its host (no final 0). The logs generated by the library have one, written after the file header,
+   while the logs merged by mergeBinLogs have one per process merged.
+ - BinaryLogThreadNames: each item is a BinaryLogThreadName followed by the nameLength_ characters of the name
+   and the roleLength_ characters of the role of a thread (no final 0s). Only the threads with a name or
+   a role have an item.
+ Several binary logs can be concatenated in the same file, as readers accept a BinaryLogFileHeader
+ where a section header is expected.
+ All the values are stored in the byte order of the machine that generated the log.
+
+ A binary log can have a sidecar time index, stored in a file with the name of the log followed by
+ ::BinaryLogIndexSuffix, which allows tools to skip the records outside a window of time. It is a
+ BinaryLogIndexHeader followed by BinaryLogIndexHeader::blocks_ BinaryLogIndexBlock, which describe
+ in order the blocks of consecutive records in which each ::BinaryLogEvents section is divided, and
+ by the BinaryLogIndexHeader::threads_ std::uint32_t numbers of the threads found in the records.
+*/
+
+namespace ThreadInstrument {
+
+  /// Characters at the beginning of a binary log
+  constexpr char BinaryLogMagic[8] = {'T', 'I', 'L', 'O', 'G', 'B', 'I', 'N'};
+
+  /// Version of the binary log format
+  constexpr std::uint32_t BinaryLogVersion = 1;
+
+  /// First bytes of a binary log
+  struct BinaryLogFileHeader {
+    char magic_[8];                 ///< ::BinaryLogMagic
+    std::uint32_t version_;         ///< ::BinaryLogVersion
+    std::uint32_t recordSize_;      ///< Size of each BinaryLogRecord
+    std::uint64_t ticksPerSecond_;  ///< Units of BinaryLogRecord::time_
+  };
+
+  /// Kinds of sections in a binary log
+  enum BinaryLogSectionKind : std::uint32_t {
+    BinaryLogEvents = 1,
+    BinaryLogEventNames = 2,
+    BinaryLogThreads = 3,
+    BinaryLogProcesses = 4,
+    BinaryLogPayloads = 5,
+    BinaryLogThreadNames = 6
+  };
+
+  /// Header of each section of a binary log
+  struct BinaryLogSectionHeader {
+    std::uint32_t kind_;   ///< A ::BinaryLogSectionKind
+    std::uint32_t count_;  ///< Number of items in the section
+    std::uint64_t bytes_;  ///< Size of the section after this header
+  };
+
+  /// Flags of a BinaryLogRecord
+  enum BinaryLogRecordFlags : std::uint32_t {
+    BinaryLogTimed = 1,    ///< The entry was timed
+    BinaryLogPayload = 2   ///< The entry has a typed payload, whose position in the preceding ::BinaryLogPayloads section is BinaryLogRecord::data_
+  };
+
+  /// Log entry
+  struct BinaryLogRecord {
+    std::int64_t time_;    ///< Moment since the beginning of the program in BinaryLogFileHeader::ticksPerSecond_ units
+    std::uint32_t thread_; ///< Number of the thread that logged the entry
+    std::uint32_t event_;  ///< Event logged
+    std::uint64_t data_;   ///< Data associated to the entry
+    std::uint32_t flags_;  ///< Combination of ::BinaryLogRecordFlags
+    std::uint32_t payloadSize_;  ///< Bytes of the payload if the flag ::BinaryLogPayload is set, 0 otherwise
+  };
+
+  /// Header of an event name, followed by its characters
+  struct BinaryLogName {
+    std::uint32_t event_;
+    std::uint32_t length_;
+  };
+
+  /// Information on a thread
+  struct BinaryLogThread {
+    std::uint32_t thread_;    ///< Number of the thread in the log
+    std::uint32_t reserved_;
+    std::uint64_t systemId_;  ///< Identifier of the thread in the operating system
+  };
+
+  /// Name and role of a thread, followed by the characters of both
+  struct BinaryLogThreadName {
+    std::uint32_t thread_;      ///< Number of the thread in the log
+    std::int32_t roleIndex_;    ///< Position of the thread among those of its role, -1 if it has no role
+    std::uint32_t nameLength_;  ///< Characters of the name
+    std::uint32_t roleLength_;  ///< Characters of the role
+  };
+
+  /// Information on a process whose threads appear in the log, followed by the name of its host
+  /** The moment of each record in the reference clock shared by the processes of a job, in nanoseconds since
+   *  the Unix epoch, is startTime_ + clockOffset_ plus the BinaryLogRecord::time_ converted to nanoseconds. */
+  struct BinaryLogProcess {
+    std::int32_t rank_;         ///< Rank of the process in its parallel job, -1 if unknown
+    std::uint32_t hostLength_;  ///< Characters of the name of the host that follow this item
+    std::uint64_t pid_;         ///< Identifier of the process in the operating system
+    std::int64_t startTime_;    ///< Nanoseconds since the Unix epoch in the clock of the process at BinaryLogRecord::time_ 0
+    std::int64_t clockOffset_;  ///< Nanoseconds to add to the clock of the process to obtain the reference clock
+    std::uint32_t firstThread_; ///< First number of the threads of the process in the log
+    std::uint32_t threads_;     ///< Number of threads of the process, 0 meaning all those from firstThread_ on
+  };
+
+  /// Characters at the beginning of a sidecar time index
+  constexpr char BinaryLogIndexMagic[8] = {'T', 'I', 'L', 'O', 'G', 'I', 'D', 'X'};
+
+  /// Version of the sidecar time index format
+  constexpr std::uint32_t BinaryLogIndexVersion = 1;
+
+  /// Suffix added to the name of a binary log to obtain the name of its sidecar time index
+  constexpr const char *BinaryLogIndexSuffix = ".tidx";
+
+  /// First bytes of a sidecar time index
+  struct BinaryLogIndexHeader {
+    char magic_[8];                 ///< ::BinaryLogIndexMagic
+    std::uint32_t version_;         ///< ::BinaryLogIndexVersion
+    std::uint32_t blockRecords_;    ///< Records of each block, except the last one of each section
+    std::uint64_t logBytes_;        ///< Size of the binary log indexed
+    std::uint64_t blocks_;          ///< Number of BinaryLogIndexBlock that follow
+    std::uint32_t threads_;         ///< Number of thread numbers after the blocks
+    std::uint32_t reserved_;
+  };
+
+  /// Description of a block of consecutive records of a ::BinaryLogEvents section
+  struct BinaryLogIndexBlock {
+    std::uint32_t section_;   ///< Position of the section among the ::BinaryLogEvents sections of the log, starting at 0
+    std::uint32_t records_;   ///< Records in the block
+    std::int64_t minTime_;    ///< Smallest time of the timed records of the block
+    std::int64_t maxTime_;    ///< Largest time of the timed records of the block
+    std::int64_t reach_;      ///< Largest time of the records of the block and of the ends of the activities begun in it
+  };
+
+  /// Sequential reader of binary logs
+  class BinaryLogReader {
+
+    FILE *f_;
+    BinaryLogFileHeader header_;
+    BinaryLogSectionHeader section_;
+    off_t sectionEnd_;                  ///< Position of the file where the current section ends
+    std::uint32_t pending_;             ///< Items not read in the current section
+    std::string payloads_;              ///< Contents of the last ::BinaryLogPayloads section
+
+    /// Fills header_ given its first \c n bytes, reading the rest from the file
+    bool readHeaderRest(const char *first_bytes, std::size_t n)
+    {
+      memcpy(&header_, first_bytes, n);
+      return (fread(reinterpret_cast<char *>(&header_) + n, sizeof(header_) - n, 1, f_) == 1) &&
+             (header_.recordSize_ >= sizeof(BinaryLogRecord));
+    }
+
+  public:
+
+    /// Checks whether the first bytes of a file are those of a binary log
+    static bool isBinaryLog(const char *first_bytes, std::size_t n) noexcept
+    {
+      return (n >= sizeof(BinaryLogMagic)) && !memcmp(first_bytes, BinaryLogMagic, sizeof(BinaryLogMagic));
+    }
+
+    /// Builds a reader for file \c f, which must be positioned at the beginning of a binary log
+    explicit BinaryLogReader(FILE *f) noexcept :
+    f_(f), sectionEnd_(0), pending_(0)
+    {
+      section_.kind_ = 0;
+      section_.count_ = 0;
+      section_.bytes_ = 0;
+    }
+
+    /// Reads the file header. Returns whether it is valid
+    bool open()
+    { char magic[sizeof(BinaryLogMagic)];
+
+      return (fread(magic, sizeof(magic), 1, f_) == 1) && isBinaryLog(magic, sizeof(magic)) && readHeaderRest(magic, sizeof(magic));
+    }
+
+    const BinaryLogFileHeader& header() const noexcept { return header_; }
+
+    /// Moves to the next section, skipping what was not read of the current one
+    /** @return whether there is a new section */
+    bool nextSection(BinaryLogSectionHeader& section)
+    {
+      if (pending_) {
+        fseeko(f_, sectionEnd_, SEEK_SET);
+        pending_ = 0;
+      }
+
+      do {
+        char buf[sizeof(BinaryLogSectionHeader)];
+        if (fread(buf, sizeof(buf), 1, f_) != 1) {
+          return false;
+        }
+        if (isBinaryLog(buf, sizeof(buf))) {
+          // A concatenated log
+          if (!readHeaderRest(buf, sizeof(buf))) {
+            return false;
+          }
+          continue;
+        }
+        memcpy(&section_, buf, sizeof(section_));
+        sectionEnd_ = ftello(f_) + static_cast<off_t>(section_.bytes_);
+        if (section_.kind_ == BinaryLogPayloads) {
+          // Kept for the records of the next section
+          payloads_.resize(section_.bytes_);
+          if (section_.bytes_ && (fread(&payloads_[0], section_.bytes_, 1, f_) != 1)) {
+            return false;
+          }
+          continue;
+        }
+        if ((section_.kind_ != BinaryLogEvents) && (section_.kind_ != BinaryLogEventNames) && (section_.kind_ != BinaryLogThreads) && (section_.kind_ != BinaryLogProcesses) &&
+            (section_.kind_ != BinaryLogThreadNames)) {
+          fseeko(f_, sectionEnd_, SEEK_SET);
+          continue;
+        }
+        break;
+      } while (true);
+
+      pending_ = section_.count_;
+      section = section_;
+      return true;
+    }
+
+    /// Position of the file where the current section ends
+    off_t sectionEnd() const noexcept { return sectionEnd_; }
+
+    /// Reads the next record of a ::BinaryLogEvents section
+    bool readRecord(BinaryLogRecord& record)
+    {
+      if (!pending_ || (section_.kind_ != BinaryLogEvents) || (fread(&record, sizeof(record), 1, f_) != 1)) {
+        return false;
+      }
+      if (header_.recordSize_ > sizeof(record)) {
+        fseeko(f_, static_cast<off_t>(header_.recordSize_ - sizeof(record)), SEEK_CUR);
+      }
+      pending_--;
+      return true;
+    }
+
+    /// Skips the next \c n records of a ::BinaryLogEvents section
+    bool skipRecords(std::uint32_t n)
+    {
+      if ((section_.kind_ != BinaryLogEvents) || (n > pending_)) {
+        return false;
+      }
+      pending_ -= n;
+      return !fseeko(f_, static_cast<off_t>(n) * header_.recordSize_, SEEK_CUR);
+    }
+
+    /// Payload of \c record, which must belong to the current section, or nullptr if it has none
+    const void *payload(const BinaryLogRecord& record) const noexcept
+    {
+      if (!(record.flags_ & BinaryLogPayload) || (record.data_ > payloads_.size()) || (record.payloadSize_ > payloads_.size() - record.data_)) {
+        return nullptr;
+      }
+      return payloads_.data() + record.data_;
+    }
+
+    /// Reads the next name of a ::BinaryLogEventNames section
+    bool readName(std::uint32_t& event, std::string& name)
+    { BinaryLogName bn;
+
+      if (!pending_ || (section_.kind_ != BinaryLogEventNames) || (fread(&bn, sizeof(bn), 1, f_) != 1)) {
+        return false;
+      }
+      name.resize(bn.length_);
+      if (bn.length_ && (fread(&name[0], bn.length_, 1, f_) != 1)) {
+        return false;
+      }
+      event = bn.event_;
+      pending_--;
+      return true;
+    }
+
+    /// Reads the next item of a ::BinaryLogThreads section
+    bool readThread(BinaryLogThread& thread)
+    {
+      if (!pending_ || (section_.kind_ != BinaryLogThreads) || (fread(&thread, sizeof(thread), 1, f_) != 1)) {
+        return false;
+      }
+      pending_--;
+      return true;
+    }
+
+    /// Reads the next item of a ::BinaryLogThreadNames section
+    bool readThreadName(BinaryLogThreadName& thread, std::string& name, std::string& role)
+    {
+      if (!pending_ || (section_.kind_ != BinaryLogThreadNames) || (fread(&thread, sizeof(thread), 1, f_) != 1)) {
+        return false;
+      }
+      name.resize(thread.nameLength_);
+      role.resize(thread.roleLength_);
+      if ((thread.nameLength_ && (fread(&name[0], thread.nameLength_, 1, f_) != 1)) ||
+          (thread.roleLength_ && (fread(&role[0], thread.roleLength_, 1, f_) != 1))) {
+        return false;
+      }
+      pending_--;
+      return true;
+    }
+
+    /// Reads the next item of a ::BinaryLogProcesses section
+    bool readProcess(BinaryLogProcess& process, std::string& host)
+    {
+      if (!pending_ || (section_.kind_ != BinaryLogProcesses) || (fread(&process, sizeof(process), 1, f_) != 1)) {
+        return false;
+      }
+      host.resize(process.hostLength_);
+      if (process.hostLength_ && (fread(&host[0], process.hostLength_, 1, f_) != 1)) {
+        return false;
+      }
+      pending_--;
+      return true;
+    }
+
+  };
+
+} //namespace ThreadInstrument
+
+#endif
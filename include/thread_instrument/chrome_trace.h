@@ -0,0 +1,145 @@
+/*
+ ThreadInstrument: Library to monitor thread activity
+ Copyright (C) 2012-2022 Basilio B. Fraguela. Universidade da Coruna
+
+ Distributed under the MIT License. (See accompanying file LICENSE)
+*/
+
+///
+/// \file     chrome_trace.h
+/// \brief    Streaming writer of traces in the Chrome Trace Event JSON format
+/// \author   Basilio B. Fraguela <basilio.fraguela@udc.es>
+///
+
+#ifndef THREAD_INSTRUMENT_CHROME_TRACE_H
+#define THREAD_INSTRUMENT_CHROME_TRACE_H
+
+#include <cstdio>
+#include <cstdint>
+#include <ostream>
+#include <string>
+
+/* The traces are JSON objects whose traceEvents array contains an object per event, which can be
+ opened by chrome://tracing, Perfetto (ui.perfetto.dev) and other viewers. The writer emits each
+ event as it is provided, so that the trace is never kept in memory. The moments are provided in
+ seconds and written in microseconds, the unit of the format.
+*/
+
+namespace ThreadInstrument {
+
+  /// Writes a trace in the Chrome Trace Event JSON format to an ostream as the events are provided
+  class ChromeTraceWriter {
+
+    std::ostream& s_;
+    const std::int64_t pid_;
+    bool first_;                      ///< Whether no event has been written yet
+
+    /// Writes the beginning of an event up to its name
+    void open(char phase, unsigned thread, double seconds, const char *name)
+    { char buf[96];
+
+      if (!first_) {
+        s_ << ",\n";
+      }
+      first_ = false;
+      snprintf(buf, sizeof(buf), "{\"ph\":\"%c\",\"pid\":%lld,\"tid\":%u,\"ts\":%.3f,\"name\":\"", phase, static_cast<long long>(pid_), thread, seconds * 1e6);
+      s_ << buf;
+      writeEscaped(name);
+      s_ << '"';
+    }
+
+  public:
+
+    /// Starts a trace of the process \c pid in \c s
+    ChromeTraceWriter(std::ostream& s, std::int64_t pid) :
+    s_(s), pid_(pid), first_(true)
+    {
+      s_ << "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n";
+    }
+
+    ChromeTraceWriter(const ChromeTraceWriter&) = delete;
+    ChromeTraceWriter& operator=(const ChromeTraceWriter&) = delete;
+
+    /// Finishes the trace
+    ~ChromeTraceWriter()
+    {
+      s_ << "\n]}\n";
+    }
+
+    /// Writes \c str as the contents of a JSON string
+    void writeEscaped(const char *str)
+    { char buf[8];
+
+      for (const char *p = str; *p; ++p) {
+        const unsigned char c = static_cast<unsigned char>(*p);
+        if ((c == '"') || (c == '\\')) {
+          s_ << '\\' << *p;
+        } else if (c < 0x20) {
+          snprintf(buf, sizeof(buf), "\\u%04x", c);
+          s_ << buf;
+        } else {
+          s_ << *p;
+        }
+      }
+    }
+
+    /// Names the thread \c thread in the viewers
+    void threadName(unsigned thread, const char *name)
+    {
+      open('M', thread, 0.0, "thread_name");
+      s_ << ",\"args\":{\"name\":\"";
+      writeEscaped(name);
+      s_ << "\"}}";
+    }
+
+    /// Makes the viewers show \c thread in the position \c index among the threads of the process
+    void threadSortIndex(unsigned thread, int index)
+    {
+      open('M', thread, 0.0, "thread_sort_index");
+      s_ << ",\"args\":{\"sort_index\":" << index << "}}";
+    }
+
+    /// Beginning of a slice \c name of \c thread at \c seconds. The slices of a thread must be properly nested
+    void begin(unsigned thread, double seconds, const char *name)
+    {
+      open('B', thread, seconds, name);
+      s_ << '}';
+    }
+
+    /// End of the innermost slice \c name of \c thread open
+    void end(unsigned thread, double seconds, const char *name)
+    {
+      open('E', thread, seconds, name);
+      s_ << '}';
+    }
+
+    /// Slice \c name of \c thread of \c duration seconds begun at \c seconds
+    void complete(unsigned thread, double seconds, double duration, const char *name)
+    { char buf[48];
+
+      open('X', thread, seconds, name);
+      snprintf(buf, sizeof(buf), ",\"dur\":%.3f}", duration * 1e6);
+      s_ << buf;
+    }
+
+    /// Instantaneous event \c name of \c thread with the string \c data as argument
+    void instant(unsigned thread, double seconds, const char *name, const char *data)
+    {
+      open('i', thread, seconds, name);
+      s_ << ",\"s\":\"t\",\"args\":{\"data\":\"";
+      writeEscaped(data);
+      s_ << "\"}}";
+    }
+
+    /// Instantaneous event \c name of \c thread with the integer \c data as argument
+    void instant(unsigned thread, double seconds, const char *name, unsigned long long data)
+    {
+      open('i', thread, seconds, name);
+      s_ << ",\"s\":\"t\",\"args\":{\"data\":" << data << "}}";
+    }
+
+  };
+
+} //namespace ThreadInstrument
+
+#endif
@@ -0,0 +1,231 @@
+/*
+ ThreadInstrument: Library to monitor thread activity
+ Copyright (C) 2012-2022 Basilio B. Fraguela. Universidade da Coruna
+
+ Distributed under the MIT License. (See accompanying file LICENSE)
+*/
+
+///
+/// \file     live_metrics.h
+/// \brief    Layout of the shared memory segment published by ::startLiveMetrics and helper to read it
+/// \author   Basilio B. Fraguela <basilio.fraguela@udc.es>
+///
+
+#ifndef THREAD_INSTRUMENT_LIVE_METRICS_H
+#define THREAD_INSTRUMENT_LIVE_METRICS_H
+
+#include <sys/types.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <cstdint>
+#include <cstring>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <vector>
+#include <thread>
+
+/* The live metrics of a process are kept in a POSIX shared memory object, by default named
+ /threadinstrument.<pid>, whose size does not change while it exists. The segment starts with a
+ LiveMetricsHeader, followed by an array of LiveMetricsHeader::maxNames_ LiveMetricsName and an
+ array of LiveMetricsHeader::maxEntries_ LiveMetricsEntry, of which the first nNames_ and nEntries_
+ are valid. There is an entry for each activity run by each thread.
+ The publisher rewrites the segment every LiveMetricsHeader::period_ seconds. LiveMetricsHeader::sequence_
+ is odd while it is being updated, so that readers copy the segment when it is even and accept the copy
+ if sequence_ did not change meanwhile. Readers thus never block the publisher nor the instrumented threads.
+ The publisher gathers the statistics before it begins the update, which thus only lasts the copy to the segment,
+ and the readers give up after a timeout, as the publisher might have died during an update.
+ All the values are stored in the byte order of the machine that generated them.
+*/
+
+namespace ThreadInstrument {
+
+  /// Characters at the beginning of a live metrics segment
+  constexpr char LiveMetricsMagic[8] = {'T', 'I', 'L', 'I', 'V', 'E', 'S', 'H'};
+
+  /// Version of the live metrics layout
+  constexpr std::uint32_t LiveMetricsVersion = 1;
+
+  /// Maximum length of the names in a LiveMetricsName, including the final 0
+  constexpr std::uint32_t LiveMetricsNameLength = 56;
+
+  /// Flags of a LiveMetricsHeader
+  enum LiveMetricsFlags : std::uint32_t {
+    LiveMetricsTruncated = 1,   ///< Some entries or names did not fit in the segment
+    LiveMetricsStopped = 2      ///< The publisher stopped, so the segment will not be updated again
+  };
+
+  /// First bytes of a live metrics segment
+  struct LiveMetricsHeader {
+    char magic_[8];                       ///< ::LiveMetricsMagic
+    std::uint32_t version_;               ///< ::LiveMetricsVersion
+    std::uint32_t headerSize_;            ///< Size of this header, where the names begin
+    std::uint32_t maxNames_;              ///< Capacity of the array of LiveMetricsName
+    std::uint32_t maxEntries_;            ///< Capacity of the array of LiveMetricsEntry
+    std::uint64_t segmentSize_;           ///< Size of the whole segment
+    std::atomic<std::uint32_t> sequence_; ///< Number of updates started, odd during an update
+    std::uint32_t flags_;                 ///< Combination of ::LiveMetricsFlags
+    std::int64_t pid_;                    ///< Process that publishes the metrics
+    double period_;                       ///< Seconds between updates
+    double updateTime_;                   ///< Seconds since the beginning of the program of the last update
+    std::uint32_t nNames_;                ///< Valid LiveMetricsName
+    std::uint32_t nEntries_;              ///< Valid LiveMetricsEntry
+    std::uint32_t nThreads_;              ///< Threads known
+    std::uint32_t reserved_;
+  };
+
+  /// Name of an event
+  struct LiveMetricsName {
+    std::int32_t event_;
+    std::uint32_t reserved_;
+    char name_[LiveMetricsNameLength];    ///< Name ended in 0, truncated if needed
+  };
+
+  /// Statistics of an activity in a thread, as provided by EventData
+  struct LiveMetricsEntry {
+    std::uint32_t thread_;
+    std::int32_t event_;
+    std::uint32_t invocations_;
+    std::uint32_t samples_;
+    std::uint32_t depth_;
+    std::uint32_t reserved_;
+    double time_;
+    double exclusiveTime_;
+    double timeError_;
+    double minTime_;
+    double maxTime_;
+    double meanTime_;
+    double timeStdDev_;
+  };
+
+  static_assert(sizeof(LiveMetricsHeader) % 8 == 0, "LiveMetricsHeader must keep the alignment of the arrays");
+
+  /// Size of a live metrics segment with the capacities given
+  inline std::size_t liveMetricsSegmentSize(std::uint32_t max_names, std::uint32_t max_entries) noexcept
+  {
+    return sizeof(LiveMetricsHeader) + max_names * sizeof(LiveMetricsName) + max_entries * sizeof(LiveMetricsEntry);
+  }
+
+  /// Default name of the live metrics segment of process \c pid
+  inline std::string defaultLiveMetricsName(long pid)
+  {
+    return "/threadinstrument." + std::to_string(pid);
+  }
+
+  /// Reader of live metrics segments
+  class LiveMetricsReader {
+
+    const char *segment_;
+    std::size_t size_;
+
+    const LiveMetricsHeader& header() const noexcept { return *reinterpret_cast<const LiveMetricsHeader *>(segment_); }
+
+  public:
+
+    LiveMetricsReader() noexcept :
+    segment_(nullptr), size_(0)
+    { }
+
+    LiveMetricsReader(const LiveMetricsReader&) = delete;
+    LiveMetricsReader& operator=(const LiveMetricsReader&) = delete;
+
+    ~LiveMetricsReader()
+    {
+      close();
+    }
+
+    /// Maps the segment \c name. Returns whether it is a valid live metrics segment
+    bool open(const std::string& name)
+    { struct stat st;
+
+      close();
+      const int fd = shm_open(name.c_str(), O_RDONLY, 0);
+      if (fd < 0) {
+        return false;
+      }
+      if ((fstat(fd, &st) == 0) && (static_cast<std::size_t>(st.st_size) >= sizeof(LiveMetricsHeader))) {
+        void * const p = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+        if (p != MAP_FAILED) {
+          segment_ = static_cast<const char *>(p);
+          size_ = st.st_size;
+        }
+      }
+      ::close(fd);
+
+      if ((segment_ != nullptr) &&
+          (memcmp(header().magic_, LiveMetricsMagic, sizeof(LiveMetricsMagic)) || (header().version_ != LiveMetricsVersion) ||
+           (header().headerSize_ != sizeof(LiveMetricsHeader)) ||
+           (header().segmentSize_ != liveMetricsSegmentSize(header().maxNames_, header().maxEntries_)) || (header().segmentSize_ > size_))) {
+        close();
+      }
+
+      return segment_ != nullptr;
+    }
+
+    void close() noexcept
+    {
+      if (segment_ != nullptr) {
+        munmap(const_cast<char *>(segment_), size_);
+        segment_ = nullptr;
+        size_ = 0;
+      }
+    }
+
+    /// Copies a consistent version of the metrics
+    /** @param header   receives the header, whose sequence_ is that of the version copied
+     *  @param names    receives the LiveMetricsHeader::nNames_ valid names
+     *  @param entries  receives the LiveMetricsHeader::nEntries_ valid entries
+     *  @param timeout  seconds after which the reader gives up if the segment is always being updated
+     *  @return false if no segment is mapped or no consistent version could be copied before the timeout, in which
+     *          case the arguments may keep a partial copy, as when the publisher died during an update
+     */
+    bool read(LiveMetricsHeader& header, std::vector<LiveMetricsName>& names, std::vector<LiveMetricsEntry>& entries, double timeout = 1.0) const
+    { std::uint32_t seq;
+
+      if (segment_ == nullptr) {
+        return false;
+      }
+
+      const LiveMetricsHeader& h = this->header();
+      const LiveMetricsName * const names_p = reinterpret_cast<const LiveMetricsName *>(segment_ + h.headerSize_);
+      const LiveMetricsEntry * const entries_p = reinterpret_cast<const LiveMetricsEntry *>(names_p + h.maxNames_);
+      const auto deadline = std::chrono::steady_clock::now() + std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(timeout));
+
+      while (true) {
+        while ((seq = h.sequence_.load(std::memory_order_acquire)) & 1) {
+          if (std::chrono::steady_clock::now() > deadline) {
+            return false;
+          }
+          std::this_thread::yield();
+        }
+        memcpy(static_cast<void *>(&header), &h, sizeof(header));
+        const std::uint32_t nnames = std::min(header.nNames_, h.maxNames_);
+        const std::uint32_t nentries = std::min(header.nEntries_, h.maxEntries_);
+        names.assign(names_p, names_p + nnames);
+        entries.assign(entries_p, entries_p + nentries);
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (h.sequence_.load(std::memory_order_relaxed) == seq) {
+          break;
+        }
+        if (std::chrono::steady_clock::now() > deadline) {
+          return false;
+        }
+      }
+
+      header.sequence_.store(seq, std::memory_order_relaxed);
+      header.nNames_ = static_cast<std::uint32_t>(names.size());
+      header.nEntries_ = static_cast<std::uint32_t>(entries.size());
+      for (LiveMetricsName& name : names) {
+        name.name_[LiveMetricsNameLength - 1] = 0;
+      }
+      return true;
+    }
+
+  };
+
+} //namespace ThreadInstrument
+
+#endif
@@ -0,0 +1,54 @@
+/*
+ ThreadInstrument: Library to monitor thread activity
+ Copyright (C) 2012-2022 Basilio B. Fraguela. Universidade da Coruna
+
+ Distributed under the MIT License. (See accompanying file LICENSE)
+*/
+
+///
+/// \file     ompt_tool.h
+/// \brief    OMPT tool that records the activity of the OpenMP runtime as ThreadInstrument activities
+/// \author   Basilio B. Fraguela <basilio.fraguela@udc.es>
+///
+
+#ifndef THREAD_INSTRUMENT_OMPT_TOOL_H
+#define THREAD_INSTRUMENT_OMPT_TOOL_H
+
+#include "thread_instrument/thread_instrument.h"
+
+/* The tool is provided by the library thread_instrument_ompt, which defines the ompt_start_tool
+ function that OpenMP runtimes supporting OMPT (e.g. LLVM libomp or Intel's) look for when the
+ program starts. Since it is a static library, the program must use some function of this header
+ (e.g. ThreadInstrument::OMPT::active()) so that the linker includes the tool.
+ The environment variable OMP_TOOL=disabled disables the tool.
+*/
+
+namespace ThreadInstrument {
+
+  /// Activities recorded by the OMPT tool
+  namespace OMPT {
+
+    constexpr const char *Idle = "OMP_IDLE";                  ///< Worker threads outside the implicit tasks of the parallel regions
+    constexpr const char *Parallel = "OMP_PARALLEL";          ///< Parallel regions in the thread that starts them
+    constexpr const char *ImplicitTask = "OMP_IMPLICIT_TASK"; ///< Implicit tasks, i.e., the work of each thread in a parallel region
+    constexpr const char *Barrier = "OMP_BARRIER";            ///< Explicit, implicit and implementation barriers
+    constexpr const char *Taskwait = "OMP_TASKWAIT";          ///< taskwait and taskgroup regions
+    constexpr const char *Wait = "OMP_WAIT";                  ///< Waiting part of the barriers, taskwaits and taskgroups
+    constexpr const char *Loop = "OMP_LOOP";                  ///< Worksharing loops
+    constexpr const char *Sections = "OMP_SECTIONS";          ///< sections regions
+    constexpr const char *Single = "OMP_SINGLE";              ///< single regions in the thread that executes them
+    constexpr const char *Taskloop = "OMP_TASKLOOP";          ///< taskloop regions
+    constexpr const char *Task = "OMP_TASK";                  ///< Explicit tasks, including the tasks run by them while they are suspended
+
+    /// Whether the OpenMP runtime started the tool and has not finalized it yet
+    bool active() noexcept;
+
+    /// Sets the category of the activities recorded, ::DefaultCategory by default
+    /** It should be changed outside the parallel regions, so that each activity ends in the category it began */
+    void setCategory(Category c) noexcept;
+
+  } // OMPT
+
+} //namespace ThreadInstrument
+
+#endif
@@ -0,0 +1,144 @@
+/*
+ ThreadInstrument: Library to monitor thread activity
+ Copyright (C) 2012-2022 Basilio B. Fraguela. Universidade da Coruna
+
+ Distributed under the MIT License. (See accompanying file LICENSE)
+*/
+
+///
+/// \file     tbb_observer.h
+/// \brief    Records the activity of the TBB workers and tasks as ThreadInstrument activities
+/// \author   Basilio B. Fraguela <basilio.fraguela@udc.es>
+///
+
+#ifndef THREAD_INSTRUMENT_TBB_OBSERVER_H
+#define THREAD_INSTRUMENT_TBB_OBSERVER_H
+
+#include <utility>
+#include <tbb/task_arena.h>
+#include <tbb/task_scheduler_observer.h>
+#include "thread_instrument/thread_instrument.h"
+
+/* A TBB::Observer records as an activity the time each worker thread spends in the arenas it observes,
+ and TBB::task wraps the bodies of the parallel algorithms and task groups so that each execution
+ is recorded as another activity. Under ::enableNestedProfiling the exclusive time of the arena
+ activity is thus the time the workers spend looking for work, stealing it or waiting.
+*/
+
+namespace ThreadInstrument {
+
+  /// Integration with Intel TBB
+  namespace TBB {
+
+    /// Activity recorded by default for the time the TBB workers spend in an arena
+    constexpr const char *Arena = "TBB_ARENA";
+
+    /// Activity recorded by default for the bodies wrapped by ::task
+    constexpr const char *Task = "TBB_TASK";
+
+    /// Records the time the worker threads spend in an arena as an activity
+    /** The threads that are not workers are not recorded, as they only enter the arenas to run
+     *  or wait for their own work. The observation begins with the construction and ends with the destruction.
+     */
+    class Observer : public tbb::task_scheduler_observer {
+
+      const int activity_;
+      const Category category_;
+
+    public:
+
+      /// Observes the arena of the threads that construct the parallel algorithms
+      explicit Observer(const char *activity = Arena, Category c = DefaultCategory) :
+      activity_(getEventNumber(activity)), category_(c)
+      {
+        observe(true);
+      }
+
+      /// Observes \c arena
+      explicit Observer(tbb::task_arena& arena, const char *activity = Arena, Category c = DefaultCategory) :
+      tbb::task_scheduler_observer(arena), activity_(getEventNumber(activity)), category_(c)
+      {
+        observe(true);
+      }
+
+      ~Observer()
+      {
+        observe(false);
+      }
+
+      void on_scheduler_entry(bool is_worker) override
+      {
+        if (is_worker) {
+          beginActivity(category_, activity_);
+        }
+      }
+
+      void on_scheduler_exit(bool is_worker) override
+      {
+        if (is_worker) {
+          endActivity(category_, activity_);
+        }
+      }
+
+    };
+
+    /// Body that records each execution of the functor \c F as an activity. Built by ::task
+    template<typename F>
+    class TaskBody {
+
+      /// Ends the activity even if the body throws an exception
+      struct Scope {
+        const Category category_;
+        const int activity_;
+
+        Scope(Category c, int activity) :
+        category_(c), activity_(activity)
+        {
+          beginActivity(category_, activity_);
+        }
+
+        ~Scope()
+        {
+          endActivity(category_, activity_);
+        }
+      };
+
+      F f_;
+      int activity_;
+      Category category_;
+
+    public:
+
+      TaskBody(F f, int activity, Category c) :
+      f_(std::move(f)), activity_(activity), category_(c)
+      { }
+
+      template<typename... Args>
+      auto operator()(Args&&... args) const -> decltype(f_(std::forward<Args>(args)...))
+      {
+        Scope scope(category_, activity_);
+        return f_(std::forward<Args>(args)...);
+      }
+
+    };
+
+    /// Wraps \c f so that each of its executions in a TBB algorithm or task group is recorded as \c activity
+    /** For example, <tt>tbb::parallel_for(range, TBB::task("Chunk", body))</tt> */
+    template<typename F>
+    TaskBody<F> task(const char *activity, F f, Category c = DefaultCategory)
+    {
+      return TaskBody<F>(std::move(f), getEventNumber(activity), c);
+    }
+
+    /// Wraps \c f so that each of its executions in a TBB algorithm or task group is recorded as the activity TBB::Task
+    template<typename F>
+    TaskBody<F> task(F f, Category c = DefaultCategory)
+    {
+      return task(Task, std::move(f), c);
+    }
+
+  } // TBB
+
+} //namespace ThreadInstrument
+
+#endif
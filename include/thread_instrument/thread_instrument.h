@@ -14,43 +14,188 @@
 #ifndef THREAD_INSTRUMENT_H
 #define THREAD_INSTRUMENT_H
 
+#include <csignal>
+#include <cstdint>
+#include <cstring>
 #include <fstream>
 #include <iostream>
+#include <atomic>
 #include <chrono>
 #include <map>
 #include <string>
+#include <vector>
 #include <functional>
+#include <type_traits>
 
 /// Contains all the library API
 namespace ThreadInstrument {
 
-  /// Clock used for profiling
+  /// Clock used for profiling by default and in which the moments reported are expressed
+  /** The library can take its timestamps from other sources (see \ref Timestamps) */
   using clock_t      = std::chrono::high_resolution_clock;
   
   /// A time point for profiling
   using time_point_t = clock_t::time_point;
 
+  /// Histogram of the durations of the invocations of an activity with buckets of logarithmically increasing width
+  /** The durations are kept in units of the clock of the library (see \ref Timestamps). The values below
+   *  ::NSubBuckets have their own bucket, and each range [2^e, 2^(e+1)) of larger values is split in ::NSubBuckets
+   *  buckets of the same width, so that the relative error of the values reported is below 1/::NSubBuckets.
+   *  The values from 2^(::MaxExponent+1) on are counted in the last bucket.
+   */
+  class LatencyHistogram {
+
+    std::vector<std::uint64_t> counts_; ///< Number of values in each bucket. Empty if no value was recorded
+    double unit_;                       ///< Seconds per unit
+    std::uint64_t total_;               ///< Number of values recorded
+
+  public:
+
+    static constexpr unsigned SubBucketBits = 4;
+    static constexpr unsigned NSubBuckets = 1u << SubBucketBits;
+    static constexpr unsigned MaxExponent = 47;
+    static constexpr unsigned NBuckets = (MaxExponent - SubBucketBits + 2) * NSubBuckets;
+
+    LatencyHistogram()
+    : unit_(0.0), total_(0)
+    {}
+
+    /// Bucket of \c value
+    static unsigned bucket(std::uint64_t value) noexcept;
+
+    /// Value in the middle of bucket \c b, in units
+    static double bucketValue(unsigned b) noexcept;
+
+    /// Builds the histogram from \c NBuckets \c counts of values measured in units of \c unit seconds
+    void assign(const std::uint32_t *counts, double unit);
+
+    /// Whether no value has been recorded
+    bool empty() const noexcept { return !total_; }
+
+    /// Number of values recorded
+    std::uint64_t count() const noexcept { return total_; }
+
+    /// Number of values in each bucket, empty if no value was recorded
+    const std::vector<std::uint64_t>& counts() const noexcept { return counts_; }
+
+    /// Duration in seconds below which are the \c p percent of the values recorded. 0 if the histogram is empty
+    double percentile(double p) const noexcept;
+
+    /// Adds the values of another histogram to this one
+    LatencyHistogram& operator+= (const LatencyHistogram& other);
+  };
+
+  /// Hardware events that can be counted for each activity by means of ::enablePerfCounters
+  enum PerfCounter : unsigned {
+    PerfCycles = 0,       ///< Cycles of the core
+    PerfInstructions,     ///< Instructions retired
+    PerfLLCMisses,        ///< Misses in the last level cache
+    PerfBranchMisses,     ///< Mispredicted branches
+    NPerfCounters
+  };
+
   /// Records the activity data for an event
   struct EventData {
     
-    double time;                    ///< Time spent in this kind of event
+    double time;                    ///< Time spent in this kind of event. Extrapolated from the samples if it is sampled (see ::setSampling)
+    double exclusiveTime;           ///< Time spent in this kind of event outside nested activities. Only measured under ::enableNestedProfiling
+    double timeError;               ///< Standard error of ::time when it is extrapolated from samples, 0 otherwise
     time_point_t lastInvocation;    ///< Last moment this event was running
     unsigned invocations;           ///< Number of times this event took place
+    unsigned samples;               ///< Number of outermost invocations that were timed
+    unsigned depth;                 ///< Number of invocations of the activity currently running, larger than 1 under recursion
     bool currentlyRunning;          ///< Whether the activity is now running or not
+    double minTime;                 ///< Shortest of the ::samples outermost invocations timed, 0 if there are none
+    double maxTime;                 ///< Longest of the ::samples outermost invocations timed
+    double meanTime;                ///< Mean duration of the ::samples outermost invocations timed
+    double timeStdDev;              ///< Standard deviation of the duration of the ::samples outermost invocations timed
+    LatencyHistogram histogram;     ///< Durations of the outermost invocations timed. Only recorded under ::enableHistograms
+    std::uint64_t counters[NPerfCounters]; ///< Hardware events of each ::PerfCounter in the ::countedSamples invocations counted
+    unsigned countedSamples;        ///< Outermost invocations timed whose hardware events were counted under ::enablePerfCounters
 
     EventData()
-    : time(0.0), invocations(0), currentlyRunning(false)
+    : time(0.0), exclusiveTime(0.0), timeError(0.0), invocations(0), samples(0), depth(0), currentlyRunning(false),
+      minTime(0.0), maxTime(0.0), meanTime(0.0), timeStdDev(0.0), counters(), countedSamples(0)
     {}
     
     /// Adds the data of another EventData to this one
-    EventData& operator+= (const EventData& other) noexcept;
+    /** It is not \c noexcept, as adding a histogram to an empty one allocates its storage */
+    EventData& operator+= (const EventData& other);
   };
   
   /// Associates each event code (an int) with its data
   using Int2EventDataMap_t = std::map<int, ThreadInstrument::EventData>;
+
+  /// Records the activity data for a call path
+  struct CallPathData {
+
+    double time;                    ///< Time spent in the last activity of the path, including the nested ones
+    double exclusiveTime;           ///< Time spent in the last activity of the path outside nested activities
+    unsigned invocations;           ///< Number of times the path took place
+
+    CallPathData()
+    : time(0.0), exclusiveTime(0.0), invocations(0)
+    {}
+
+    /// Adds the data of another CallPathData to this one
+    CallPathData& operator+= (const CallPathData& other) noexcept;
+  };
+
+  /// Sequence of nested activities, from the outermost to the innermost one
+  using CallPath_t = std::vector<int>;
+
+  /// Associates each call path with its data
+  using CallPath2DataMap_t = std::map<CallPath_t, ThreadInstrument::CallPathData>;
+
+  /////////////////////////// CATEGORIES ///////////////////////////
+
+  /// Number of categories supported
+  constexpr unsigned NCategories = 64;
+
+  /// Category of activities and log events that can be enabled or disabled at runtime
+  /** There are ::NCategories categories, numbered from 0. The functions that do not take a Category use ::DefaultCategory */
+  struct Category {
+
+    unsigned id;  ///< Number of the category, below ::NCategories for valid categories
+
+    /// Builds the category \c in_id, which is invalid, and thus never enabled, if it is not below ::NCategories
+    explicit constexpr Category(unsigned in_id) noexcept
+    : id((in_id < NCategories) ? in_id : NCategories)
+    {}
+  };
+
+  /// Category of the activities and log events that do not specify one
+  constexpr Category DefaultCategory {0};
+
+  namespace internal {
+    /// Bit \c i is set if the category \c i is enabled
+    extern std::atomic<std::uint64_t> EnabledCategories;
+  };
+
+  /// Whether the activities and log events of category \c c are being recorded
+  inline bool isEnabled(Category c) noexcept {
+    return (c.id < NCategories) && ((internal::EnabledCategories.load(std::memory_order_relaxed) >> c.id) & 1);
+  }
+
+  /// Enables or disables the recording of the activities and log events of category \c c
+  /** All the categories are enabled by default, unless the environment variable THREADINSTRUMENT_CATEGORIES
+   *  provides the mask of categories enabled when the program starts. Disabling a category discards the measurement
+   *  of the activities of that category that are running at that moment, while those of other categories are not affected.
+   */
+  void enableCategory(Category c, bool enable = true) noexcept;
+
+  /// Sets the categories enabled, the bit \c i of \c mask enabling the category \c i
+  void setEnabledCategories(std::uint64_t mask) noexcept;
+
+  /// Mask of the categories enabled
+  std::uint64_t enabledCategories() noexcept;
+
+  /// Makes the signal \c signum disable all the categories, or restore the ones enabled before, each time it is received
+  /** If no categories were enabled when the first signal arrives, all of them are enabled */
+  void toggleCategoriesOnSignal(int signum = SIGUSR2);
   
   namespace internal {
-    void begin_activity_inner(int activity);
+    void begin_activity_inner(int activity, unsigned category);
   
     void end_activity_inner(int activity);
   };
@@ -60,23 +205,137 @@ namespace ThreadInstrument {
   
   /// Get the number for the calling thread
   unsigned getMyThreadNumber();
+
+  /// Names the calling thread in the dumps of the library
+  void setThreadName(const std::string& name);
+
+  /// Sets the \c role of the calling thread, such as the kind of pool it belongs to, and its position \c index among the threads of that role
+  /** The index is typically the number of the thread in its pool, for example provided by \c omp_get_thread_num(),
+   *  so that it identifies the same worker in different runs. Under a negative \c index the threads of each role are numbered
+   *  in the order they invoke this function. The dumps of the library list the threads ordered by role and index
+   *  (see ::getThreadsInfo). */
+  void setThreadRole(const std::string& role, int index = -1);
+
+  /// Identification of a thread
+  struct ThreadInfo {
+
+    unsigned thread;      ///< Number of the thread (see ::getMyThreadNumber)
+    std::string name;     ///< Name set by ::setThreadName, empty if there is none
+    std::string role;     ///< Role set by ::setThreadRole, empty if there is none
+    int roleIndex;        ///< Position of the thread among those of its role, -1 if it has no role
+
+    ThreadInfo()
+    : thread(0), roleIndex(-1)
+    {}
+
+    /// Label of the thread in the dumps: its name, or its role followed by a period and its index, or T followed by its number
+    std::string label() const;
+  };
+
+  /// Get the identification of all the threads known, ordered by role and index
+  /** The threads without role come first, ordered by their number, followed by the ones of each role,
+   *  in alphabetical order of the roles, ordered by their index */
+  std::vector<ThreadInfo> getThreadsInfo();
   
   /// Get the activity for the \n th thread
-  /// Notice that the returned value is a non-const reference,
-  ///thus this can be used for example to clear the activity of the thread,
-  ///modify the statistics of some activity etc.
-  Int2EventDataMap_t& getActivity(unsigned n);
+  /// Notice that the returned value is a copy of the statistics built in each invocation,
+  ///so modifying it, e.g. getActivity(n).clear(), does not change the data kept by the library.
+  ///Use ::clearActivity to clear the activity of a thread.
+  Int2EventDataMap_t getActivity(unsigned n);
+
+  /// Clears the activity statistics of the \n th thread
+  /** The statistics of other threads are reported as empty and cleared by their thread when it begins its next activity */
+  void clearActivity(unsigned n);
   
   /// Get the activity added for all the threads
+  /** It can be invoked while the threads are running, the statistics of each activity in each thread being consistent */
   Int2EventDataMap_t getAllActivity();
 
   /// Clears all the activity statistics, although the numbering of the known threads will be remembered
+  /** As in ::clearActivity, each thread actually clears its own statistics */
   void clearAllActivity() noexcept;
 
+  /// Makes the library time only one of each \c period invocations of \c event, or record one of each \c period log entries or pairs of entries of \c event
+  /** The invocations recorded are chosen at random, with a mean distance of \c period invocations among them, so that
+   *  they are spread over the execution and do not follow periodic patterns of the application.
+   *  EventData::invocations is still exact, while EventData::time is extrapolated from the samples and EventData::timeError
+   *  estimates its error. A \c period of 0 or 1 records all the invocations. Under recursion, the decision is taken for the
+   *  outermost invocation. Under ::enableNestedProfiling the activities not sampled count as exclusive time of their parent.
+   *  The log entries with data 0 and 1, such as those of ::THREADINSTRUMENT_TIMED_LOG, are sampled as pairs: the decision is
+   *  taken when the entry with data 0 is logged, and the next entry with data 1 of the same event in the thread is recorded
+   *  if and only if it was. Other entries are sampled individually, with the same period as the pairs. The sampling of the
+   *  log entries and that of the activities of the same number are independent.
+   */
+  void setSampling(int event, unsigned period);
+
+  /// Same as ::setSampling(int, unsigned) for an event named by a string
+  void setSampling(const char *event, unsigned period);
+
+  /// Enables or disables the tracking of the nesting of the activities
+  /** While enabled, each thread keeps a stack of the activities it is running, which allows to measure
+   *  EventData::exclusiveTime and to aggregate the activity by call path (see ::getCallPaths).
+   *  Activities must then be ended in the reverse order of their beginning. It should be changed
+   *  when no activity is running, as the activities that are already running are not tracked.
+   */
+  void enableNestedProfiling(bool enable = true) noexcept;
+
+  /// Enables or disables the recording of a LatencyHistogram of the durations of each activity in each thread
+  /** The histogram of an activity takes LatencyHistogram::NBuckets 32-bit counters per thread, allocated
+   *  the first time the activity is timed after it is enabled, so that then recording a duration does not
+   *  allocate memory. The histograms are reported in EventData::histogram.
+   */
+  void enableHistograms(bool enable = true) noexcept;
+
+  /// Enables or disables counting the hardware events of each ::PerfCounter during the outermost invocations timed of each activity
+  /** Each thread opens a group of counters by means of \c perf_event_open the first time it begins an activity after
+   *  this is enabled, and reads them from user space with \c rdpmc when the kernel allows it. When the kernel multiplexes
+   *  the counters, their readings are scaled by the time they were enabled over the time they actually counted.
+   *  The counts are reported in EventData::counters, and ::dumpActivity reports the IPC and the events per invocation.
+   *  Only available in Linux.
+   *  @return whether some counter could be opened in the calling thread
+   */
+  bool enablePerfCounters(bool enable = true) noexcept;
+
+  /// Whether the hardware event \c c could be counted when ::enablePerfCounters was invoked
+  bool perfCounterAvailable(PerfCounter c) noexcept;
+
+  /// Get the activity of the \n th thread aggregated by call path
+  /** Only the activity measured under ::enableNestedProfiling is reported. As ::getActivity, the result is a snapshot */
+  CallPath2DataMap_t getCallPaths(unsigned n);
+
+  /// Get the activity aggregated by call path added for all the threads
+  CallPath2DataMap_t getAllCallPaths();
+
+  /// Starts a background thread that periodically publishes the activity statistics of all the threads in a shared memory segment
+  /** External processes can read the segment without locks nor stalling this process, for example by means of
+   *  the \c liveMetrics application. The layout of the segment is described in \c thread_instrument/live_metrics.h.
+   *  The publisher does not wait for the threads either, so a thread that is adding new activities when an update gathers
+   *  the statistics keeps those of the previous update. If a publisher was already running, it is stopped before starting
+   *  the new one. The publisher is stopped at program exit.
+   *  @param name        POSIX shared memory name of the segment. If empty, \c /threadinstrument.<pid> is used
+   *  @param period      seconds between consecutive updates
+   *  @param max_entries maximum number of pairs (thread, activity) published
+   */
+  void startLiveMetrics(const std::string& name = std::string(), double period = 1.0, unsigned max_entries = 4096);
+
+  /// Stops the publisher started by ::startLiveMetrics after a final update, removing its segment
+  void stopLiveMetrics();
+
+  /// Print the data for the call paths in a ::CallPath2DataMap_t in the ostream \c s (defaults to std::cout)
+  /** Each path is printed in a line, indented according to its depth, after its enclosing paths
+   *
+   * @param m Set of call paths
+   * @param names names of the events or nullptr, as in ::dumpActivity
+   * @param s ostream for dumping the data
+   */
+  void dumpCallPaths(const CallPath2DataMap_t& m, const std::string *names = nullptr, std::ostream& s = std::cout);
+
   /// Print the data for the events in a ::Int2EventDataMap_t in the ostream \c s (defaults to std::cout)
   /**
     * If \c names is not provided and the activities were registered using strings, the function will
-    *use the names provided during the logging.
+    *use the names provided during the logging. The activities with a EventData::histogram are followed by a line
+    *with the distribution of their durations, and those with EventData::countedSamples by a line with their IPC
+    *and their hardware events per invocation counted.
     *
     * @param m Set of events
     * @param names names of the events or nullptr
@@ -94,6 +353,32 @@ namespace ThreadInstrument {
    * @param filename name of the file for dumping the data
    */
   void dumpActivity(const Int2EventDataMap_t& m, const std::string *names, const std::string& filename);
+
+  /// Prints the data stored in a ::Int2EventDataMap_t in CSV format, with a header line followed by a line per activity
+  /** The columns are the number and the name of the event followed by the fields of EventData: \c invocations, \c samples,
+   *  \c time, \c exclusive_time, \c time_error, \c min_time, \c max_time, \c mean_time and \c stddev_time, the percentiles
+   *  \c p50, \c p90, \c p99 and \c p99.9 of the histogram, \c counted_samples and the hardware events \c cycles, \c instructions,
+   *  \c llc_misses and \c branch_misses per invocation counted. The times are in seconds and the values not measured are empty.
+   *  The \c compareProfiles application compares the reports of different runs.
+   *
+   * @param m Set of events
+   * @param names names of the events or nullptr, as in ::dumpActivity
+   * @param s ostream for dumping the data
+   */
+  void dumpActivityCSV(const Int2EventDataMap_t& m, const std::string *names = nullptr, std::ostream& s = std::cout);
+
+  /// Same as ::dumpActivityCSV, but writing the file \c filename, which is overwritten
+  void dumpActivityCSV(const Int2EventDataMap_t& m, const std::string *names, const std::string& filename);
+
+  /// Prints the data stored in a ::Int2EventDataMap_t as a JSON object whose \c activities array has an object per activity
+  /** Each object has the members \c event and \c name followed by the columns of ::dumpActivityCSV, the values not measured being \c null */
+  void dumpActivityJSON(const Int2EventDataMap_t& m, const std::string *names = nullptr, std::ostream& s = std::cout);
+
+  /// Same as ::dumpActivityJSON, but writing the file \c filename, which is overwritten
+  void dumpActivityJSON(const Int2EventDataMap_t& m, const std::string *names, const std::string& filename);
+
+  /// Prints in \c s the activity of each thread under a line with its ThreadInfo::label, the threads being ordered as in ::getThreadsInfo
+  void dumpThreadsActivity(std::ostream& s = std::cout);
   
   /// Facility for automatically numbering in a thread-safe way events based on their names
   int getEventNumber(const char *event);
@@ -101,34 +386,259 @@ namespace ThreadInstrument {
   /// Gets the name of an event number collected using ::GetEventNumber
   const char *getEventName(const int event) noexcept;
 
-  /// Records the beginning of an \c activity
-  inline void beginActivity(int activity) {
+  namespace internal {
+
+    /// Whether the type \c T of a name given to ::THREADINSTRUMENT_EVENT guarantees that the contents at its address never change
+    /** This is the case of the string literals and the other arrays of constant characters. The names provided by
+     *  pointers or by arrays that can be modified, such as buffers in which names are built at runtime, do not.
+     *  A fixed name can still be a different array in each evaluation, e.g. \c names[i] or a parameter of type \c const \c char(&)[N] */
+    template<typename T>
+    struct IsFixedName {
+      typedef typename std::remove_reference<T>::type Name_t;
+      static constexpr bool value = std::is_array<Name_t>::value && std::is_const<typename std::remove_extent<Name_t>::type>::value;
+    };
+
+    /// Number of the event with a fixed name used at a point of ::THREADINSTRUMENT_EVENT
+    /** It keeps the address of the first name looked up together with its number, the other names being looked up by
+     *  ::getEventNumber, as the same point may be evaluated with different arrays.
+     *  Its constructor allows the constant initialization of the function-local static in the macro, which thus requires no guard */
+    class EventSite {
+
+      std::atomic<int> state_;  ///< 0 before a name is kept, 1 while it is being stored and 2 when ::name_ and ::id_ can be read
+      const char *name_;        ///< Name kept
+      int id_;                  ///< Number of the event ::name_
+
+    public:
+
+      constexpr EventSite() noexcept :
+      state_{0}, name_{nullptr}, id_{-1}
+      { }
+
+      /// Number of the event named \c name, which is only looked up the first time if it is the name kept
+      int id(const char *name) {
+        if (state_.load(std::memory_order_acquire) == 2) {
+          if (name_ == name) {
+            return id_;
+          }
+          return getEventNumber(name);
+        }
+        const int id = getEventNumber(name);
+        int empty = 0;
+        if (state_.compare_exchange_strong(empty, 1, std::memory_order_relaxed)) {
+          name_ = name;
+          id_ = id;
+          state_.store(2, std::memory_order_release);
+        }
+        return id;
+      }
+
+    };
+
+  };
+
+  /// Records the beginning of an \c activity of category \c c
+  inline void beginActivity(Category c, int activity) {
 #ifdef THREADINSTRUMENT
-    internal::begin_activity_inner(activity);
+    if (isEnabled(c)) {
+      internal::begin_activity_inner(activity, c.id);
+    }
 #endif
   }
   
-  /// Records the end of an \c activity
-  inline void endActivity(int activity) {
+  /// Records the end of an \c activity of category \c c
+  inline void endActivity(Category c, int activity) {
 #ifdef THREADINSTRUMENT
-    internal::end_activity_inner(activity);
+    if (isEnabled(c)) {
+      internal::end_activity_inner(activity);
+    }
 #endif
   }
 
-  /// Records the beginning of an \c activity
-  inline void beginActivity(const char *activity) {
+  /// Records the beginning of an \c activity of category \c c
+  inline void beginActivity(Category c, const char *activity) {
+#ifdef THREADINSTRUMENT
+    if (isEnabled(c)) {
+      internal::begin_activity_inner(getEventNumber(activity), c.id);
+    }
+#endif
+  }
+  
+  /// Records the end of an \c activity of category \c c
+  inline void endActivity(Category c, const char *activity) {
 #ifdef THREADINSTRUMENT
-    internal::begin_activity_inner(getEventNumber(activity));
+    if (isEnabled(c)) {
+      internal::end_activity_inner(getEventNumber(activity));
+    }
 #endif
   }
+
+  /// Records the beginning of an \c activity
+  inline void beginActivity(int activity) {
+    beginActivity(DefaultCategory, activity);
+  }
+  
+  /// Records the end of an \c activity
+  inline void endActivity(int activity) {
+    endActivity(DefaultCategory, activity);
+  }
+
+  /// Records the beginning of an \c activity
+  inline void beginActivity(const char *activity) {
+    beginActivity(DefaultCategory, activity);
+  }
   
   /// Records the end of an \c activity
   inline void endActivity(const char *activity) {
+    endActivity(DefaultCategory, activity);
+  }
+
+  /////////////////////////// LANES ///////////////////////////
+
+  /// Creates a lane for the activity of an entity that is not a thread of the process, such as a stream of a GPU, returning its number
+  /** The lane is numbered and reported as the threads, so that its activity appears in ::getAllActivity, ::getActivity
+   *  and the dumps of the log next to that of the threads, and pictureTime shows it as another row. The moments of its
+   *  activity are provided by the application, typically from the timestamps of the device, which allows to see the
+   *  overlap between the host and the devices and the periods in which the devices are idle.
+   *  @param name  name of the lane in the dumps (see ThreadInfo::label)
+   *  @param role  role of the lane, as in ::setThreadRole, so that the lanes are listed together
+   *  @param index position of the lane among those of its role, assigned in order of creation if negative
+   */
+  unsigned createLane(const std::string& name, const std::string& role = "device", int index = -1);
+
+  /// Sets the nanoseconds added to the moments provided for the activity of \c lane to obtain the clock of ::syncClockTime, 0 by default
+  /** The offset of the clock of a device can be estimated by reading it at the same time as ::syncClockTime */
+  void setLaneClockOffset(unsigned lane, std::int64_t ns);
+
+  namespace internal {
+    void lane_activity_inner(unsigned lane, int activity, std::int64_t ns, bool begin);
+  };
+
+  /// Records the beginning at \c ns of an \c activity of category \c c in the \c lane created by ::createLane
+  /** The moment is given in nanoseconds in the clock of ::syncClockTime after adding the offset of ::setLaneClockOffset.
+   *  The activity of a lane can be recorded by any thread, but in chronological order, as the moments older than
+   *  the previous ones of the lane are replaced by the latest one. Besides the statistics, it is logged as
+   *  ::THREADINSTRUMENT_TIMED_LOG does, the beginning with data 0 and the end with data 1. The lanes are not sampled. */
+  inline void beginLaneActivity(Category c, unsigned lane, int activity, std::int64_t ns) {
 #ifdef THREADINSTRUMENT
-    internal::end_activity_inner(getEventNumber(activity));
+    if (isEnabled(c)) {
+      internal::lane_activity_inner(lane, activity, ns, true);
+    }
+#endif
+  }
+
+  /// Records the end at \c ns of an \c activity of category \c c in the \c lane created by ::createLane
+  inline void endLaneActivity(Category c, unsigned lane, int activity, std::int64_t ns) {
+#ifdef THREADINSTRUMENT
+    if (isEnabled(c)) {
+      internal::lane_activity_inner(lane, activity, ns, false);
+    }
+#endif
+  }
+
+  /// Records the beginning at \c ns of an \c activity of category \c c in the \c lane created by ::createLane
+  inline void beginLaneActivity(Category c, unsigned lane, const char *activity, std::int64_t ns) {
+#ifdef THREADINSTRUMENT
+    if (isEnabled(c)) {
+      internal::lane_activity_inner(lane, getEventNumber(activity), ns, true);
+    }
+#endif
+  }
+
+  /// Records the end at \c ns of an \c activity of category \c c in the \c lane created by ::createLane
+  inline void endLaneActivity(Category c, unsigned lane, const char *activity, std::int64_t ns) {
+#ifdef THREADINSTRUMENT
+    if (isEnabled(c)) {
+      internal::lane_activity_inner(lane, getEventNumber(activity), ns, false);
+    }
 #endif
   }
 
+  /// Records the beginning at \c ns of an \c activity in the \c lane created by ::createLane
+  inline void beginLaneActivity(unsigned lane, int activity, std::int64_t ns) {
+    beginLaneActivity(DefaultCategory, lane, activity, ns);
+  }
+
+  /// Records the end at \c ns of an \c activity in the \c lane created by ::createLane
+  inline void endLaneActivity(unsigned lane, int activity, std::int64_t ns) {
+    endLaneActivity(DefaultCategory, lane, activity, ns);
+  }
+
+  /// Records the beginning at \c ns of an \c activity in the \c lane created by ::createLane
+  inline void beginLaneActivity(unsigned lane, const char *activity, std::int64_t ns) {
+    beginLaneActivity(DefaultCategory, lane, activity, ns);
+  }
+
+  /// Records the end at \c ns of an \c activity in the \c lane created by ::createLane
+  inline void endLaneActivity(unsigned lane, const char *activity, std::int64_t ns) {
+    endLaneActivity(DefaultCategory, lane, activity, ns);
+  }
+
+  /// Records an \c activity of the \c lane created by ::createLane that took place between \c begin_ns and \c end_ns
+  /** It is useful when the device reports each operation once it finished, as the activity records of CUPTI */
+  inline void laneActivity(unsigned lane, int activity, std::int64_t begin_ns, std::int64_t end_ns) {
+    beginLaneActivity(lane, activity, begin_ns);
+    endLaneActivity(lane, activity, end_ns);
+  }
+
+  /// Records an \c activity of the \c lane created by ::createLane that took place between \c begin_ns and \c end_ns
+  inline void laneActivity(unsigned lane, const char *activity, std::int64_t begin_ns, std::int64_t end_ns) {
+    laneActivity(lane, getEventNumber(activity), begin_ns, end_ns);
+  }
+
+  /////////////////////////// MEMORY ///////////////////////////
+
+  /// Memory used by the library on behalf of a thread
+  struct ThreadMemoryUsage {
+
+    unsigned thread;                  ///< Number of the thread (see ::getMyThreadNumber)
+    bool exited;                      ///< Whether the thread exited and its data waits for reuse under ::reclaimExitedThreads
+    std::size_t activityBytes;        ///< Bytes of its activity statistics and calling contexts
+    std::size_t logBytes;             ///< Bytes of the storage held by its log
+    std::size_t logEntries;           ///< Entries of its log not yet consumed
+    std::uint64_t droppedLogEntries;  ///< Log entries it discarded because of the ::setMemoryBudget
+
+    ThreadMemoryUsage()
+    : thread(0), exited(false), activityBytes(0), logBytes(0), logEntries(0), droppedLogEntries(0)
+    {}
+  };
+
+  /// Memory used by the library
+  /** The log storage is only returned to the system when the flight recorder rings are released, the chunks
+   *  of the normal logs being kept for reuse once they are consumed (see ::reserveLog). */
+  struct MemoryUsage {
+
+    std::size_t totalBytes;           ///< Sum of ::logBytes, ::activityBytes and ::registryBytes
+    std::size_t logBytes;             ///< Bytes allocated for the logs of all the threads, including the storage kept for reuse
+    std::size_t activityBytes;        ///< Bytes of the activity statistics and calling contexts of all the threads
+    std::size_t registryBytes;        ///< Bytes of the registry of threads and event names
+    std::size_t logEntries;           ///< Log entries not yet consumed
+    std::uint64_t droppedLogEntries;  ///< Log entries discarded because of the ::setMemoryBudget
+    std::size_t budget;               ///< Budget set by ::setMemoryBudget, 0 if there is none
+    std::vector<ThreadMemoryUsage> threads; ///< Usage of each thread
+
+    MemoryUsage()
+    : totalBytes(0), logBytes(0), activityBytes(0), registryBytes(0), logEntries(0), droppedLogEntries(0), budget(0)
+    {}
+  };
+
+  /// Reports the memory used by the library
+  /** The sizes of the containers of the activity statistics are estimations */
+  MemoryUsage memoryUsage();
+
+  /// Limits to \c bytes the memory used by the library, 0 meaning that there is no limit, which is the default
+  /** The environment variable THREADINSTRUMENT_MEMORY_BUDGET provides the budget when the program starts.
+   *  The log entries that require new storage beyond the budget are discarded and counted in
+   *  MemoryUsage::droppedLogEntries, while the activity statistics are always recorded. The storage preallocated
+   *  by ::reserveLog is not limited by the budget. */
+  void setMemoryBudget(std::size_t bytes);
+
+  /// Makes the activity data of each thread that exits be accumulated in a global record and reused by new threads
+  /** It bounds the memory and ::nThreadsWithActivity of applications that create many short-lived threads.
+   *  ::getAllActivity and ::getAllCallPaths include the activity of the exited threads, while ::getActivity and ::getCallPaths
+   *  for the number of a reclaimed thread only report the threads that reused it afterwards, as the number is shared by them.
+   *  The log entries of an exited thread are kept until they are consumed. The data of the main thread is never reclaimed. */
+  void reclaimExitedThreads(bool enable = true) noexcept;
+
   /////////////////////////// LOGS ///////////////////////////
   
   namespace internal {
@@ -139,6 +649,8 @@ namespace ThreadInstrument {
     void timed_log_inner(unsigned event, void *data);
     
     void timed_log_inner(unsigned event, int data);
+
+    void payload_log_inner(unsigned event, const void *payload, std::size_t size, bool is_timed);
   };
   
   /// Dumps the log to the ostream \c s, clearing it in the process
@@ -147,6 +659,40 @@ namespace ThreadInstrument {
   /// Dumps the log to the file \c filename, clearing it in the process
   void dumpLog(const std::string& filename, std::ios_base::openmode mode = std::ios_base::out);
 
+  /// Dumps the log to \c s in the Chrome Trace Event JSON format described in chrome_trace.h, clearing it in the process
+  /** The entries with data 0 and 1, as those generated by ::THREADINSTRUMENT_TIMED_LOG and ::THREADINSTRUMENT_LOG, are
+   *  written as the beginning and the end of slices, and the rest as instantaneous events whose argument \c data
+   *  is the data logged, or the string built by the printer registered for the event if there is one.
+   *  The trace is streamed as the entries are merged, so that it is not built in memory.
+   */
+  void dumpLogChromeTrace(std::ostream& s);
+
+  /// Dumps the log to the file \c filename in the Chrome Trace Event JSON format, clearing it in the process
+  void dumpLogChromeTrace(const std::string& filename);
+
+  /// Dumps the log in the binary format described in binary_log.h to the file descriptor \c fd, clearing it in the process
+  /** The output is streamed as the entries are merged, so that the log is not formatted nor copied in memory */
+  void dumpLogBinary(int fd);
+
+  /// Dumps the log in the binary format described in binary_log.h to the file \c filename, clearing it in the process
+  /** @param filename name of the file
+   *  @param append whether the log is added at the end of the file or the file is overwritten
+   */
+  void dumpLogBinary(const std::string& filename, bool append = false);
+
+  /// Starts a background thread that periodically appends the log to the file \c filename in binary format, clearing it in the process
+  /** If a flusher was already running, it is stopped before starting the new one. The flusher is stopped
+   *  at program exit, its last flush writing the entries logged until then.
+   *  @param filename name of the file, which is overwritten
+   *  @param period   seconds between consecutive flushes
+   *  @param max_filled_chunks number of chunks of log entries filled by the threads that triggers a flush before the
+   *         period expires, thus bounding the memory used by the log. 0 means no limit. Each chunk holds 4096 entries.
+   */
+  void startLogFlusher(const std::string& filename, double period = 1.0, unsigned max_filled_chunks = 64);
+
+  /// Stops the background thread started by ::startLogFlusher after a final flush
+  void stopLogFlusher();
+
   /// Clears the log
   void clearLog();
 
@@ -158,6 +704,54 @@ namespace ThreadInstrument {
 
   /// Sets a maximum number of log entries to print
   void logLimit(unsigned nlogs);
+
+  /// Keeps in the log of each thread only its last \c nlogs entries, overwriting the oldest ones in place
+  /** Each thread allocates a ring of \c nlogs entries the first time it logs, so that the memory used by the
+   *  log is proportional to \c nlogs. 0 returns to the unbounded log. The log is cleared, and the threads
+   *  should not log meanwhile. The dumps of the log consume the entries of the rings as usual, but if the
+   *  threads log during the dump some of the oldest entries may be replaced by newer ones. */
+  void flightRecorder(unsigned nlogs);
+
+  /// Dumps to the file descriptor \c fd the entries of the flight recorder in the binary format described in binary_log.h
+  /** It is async-signal-safe, as it neither allocates memory nor takes locks, and it does not consume the entries.
+   *  The records of each thread are written together, and the entries logged during the dump may be lost or
+   *  replace older ones. Only the entries kept under ::flightRecorder are dumped. */
+  void dumpFlightRecorder(int fd) noexcept;
+
+  /// Makes SIGUSR1, and if \c crashes is true SIGSEGV, SIGBUS, SIGFPE, SIGILL and SIGABRT, dump the flight recorder to the file \c filename
+  /** The file is created when this function is invoked and each dump is appended to it as a new binary log.
+   *  After the dump the crash signals get their default action, which usually terminates the program. */
+  void installFlightRecorderHandler(const std::string& filename, bool crashes = true);
+
+  /// Sets the rank of this process in its parallel job and the name of its host, which are stored in the binary logs
+  /** By default the rank is taken from the first environment variable defined among THREADINSTRUMENT_RANK,
+   *  OMPI_COMM_WORLD_RANK, PMI_RANK, PMIX_RANK and SLURM_PROCID, being -1 if none is, and the host is the one
+   *  reported by gethostname. An empty \c host keeps the current one. It should be invoked before the logs are dumped. */
+  void setProcessInfo(int rank, const std::string& host = std::string());
+
+  /// Rank of this process stored in the binary logs
+  int processRank() noexcept;
+
+  /// Current moment of the clock of this process in which the log is expressed, in nanoseconds since the Unix epoch
+  /** This is the time that the processes of a job must exchange in order to synchronize their clocks with ::synchronizeClock */
+  std::int64_t syncClockTime() noexcept;
+
+  /// Estimates and sets the offset of the clock of this process with respect to the clock of a reference process
+  /** \c reference_time must return the ::syncClockTime() of the reference process, typically by exchanging messages with it.
+   *  It is invoked \c rounds times, and the offset is estimated from the exchange with the shortest round trip,
+   *  assuming that the reference time was taken in its middle. The clocks are assumed to advance at the same rate.
+   *  @return the offset in nanoseconds, which is stored in the binary logs so that the ones of the processes of a job can be merged */
+  std::int64_t synchronizeClock(const std::function<std::int64_t()>& reference_time, unsigned rounds = 8);
+
+  /// Sets the nanoseconds to add to the clock of this process to obtain the reference clock, 0 by default
+  void setClockOffset(std::int64_t ns) noexcept;
+
+  /// Nanoseconds added to the clock of this process to obtain the reference clock
+  std::int64_t clockOffset() noexcept;
+
+  /// Preallocates storage for \c nlogs log entries so that logging them does not allocate memory
+  /** The storage is organized in chunks of entries, each thread that logs holding at least one chunk */
+  void reserveLog(std::size_t nlogs);
   
   /// Transform the data associated to a log entry of a given event type into a std::string
   using LogPrinter_t = std::function<std::string(void *)>;
@@ -182,6 +776,52 @@ namespace ThreadInstrument {
   /** @param printer function that takes the event number and the pointer to the event data and returns a string representing it */
   void registerLogPrinter(const AllLogPrinter_t& printer);
 
+  /// Writes in the buffer \c buf of \c size bytes a representation of the typed payload of a log entry, returning the characters written
+  /** It must not write more than \c size characters, nor a final 0 */
+  template<typename T>
+  using LogFormatter_t = std::size_t (*)(char *buf, std::size_t size, const T& payload);
+
+  /// Size of the buffer provided to the formatters, which bounds the characters printed for each payload
+  constexpr std::size_t LogFormatterBufferSize = 128;
+
+  namespace internal {
+
+    /// Invokes a type-erased LogFormatter_t on a payload copied in the log
+    using LogFormatterThunk_t = std::size_t (*)(void (*formatter)(), char *buf, std::size_t size, const void *payload);
+
+    template<typename T>
+    std::size_t formatPayload(void (*formatter)(), char *buf, std::size_t size, const void *payload)
+    { typename std::aligned_storage<sizeof(T), alignof(T)>::type storage;
+
+      // The copy in the log may not be suitably aligned for T
+      memcpy(&storage, payload, sizeof(T));
+      return reinterpret_cast<LogFormatter_t<T>>(formatter)(buf, size, *reinterpret_cast<const T *>(&storage));
+    }
+
+    void registerLogFormatter(int event, LogFormatterThunk_t thunk, void (*formatter)());
+  };
+
+  /// Registers the function used to print the typed payloads of type \c T of the entries of \c event
+  /** It is used by dumpLog and dumpLogChromeTrace, which neither allocate memory to print the payloads, and it takes
+   *  precedence over the printer registered by registerLogPrinter(int, const LogPrinter_t&), which receives a pointer
+   *  to a copy of the payload. The payloads without printers are printed in hexadecimal. Captureless lambdas can be used:
+   * @code
+   *    ThreadInstrument::registerLogFormatter<Point>(event, [](char *buf, std::size_t size, const Point& p) -> std::size_t {
+   *      return std::min<std::size_t>(size, snprintf(buf, size, "x=%d y=%d", p.x, p.y));
+   *    });
+   * @endcode
+   */
+  template<typename T>
+  void registerLogFormatter(int event, LogFormatter_t<T> formatter) {
+    internal::registerLogFormatter(event, internal::formatPayload<T>, reinterpret_cast<void (*)()>(formatter));
+  }
+
+  /// Same as ::registerLogFormatter(int, LogFormatter_t<T>) for an event named by a string
+  template<typename T>
+  void registerLogFormatter(const char *event, LogFormatter_t<T> formatter) {
+    registerLogFormatter<T>(getEventNumber(event), formatter);
+  }
+
   /// Printer used by default for the logged events
   std::string defaultPrinter(int event, void *p);
   
@@ -189,74 +829,190 @@ namespace ThreadInstrument {
   std::string pictureTimePrinter(int event, void *p);
   
   /// Register a inspector function that will be run when a SIGUSR1 signal is received
-  /** Only a single function is run, so new each new registration overwrites the previous one */
+  /** Only a single function is run, so new each new registration overwrites the previous one.
+   *  Like the dump of the log made by default, it is not run in the handler of the signal, but afterwards by a thread of
+   *  the library started by this registration or by the first entry logged, so it can allocate memory and take locks.
+   *  Thus the inspector does not run in the thread interrupted by the signal: ::getMyThreadNumber and the
+   *  thread_local variables refer to the thread of the library, which is not instrumented.
+   *  In the child of a \c fork the thread is started again by the next registration or by the first entry it logs. */
   void registerInspector(void (*inspector)());
 
-  /// Logs an event
-  inline void log(int event, void *data = nullptr, bool is_timed = false) {
+  /// Logs an event of category \c c
+  inline void log(Category c, int event, void *data = nullptr, bool is_timed = false) {
 #ifdef THREADINSTRUMENT
-    if (is_timed) {
-      internal::timed_log_inner(event, data);
-    } else {
-      internal::log_inner(event, data);
+    if (isEnabled(c)) {
+      if (is_timed) {
+        internal::timed_log_inner(event, data);
+      } else {
+        internal::log_inner(event, data);
+      }
     }
 #endif
   }
   
-  /// Logs an event
-  inline void log(int event, int data, bool is_timed = false) {
+  /// Logs an event of category \c c
+  inline void log(Category c, int event, int data, bool is_timed = false) {
 #ifdef THREADINSTRUMENT
-    if (is_timed) {
-      internal::timed_log_inner(event, data);
-    } else {
-      internal::log_inner(event, data);
+    if (isEnabled(c)) {
+      if (is_timed) {
+        internal::timed_log_inner(event, data);
+      } else {
+        internal::log_inner(event, data);
+      }
     }
 #endif
   }
 
-  /// Logs an event relying on ::GetEventNumber
-  inline void log(const char *event, void *data = nullptr, bool is_timed = false) {
+  /// Logs an event of category \c c relying on ::GetEventNumber
+  inline void log(Category c, const char *event, void *data = nullptr, bool is_timed = false) {
+#ifdef THREADINSTRUMENT
+    if (isEnabled(c)) {
+      log(c, getEventNumber(event), data, is_timed);
+    }
+#endif
+  }
+  
+  /// Logs an event of category \c c relying on ::GetEventNumber
+  inline void log(Category c, const char *event, int data, bool is_timed = false) {
 #ifdef THREADINSTRUMENT
-    log(getEventNumber(event), data, is_timed);
+    if (isEnabled(c)) {
+      log(c, getEventNumber(event), data, is_timed);
+    }
 #endif
   }
+
+  /// Logs an event
+  inline void log(int event, void *data = nullptr, bool is_timed = false) {
+    log(DefaultCategory, event, data, is_timed);
+  }
+  
+  /// Logs an event
+  inline void log(int event, int data, bool is_timed = false) {
+    log(DefaultCategory, event, data, is_timed);
+  }
+
+  /// Logs an event relying on ::GetEventNumber
+  inline void log(const char *event, void *data = nullptr, bool is_timed = false) {
+    log(DefaultCategory, event, data, is_timed);
+  }
   
   /// Logs an event relying on ::GetEventNumber
   inline void log(const char *event, int data, bool is_timed = false) {
+    log(DefaultCategory, event, data, is_timed);
+  }
+
+  /// Maximum size of the typed payloads that log entries can hold
+  constexpr std::size_t LogPayloadSize = 16;
+
+  /// Type of the result of the functions that log typed payloads, which are only provided for classes and unions
+  /** The other types are logged as until now, i.e., the integers and pointers are kept in the data of the entry */
+  template<typename T>
+  using LogPayloadResult_t = typename std::enable_if<std::is_class<T>::value || std::is_union<T>::value>::type;
+
+  /// Logs an event of category \c c with a copy of \c payload, so that it need not remain alive and no memory is allocated
+  /** See ::registerLogFormatter to print the payloads */
+  template<typename T>
+  inline LogPayloadResult_t<T> log(Category c, int event, const T& payload, bool is_timed = false) {
+    static_assert(std::is_trivially_copyable<T>::value, "Log payloads must be trivially copyable");
+    static_assert(sizeof(T) <= LogPayloadSize, "Log payloads cannot be larger than LogPayloadSize");
+#ifdef THREADINSTRUMENT
+    if (isEnabled(c)) {
+      internal::payload_log_inner(event, &payload, sizeof(T), is_timed);
+    }
+#endif
+  }
+
+  /// Logs an event of category \c c with a copy of \c payload relying on ::GetEventNumber
+  template<typename T>
+  inline LogPayloadResult_t<T> log(Category c, const char *event, const T& payload, bool is_timed = false) {
 #ifdef THREADINSTRUMENT
-    log(getEventNumber(event), data, is_timed);
+    if (isEnabled(c)) {
+      log(c, getEventNumber(event), payload, is_timed);
+    }
 #endif
   }
 
+  /// Logs an event with a copy of \c payload
+  template<typename T>
+  inline LogPayloadResult_t<T> log(int event, const T& payload, bool is_timed = false) {
+    log(DefaultCategory, event, payload, is_timed);
+  }
+
+  /// Logs an event with a copy of \c payload relying on ::GetEventNumber
+  template<typename T>
+  inline LogPayloadResult_t<T> log(const char *event, const T& payload, bool is_timed = false) {
+    log(DefaultCategory, event, payload, is_timed);
+  }
+
 #define THREADINSTRUMENT_COMBINE1(X,Y) X##Y
 #define THREADINSTRUMENT_COMBINE(X,Y) THREADINSTRUMENT_COMBINE1(X,Y)
-  
+
 #ifdef THREADINSTRUMENT
 
-#define THREADINSTRUMENT_INTL_PROF(STR_ID, ...) {                                                                         \
-    static const int THREADINSTRUMENT_COMBINE(_threadinstrument_idx,__LINE__) = ThreadInstrument::getEventNumber(STR_ID); \
-    ThreadInstrument::beginActivity(THREADINSTRUMENT_COMBINE(_threadinstrument_idx,__LINE__));                            \
+/// Integer code associated to the event named by the C string \c STR_ID
+/** When \c STR_ID is a string literal or another array of constant characters, each use of the macro looks up its number
+ *  the first time and keeps it with the address of the array, so that afterwards evaluating the macro with the same array
+ *  only requires reading it. Other arrays given in the same use, as in \c THREADINSTRUMENT_EVENT(names[i]), and names such as
+ *  pointers or buffers in which the names are built at runtime, are looked up by ::getEventNumber in every evaluation.
+ *  Without THREADINSTRUMENT the macro evaluates to 0.
+ *
+ * Example Usage:
+ * @code
+ *    ThreadInstrument::beginActivity(THREADINSTRUMENT_EVENT("Initializing"));
+ * @endcode
+ */
+#define THREADINSTRUMENT_EVENT(STR_ID) ([](const char *_threadinstrument_name, bool _threadinstrument_fixed) -> int {     \
+    static ThreadInstrument::internal::EventSite _threadinstrument_site;                                                  \
+    return _threadinstrument_fixed ? _threadinstrument_site.id(_threadinstrument_name) :                                  \
+                                     ThreadInstrument::getEventNumber(_threadinstrument_name);                            \
+  }(STR_ID, ThreadInstrument::internal::IsFixedName<decltype((STR_ID))>::value))
+
+// The category is checked once so that the beginnings and the ends are recorded or skipped together.
+// The event is only looked up when the category is enabled, so that a disabled one only costs a branch
+#define THREADINSTRUMENT_INTL_PROF(CATEGORY, STR_ID, ...) {                                                               \
+    const ThreadInstrument::Category THREADINSTRUMENT_COMBINE(_threadinstrument_cat,__LINE__)(CATEGORY);                  \
+    const bool THREADINSTRUMENT_COMBINE(_threadinstrument_on,__LINE__) = ThreadInstrument::isEnabled(THREADINSTRUMENT_COMBINE(_threadinstrument_cat,__LINE__)); \
+    const int THREADINSTRUMENT_COMBINE(_threadinstrument_idx,__LINE__) =                                                  \
+      THREADINSTRUMENT_COMBINE(_threadinstrument_on,__LINE__) ? THREADINSTRUMENT_EVENT(STR_ID) : 0;                       \
+    if (THREADINSTRUMENT_COMBINE(_threadinstrument_on,__LINE__))                                                          \
+      ThreadInstrument::internal::begin_activity_inner(THREADINSTRUMENT_COMBINE(_threadinstrument_idx,__LINE__),          \
+                                                       THREADINSTRUMENT_COMBINE(_threadinstrument_cat,__LINE__).id);      \
     __VA_ARGS__;                                                                                                          \
-    ThreadInstrument::endActivity(THREADINSTRUMENT_COMBINE(_threadinstrument_idx,__LINE__));                              \
+    if (THREADINSTRUMENT_COMBINE(_threadinstrument_on,__LINE__))                                                          \
+      ThreadInstrument::internal::end_activity_inner(THREADINSTRUMENT_COMBINE(_threadinstrument_idx,__LINE__));           \
   }
 
-#define THREADINSTRUMENT_INTL_LOG(STR_ID, DO_TIMING, ...) {                                                                \
-    static const int THREADINSTRUMENT_COMBINE(_threadinstrument_idx,__LINE__) = ThreadInstrument::getEventNumber(STR_ID); \
-    ThreadInstrument::log(THREADINSTRUMENT_COMBINE(_threadinstrument_idx,__LINE__), 0, DO_TIMING);                         \
+#define THREADINSTRUMENT_INTL_LOG(CATEGORY, STR_ID, DO_TIMING, ...) {                                                     \
+    const ThreadInstrument::Category THREADINSTRUMENT_COMBINE(_threadinstrument_cat,__LINE__)(CATEGORY);                  \
+    const bool THREADINSTRUMENT_COMBINE(_threadinstrument_on,__LINE__) = ThreadInstrument::isEnabled(THREADINSTRUMENT_COMBINE(_threadinstrument_cat,__LINE__)); \
+    const int THREADINSTRUMENT_COMBINE(_threadinstrument_idx,__LINE__) =                                                  \
+      THREADINSTRUMENT_COMBINE(_threadinstrument_on,__LINE__) ? THREADINSTRUMENT_EVENT(STR_ID) : 0;                       \
+    if (THREADINSTRUMENT_COMBINE(_threadinstrument_on,__LINE__)) {                                                        \
+      if (DO_TIMING)                                                                                                      \
+        ThreadInstrument::internal::timed_log_inner(THREADINSTRUMENT_COMBINE(_threadinstrument_idx,__LINE__), 0);         \
+      else                                                                                                                \
+        ThreadInstrument::internal::log_inner(THREADINSTRUMENT_COMBINE(_threadinstrument_idx,__LINE__), 0);               \
+    }                                                                                                                     \
     __VA_ARGS__;                                                                                                          \
-    ThreadInstrument::log(THREADINSTRUMENT_COMBINE(_threadinstrument_idx,__LINE__), 1, DO_TIMING);                         \
+    if (THREADINSTRUMENT_COMBINE(_threadinstrument_on,__LINE__)) {                                                        \
+      if (DO_TIMING)                                                                                                      \
+        ThreadInstrument::internal::timed_log_inner(THREADINSTRUMENT_COMBINE(_threadinstrument_idx,__LINE__), 1);         \
+      else                                                                                                                \
+        ThreadInstrument::internal::log_inner(THREADINSTRUMENT_COMBINE(_threadinstrument_idx,__LINE__), 1);               \
+    }                                                                                                                     \
   }
   
 #else  //THREADINSTRUMENT
 
-#define THREADINSTRUMENT_INTL_PROF(STR_ID, ...)            __VA_ARGS__
-#define THREADINSTRUMENT_INTL_LOG(STR_ID, DO_TIMING, ...)  __VA_ARGS__
+#define THREADINSTRUMENT_EVENT(STR_ID)                               ((void)(STR_ID), 0)
+#define THREADINSTRUMENT_INTL_PROF(CATEGORY, STR_ID, ...)            __VA_ARGS__
+#define THREADINSTRUMENT_INTL_LOG(CATEGORY, STR_ID, DO_TIMING, ...)  __VA_ARGS__
 
 #endif //THREADINSTRUMENT
 
 /// Profile the execution of the statements that follow the event name
 /** It is equivalent to <tt>beginActivity(STR_ID); statements; endActivity(STR_ID);</tt> but it is more efficient
- *  thanks to the caching of the integer code associated to the event
+ *  because the integer code associated to the event is obtained by means of ::THREADINSTRUMENT_EVENT
  *
  *  @param [in] STR_ID C string identifying the event
  *  @param [in] ...       statement(s)
@@ -266,11 +1022,14 @@ namespace ThreadInstrument {
  *    THREADINSTRUMENT_PROF("Initializing", initialize());
  * @endcode
  */
-#define THREADINSTRUMENT_PROF(STR_ID, ...)       THREADINSTRUMENT_INTL_PROF(STR_ID, __VA_ARGS__ )
+#define THREADINSTRUMENT_PROF(STR_ID, ...)       THREADINSTRUMENT_INTL_PROF(ThreadInstrument::DefaultCategory, STR_ID, __VA_ARGS__ )
+
+/// Same as ::THREADINSTRUMENT_PROF for an activity of category \c CATEGORY, which can be a ThreadInstrument::Category or its number
+#define THREADINSTRUMENT_PROF_IN(CATEGORY, STR_ID, ...) THREADINSTRUMENT_INTL_PROF(CATEGORY, STR_ID, __VA_ARGS__ )
   
 /// Log with timing the beginning and the end of the execution of the statements that follow the event name
 /** It is equivalent to <tt>log(STR_ID, 0, true); statements; log(STR_ID, 1, true);</tt> but it is more efficient
- *  thanks to the caching of the integer code associated to the event
+ *  because the integer code associated to the event is obtained by means of ::THREADINSTRUMENT_EVENT
  *
  *  @param [in] STR_ID C string identifying the event
  *  @param [in] ...       statement(s)
@@ -280,11 +1039,14 @@ namespace ThreadInstrument {
  *    THREADINSTRUMENT_TIMED_LOG("Inverse", tiles[dim*n+n] = tiles[dim*n+n].inverse() );
  * @endcode
  */
-#define THREADINSTRUMENT_TIMED_LOG(STR_ID, ...) THREADINSTRUMENT_INTL_LOG(STR_ID,  true, __VA_ARGS__ )
+#define THREADINSTRUMENT_TIMED_LOG(STR_ID, ...) THREADINSTRUMENT_INTL_LOG(ThreadInstrument::DefaultCategory, STR_ID,  true, __VA_ARGS__ )
+
+/// Same as ::THREADINSTRUMENT_TIMED_LOG for an event of category \c CATEGORY, which can be a ThreadInstrument::Category or its number
+#define THREADINSTRUMENT_TIMED_LOG_IN(CATEGORY, STR_ID, ...) THREADINSTRUMENT_INTL_LOG(CATEGORY, STR_ID,  true, __VA_ARGS__ )
 
 /// Log without timing the beginning and the end of the execution of the statements that follow the event name
 /** It is equivalent to <tt>log(STR_ID, 0, false); statements; log(STR_ID, 1, false);</tt> but it is more efficient
- *  thanks to the caching of the integer code associated to the event
+ *  because the integer code associated to the event is obtained by means of ::THREADINSTRUMENT_EVENT
  *
  *  @param [in] STR_ID C string identifying the event
  *  @param [in] ...       statement(s)
@@ -294,7 +1056,10 @@ namespace ThreadInstrument {
  *    THREADINSTRUMENT_LOG("Initializing", initialize());
  * @endcode
 */
-#define THREADINSTRUMENT_LOG(STR_ID, ...)       THREADINSTRUMENT_INTL_LOG(STR_ID, false, __VA_ARGS__ )
+#define THREADINSTRUMENT_LOG(STR_ID, ...)       THREADINSTRUMENT_INTL_LOG(ThreadInstrument::DefaultCategory, STR_ID, false, __VA_ARGS__ )
+
+/// Same as ::THREADINSTRUMENT_LOG for an event of category \c CATEGORY, which can be a ThreadInstrument::Category or its number
+#define THREADINSTRUMENT_LOG_IN(CATEGORY, STR_ID, ...) THREADINSTRUMENT_INTL_LOG(CATEGORY, STR_ID, false, __VA_ARGS__ )
 
 } //namespace ThreadInstrument
 
@@ -0,0 +1,157 @@
+/*
+ ThreadInstrument: Library to monitor thread activity
+ Copyright (C) 2012-2022 Basilio B. Fraguela. Universidade da Coruna
+
+ Distributed under the MIT License. (See accompanying file LICENSE)
+ */
+
+///
+/// \file     binLogToText.cpp
+/// \brief    application to convert binary ThreadInstrument logs into text logs
+/// \author   Basilio B. Fraguela <basilio.fraguela@udc.es>
+///
+#include <unistd.h>
+#include <cstdio>
+#include <cstdlib>
+#include <cinttypes>
+#include <string>
+#include <map>
+#include <iostream>
+#include "thread_instrument/binary_log.h"
+
+/* This program prints the binary logs generated by ThreadInstrument::dumpLogBinary
+ with the same format used by ThreadInstrument::dumpLog for text logs. The data of
+ each entry is printed as ThreadInstrument::defaultPrinter does, or as
+ ThreadInstrument::pictureTimePrinter does if -p is used, so that the output can be
+ processed by pictureTime.
+ */
+
+namespace {
+
+  bool PictureTimeFormat = false;
+
+  std::map<std::uint32_t, std::string> EventNames;
+
+  const std::string C_Event_Str("Event");
+
+}
+
+void usage()
+{
+  std::cout <<
+R"(binLogToText [options] <files>
+-p             print entries as pictureTimePrinter does
+-t             print the threads found in the logs
+)";
+  exit(EXIT_FAILURE);
+}
+
+/// Hexadecimal representation of the \c size bytes at \c p, as ThreadInstrument::dumpLog prints the typed payloads without formatter
+std::string hexPayload(const void *p, std::size_t size)
+{ static const char hex_digits[] = "0123456789abcdef";
+  std::string s(" 0x");
+
+  for (std::size_t i = 0; i < size; i++) {
+    const unsigned char c = static_cast<const unsigned char *>(p)[i];
+    s.push_back(hex_digits[c >> 4]);
+    s.push_back(hex_digits[c & 15]);
+  }
+
+  return s;
+}
+
+void printRecord(const ThreadInstrument::BinaryLogRecord& record, const void *payload, const std::uint64_t ticks_per_second)
+{
+  const auto it = EventNames.find(record.event_);
+  const std::string event_name = (it != EventNames.end()) ? it->second : (C_Event_Str + std::to_string(record.event_));
+  const std::string label = (payload != nullptr) ? hexPayload(payload, record.payloadSize_) :
+                            PictureTimeFormat ? (record.data_ ? " END" : " BEGIN") : std::to_string(record.data_);
+
+  if (record.flags_ & ThreadInstrument::BinaryLogTimed) {
+    printf("Th%3u %lf %s%s\n", record.thread_, static_cast<double>(record.time_) / ticks_per_second, event_name.c_str(), label.c_str());
+  } else {
+    printf("Th%3u %s%s\n", record.thread_, event_name.c_str(), label.c_str());
+  }
+}
+
+int main(int argc, char **argv)
+{ ThreadInstrument::BinaryLogSectionHeader section;
+  ThreadInstrument::BinaryLogRecord record;
+  ThreadInstrument::BinaryLogThread thread;
+  ThreadInstrument::BinaryLogThreadName thread_name;
+  std::string name, role;
+  std::uint32_t event;
+  bool show_threads = false;
+  int i;
+
+  while ((i = getopt(argc, argv, "pt")) != -1)
+    switch(i) {
+      case 'p':
+        PictureTimeFormat = true;
+        break;
+      case 't':
+        show_threads = true;
+        break;
+      case '?':
+      default:
+        usage();
+    }
+
+  if(argc <= optind) {
+    usage();
+  }
+
+  for (int narg = optind; narg < argc; narg++) {
+
+    const char * const filename = argv[narg];
+
+    FILE *fin = fopen(filename, "rb");
+    if ( fin == nullptr ) {
+      printf("File %s not found\n", filename);
+      exit(EXIT_FAILURE);
+    }
+
+    ThreadInstrument::BinaryLogReader reader(fin);
+    if (!reader.open()) {
+      std::cerr << "File " << filename << " is not a valid binary log\n";
+      exit(EXIT_FAILURE);
+    }
+
+    EventNames.clear();
+
+    while (reader.nextSection(section)) {
+      switch (section.kind_) {
+        case ThreadInstrument::BinaryLogEventNames:
+          while (reader.readName(event, name)) {
+            EventNames[event] = name;
+          }
+          break;
+        case ThreadInstrument::BinaryLogThreads:
+          while (reader.readThread(thread)) {
+            if (show_threads) {
+              printf("# Thread %u system id %" PRIu64 "\n", thread.thread_, thread.systemId_);
+            }
+          }
+          break;
+        case ThreadInstrument::BinaryLogThreadNames:
+          while (reader.readThreadName(thread_name, name, role)) {
+            if (show_threads) {
+              printf("# Thread %u name %s role %s index %d\n", thread_name.thread_, name.c_str(), role.c_str(), thread_name.roleIndex_);
+            }
+          }
+          break;
+        case ThreadInstrument::BinaryLogEvents:
+          while (reader.readRecord(record)) {
+            printRecord(record, reader.payload(record), reader.header().ticksPerSecond_);
+          }
+          break;
+        default:
+          break;
+      }
+    }
+
+    fclose(fin);
+  }
+
+  return 0;
+}
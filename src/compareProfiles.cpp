@@ -0,0 +1,328 @@
+/*
+ ThreadInstrument: Library to monitor thread activity
+ Copyright (C) 2012-2022 Basilio B. Fraguela. Universidade da Coruna
+
+ Distributed under the MIT License. (See accompanying file LICENSE)
+ */
+
+///
+/// \file     compareProfiles.cpp
+/// \brief    application to compare the activity reports of different runs and detect performance regressions
+/// \author   Basilio B. Fraguela <basilio.fraguela@udc.es>
+///
+#include <unistd.h>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <string>
+#include <vector>
+
+/* This program compares the reports generated by ThreadInstrument::dumpActivityCSV in
+ one or more baseline runs with those of one or more candidate runs. The activities are
+ matched by name, and for each one the program compares the mean across the runs of its
+ total time, its number of invocations and, when the histograms of the activities were
+ enabled, its mean time and its percentiles 50, 90 and 99. An increase of a time larger
+ than the threshold (-t) is a regression if the baseline or the candidate have a single run,
+ or if the one-sided Welch's t-test of the runs finds it significant with level -a.
+ The exit status is EXIT_FAILURE when regressions are found, so that the program can
+ gate the performance in continuous integration.
+ */
+
+namespace {
+
+  /// Relative increase of a time above which it is considered a slowdown
+  double Threshold = 0.05;
+
+  /// Significance level of the tests of the differences
+  double Alpha = 0.05;
+
+  /// Print all the comparisons, and not only those that changed beyond the threshold
+  bool Verbose = false;
+
+  /// Field of the reports that is compared
+  struct Metric {
+    const char *column_;
+    bool isTime_;   ///< Whether an increase is a slowdown
+  };
+
+  const Metric Metrics[] = {
+    {"time", true}, {"invocations", false}, {"mean_time", true}, {"p50", true}, {"p90", true}, {"p99", true}
+  };
+
+  constexpr int NMetrics = sizeof(Metrics) / sizeof(Metrics[0]);
+
+  /// Values of each metric of an activity in each run of a side of the comparison
+  struct ActivityRuns {
+    std::vector<double> values_[NMetrics];
+  };
+
+  typedef std::map<std::string, ActivityRuns> Side_t;
+
+  /// Mean, variance and number of the values of a metric
+  struct Summary {
+    double mean_ = 0., var_ = 0.;
+    std::size_t n_ = 0;
+  };
+
+}
+
+void usage()
+{
+  std::cout <<
+R"(compareProfiles [options] -b <baseline> [-b <baseline> ...] <candidates>
+-b file        CSV report of a baseline run, written by dumpActivityCSV
+-t threshold   relative increase of a time considered a slowdown (default 0.05)
+-a alpha       significance level of the tests when there are several runs (default 0.05)
+-v             print all the comparisons
+)";
+  exit(EXIT_FAILURE);
+}
+
+/// Splits a CSV line into its fields, removing the quotes of the quoted fields
+std::vector<std::string> splitCSV(const std::string& line)
+{ std::vector<std::string> fields(1);
+  bool quoted = false;
+
+  for (std::string::size_type i = 0; i < line.size(); i++) {
+    const char c = line[i];
+    if (quoted) {
+      if (c != '"') {
+        fields.back().push_back(c);
+      } else if ((i + 1 < line.size()) && (line[i + 1] == '"')) {
+        fields.back().push_back('"');
+        i++;
+      } else {
+        quoted = false;
+      }
+    } else if (c == '"') {
+      quoted = true;
+    } else if (c == ',') {
+      fields.emplace_back();
+    } else if (c != '\r') {
+      fields.back().push_back(c);
+    }
+  }
+
+  return fields;
+}
+
+/// Adds the values of the report \c filename to \c side, the run being number \c run of the side
+void readReport(const char *filename, Side_t& side, std::size_t run)
+{ std::ifstream in(filename);
+  std::string line;
+  int columns[NMetrics];
+  int name_column = -1;
+
+  if (!in || !std::getline(in, line)) {
+    std::cerr << "Unable to read " << filename << '\n';
+    exit(EXIT_FAILURE);
+  }
+
+  const std::vector<std::string> header = splitCSV(line);
+  for (int i = 0; i < NMetrics; i++) {
+    columns[i] = -1;
+  }
+  for (int i = 0; i < static_cast<int>(header.size()); i++) {
+    if (header[i] == "name") {
+      name_column = i;
+    }
+    for (int j = 0; j < NMetrics; j++) {
+      if (header[i] == Metrics[j].column_) {
+        columns[j] = i;
+      }
+    }
+  }
+  if (name_column < 0) {
+    std::cerr << filename << " is not a report of dumpActivityCSV\n";
+    exit(EXIT_FAILURE);
+  }
+
+  while (std::getline(in, line)) {
+    if (line.empty()) {
+      continue;
+    }
+    const std::vector<std::string> fields = splitCSV(line);
+    if (static_cast<int>(fields.size()) <= name_column) {
+      continue;
+    }
+    ActivityRuns& activity = side[fields[name_column]];
+    for (int j = 0; j < NMetrics; j++) {
+      std::vector<double>& values = activity.values_[j];
+      // Runs in which the activity did not appear or the metric was not measured are NaN
+      values.resize(run, NAN);
+      values.push_back(((columns[j] >= 0) && (columns[j] < static_cast<int>(fields.size())) && !fields[columns[j]].empty()) ?
+                       strtod(fields[columns[j]].c_str(), nullptr) : NAN);
+    }
+  }
+}
+
+/// Mean and unbiased variance of the values of \c v that are not NaN
+Summary summarize(const std::vector<double>& v)
+{ Summary r;
+
+  for (const double x : v) {
+    if (!std::isnan(x)) {
+      r.mean_ += x;
+      r.n_++;
+    }
+  }
+  if (r.n_) {
+    r.mean_ /= r.n_;
+    for (const double x : v) {
+      if (!std::isnan(x)) {
+        r.var_ += (x - r.mean_) * (x - r.mean_);
+      }
+    }
+    r.var_ = (r.n_ > 1) ? r.var_ / (r.n_ - 1) : 0.;
+  }
+
+  return r;
+}
+
+/// Continued fraction of the incomplete beta function, evaluated by the modified Lentz's method
+double betaContinuedFraction(double a, double b, double x)
+{ constexpr double Tiny = 1e-300;
+  double c = 1., d = 1. - (a + b) * x / (a + 1.);
+
+  if (std::fabs(d) < Tiny) {
+    d = Tiny;
+  }
+  d = 1. / d;
+  double h = d;
+  for (int m = 1; m <= 300; m++) {
+    const double m2 = 2. * m;
+    double aa = m * (b - m) * x / ((a + m2 - 1.) * (a + m2));
+    d = 1. + aa * d;
+    c = 1. + aa / c;
+    d = 1. / ((std::fabs(d) < Tiny) ? Tiny : d);
+    c = (std::fabs(c) < Tiny) ? Tiny : c;
+    h *= d * c;
+    aa = -(a + m) * (a + b + m) * x / ((a + m2) * (a + m2 + 1.));
+    d = 1. + aa * d;
+    c = 1. + aa / c;
+    d = 1. / ((std::fabs(d) < Tiny) ? Tiny : d);
+    c = (std::fabs(c) < Tiny) ? Tiny : c;
+    const double delta = d * c;
+    h *= delta;
+    if (std::fabs(delta - 1.) < 1e-12) {
+      break;
+    }
+  }
+
+  return h;
+}
+
+/// Regularized incomplete beta function I_x(a, b)
+double incompleteBeta(double a, double b, double x)
+{
+  if (x <= 0.) {
+    return 0.;
+  }
+  if (x >= 1.) {
+    return 1.;
+  }
+  const double front = std::exp(std::lgamma(a + b) - std::lgamma(a) - std::lgamma(b) + a * std::log(x) + b * std::log(1. - x));
+  return (x < (a + 1.) / (a + b + 2.)) ? front * betaContinuedFraction(a, b, x) / a :
+                                         1. - front * betaContinuedFraction(b, a, 1. - x) / b;
+}
+
+/// p-value of the one-sided Welch's t-test of the hypothesis that the mean of \c c is larger than that of \c b
+double welchPValue(const Summary& b, const Summary& c)
+{
+  const double sb = b.var_ / b.n_, sc = c.var_ / c.n_, se2 = sb + sc;
+
+  if (se2 <= 0.) {
+    return (c.mean_ > b.mean_) ? 0. : 1.;
+  }
+
+  const double t = (c.mean_ - b.mean_) / std::sqrt(se2);
+  const double df = se2 * se2 / (sb * sb / (b.n_ - 1) + sc * sc / (c.n_ - 1));
+  const double tail = 0.5 * incompleteBeta(0.5 * df, 0.5, df / (df + t * t));
+
+  return (t > 0.) ? tail : 1. - tail;
+}
+
+/// Compares the activities of the baseline and the candidate runs, returning the number of regressions found
+unsigned compare(const Side_t& baseline, const Side_t& candidate)
+{ unsigned nregressions = 0;
+
+  for (const auto& activity : baseline) {
+    const auto it = candidate.find(activity.first);
+    if (it == candidate.end()) {
+      std::cout << activity.first << " : only in the baseline\n";
+      continue;
+    }
+    for (int j = 0; j < NMetrics; j++) {
+      const Summary b = summarize(activity.second.values_[j]), c = summarize(it->second.values_[j]);
+      if (!b.n_ || !c.n_) {
+        continue;
+      }
+      const double change = (b.mean_ != 0.) ? (c.mean_ - b.mean_) / b.mean_ : ((c.mean_ != 0.) ? INFINITY : 0.);
+      const bool tested = (b.n_ > 1) && (c.n_ > 1);
+      const double p = tested ? welchPValue(b, c) : NAN;
+      const bool regression = Metrics[j].isTime_ && (change > Threshold) && (!tested || (p < Alpha));
+      if (regression) {
+        nregressions++;
+      }
+      if (Verbose || regression || (std::fabs(change) > Threshold)) {
+        printf("%s %s : %.6g -> %.6g (%+.2f%%)", activity.first.c_str(), Metrics[j].column_, b.mean_, c.mean_, 100. * change);
+        if (tested) {
+          printf(" p=%.4g", p);
+        }
+        puts(regression ? " REGRESSION" : "");
+      }
+    }
+  }
+
+  for (const auto& activity : candidate) {
+    if (!baseline.count(activity.first)) {
+      std::cout << activity.first << " : only in the candidate\n";
+    }
+  }
+
+  return nregressions;
+}
+
+int main(int argc, char **argv)
+{ std::vector<const char *> baseline_files;
+  Side_t baseline, candidate;
+  int i;
+
+  while ((i = getopt(argc, argv, "b:t:a:v")) != -1)
+    switch(i) {
+      case 'b':
+        baseline_files.push_back(optarg);
+        break;
+      case 't':
+        Threshold = strtod(optarg, nullptr);
+        break;
+      case 'a':
+        Alpha = strtod(optarg, nullptr);
+        break;
+      case 'v':
+        Verbose = true;
+        break;
+      case '?':
+      default:
+        usage();
+    }
+
+  if (baseline_files.empty() || (argc <= optind)) {
+    usage();
+  }
+
+  for (std::size_t run = 0; run < baseline_files.size(); run++) {
+    readReport(baseline_files[run], baseline, run);
+  }
+  for (int narg = optind; narg < argc; narg++) {
+    readReport(argv[narg], candidate, narg - optind);
+  }
+
+  const unsigned nregressions = compare(baseline, candidate);
+  std::cout << nregressions << " regressions\n";
+
+  return nregressions ? EXIT_FAILURE : EXIT_SUCCESS;
+}
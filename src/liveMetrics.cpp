@@ -0,0 +1,145 @@
+/*
+ ThreadInstrument: Library to monitor thread activity
+ Copyright (C) 2012-2022 Basilio B. Fraguela. Universidade da Coruna
+
+ Distributed under the MIT License. (See accompanying file LICENSE)
+ */
+
+///
+/// \file     liveMetrics.cpp
+/// \brief    application to read the live metrics published by a process with ThreadInstrument::startLiveMetrics
+/// \author   Basilio B. Fraguela <basilio.fraguela@udc.es>
+///
+#include <unistd.h>
+#include <cstdio>
+#include <cstdlib>
+#include <cctype>
+#include <cinttypes>
+#include <string>
+#include <map>
+#include <vector>
+#include <chrono>
+#include <thread>
+#include <iostream>
+#include "thread_instrument/live_metrics.h"
+
+/* This program prints the activity statistics kept in the shared memory segment of a
+ process that invoked ThreadInstrument::startLiveMetrics, with the same format used by
+ ThreadInstrument::dumpActivity. The segment is identified by the pid of the process,
+ in which case its default name is used, or by its name. By default it prints the
+ statistics of each activity added for all the threads once.
+ */
+
+namespace {
+
+  bool PerThread = false;
+
+  const std::string C_Event_Str("Event");
+
+  /// Statistics of an activity, possibly added for several threads
+  struct Totals {
+    double time, exclusiveTime;
+    unsigned invocations;
+
+    Totals() : time(0.0), exclusiveTime(0.0), invocations(0) {}
+  };
+
+}
+
+void usage()
+{
+  std::cout <<
+R"(liveMetrics [options] <pid | segment name>
+-i seconds     print the metrics every this number of seconds
+-n count       number of times the metrics are printed (default 1, 0 means forever)
+-t             print the metrics of each thread instead of their total
+)";
+  exit(EXIT_FAILURE);
+}
+
+void printMetrics(const ThreadInstrument::LiveMetricsHeader& header,
+                  const std::vector<ThreadInstrument::LiveMetricsName>& names,
+                  const std::vector<ThreadInstrument::LiveMetricsEntry>& entries)
+{ std::map<std::int32_t, std::string> event_names;
+  std::map<std::pair<std::uint32_t, std::int32_t>, Totals> totals;
+
+  for (const auto& name : names) {
+    event_names[name.event_] = name.name_;
+  }
+
+  for (const auto& entry : entries) {
+    Totals& t = totals[std::make_pair(PerThread ? entry.thread_ : 0u, entry.event_)];
+    t.time += entry.time_;
+    t.exclusiveTime += entry.exclusiveTime_;
+    t.invocations += entry.invocations_;
+  }
+
+  printf("# pid %" PRId64 " at %lf seconds, %u threads%s%s\n", header.pid_, header.updateTime_, header.nThreads_,
+         (header.flags_ & ThreadInstrument::LiveMetricsTruncated) ? ", truncated" : "",
+         (header.flags_ & ThreadInstrument::LiveMetricsStopped) ? ", stopped" : "");
+
+  for (const auto& item : totals) {
+    const auto it = event_names.find(item.first.second);
+    const std::string event_name = (it != event_names.end()) ? it->second : (C_Event_Str + ' ' + std::to_string(item.first.second));
+    if (PerThread) {
+      printf("Th%3u ", item.first.first);
+    }
+    printf("Event %16s : %lf seconds (%lf exclusive) %u invocations\n", event_name.c_str(),
+           item.second.time, item.second.exclusiveTime, item.second.invocations);
+  }
+  fflush(stdout);
+}
+
+int main(int argc, char **argv)
+{ ThreadInstrument::LiveMetricsHeader header;
+  std::vector<ThreadInstrument::LiveMetricsName> names;
+  std::vector<ThreadInstrument::LiveMetricsEntry> entries;
+  ThreadInstrument::LiveMetricsReader reader;
+  double interval = 1.0;
+  unsigned count = 1;
+  int i;
+
+  while ((i = getopt(argc, argv, "i:n:t")) != -1)
+    switch(i) {
+      case 'i':
+        interval = atof(optarg);
+        break;
+      case 'n':
+        count = static_cast<unsigned>(atoi(optarg));
+        break;
+      case 't':
+        PerThread = true;
+        break;
+      case '?':
+      default:
+        usage();
+    }
+
+  if(argc != optind + 1) {
+    usage();
+  }
+
+  const char * const target = argv[optind];
+  const std::string segment_name = isdigit(target[0]) ? ThreadInstrument::defaultLiveMetricsName(atol(target)) : std::string(target);
+
+  if (!reader.open(segment_name)) {
+    std::cerr << "Segment " << segment_name << " not found or not valid\n";
+    exit(EXIT_FAILURE);
+  }
+
+  for (unsigned n = 0; !count || (n < count); n++) {
+    if (n) {
+      std::this_thread::sleep_for(std::chrono::duration<double>(interval));
+    }
+    if (!reader.read(header, names, entries)) {
+      std::cerr << "Segment " << segment_name << " is stale: its publisher has been updating it for too long\n";
+      exit(EXIT_FAILURE);
+    }
+    printMetrics(header, names, entries);
+    if (header.flags_ & ThreadInstrument::LiveMetricsStopped) {
+      break;
+    }
+  }
+
+  return 0;
+}
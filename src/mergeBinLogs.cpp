@@ -0,0 +1,455 @@
+/*
+ ThreadInstrument: Library to monitor thread activity
+ Copyright (C) 2012-2022 Basilio B. Fraguela. Universidade da Coruna
+
+ Distributed under the MIT License. (See accompanying file LICENSE)
+ */
+
+///
+/// \file     mergeBinLogs.cpp
+/// \brief    application to merge the binary ThreadInstrument logs of several processes into a single one
+/// \author   Basilio B. Fraguela <basilio.fraguela@udc.es>
+///
+#include <unistd.h>
+#include <cstdio>
+#include <cstdlib>
+#include <algorithm>
+#include <atomic>
+#include <iostream>
+#include <limits>
+#include <map>
+#include <queue>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include "thread_instrument/binary_log.h"
+
+/* This program merges the binary logs generated by ThreadInstrument::dumpLogBinary,
+ ThreadInstrument::startLogFlusher or ThreadInstrument::dumpFlightRecorder in different
+ processes, possibly in different hosts, into a single binary log with all the records in
+ chronological order, which can be analyzed with pictureTime or binLogToText.
+ The moments of the records are aligned by means of the ::BinaryLogProcesses sections
+ of the logs, which indicate when each process started and the offset of its clock with
+ respect to the reference one obtained with ThreadInstrument::synchronizeClock. The logs
+ without that section are assumed to start at the same time as the earliest process.
+ The threads of each log are renumbered after those of the previous logs, which are sorted
+ by the rank of their first process, and the events are unified by name.
+ The logs are read and sorted in parallel, and then merged by a k-way merge.
+ */
+
+namespace {
+
+  /// Records of each ::BinaryLogEvents section of the output
+  constexpr unsigned RecordsPerSection = 2048;
+
+  /// Process whose threads appear in an input log
+  struct Process {
+    ThreadInstrument::BinaryLogProcess info_;
+    std::string host_;
+  };
+
+  /// Name and role of a thread
+  struct ThreadName {
+    std::string name_, role_;
+    std::int32_t roleIndex_;
+  };
+
+  /// Contents of an input log
+  struct InputLog {
+    const char *filename_;
+    std::vector<Process> processes_;                    ///< Empty if the log has no ::BinaryLogProcesses section
+    std::map<std::uint32_t, std::string> names_;
+    std::map<std::uint32_t, std::uint64_t> threads_;    ///< System identifier of each thread of the log
+    std::map<std::uint32_t, ThreadName> threadNames_;   ///< Name and role of the threads of the log that have them
+    std::vector<ThreadInstrument::BinaryLogRecord> records_;  ///< Sorted by their time_ in nanoseconds since the Unix epoch, or since the start of the log if processes_ is empty
+    std::string payloads_;                              ///< Typed payloads of the records, whose data_ is their position here
+    std::uint32_t nthreads_;                            ///< One more than the largest thread number of the log
+    std::uint32_t firstThread_;                         ///< Number of the first thread of the log in the output
+    std::unordered_map<std::uint32_t, std::uint32_t> events_;  ///< Event of the output of each event of the log
+
+    explicit InputLog(const char *filename) :
+    filename_(filename), nthreads_(0), firstThread_(0)
+    { }
+
+    /// Rank used to sort the logs, -1 if unknown
+    int rank() const noexcept
+    {
+      return processes_.empty() ? -1 : processes_.front().info_.rank_;
+    }
+
+    /// Process of the log to which \c thread belongs, which is assumed to be the first one if none includes it. Only valid if processes_ is not empty
+    const Process& processOf(std::uint32_t thread) const noexcept
+    {
+      for (auto it = processes_.rbegin(); it != processes_.rend(); ++it) {
+        if ((thread >= it->info_.firstThread_) && (!it->info_.threads_ || (thread < it->info_.firstThread_ + it->info_.threads_))) {
+          return *it;
+        }
+      }
+      return processes_.front();
+    }
+
+  };
+
+  /// Nanoseconds in \c ticks units of a clock with \c ticks_per_second, avoiding overflows
+  inline std::int64_t nanoseconds(std::int64_t ticks, std::uint64_t ticks_per_second) noexcept
+  {
+    const std::int64_t tps = static_cast<std::int64_t>(ticks_per_second);
+    return (ticks / tps) * 1000000000 + ((ticks % tps) * 1000000000) / tps;
+  }
+
+  /// Reads and sorts the log \c log
+  void readLog(InputLog& log)
+  { ThreadInstrument::BinaryLogSectionHeader section;
+    ThreadInstrument::BinaryLogRecord record;
+    ThreadInstrument::BinaryLogThread thread;
+    ThreadInstrument::BinaryLogThreadName thread_name;
+    Process process;
+    std::string name, role;
+    std::uint32_t event;
+
+    FILE * const fin = fopen(log.filename_, "rb");
+    if (fin == nullptr) {
+      printf("File %s not found\n", log.filename_);
+      exit(EXIT_FAILURE);
+    }
+
+    ThreadInstrument::BinaryLogReader reader(fin);
+    if (!reader.open()) {
+      std::cerr << "File " << log.filename_ << " is not a valid binary log\n";
+      exit(EXIT_FAILURE);
+    }
+
+    while (reader.nextSection(section)) {
+      switch (section.kind_) {
+        case ThreadInstrument::BinaryLogProcesses:
+          while (reader.readProcess(process.info_, process.host_)) {
+            log.processes_.push_back(process);
+          }
+          break;
+        case ThreadInstrument::BinaryLogEventNames:
+          while (reader.readName(event, name)) {
+            log.names_[event] = name;
+          }
+          break;
+        case ThreadInstrument::BinaryLogThreads:
+          while (reader.readThread(thread)) {
+            log.threads_[thread.thread_] = thread.systemId_;
+            log.nthreads_ = std::max(log.nthreads_, thread.thread_ + 1);
+          }
+          break;
+        case ThreadInstrument::BinaryLogThreadNames:
+          while (reader.readThreadName(thread_name, name, role)) {
+            log.threadNames_[thread_name.thread_] = {name, role, thread_name.roleIndex_};
+          }
+          break;
+        case ThreadInstrument::BinaryLogEvents:
+          while (reader.readRecord(record)) {
+            record.time_ = nanoseconds(record.time_, reader.header().ticksPerSecond_);
+            const void * const payload = reader.payload(record);
+            if (payload != nullptr) {
+              record.data_ = log.payloads_.size();
+              log.payloads_.append(static_cast<const char *>(payload), record.payloadSize_);
+            } else {
+              record.flags_ &= ~ThreadInstrument::BinaryLogPayload;
+            }
+            log.nthreads_ = std::max(log.nthreads_, record.thread_ + 1);
+            log.records_.push_back(record);
+          }
+          break;
+        default:
+          break;
+      }
+    }
+
+    fclose(fin);
+
+    // The records are moved to the clock of reference of their process
+    if (!log.processes_.empty()) {
+      for (ThreadInstrument::BinaryLogRecord& r : log.records_) {
+        const Process& p = log.processOf(r.thread_);
+        r.time_ += p.info_.startTime_ + p.info_.clockOffset_;
+      }
+    }
+
+    // The order of the records of each thread must be kept
+    std::stable_sort(log.records_.begin(), log.records_.end(),
+                     [](const ThreadInstrument::BinaryLogRecord& a, const ThreadInstrument::BinaryLogRecord& b) {
+                       return a.time_ < b.time_;
+                     });
+  }
+
+  /// Reads the logs in parallel by means of \c nthreads threads
+  void readLogs(std::vector<InputLog>& logs, unsigned nthreads)
+  { std::atomic<std::size_t> next {0};
+    std::vector<std::thread> threads;
+
+    auto reader = [&]() {
+      for (std::size_t i = next++; i < logs.size(); i = next++) {
+        readLog(logs[i]);
+      }
+    };
+
+    nthreads = std::min<unsigned>(nthreads, static_cast<unsigned>(logs.size()));
+    for (unsigned i = 1; i < nthreads; i++) {
+      threads.emplace_back(reader);
+    }
+    reader();
+    for (auto& t : threads) {
+      t.join();
+    }
+  }
+
+  /// Writer of the output log
+  class Output {
+
+    FILE *f_;
+    std::vector<ThreadInstrument::BinaryLogRecord> records_;
+    std::string payloads_;              ///< Typed payloads of records_
+    std::uint32_t npayloads_;
+
+    void write(const void *p, size_t n)
+    {
+      if (n && (fwrite(p, n, 1, f_) != 1)) {
+        perror("mergeBinLogs");
+        exit(EXIT_FAILURE);
+      }
+    }
+
+    void writeSection(ThreadInstrument::BinaryLogSectionKind kind, std::uint32_t count, const void *p, size_t n)
+    {
+      const ThreadInstrument::BinaryLogSectionHeader header {kind, count, n};
+      write(&header, sizeof(header));
+      write(p, n);
+    }
+
+  public:
+
+    explicit Output(const char *filename) :
+    npayloads_(0)
+    {
+      f_ = fopen(filename, "wb");
+      if (f_ == nullptr) {
+        std::cerr << "Unable to open file " << filename << '\n';
+        exit(EXIT_FAILURE);
+      }
+      records_.reserve(RecordsPerSection);
+    }
+
+    ~Output()
+    {
+      flush();
+      fclose(f_);
+    }
+
+    /// Writes the file header and the description of the processes, names and threads of \c logs
+    void writeHeaders(const std::vector<InputLog>& logs, const std::vector<std::string>& names, std::int64_t origin)
+    { ThreadInstrument::BinaryLogFileHeader header;
+      std::vector<ThreadInstrument::BinaryLogThread> threads;
+      std::string buf;
+      std::uint32_t count = 0;
+
+      memcpy(header.magic_, ThreadInstrument::BinaryLogMagic, sizeof(header.magic_));
+      header.version_ = ThreadInstrument::BinaryLogVersion;
+      header.recordSize_ = sizeof(ThreadInstrument::BinaryLogRecord);
+      header.ticksPerSecond_ = 1000000000;
+      write(&header, sizeof(header));
+
+      // The times of the output are already in the clock of reference
+      for (const InputLog& log : logs) {
+        for (const Process& p : log.processes_) {
+          ThreadInstrument::BinaryLogProcess info = p.info_;
+          info.hostLength_ = static_cast<std::uint32_t>(p.host_.size());
+          info.startTime_ = origin;
+          info.clockOffset_ = 0;
+          info.firstThread_ = log.firstThread_ + p.info_.firstThread_;
+          info.threads_ = (p.info_.threads_ || (p.info_.firstThread_ >= log.nthreads_)) ? p.info_.threads_ : (log.nthreads_ - p.info_.firstThread_);
+          buf.append(reinterpret_cast<const char *>(&info), sizeof(info));
+          buf.append(p.host_);
+          count++;
+        }
+      }
+      if (count) {
+        writeSection(ThreadInstrument::BinaryLogProcesses, count, buf.data(), buf.size());
+      }
+
+      buf.clear();
+      for (std::uint32_t i = 0; i < names.size(); i++) {
+        const ThreadInstrument::BinaryLogName bn {i, static_cast<std::uint32_t>(names[i].size())};
+        buf.append(reinterpret_cast<const char *>(&bn), sizeof(bn));
+        buf.append(names[i]);
+      }
+      writeSection(ThreadInstrument::BinaryLogEventNames, static_cast<std::uint32_t>(names.size()), buf.data(), buf.size());
+
+      for (const InputLog& log : logs) {
+        for (const auto& thread : log.threads_) {
+          threads.push_back({log.firstThread_ + thread.first, 0, thread.second});
+        }
+      }
+      writeSection(ThreadInstrument::BinaryLogThreads, static_cast<std::uint32_t>(threads.size()), threads.data(), threads.size() * sizeof(ThreadInstrument::BinaryLogThread));
+
+      buf.clear();
+      count = 0;
+      for (const InputLog& log : logs) {
+        for (const auto& thread : log.threadNames_) {
+          const ThreadInstrument::BinaryLogThreadName btn {log.firstThread_ + thread.first, thread.second.roleIndex_,
+            static_cast<std::uint32_t>(thread.second.name_.size()), static_cast<std::uint32_t>(thread.second.role_.size())};
+          buf.append(reinterpret_cast<const char *>(&btn), sizeof(btn));
+          buf.append(thread.second.name_);
+          buf.append(thread.second.role_);
+          count++;
+        }
+      }
+      if (count) {
+        writeSection(ThreadInstrument::BinaryLogThreadNames, count, buf.data(), buf.size());
+      }
+    }
+
+    /// Writes \c record, whose typed payload, if it has one, is \c payload
+    void writeRecord(const ThreadInstrument::BinaryLogRecord& record, const char *payload)
+    {
+      records_.push_back(record);
+      if (record.flags_ & ThreadInstrument::BinaryLogPayload) {
+        records_.back().data_ = payloads_.size();
+        payloads_.append(payload, record.payloadSize_);
+        npayloads_++;
+      }
+      if (records_.size() == RecordsPerSection) {
+        flush();
+      }
+    }
+
+    void flush()
+    {
+      if (!records_.empty()) {
+        if (npayloads_) {
+          writeSection(ThreadInstrument::BinaryLogPayloads, npayloads_, payloads_.data(), payloads_.size());
+          payloads_.clear();
+          npayloads_ = 0;
+        }
+        writeSection(ThreadInstrument::BinaryLogEvents, static_cast<std::uint32_t>(records_.size()), records_.data(), records_.size() * sizeof(ThreadInstrument::BinaryLogRecord));
+        records_.clear();
+      }
+    }
+
+  };
+
+}
+
+void usage()
+{
+  std::cout <<
+R"(mergeBinLogs [options] <files>
+-o file        output file (merged.bin by default)
+-j n           threads used to read the logs (hardware threads by default)
+)";
+  exit(EXIT_FAILURE);
+}
+
+int main(int argc, char **argv)
+{ std::vector<InputLog> logs;
+  std::vector<std::string> names;
+  std::unordered_map<std::string, std::uint32_t> name2event;
+  const char *output_filename = "merged.bin";
+  unsigned nthreads = std::max(1u, std::thread::hardware_concurrency());
+  int i;
+
+  while ((i = getopt(argc, argv, "o:j:")) != -1)
+    switch(i) {
+      case 'o':
+        output_filename = optarg;
+        break;
+      case 'j':
+        nthreads = static_cast<unsigned>(std::max(1, atoi(optarg)));
+        break;
+      case '?':
+      default:
+        usage();
+    }
+
+  if(argc <= optind) {
+    usage();
+  }
+
+  for (int narg = optind; narg < argc; narg++) {
+    logs.emplace_back(argv[narg]);
+  }
+
+  readLogs(logs, nthreads);
+
+  // The logs with an unknown rank follow those with a known one
+  std::stable_sort(logs.begin(), logs.end(), [](const InputLog& a, const InputLog& b) {
+    return static_cast<unsigned>(a.rank()) < static_cast<unsigned>(b.rank());
+  });
+
+  std::int64_t origin = std::numeric_limits<std::int64_t>::max();
+  std::uint32_t first_thread = 0;
+  for (InputLog& log : logs) {
+    log.firstThread_ = first_thread;
+    first_thread += log.nthreads_;
+    for (const Process& p : log.processes_) {
+      origin = std::min(origin, p.info_.startTime_ + p.info_.clockOffset_);
+    }
+    for (const auto& name : log.names_) {
+      auto it = name2event.find(name.second);
+      if (it == name2event.end()) {
+        it = name2event.emplace(name.second, static_cast<std::uint32_t>(names.size())).first;
+        names.push_back(name.second);
+      }
+      log.events_[name.first] = it->second;
+    }
+  }
+  if (origin == std::numeric_limits<std::int64_t>::max()) {
+    origin = 0;
+  }
+
+  // The events without a name need one in order to be unified
+  for (InputLog& log : logs) {
+    for (ThreadInstrument::BinaryLogRecord& r : log.records_) {
+      if (!log.events_.count(r.event_)) {
+        const std::string name = "Event" + std::to_string(r.event_);
+        auto it = name2event.find(name);
+        if (it == name2event.end()) {
+          it = name2event.emplace(name, static_cast<std::uint32_t>(names.size())).first;
+          names.push_back(name);
+        }
+        log.events_[r.event_] = it->second;
+      }
+    }
+  }
+
+  Output output(output_filename);
+  output.writeHeaders(logs, names, origin);
+
+  // k-way merge of the logs giving priority to the earliest record and then to the first log
+  typedef std::pair<std::int64_t, std::size_t> Head_t;
+  std::priority_queue<Head_t, std::vector<Head_t>, std::greater<Head_t>> heads;
+  std::vector<std::size_t> next(logs.size(), 0);
+
+  // The logs without processes start at the origin
+  auto time_of = [&](std::size_t nlog, const ThreadInstrument::BinaryLogRecord& r) {
+    return logs[nlog].processes_.empty() ? r.time_ : (r.time_ - origin);
+  };
+
+  for (std::size_t nlog = 0; nlog < logs.size(); nlog++) {
+    if (!logs[nlog].records_.empty()) {
+      heads.emplace(time_of(nlog, logs[nlog].records_.front()), nlog);
+    }
+  }
+
+  while (!heads.empty()) {
+    const std::size_t nlog = heads.top().second;
+    InputLog& log = logs[nlog];
+    ThreadInstrument::BinaryLogRecord record = log.records_[next[nlog]];
+    record.time_ = heads.top().first;
+    record.thread_ += log.firstThread_;
+    record.event_ = log.events_[record.event_];
+    output.writeRecord(record, (record.flags_ & ThreadInstrument::BinaryLogPayload) ? (log.payloads_.data() + record.data_) : nullptr);
+    heads.pop();
+    if (++next[nlog] < log.records_.size()) {
+      heads.emplace(time_of(nlog, log.records_[next[nlog]]), nlog);
+    }
+  }
+
+  return 0;
+}
@@ -11,25 +11,53 @@
 /// \author   Basilio B. Fraguela <basilio.fraguela@udc.es>
 ///
 #include <unistd.h>
+#include <getopt.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include <cstring>
 #include <cstdio>
 #include <cstdlib>
 #include <cassert>
+#include <cmath>
+#include <climits>
 #include <string>
 #include <vector>
 #include <set>
 #include <map>
 #include <iostream>
-//#include <algorithm>
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include "thread_instrument/binary_log.h"
+#include "thread_instrument/chrome_trace.h"
 
 /* This program generates a LaTeX file that displays the execution time of a program split by
  activitied based on events generated by a tool such as ThreadInstrument. 
  
  The LaTeX file relies on the tikz-timing package and it can distinguish the activities by colors
  or patterns depending on the options provided. Run the program without argument to see the help.
+ With -j the program generates instead a trace in the Chrome Trace Event JSON format, which can be
+ opened by chrome://tracing or Perfetto and is better suited for large logs. In this mode the events
+ are streamed to the output as they are read, and the activities of a thread can be nested.
+ With -b the LaTeX file is instead a level of detail view for traces with many activities, in which
+ the timeline of each thread is divided in a given number of bins that are depicted by their main
+ activity or, with -u, by the fraction of their time in which the thread is busy.
+ With -a the program prints instead a report, as text or JSON, with an estimation of the critical path,
+ the load imbalance of the activities and of their phases, and the idle time of the threads.
 
  The format of each line in the input must have the form:
  [^d]* thread_number event_time event_name [BEGIN|END]
+ Lines that begin with # are comments.
+
+ Binary logs generated by ThreadInstrument::dumpLogBinary are also accepted. In them the timed
+ entries with data 0 are the BEGIN of the activity and the ones with another value are the END.
+
+ The text logs are mapped in memory and split in pieces of lines that are parsed in parallel, as
+ are the different files provided, the events being then added in the order of the files, so that
+ the result is the same as with a sequential reading. Lines that do not follow the format are skipped.
+ With --from, --to and --threads the events outside a window of time or the threads selected are
+ dropped while they are read, and the sidecar time index of the binary logs (see binary_log.h), which
+ is built the first time a window is used on them, allows to skip the records that are not needed.
  
  Example input file:
  Th   0 0.2  COMPUTE_MATRIX BEGIN
@@ -68,7 +96,6 @@ enum class MergingPolicy_t {Basic, Advanced, Full};
 namespace  {
 
   const int MXBUF = 256;
-  const char * const _SPCS = " \t\n";
 
   const char * Colors[] = {
     "red",
@@ -124,6 +151,40 @@ namespace  {
   bool NoSlopes = false;
   bool LightLines = false;
   bool GenerateTable = false;
+  bool GenerateChromeTrace = false;
+  unsigned NBins = 0;                 ///< Under -b, number of bins in which the timeline of each thread is divided
+  bool UtilizationShades = false;     ///< Under -u, the bins are shaded by their utilization instead of their dominant activity
+
+  /// Format of the analysis report generated instead of the graph under -a
+  enum class AnalysisFormat_t {None, Text, JSON};
+  AnalysisFormat_t AnalysisFormat = AnalysisFormat_t::None;
+
+  /// Phases run by several threads with the largest barrier idle time shown in the analysis report
+  const unsigned NReportedPhases = 10;
+
+  /// Whether --from or --to were used, so that the events out of [FromTime, ToTime] are dropped while they are read
+  bool TimeWindow = false;
+  double FromTime = -HUGE_VAL;
+  double ToTime = HUGE_VAL;
+
+  /// Under --threads, threads whose events are kept, numbered as in the -j traces. Empty means all of them
+  std::set<unsigned> SelectedThreads;
+
+  /// Under -j, writer to which the events are streamed as they are read, so that activities can be nested
+  ThreadInstrument::ChromeTraceWriter *TraceWriter = nullptr;
+
+  /// Under -j, threads whose name has been written
+  std::set<unsigned> NamedThreads;
+
+  /// Name and role of a thread found in a binary log
+  struct ThreadLabel {
+    std::string label_;   ///< Its name, or its role followed by a period and its index
+    std::string role_;
+    int roleIndex_;
+  };
+
+  /// Labels of the threads with name or role, numbered as in the -j traces
+  std::map<unsigned, ThreadLabel> ThreadLabels;
 
   double Ratio;
 }
@@ -238,19 +299,29 @@ std::string escapeLatex(const std::string& s)
   return ret;
 }
 
-int classifyLabel(const char *label_str)
+/// Label of the thread \c nthread, or \c default_label if it has neither name nor role
+std::string threadLabel(unsigned nthread, const std::string& default_label)
 {
-  if (!strcmp(label_str, "BEGIN")) {
-    return 0;
+  const auto it = ThreadLabels.find(nthread);
+  return (it != ThreadLabels.end()) ? it->second.label_ : default_label;
+}
+
+/// Whether the thread \c a is shown before \c b: the threads without role first, then those of each role by their index
+bool threadBefore(unsigned a, unsigned b)
+{
+  const auto it_a = ThreadLabels.find(a), it_b = ThreadLabels.find(b);
+  const std::string empty;
+  const std::string& role_a = ((it_a != ThreadLabels.end()) ? it_a->second.role_ : empty);
+  const std::string& role_b = ((it_b != ThreadLabels.end()) ? it_b->second.role_ : empty);
+  if (role_a != role_b) {
+    return role_a.empty() || (!role_b.empty() && (role_a < role_b));
   }
-  if (!strcmp(label_str, "END")) {
-    return 1;
+  if (!role_a.empty() && (it_a->second.roleIndex_ != it_b->second.roleIndex_)) {
+    return it_a->second.roleIndex_ < it_b->second.roleIndex_;
   }
-  assert(false);
-  return -1;
+  return a < b;
 }
 
-
 void gatherStatistics()
 {
   assert(!Thr2ActivityMap.empty());
@@ -512,6 +583,101 @@ void print_thread_activities(std::ostream &s,
   buffer.print(end_ptr);
 }
 
+/// Prints a run of \c nbins consecutive bins of the level-of-detail mode with the same representation
+/** The representation is \c activity, or idle if it is negative. Under -u it is instead the utilization
+ *  level of the bins in tenths, which is idle when it is 0. */
+void print_bin_run(MergingBuffer& buffer, const int representation, const unsigned nbins)
+{
+  const double char_length = nbins * static_cast<double>(NChars) / NBins;
+
+  if (UtilizationShades ? (representation == 0) : (representation < 0)) {
+    buffer.print(std::string(my_double_to_str(char_length)) + 'Z');
+  } else if (UtilizationShades) {
+    buffer.print(",[[timing/d/background/.style={fill=black!" + std::to_string(representation * 10) + "}]]" +
+                 my_double_to_str(char_length) + ActivityDescription::DefaultRepr + (NoSlopes ? "," : "{},"));
+  } else {
+    buffer.cached_push_to_buffer(static_cast<unsigned>(representation), char_length);
+  }
+}
+
+/// Prints the timeline of a thread divided in NBins bins of the same length in a single sweep of its activities
+/** Each bin is represented by the activity that occupies most of it, or as idle if the thread is busy
+ *  less than half of it, or under -u by the fraction of it in which the thread is busy. The consecutive
+ *  bins with the same representation are printed together, so that the size of the output depends on
+ *  NBins rather than on the number of activities. */
+void print_thread_bins(std::ostream &s,
+                       const std::vector<activity_data>& activity_vector,
+                       double * const times_per_activity)
+{ MergingBuffer buffer(s);
+  std::vector<double> bin_times(Activities.size(), 0.);
+  std::vector<unsigned> bin_activities;   // activities with time in the current bin
+
+  const double bin_length = maxTime / NBins;
+  auto it = activity_vector.cbegin();
+  const auto it_end = activity_vector.cend();
+  int run_representation = 0;
+  unsigned run_bins = 0;
+
+  for (unsigned nbin = 0; nbin < NBins; ++nbin) {
+    const double bin_begin = nbin * bin_length;
+    const double bin_end = (nbin + 1 == NBins) ? maxTime : (bin_begin + bin_length);
+    double busy_time = 0.;
+
+    while ((it != it_end) && (it->begin_ < bin_end)) {
+      const double time_spent = std::min(it->end_, bin_end) - std::max(it->begin_, bin_begin);
+      if (time_spent > 0.) {
+        if (bin_times[it->activity_] == 0.) {
+          bin_activities.push_back(it->activity_);
+        }
+        bin_times[it->activity_] += time_spent;
+        times_per_activity[it->activity_] += time_spent;
+        busy_time += time_spent;
+      }
+      if (it->end_ > bin_end) {
+        break; // it continues in the next bin
+      }
+      ++it;
+    }
+
+    int representation;
+    if (UtilizationShades) {
+      representation = static_cast<int>(busy_time / (bin_end - bin_begin) * 10. + 0.5);
+      representation = std::min(representation, 10);
+    } else {
+      // the bin is idle if the thread is busy less than half of it
+      representation = -1;
+      if (2. * busy_time >= (bin_end - bin_begin)) {
+        double max_time = 0.;
+        for (const unsigned activity : bin_activities) {
+          if (bin_times[activity] > max_time) {
+            max_time = bin_times[activity];
+            representation = static_cast<int>(activity);
+          }
+        }
+      }
+    }
+
+    for (const unsigned activity : bin_activities) {
+      bin_times[activity] = 0.;
+    }
+    bin_activities.clear();
+
+    if (run_bins && (representation != run_representation)) {
+      print_bin_run(buffer, run_representation, run_bins);
+      run_bins = 0;
+    }
+    run_representation = representation;
+    run_bins++;
+  }
+
+  if (run_bins) {
+    print_bin_run(buffer, run_representation, run_bins);
+  }
+
+  const char * const end_ptr = GenerateTable ? "G\\\\\n" : "G};\n";
+  buffer.print(end_ptr);
+}
+
 void dump(std::ostream &s, const std::string& config_str)
 {
   const auto n_activities = static_cast<unsigned int>(Activities.size());
@@ -542,16 +708,23 @@ void dump(std::ostream &s, const std::string& config_str)
 
   Ratio = NChars / maxTime;
 
+  // The threads with role are shown after the others, grouped by role
+  std::vector<Thr2ActivityMap_t::const_iterator> rows;
+  for (auto it = Thr2ActivityMap.cbegin(); it != Thr2ActivityMap.cend(); ++it) {
+    rows.push_back(it);
+  }
+  std::stable_sort(rows.begin(), rows.end(), [](Thr2ActivityMap_t::const_iterator a, Thr2ActivityMap_t::const_iterator b) {
+    return threadBefore(a->first, b->first);
+  });
+
   unsigned cur_thread = 0;
-  for (auto it = Thr2ActivityMap.begin(); it != Thr2ActivityMap.end(); ++it) {
+  for (const auto it : rows) {
+    const std::string label = ShowThreads ? escapeLatex(threadLabel(it->first, 'T' + std::to_string(cur_thread))) : std::string();
     if (GenerateTable) {
-      if(ShowThreads) {
-        s << 'T' << cur_thread;
-      }
-      s << " & G";
+      s << label << " & G";
     } else {
       if(ShowThreads) {
-        s << "\\draw(0," << (RowDist * (cur_thread + 0.5)) << "ex) node {T" << cur_thread << "};\n";
+        s << "\\draw(0," << (RowDist * (cur_thread + 0.5)) << "ex) node {" << label << "};\n";
       }
       s << "\\timing at (0.5cm," << (RowDist * cur_thread) << "ex) {G";
     }
@@ -562,7 +735,11 @@ void dump(std::ostream &s, const std::string& config_str)
       s << "[[timing/slope=0]]";
     }
 
-    print_thread_activities(s, it->second, times_per_activity[cur_thread]);
+    if (NBins) {
+      print_thread_bins(s, it->second, times_per_activity[cur_thread]);
+    } else {
+      print_thread_activities(s, it->second, times_per_activity[cur_thread]);
+    }
 
     cur_thread++;
   }
@@ -587,10 +764,17 @@ void dump(std::ostream &s, const std::string& config_str)
         s << "\\texttiming[Z]{[[" + slope_string + "timing/d/background/.style={pattern=" + activity.pattern_ + "}]]2D[black]0.01Z} " + escapeLatex(activity.name_) + '\n';
       }
     }
-    if (UseGreyAreas) {
+    if (UseGreyAreas && !NBins) {
       s << "\\texttiming[Z]{[[" + slope_string + "]]2U[black]0.01Z} very small tasks\n";
     }
   }
+
+  if (UtilizationShades) {
+    const std::string slope_string = VerticalSlope ? "timing/slope=0," : "";
+    for (int percentage = 20; percentage <= 100; percentage += 40) {
+      s << "\\texttiming[Z]{[[" + slope_string + "timing/d/background/.style={fill=black!" + std::to_string(percentage) + "}]]2D[black]0.01Z} " + std::to_string(percentage) + "\\% busy\n";
+    }
+  }
   
   if (Verbosity) {
     
@@ -626,16 +810,281 @@ void dump(std::ostream &s, const std::string& config_str)
   s << "\n\\end{document}\n";
 }
 
+/// Instance of an activity in a thread considered by the analysis
+struct AnalysisInterval {
+
+  unsigned thread_;
+  const activity_data *data_;
+
+  AnalysisInterval(unsigned nthread, const activity_data *data) :
+  thread_(nthread), data_(data)
+  {}
+
+};
+
+/// Maximal lapse of time in which an activity is run without interruption by some thread
+struct PhaseInstance {
+
+  unsigned activity_;
+  double begin_, end_;
+  unsigned threads_;      ///< Threads that run the activity in the phase
+  double maxBusy_;        ///< Largest time spent by a thread in the activity in the phase
+  double meanBusy_;       ///< Mean time spent in the activity in the phase by the threads that run it
+  double barrierIdle_;    ///< Time the threads wait from their last instance in the phase until its end
+
+};
+
+/// Statistics of an activity in the analysis report
+struct ActivitySummary {
+
+  unsigned invocations_ = 0;
+  unsigned threads_ = 0;        ///< Threads that run it
+  double total_ = 0.;
+  double maxBusy_ = 0.;         ///< Largest time spent by a thread in the activity
+  unsigned phases_ = 0;
+  unsigned parallelPhases_ = 0; ///< Phases run by more than one thread
+  double barrierIdle_ = 0.;     ///< Sum of PhaseInstance::barrierIdle_ of its phases
+  double criticalPath_ = 0.;    ///< Time of the critical path spent in it
+
+};
+
+std::string jsonString(const std::string& str)
+{ char buf[8];
+  std::string ret(1, '"');
+
+  for (const char c : str) {
+    if ((c == '"') || (c == '\\')) {
+      ret += '\\';
+      ret += c;
+    } else if (static_cast<unsigned char>(c) < 0x20) {
+      snprintf(buf, sizeof(buf), "\\u%04x", static_cast<unsigned char>(c));
+      ret += buf;
+    } else {
+      ret += c;
+    }
+  }
+  ret += '"';
+  return ret;
+}
+
+/// @internal non thread safe
+const char *fixed_str(double d)
+{ static char buf[32];
+
+  snprintf(buf, sizeof(buf), "%.6f", d);
+  return buf;
+}
+
+/// Adds to \c phases the phases of \c activity_intervals run by several threads and adds the statistics of all of them to \c summary
+void findPhases(std::vector<AnalysisInterval>& activity_intervals, const unsigned nactivity,
+                ActivitySummary& summary, std::vector<PhaseInstance>& phases)
+{ std::map<unsigned, std::pair<double, double>> thread_times; // busy and last end per thread in the phase
+
+  std::sort(activity_intervals.begin(), activity_intervals.end(), [](const AnalysisInterval& a, const AnalysisInterval& b) {
+    return a.data_->begin_ < b.data_->begin_;
+  });
+
+  auto close_phase = [&](const double begin, const double end) {
+    PhaseInstance phase {nactivity, begin, end, static_cast<unsigned>(thread_times.size()), 0., 0., 0.};
+    for (const auto& pair : thread_times) {
+      phase.maxBusy_ = std::max(phase.maxBusy_, pair.second.first);
+      phase.meanBusy_ += pair.second.first;
+      phase.barrierIdle_ += end - pair.second.second;
+    }
+    phase.meanBusy_ /= phase.threads_;
+    summary.phases_++;
+    summary.barrierIdle_ += phase.barrierIdle_;
+    if (phase.threads_ > 1) {
+      summary.parallelPhases_++;
+      phases.push_back(phase);
+    }
+    thread_times.clear();
+  };
+
+  double phase_begin = 0., phase_end = 0.;
+  for (const AnalysisInterval& interval : activity_intervals) {
+    const activity_data& ac = *interval.data_;
+    if (!thread_times.empty() && (ac.begin_ > phase_end)) {
+      close_phase(phase_begin, phase_end);
+    }
+    if (thread_times.empty()) {
+      phase_begin = ac.begin_;
+      phase_end = ac.end_;
+    }
+    phase_end = std::max(phase_end, ac.end_);
+    std::pair<double, double>& times = thread_times[interval.thread_];
+    times.first += ac.end_ - ac.begin_;
+    times.second = std::max(times.second, ac.end_);
+  }
+  if (!thread_times.empty()) {
+    close_phase(phase_begin, phase_end);
+  }
+}
+
+/// Prints a report of the critical path, the load imbalance and the idle time of the threads
+/** The phases are the maximal lapses of time in which an activity is run without interruption by some
+ *  thread, so that for example each parallel region separated by barriers from the next one is a phase.
+ *  The barrier idle time of a phase is the time its threads wait from their last instance of the activity
+ *  in the phase until its end. The imbalance of an activity is the maximum time spent on it by a thread
+ *  divided by the mean among all the threads, while for the phases the mean is computed among the threads
+ *  that run them.
+ *  As the logs do not record the dependences, the critical path is estimated walking back from the instance
+ *  that ends last, taking as predecessor of each instance the one of any thread that ends last before it
+ *  begins, which is the one it most probably waited for. */
+void analyze(std::ostream &s)
+{ std::vector<std::vector<AnalysisInterval>> intervals(Activities.size());
+  std::vector<AnalysisInterval> all_intervals;
+  std::vector<ActivitySummary> summaries(Activities.size());
+  std::vector<PhaseInstance> phases;
+  std::map<unsigned, double> thread_busy;
+
+  const unsigned n_threads = static_cast<unsigned>(Thr2ActivityMap.size());
+
+  for (const auto& pair : Thr2ActivityMap) {
+    std::vector<double> busy(Activities.size(), 0.);
+    double& total_busy = thread_busy[pair.first];
+    for (const activity_data& ac : pair.second) {
+      const double time_spent = ac.end_ - ac.begin_;
+      intervals[ac.activity_].emplace_back(pair.first, &ac);
+      all_intervals.emplace_back(pair.first, &ac);
+      summaries[ac.activity_].invocations_++;
+      summaries[ac.activity_].total_ += time_spent;
+      busy[ac.activity_] += time_spent;
+      total_busy += time_spent;
+    }
+    for (unsigned i = 0; i < Activities.size(); ++i) {
+      if (busy[i] > 0.) {
+        summaries[i].threads_++;
+        summaries[i].maxBusy_ = std::max(summaries[i].maxBusy_, busy[i]);
+      }
+    }
+  }
+
+  for (unsigned i = 0; i < Activities.size(); ++i) {
+    findPhases(intervals[i], i, summaries[i], phases);
+  }
+
+  // critical path
+  std::sort(all_intervals.begin(), all_intervals.end(), [](const AnalysisInterval& a, const AnalysisInterval& b) {
+    return a.data_->end_ < b.data_->end_;
+  });
+  std::vector<double> ends;
+  ends.reserve(all_intervals.size());
+  for (const AnalysisInterval& interval : all_intervals) {
+    ends.push_back(interval.data_->end_);
+  }
+
+  double path_busy = 0., path_idle = 0.;
+  unsigned path_segments = 0, path_switches = 0;
+  for (long p = static_cast<long>(all_intervals.size()) - 1; p >= 0; ) {
+    const activity_data& ac = *all_intervals[p].data_;
+    path_busy += ac.end_ - ac.begin_;
+    summaries[ac.activity_].criticalPath_ += ac.end_ - ac.begin_;
+    path_segments++;
+    const long q = std::min(p - 1, static_cast<long>(std::upper_bound(ends.begin(), ends.end(), ac.begin_) - ends.begin()) - 1);
+    if (q < 0) {
+      path_idle += ac.begin_;
+    } else {
+      path_idle += ac.begin_ - all_intervals[q].data_->end_;
+      path_switches += (all_intervals[q].thread_ != all_intervals[p].thread_);
+    }
+    p = q;
+  }
+
+  std::stable_sort(phases.begin(), phases.end(), [](const PhaseInstance& a, const PhaseInstance& b) {
+    return a.barrierIdle_ > b.barrierIdle_;
+  });
+  const std::size_t n_phases = std::min<std::size_t>(phases.size(), NReportedPhases);
+
+  auto imbalance = [n_threads](const ActivitySummary& summary) {
+    return (summary.total_ > 0.) ? (summary.maxBusy_ * n_threads / summary.total_) : 0.;
+  };
+  auto phase_imbalance = [](const PhaseInstance& phase) {
+    return (phase.meanBusy_ > 0.) ? (phase.maxBusy_ / phase.meanBusy_) : 0.;
+  };
+
+  if (AnalysisFormat == AnalysisFormat_t::JSON) {
+    s << "{\"nthreads\":" << n_threads << ",\"makespan\":" << fixed_str(maxTime);
+    s << ",\n\"critical_path\":{\"busy\":" << fixed_str(path_busy);
+    s << ",\"idle\":" << fixed_str(path_idle) << ",\"segments\":" << path_segments << ",\"switches\":" << path_switches << "},\n\"activities\":[";
+    for (unsigned i = 0; i < Activities.size(); ++i) {
+      const ActivitySummary& summary = summaries[i];
+      s << (i ? ",\n" : "\n") << "{\"name\":" << jsonString(Activities[i].name_) << ",\"invocations\":" << summary.invocations_;
+      s << ",\"threads\":" << summary.threads_ << ",\"total\":" << fixed_str(summary.total_);
+      s << ",\"max_thread\":" << fixed_str(summary.maxBusy_) << ",\"imbalance\":" << fixed_str(imbalance(summary));
+      s << ",\"phases\":" << summary.phases_ << ",\"parallel_phases\":" << summary.parallelPhases_;
+      s << ",\"barrier_idle\":" << fixed_str(summary.barrierIdle_) << ",\"critical_path\":" << fixed_str(summary.criticalPath_) << '}';
+    }
+    s << "],\n\"phases\":[";
+    for (std::size_t i = 0; i < n_phases; ++i) {
+      const PhaseInstance& phase = phases[i];
+      s << (i ? ",\n" : "\n") << "{\"name\":" << jsonString(Activities[phase.activity_].name_) << ",\"begin\":" << fixed_str(phase.begin_);
+      s << ",\"end\":" << fixed_str(phase.end_) << ",\"threads\":" << phase.threads_ << ",\"max_thread\":" << fixed_str(phase.maxBusy_);
+      s << ",\"imbalance\":" << fixed_str(phase_imbalance(phase)) << ",\"barrier_idle\":" << fixed_str(phase.barrierIdle_) << '}';
+    }
+    s << "],\n\"threads\":[";
+    bool first = true;
+    for (const auto& pair : thread_busy) {
+      s << (first ? "\n" : ",\n") << "{\"thread\":" << pair.first << ",\"busy\":" << fixed_str(pair.second);
+      s << ",\"idle\":" << fixed_str(maxTime - pair.second) << '}';
+      first = false;
+    }
+    s << "]}\n";
+  } else {
+    char buf[256];
+
+    snprintf(buf, sizeof(buf), "Analysis of %u threads during %.6f s\n", n_threads, maxTime);
+    s << buf;
+    snprintf(buf, sizeof(buf), "Critical path: %.6f s busy (%.1f%%), %.6f s idle, %u segments, %u thread switches\n",
+             path_busy, 100. * path_busy / maxTime, path_idle, path_segments, path_switches);
+    s << buf;
+
+    s << "\nActivities:\n";
+    snprintf(buf, sizeof(buf), "%-24s %11s %7s %12s %12s %9s %7s %12s %12s\n",
+             "name", "invocations", "threads", "total", "max_thread", "imbalance", "phases", "barrier_idle", "crit_path");
+    s << buf;
+    for (unsigned i = 0; i < Activities.size(); ++i) {
+      const ActivitySummary& summary = summaries[i];
+      snprintf(buf, sizeof(buf), "%-24s %11u %7u %12.6f %12.6f %9.3f %7u %12.6f %12.6f\n",
+               Activities[i].name_.c_str(), summary.invocations_, summary.threads_, summary.total_, summary.maxBusy_,
+               imbalance(summary), summary.phases_, summary.barrierIdle_, summary.criticalPath_);
+      s << buf;
+    }
+
+    s << "\nParallel phases with the largest barrier idle time (" << n_phases << " of " << phases.size() << "):\n";
+    snprintf(buf, sizeof(buf), "%-24s %12s %12s %7s %12s %9s %12s\n",
+             "name", "begin", "end", "threads", "max_thread", "imbalance", "barrier_idle");
+    s << buf;
+    for (std::size_t i = 0; i < n_phases; ++i) {
+      const PhaseInstance& phase = phases[i];
+      snprintf(buf, sizeof(buf), "%-24s %12.6f %12.6f %7u %12.6f %9.3f %12.6f\n",
+               Activities[phase.activity_].name_.c_str(), phase.begin_, phase.end_, phase.threads_, phase.maxBusy_,
+               phase_imbalance(phase), phase.barrierIdle_);
+      s << buf;
+    }
+
+    s << "\nThreads:\n";
+    snprintf(buf, sizeof(buf), "%-8s %12s %12s\n", "thread", "busy", "idle");
+    s << buf;
+    for (const auto& pair : thread_busy) {
+      snprintf(buf, sizeof(buf), "%-8s %12.6f %12.6f\n", threadLabel(pair.first, 'T' + std::to_string(pair.first)).c_str(), pair.second, maxTime - pair.second);
+      s << buf;
+    }
+  }
+}
 
 void usage()
 {
   std::cout <<
 R"(pictureTime [options] <files>
 -0             no transitions between tasks
+-a format      analysis report (text or json) instead of the graph
+-b bins        level of detail: divide each timeline in bins shown by their main activity
 -C             automatic colors for activities
 -c act=color   color for activity
 -f             fill activities (all in grey)
 -g             grey areas for small consecutive tasks
+-j             generate a Chrome Trace Event JSON trace instead of LaTeX
 -L             light lines
 -l length      graph length in x (char size)
 -M [B|A|F]     merging policy (Basic, Advanced, Full)
@@ -648,8 +1097,12 @@ R"(pictureTime [options] <files>
 -s activity    silence activity
 -T             generate table
 -t             show thread numbers
+-u             shade bins by fraction of busy time (implies -b 4*length)
 -V             vertical transitions
 -v level       verbosity level
+--from time    only depict from this time of the logs (in seconds)
+--to time      only depict until this time of the logs (in seconds)
+--threads list only depict these threads (e.g. 0-7,12)
 )";
   exit(EXIT_FAILURE);
 }
@@ -666,6 +1119,32 @@ std::pair<const char *, const char *> extractPair(char *arg)
   return {arg, (equal + 1)};
 }
 
+/// Adds to SelectedThreads the threads of a list such as 0-7,12
+void selectThreads(const char *list)
+{ char *end;
+
+  do {
+    const unsigned long first = strtoul(list, &end, 10);
+    unsigned long last = first;
+    if (end == list) {
+      std::cerr << "Wrong list of threads " << list << '\n';
+      exit(EXIT_FAILURE);
+    }
+    if (*end == '-') {
+      list = end + 1;
+      last = strtoul(list, &end, 10);
+      if ((end == list) || (last < first)) {
+        std::cerr << "Wrong range of threads " << list << '\n';
+        exit(EXIT_FAILURE);
+      }
+    }
+    for (unsigned long nthread = first; nthread <= last; ++nthread) {
+      SelectedThreads.insert(static_cast<unsigned>(nthread));
+    }
+    list = end + 1;
+  } while (*end == ',');
+}
+
 std::string config(int argc, char *argv[])
 { std::pair<const char *, const char *> charpair;
   int i;
@@ -673,14 +1152,34 @@ std::string config(int argc, char *argv[])
 #ifdef __linux__
   "+"
 #endif
-  "0Cc:fgLl:M:mnPp:r:S:s:TtVv:";
+  "0a:b:Cc:fgjLl:M:mnPp:r:S:s:TtuVv:";
+  enum { FromOption = 256, ToOption, ThreadsOption };
+  static const struct option longArgs[] = {
+    {"from", required_argument, nullptr, FromOption},
+    {"to", required_argument, nullptr, ToOption},
+    {"threads", required_argument, nullptr, ThreadsOption},
+    {nullptr, 0, nullptr, 0}
+  };
   
-  while ((i = getopt(argc, argv, srchArgs)) != -1)
+  while ((i = getopt_long(argc, argv, srchArgs, longArgs, nullptr)) != -1)
     switch(i) {
       case '0':
         NoSlopes = true; // Can avoid the D-D slopes, but not the D-U and U-D ones
         VerticalSlope = true; // This helps make lighter the D-U and U-D slopes
         break;
+      case 'a':
+        if (!strcmp(optarg, "text")) {
+          AnalysisFormat = AnalysisFormat_t::Text;
+        } else if (!strcmp(optarg, "json")) {
+          AnalysisFormat = AnalysisFormat_t::JSON;
+        } else {
+          std::cerr << "Unknown option -a " << optarg << '\n';
+          exit(EXIT_FAILURE);
+        }
+        break;
+      case 'b':
+        NBins = (unsigned)strtoul(optarg, (char **)nullptr, 10);
+        break;
       case 'C':
         AutoColorize = true;
         AutoPattern = false;
@@ -695,6 +1194,9 @@ std::string config(int argc, char *argv[])
       case 'g':
         UseGreyAreas = true;
         break;
+      case 'j':
+        GenerateChromeTrace = true;
+        break;
       case 'L':
         LightLines = true;
         break;
@@ -752,12 +1254,26 @@ std::string config(int argc, char *argv[])
       case 't':
         ShowThreads = true;
         break;
+      case 'u':
+        UtilizationShades = true;
+        break;
       case 'V':
         VerticalSlope =true;
         break;
       case 'v':
         Verbosity = std::max(1, (int)strtoul(optarg, (char **) nullptr, 10));
         break;
+      case FromOption:
+        FromTime = strtod(optarg, nullptr);
+        TimeWindow = true;
+        break;
+      case ToOption:
+        ToTime = strtod(optarg, nullptr);
+        TimeWindow = true;
+        break;
+      case ThreadsOption:
+        selectThreads(optarg);
+        break;
       case '?':
       default:
         usage();
@@ -766,6 +1282,10 @@ std::string config(int argc, char *argv[])
   if(argc <= optind) {
     usage();
   }
+
+  if (UtilizationShades && !NBins) {
+    NBins = 4 * NChars;
+  }
   
   std::string ret("%Config: ");
   for (int tmp = 1;  tmp < optind; tmp++) {
@@ -777,69 +1297,908 @@ std::string config(int argc, char *argv[])
 }
 
 
-int main(int argc, char **argv)
-{ char *p, bufin[MXBUF];
+/// Number of the activities silenced in the ParsedChunk and by processEvent
+const unsigned SilencedActivity = ~0u;
 
-  const std::string config_str = config(argc, argv);
+/// Event read from a log, whose activity is numbered in the table of names of the ParsedChunk that contains it
+struct ParsedEvent {
 
-  if (argc < 1) {
-    std::cerr << "Missing file argument";
+  double time_;
+  unsigned thread_;     ///< Number of the thread in its file
+  unsigned activity_;
+  int label_;           ///< 0 for BEGIN, 1 for END
+
+  ParsedEvent(double time_point, unsigned nthread, unsigned activity, int label) :
+  time_(time_point), thread_(nthread), activity_(activity), label_(label)
+  {}
+
+};
+
+/// Events parsed from a piece of a log
+/** Under --from/--to the events out of the window whose pairs are found in the same piece are dropped
+ *  as they are added, the remaining ones being processed by windowEvent when the piece is merged */
+class ParsedChunk {
+
+  /// Value of OpenBegin::event_ for the activities dropped because they began after the window
+  static constexpr std::size_t Dropped = ~static_cast<std::size_t>(0);
+
+  /// Activity begun in the piece whose end has not been found yet
+  struct OpenBegin {
+    std::size_t event_;   ///< Position of its BEGIN in events_, or Dropped
+    unsigned activity_;
+  };
+
+  std::map<unsigned, std::vector<OpenBegin>> open_;   ///< Activities open in each thread
+  std::vector<OpenBegin> *lastOpen_ = nullptr;        ///< Entry of open_ of lastThread_
+  unsigned lastThread_ = ~0u;
+
+  void addInWindow(const double time_point, const unsigned nthread, const unsigned activity, const int label)
+  {
+    std::vector<OpenBegin>& open = *lastOpen_;
+
+    if (!label) {
+      if (time_point > ToTime) {
+        open.push_back({Dropped, activity});
+      } else {
+        open.push_back({events_.size(), activity});
+        events_.emplace_back(time_point, nthread, activity, label);
+      }
+    } else {
+      if (!open.empty() && (open.back().activity_ == activity)) {
+        const std::size_t nbegin = open.back().event_;
+        open.pop_back();
+        if (nbegin == Dropped) {
+          return;
+        }
+        if ((time_point < FromTime) && (events_[nbegin].time_ < FromTime)) {
+          events_[nbegin].label_ = -1; // the whole activity is before the window
+          return;
+        }
+      }
+      events_.emplace_back(time_point, nthread, activity, label);
+    }
+  }
+
+public:
+
+  std::vector<ParsedEvent> events_;
+  std::vector<std::string> names_;    ///< Names of the activities in the order they appear in the piece
+  std::set<unsigned> threads_;        ///< Threads found in the piece, even if all their events were dropped
+  std::map<unsigned, ThreadLabel> labels_; ///< Labels of the threads of the piece with name or role
+
+  void addThread(const unsigned nthread)
+  {
+    if (nthread != lastThread_) {
+      lastThread_ = nthread;
+      threads_.insert(nthread);
+      if (TimeWindow) {
+        lastOpen_ = &open_[nthread];
+      }
+    }
+  }
+
+  void add(const double time_point, const unsigned nthread, const unsigned activity, const int label)
+  {
+    addThread(nthread);
+    if (TimeWindow) {
+      addInWindow(time_point, nthread, activity, label);
+    } else {
+      events_.emplace_back(time_point, nthread, activity, label);
+    }
+  }
+
+  /// Removes the events dropped once the piece has been parsed
+  void finish()
+  {
+    if (TimeWindow) {
+      events_.erase(std::remove_if(events_.begin(), events_.end(), [](const ParsedEvent& ev) { return ev.label_ < 0; }), events_.end());
+      open_.clear();
+      lastOpen_ = nullptr;
+      lastThread_ = ~0u;
+    }
+  }
+
+};
+
+/// Numbers the names of the activities of a ParsedChunk without building a std::string for those already known
+class ChunkNameTable {
+
+  std::vector<std::string>& names_;
+  std::vector<unsigned> slots_;       ///< Open addressing hash table of positions in names_ plus one, 0 meaning empty
+
+  static std::size_t hash(const char *s, std::size_t len) noexcept
+  { std::size_t h = 14695981039346656037ull;
+
+    for (std::size_t i = 0; i < len; ++i) {
+      h = (h ^ static_cast<unsigned char>(s[i])) * 1099511628211ull;
+    }
+    return h;
+  }
+
+public:
+
+  explicit ChunkNameTable(std::vector<std::string>& names) :
+  names_(names), slots_(64, 0)
+  {}
+
+  /// Number of the activity named by the \c len characters at \c s, registering it if needed
+  unsigned find(const char *s, std::size_t len)
+  {
+    const std::size_t mask = slots_.size() - 1;
+    for (std::size_t pos = hash(s, len) & mask; ; pos = (pos + 1) & mask) {
+      const unsigned slot = slots_[pos];
+      if (!slot) {
+        names_.emplace_back(s, len);
+        slots_[pos] = static_cast<unsigned>(names_.size());
+        if (2 * names_.size() > slots_.size()) {
+          rehash();
+        }
+        return static_cast<unsigned>(names_.size() - 1);
+      }
+      const std::string& name = names_[slot - 1];
+      if ((name.size() == len) && !memcmp(name.data(), s, len)) {
+        return slot - 1;
+      }
+    }
+  }
+
+  void rehash()
+  {
+    std::vector<unsigned> slots(2 * slots_.size(), 0);
+    const std::size_t mask = slots.size() - 1;
+    for (unsigned i = 0; i < names_.size(); ++i) {
+      std::size_t pos = hash(names_[i].data(), names_[i].size()) & mask;
+      while (slots[pos]) {
+        pos = (pos + 1) & mask;
+      }
+      slots[pos] = i + 1;
+    }
+    slots_.swap(slots);
+  }
+
+};
+
+/// Records the beginning (\c label 0) or the end (\c label 1) of the activity \c nactivity, registered by registerActivity
+void processEvent(unsigned nthread, double time_point, unsigned nactivity, int label)
+{
+  if (TraceWriter != nullptr) {
+    if (nactivity != SilencedActivity) {
+      if (NamedThreads.insert(nthread).second) {
+        TraceWriter->threadName(nthread, threadLabel(nthread, 'T' + std::to_string(nthread)).c_str());
+      }
+      if (!label) {
+        TraceWriter->begin(nthread, time_point, Activities[nactivity].name_.c_str());
+      } else {
+        TraceWriter->end(nthread, time_point, Activities[nactivity].name_.c_str());
+      }
+    }
+    // The thread is registered so that the numbering of the threads of the next files is kept
+    Thr2ActivityMap[nthread];
+    return;
+  }
+
+  if (nactivity != SilencedActivity) {
+    assert(label >= 0); // BEGIN (0) OR END(1)
+
+    // printf("%u %lf %u %d\n", nthread, time_point, nactivity, label);
+
+    std::vector<activity_data>& vec_act_data = Thr2ActivityMap[nthread];
+    if (!label) { // BEGIN
+      assert(vec_act_data.empty() || (vec_act_data.back().end_ > 0.) );
+      vec_act_data.emplace_back(nactivity, time_point);
+    } else {  // END
+      assert(!vec_act_data.empty() && (vec_act_data.back().end_ == 0.) );
+      vec_act_data.back().end_ = time_point;
+    }
+  }
+}
+
+/// Activity begun and not ended yet in a thread under --from/--to
+struct WindowActivity {
+
+  enum State {
+    Delayed,  ///< It began before the window, so its BEGIN is processed at FromTime if it is still running then
+    Emitted,  ///< Its BEGIN was processed
+    Dropped   ///< It began after the window
+  };
+
+  unsigned activity_;
+  State state_;
+
+};
+
+/// Activities open in each thread under --from/--to
+std::map<unsigned, std::vector<WindowActivity>> WindowActivities;
+
+/// Processes at FromTime the BEGIN of the activities of thread \c nthread that began before the window
+void emitDelayedActivities(const unsigned nthread, std::vector<WindowActivity>& open)
+{
+  // The delayed activities are the outermost ones, as the events of each thread are in chronological order
+  for (WindowActivity& wa : open) {
+    if (wa.state_ != WindowActivity::Delayed) {
+      break;
+    }
+    processEvent(nthread, FromTime, wa.activity_, 0);
+    wa.state_ = WindowActivity::Emitted;
+  }
+}
+
+/// Processes an event under --from/--to, clipping to the window the activities that overlap it
+void windowEvent(const unsigned nthread, const double time_point, const unsigned nactivity, const int label)
+{
+  std::vector<WindowActivity>& open = WindowActivities[nthread];
+
+  if (!label) {
+    if (time_point > ToTime) {
+      open.push_back({nactivity, WindowActivity::Dropped});
+    } else if (time_point < FromTime) {
+      open.push_back({nactivity, WindowActivity::Delayed});
+    } else {
+      if (!open.empty() && (open.front().state_ == WindowActivity::Delayed)) {
+        emitDelayedActivities(nthread, open);
+      }
+      processEvent(nthread, time_point, nactivity, 0);
+      open.push_back({nactivity, WindowActivity::Emitted});
+    }
+  } else {
+    // As in the nested profiling, an END that does not match the innermost activity is ignored
+    if (open.empty() || (open.back().activity_ != nactivity)) {
+      return;
+    }
+    const WindowActivity::State state = open.back().state_;
+    if ((state == WindowActivity::Emitted) || ((state == WindowActivity::Delayed) && (time_point >= FromTime))) {
+      emitDelayedActivities(nthread, open);
+      processEvent(nthread, std::min(time_point, ToTime), nactivity, 1);
+    }
+    open.pop_back();
+  }
+}
+
+/// Ends at ToTime the activities still open in the window once all the events have been read
+void finishWindow()
+{
+  if (TimeWindow && (ToTime < HUGE_VAL)) {
+    for (auto& pair : WindowActivities) {
+      for (auto it = pair.second.rbegin(); it != pair.second.rend(); ++it) {
+        if (it->state_ == WindowActivity::Emitted) {
+          processEvent(pair.first, ToTime, it->activity_, 1);
+        }
+      }
+    }
+  }
+  WindowActivities.clear();
+}
+
+/// Adds the events of \c chunk of a file whose first thread is numbered \c cur_base_nthread, in the order they were read
+void mergeChunk(const ParsedChunk& chunk, const unsigned cur_base_nthread)
+{
+  std::vector<unsigned> nactivities;
+  nactivities.reserve(chunk.names_.size());
+  for (const std::string& name : chunk.names_) {
+    nactivities.push_back(SilencedActivities.count(name) ? SilencedActivity : registerActivity(name));
+  }
+
+  for (const auto& pair : chunk.labels_) {
+    ThreadLabels[pair.first + cur_base_nthread] = pair.second;
+  }
+
+  for (const ParsedEvent& ev : chunk.events_) {
+    const unsigned nthread = ev.thread_ + cur_base_nthread;
+    if (!SelectedThreads.empty() && !SelectedThreads.count(nthread)) {
+      continue;
+    }
+    if (TimeWindow) {
+      windowEvent(nthread, ev.time_, nactivities[ev.activity_], ev.label_);
+    } else {
+      processEvent(nthread, ev.time_, nactivities[ev.activity_], ev.label_);
+    }
+  }
+}
+
+inline bool isSpace(char c)
+{
+  return (c == ' ') || (c == '\t') || (c == '\n') || (c == '\r');
+}
+
+inline bool isDigit(char c)
+{
+  return (c >= '0') && (c <= '9');
+}
+
+/// Parses with strtod the number at [p, end), which may not be followed by a 0
+const char *slowParseDouble(const char *p, const char * const end, double& value)
+{ char buf[MXBUF];
+
+  const char *q = p;
+  while ((q < end) && !isSpace(*q)) {
+    q++;
+  }
+  const std::size_t len = std::min<std::size_t>(q - p, MXBUF - 1);
+  memcpy(buf, p, len);
+  buf[len] = 0;
+  value = strtod(buf, nullptr);
+  return q;
+}
+
+/// Parses the decimal number at [p, end) as strtod would. Returns the position after it
+/** The numbers with up to 19 significant digits whose exponent is small, as the times in the logs, are
+ *  parsed exactly without strtod, which is used for the rest */
+const char *parseDouble(const char *p, const char * const end, double& value)
+{ static const double Pow10[] = {
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22 };
+  std::uint64_t mantissa = 0;
+  int digits = 0, exponent = 0;
+  bool any_digit = false;
+
+  const char * const start = p;
+  const bool negative = (p < end) && (*p == '-');
+  if ((p < end) && ((*p == '-') || (*p == '+'))) {
+    p++;
+  }
+
+  for (; (p < end) && isDigit(*p); ++p) {
+    any_digit = true;
+    if (digits < 19) {
+      mantissa = mantissa * 10 + (*p - '0');
+      digits += (mantissa != 0);
+    } else {
+      exponent++;
+    }
+  }
+  if ((p < end) && (*p == '.')) {
+    for (++p; (p < end) && isDigit(*p); ++p) {
+      any_digit = true;
+      if (digits < 19) {
+        mantissa = mantissa * 10 + (*p - '0');
+        digits += (mantissa != 0);
+        exponent--;
+      }
+    }
+  }
+  if (any_digit && (p < end) && ((*p == 'e') || (*p == 'E'))) {
+    const char *q = p + 1;
+    const bool negative_exp = (q < end) && (*q == '-');
+    if ((q < end) && ((*q == '-') || (*q == '+'))) {
+      q++;
+    }
+    if ((q < end) && isDigit(*q)) {
+      int e = 0;
+      for (; (q < end) && isDigit(*q); ++q) {
+        e = std::min(e * 10 + (*q - '0'), 100000);
+      }
+      exponent += negative_exp ? -e : e;
+      p = q;
+    }
+  }
+
+  if (!any_digit || ((p < end) && !isSpace(*p)) || (mantissa >= (1ull << 53)) || (exponent < -22) || (exponent > 22)) {
+    return slowParseDouble(start, end, value);
+  }
+
+  value = static_cast<double>(mantissa);
+  value = (exponent < 0) ? (value / Pow10[-exponent]) : (value * Pow10[exponent]);
+  if (negative) {
+    value = -value;
+  }
+  return p;
+}
+
+/// Parses the lines of a text log in [p, end), which begins at the beginning of a line
+void parseTextChunk(const char *p, const char * const end, ParsedChunk& chunk)
+{ ChunkNameTable names(chunk.names_);
+
+  while (p < end) {
+    const char *line_end = static_cast<const char *>(memchr(p, '\n', end - p));
+    if (line_end == nullptr) {
+      line_end = end;
+    }
+    const char *q = p;
+    p = line_end + 1;
+
+    if (*q == '#') { // comment
+      continue;
+    }
+
+    // search first digit
+    while ((q < line_end) && !isDigit(*q)) {
+      q++;
+    }
+    if (q == line_end) {
+      continue;
+    }
+
+    // take thread number, which strtoul(,,0) would read as octal or hexadecimal if it begins with 0
+    unsigned nthread = 0;
+    if ((*q == '0') && (q + 1 < line_end) && !isSpace(q[1])) {
+      char buf[32];
+      const char *t = q;
+      while ((t < line_end) && !isSpace(*t)) {
+        t++;
+      }
+      const std::size_t len = std::min<std::size_t>(t - q, sizeof(buf) - 1);
+      memcpy(buf, q, len);
+      buf[len] = 0;
+      nthread = static_cast<unsigned>(strtoul(buf, nullptr, 0));
+      q = t;
+    } else {
+      for (; (q < line_end) && isDigit(*q); ++q) {
+        nthread = nthread * 10 + (*q - '0');
+      }
+      while ((q < line_end) && !isSpace(*q)) {
+        q++;
+      }
+    }
+
+    // take time point
+    while ((q < line_end) && isSpace(*q)) {
+      q++;
+    }
+    double time_point;
+    q = parseDouble(q, line_end, time_point);
+
+    // take activity
+    while ((q < line_end) && isSpace(*q)) {
+      q++;
+    }
+    const char * const act_str = q;
+    while ((q < line_end) && !isSpace(*q)) {
+      q++;
+    }
+    const std::size_t act_len = q - act_str;
+
+    // take BEGIN or END
+    while ((q < line_end) && isSpace(*q)) {
+      q++;
+    }
+    const char * const label_str = q;
+    while ((q < line_end) && !isSpace(*q)) {
+      q++;
+    }
+    const std::size_t label_len = q - label_str;
+
+    if (!act_len || !label_len) {
+      continue;
+    }
+
+    int label;
+    if ((label_len == 5) && !memcmp(label_str, "BEGIN", 5)) {
+      label = 0;
+    } else if ((label_len == 3) && !memcmp(label_str, "END", 3)) {
+      label = 1;
+    } else {
+      continue;
+    }
+
+    chunk.add(time_point, nthread, names.find(act_str, act_len), label);
+  }
+}
+
+/// Sidecar time index of a binary log, which is described in binary_log.h
+class TimeIndex {
+
+  /// Activity begun in a block whose end has not been found yet
+  struct OpenBegin {
+    std::uint32_t event_;
+    std::size_t block_;
+  };
+
+  std::vector<ThreadInstrument::BinaryLogIndexBlock> blocks_;
+  std::vector<std::uint32_t> threads_;
+  std::map<std::uint32_t, std::vector<OpenBegin>> open_;  ///< Activities open in each thread while the index is built
+
+public:
+
+  /// Records per block
+  static constexpr std::uint32_t BlockRecords = 4096;
+
+  const std::vector<ThreadInstrument::BinaryLogIndexBlock>& blocks() const { return blocks_; }
+
+  const std::vector<std::uint32_t>& threads() const { return threads_; }
+
+  /// Loads the index of the log \c filename, whose status is \c log_stat. Fails if it does not exist or it is outdated
+  bool load(const std::string& filename, const struct stat& log_stat)
+  { ThreadInstrument::BinaryLogIndexHeader header;
+    struct stat st;
+
+    const std::string index_name = filename + ThreadInstrument::BinaryLogIndexSuffix;
+    if ((stat(index_name.c_str(), &st) != 0) || (st.st_mtime < log_stat.st_mtime)) {
+      return false;
+    }
+
+    FILE * const fin = fopen(index_name.c_str(), "rb");
+    if (fin == nullptr) {
+      return false;
+    }
+
+    bool ok = (fread(&header, sizeof(header), 1, fin) == 1) &&
+              !memcmp(header.magic_, ThreadInstrument::BinaryLogIndexMagic, sizeof(header.magic_)) &&
+              (header.version_ == ThreadInstrument::BinaryLogIndexVersion) &&
+              (header.logBytes_ == static_cast<std::uint64_t>(log_stat.st_size));
+    if (ok) {
+      blocks_.resize(header.blocks_);
+      threads_.resize(header.threads_);
+      ok = (blocks_.empty() || (fread(blocks_.data(), sizeof(blocks_[0]), blocks_.size(), fin) == blocks_.size())) &&
+           (threads_.empty() || (fread(threads_.data(), sizeof(threads_[0]), threads_.size(), fin) == threads_.size()));
+    }
+
+    fclose(fin);
+    return ok;
+  }
+
+  /// Stores the index of the log \c filename. The failures are ignored, as the index is just an optimization
+  void save(const std::string& filename, const struct stat& log_stat) const
+  { ThreadInstrument::BinaryLogIndexHeader header;
+
+    FILE * const fout = fopen((filename + ThreadInstrument::BinaryLogIndexSuffix).c_str(), "wb");
+    if (fout == nullptr) {
+      return;
+    }
+
+    memcpy(header.magic_, ThreadInstrument::BinaryLogIndexMagic, sizeof(header.magic_));
+    header.version_ = ThreadInstrument::BinaryLogIndexVersion;
+    header.blockRecords_ = BlockRecords;
+    header.logBytes_ = static_cast<std::uint64_t>(log_stat.st_size);
+    header.blocks_ = blocks_.size();
+    header.threads_ = static_cast<std::uint32_t>(threads_.size());
+    header.reserved_ = 0;
+
+    fwrite(&header, sizeof(header), 1, fout);
+    fwrite(blocks_.data(), sizeof(blocks_[0]), blocks_.size(), fout);
+    fwrite(threads_.data(), sizeof(threads_[0]), threads_.size(), fout);
+    fclose(fout);
+  }
+
+  /// Adds to the index under construction the next \c record of the events section number \c nsection
+  void add(const std::uint32_t nsection, const ThreadInstrument::BinaryLogRecord& record)
+  {
+    if (blocks_.empty() || (blocks_.back().section_ != nsection) || (blocks_.back().records_ == BlockRecords)) {
+      blocks_.push_back({nsection, 0, LLONG_MAX, LLONG_MIN, LLONG_MIN});
+    }
+
+    ThreadInstrument::BinaryLogIndexBlock& block = blocks_.back();
+    block.records_++;
+
+    if (record.flags_ & ThreadInstrument::BinaryLogTimed) {
+      block.minTime_ = std::min<std::int64_t>(block.minTime_, record.time_);
+      block.maxTime_ = std::max<std::int64_t>(block.maxTime_, record.time_);
+      block.reach_ = std::max<std::int64_t>(block.reach_, record.time_);
+
+      std::vector<OpenBegin>& open = open_[record.thread_];
+      if (!record.data_) {
+        open.push_back({record.event_, blocks_.size() - 1});
+      } else if (!open.empty() && (open.back().event_ == record.event_)) {
+        std::int64_t& reach = blocks_[open.back().block_].reach_;
+        reach = std::max<std::int64_t>(reach, record.time_);
+        open.pop_back();
+      }
+    }
+  }
+
+  /// Completes the index once all the records have been added
+  void finish()
+  {
+    for (const auto& pair : open_) {
+      threads_.push_back(pair.first);
+      // the activities that never end may overlap any window after them
+      for (const OpenBegin& ob : pair.second) {
+        blocks_[ob.block_].reach_ = LLONG_MAX;
+      }
+    }
+    open_.clear();
+  }
+
+};
+
+/// Parses a binary log generated by ThreadInstrument::dumpLogBinary
+/** Under --from/--to its sidecar time index is used to skip the records before and after the window,
+ *  and if it does not exist or it is outdated, it is built while the log is read */
+void parseBinaryLog(const char * const filename, ParsedChunk& chunk)
+{ ThreadInstrument::BinaryLogSectionHeader section;
+  ThreadInstrument::BinaryLogRecord record;
+  std::map<std::uint32_t, unsigned> event2activity;
+  ThreadInstrument::BinaryLogThreadName thread_name;
+  std::map<std::uint32_t, std::string> names;
+  std::string name, role;
+  std::uint32_t event;
+  struct stat log_stat;
+  TimeIndex index;
+
+  FILE * const fin = fopen(filename, "rb");
+  if (fin == nullptr) {
+    printf("File %s not found\n", filename);
     exit(EXIT_FAILURE);
   }
-  
-  for (int narg = optind; narg < argc; narg++) {
 
-    const char * const filename = argv[narg];
-    
-    FILE *fin = fopen(filename, "rt");
-    if ( fin == nullptr ) {
+  ThreadInstrument::BinaryLogReader reader(fin);
+  if (!reader.open()) {
+    std::cerr << "File " << filename << " is not a valid binary log\n";
+    exit(EXIT_FAILURE);
+  }
+
+  const bool use_index = TimeWindow && !fstat(fileno(fin), &log_stat) && index.load(filename, log_stat);
+  const bool build_index = TimeWindow && !use_index;
+  ThreadInstrument::BinaryLogIndexBlock const * block = index.blocks().data();
+  ThreadInstrument::BinaryLogIndexBlock const * const blocks_end = block + index.blocks().size();
+  std::uint32_t nsection = 0;
+
+  if (use_index) {
+    for (const std::uint32_t nthread : index.threads()) {
+      chunk.addThread(nthread);
+    }
+  }
+
+  // The entries with typed payloads are not the beginning nor the end of activities
+  auto process_record = [&]() {
+    if ((record.flags_ & (ThreadInstrument::BinaryLogTimed | ThreadInstrument::BinaryLogPayload)) == ThreadInstrument::BinaryLogTimed) {
+      auto it = event2activity.find(record.event_);
+      if (it == event2activity.end()) {
+        const auto it_name = names.find(record.event_);
+        chunk.names_.push_back((it_name != names.end()) ? it_name->second : ("Event" + std::to_string(record.event_)));
+        it = event2activity.emplace(record.event_, static_cast<unsigned>(chunk.names_.size() - 1)).first;
+      }
+      const double time_point = static_cast<double>(record.time_) / reader.header().ticksPerSecond_;
+      chunk.add(time_point, record.thread_, it->second, record.data_ ? 1 : 0);
+    }
+  };
+
+  while (reader.nextSection(section)) {
+    switch (section.kind_) {
+      case ThreadInstrument::BinaryLogEventNames:
+        while (reader.readName(event, name)) {
+          names[event] = name;
+        }
+        break;
+      case ThreadInstrument::BinaryLogThreadNames:
+        while (reader.readThreadName(thread_name, name, role)) {
+          chunk.labels_[thread_name.thread_] = {name.empty() ? (role + '.' + std::to_string(thread_name.roleIndex_)) : name,
+                                                role, thread_name.roleIndex_};
+        }
+        break;
+      case ThreadInstrument::BinaryLogEvents:
+        if (use_index) {
+          const double ticks = static_cast<double>(reader.header().ticksPerSecond_);
+          ThreadInstrument::BinaryLogIndexBlock const * first = block;
+          while ((block != blocks_end) && (block->section_ == nsection)) {
+            block++;
+          }
+          ThreadInstrument::BinaryLogIndexBlock const * last = block;
+          // The first blocks can be skipped if all the activities they include end before the window
+          while ((first != last) && (first->reach_ / ticks < FromTime)) {
+            reader.skipRecords(first->records_);
+            first++;
+          }
+          // The last blocks can be skipped if all their records are after the window
+          while ((last != first) && ((last - 1)->minTime_ / ticks > ToTime)) {
+            last--;
+          }
+          for (; first != last; ++first) {
+            for (std::uint32_t i = 0; (i < first->records_) && reader.readRecord(record); ++i) {
+              process_record();
+            }
+          }
+        } else {
+          while (reader.readRecord(record)) {
+            if (build_index) {
+              index.add(nsection, record);
+            }
+            process_record();
+          }
+        }
+        nsection++;
+        break;
+      default:
+        break;
+    }
+  }
+
+  if (build_index) {
+    index.finish();
+    index.save(filename, log_stat);
+  }
+
+  fclose(fin);
+}
+
+/// Log provided in the command line, whose text is kept in memory, preferably by mapping it
+class InputFile {
+
+  const char *data_;
+  std::size_t size_;
+  bool mapped_;
+  std::string contents_;    ///< Contents of the files that cannot be mapped
+
+public:
+
+  const char * const filename_;
+  bool binary_;
+  unsigned nchunks_;        ///< Chunks that are still to be merged
+  unsigned baseThread_;     ///< Number of its first thread, known when its first chunk is merged
+
+  explicit InputFile(const char *filename) :
+  data_(nullptr), size_(0), mapped_(false), filename_(filename), binary_(false), nchunks_(0), baseThread_(0)
+  {
+    FILE *fin = fopen(filename, "rb");
+    if (fin == nullptr) {
       printf("File %s not found\n", filename);
       exit(EXIT_FAILURE);
     }
-    
-    // will be 0 for first file, #threads0 for second file, etc.
-    const auto cur_base_nthread = static_cast<unsigned int>(Thr2ActivityMap.size());
-    
-    while( fgets(bufin, MXBUF, fin) != nullptr ) {
-      // search first digit
-      for (p = bufin; (*p) && ((*p < '0') || (*p > '9')); p++);
-      
-      if (*p) {
-        p = strtok(p, _SPCS);
-        unsigned nthread = (int)strtoul(p, nullptr, 0); // take thread number
-        nthread += cur_base_nthread;                    // adjust thread number for previous files threads
-        p = strtok(nullptr, _SPCS);
-        double time_point = strtod(p, nullptr);         // take time point
-        const char *act_str = strtok(nullptr, _SPCS);   // take activity
-        if (!SilencedActivities.count(std::string{act_str})) {
-          const char *label_str = strtok(nullptr, _SPCS); // take BEGIN or END
-          
-          unsigned nactivity = registerActivity(act_str); // get activity number
-          int label = classifyLabel(label_str);
-          assert(label >= 0); // BEGIN (0) OR END(1)
-          
-          // printf("%u %lf %s %s (%u %d)\n", nthread, time_point, act_str, label_str, nactivity, label);
-          
-          std::vector<activity_data>& vec_act_data = Thr2ActivityMap[nthread];
-          if (!label) { // BEGIN
-            assert(vec_act_data.empty() || (vec_act_data.back().end_ > 0.) );
-            vec_act_data.emplace_back(nactivity, time_point);
-          } else {  // END
-            assert(!vec_act_data.empty() && (vec_act_data.back().end_ == 0.) );
-            vec_act_data.back().end_ = time_point;
-          }
+
+    char first_bytes[sizeof(ThreadInstrument::BinaryLogMagic)];
+    const size_t nread = fread(first_bytes, 1, sizeof(first_bytes), fin);
+    binary_ = ThreadInstrument::BinaryLogReader::isBinaryLog(first_bytes, nread);
+
+    if (!binary_) {
+      struct stat st;
+      if ((fstat(fileno(fin), &st) == 0) && S_ISREG(st.st_mode) && (st.st_size > 0)) {
+        void * const p = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fileno(fin), 0);
+        if (p != MAP_FAILED) {
+          madvise(p, st.st_size, MADV_SEQUENTIAL);
+          data_ = static_cast<const char *>(p);
+          size_ = st.st_size;
+          mapped_ = true;
+        }
+      }
+      if (!mapped_) {
+        char buf[65536];
+        contents_.assign(first_bytes, nread);
+        size_t n;
+        while ((n = fread(buf, 1, sizeof(buf), fin)) > 0) {
+          contents_.append(buf, n);
         }
+        data_ = contents_.data();
+        size_ = contents_.size();
       }
     }
-    
+
     fclose(fin);
-    
-    NThreadsPerFile.push_back(static_cast<unsigned int>(Thr2ActivityMap.size()) - cur_base_nthread);
+  }
+
+  InputFile(const InputFile&) = delete;
+  InputFile& operator=(const InputFile&) = delete;
+
+  ~InputFile()
+  {
+    if (mapped_) {
+      munmap(const_cast<char *>(data_), size_);
+    }
+  }
+
+  const char *data() const { return data_; }
+
+  std::size_t size() const { return size_; }
+
+};
+
+/// Piece of an input file parsed by a thread
+struct ParseJob {
+
+  InputFile *file_;
+  const char *begin_, *end_;    ///< Part of a text log. Binary logs are parsed in a single job
+  ParsedChunk chunk_;
+
+  ParseJob(InputFile *file, const char *begin, const char *end) :
+  file_(file), begin_(begin), end_(end)
+  {}
+
+  void run()
+  {
+    if (file_->binary_) {
+      parseBinaryLog(file_->filename_, chunk_);
+    } else {
+      parseTextChunk(begin_, end_, chunk_);
+    }
+    chunk_.finish();
+  }
+
+};
+
+/// Bytes of text logs parsed by each job
+const std::size_t ChunkBytes = 16 << 20;
+
+/// Reads the logs, parsing them in parallel by pieces that are merged in the order of the files
+/** The pieces are processed in rounds of as many pieces as threads, so that the memory used by the
+ *  events parsed but not merged is bounded */
+void readLogs(const std::vector<InputFile *>& files)
+{ std::vector<ParseJob> jobs;
+  std::set<unsigned> known_threads;   // found in the files, even if their events were dropped
+
+  for (InputFile * const file : files) {
+    if (file->binary_ || !file->size()) {
+      jobs.emplace_back(file, file->data(), file->data() + file->size());
+    } else {
+      const char * const end = file->data() + file->size();
+      for (const char *p = file->data(); p < end; ) {
+        const char *q = (static_cast<std::size_t>(end - p) > ChunkBytes) ? (p + ChunkBytes) : end;
+        if (q < end) {
+          const char * const nl = static_cast<const char *>(memchr(q, '\n', end - q));
+          q = (nl == nullptr) ? end : (nl + 1);
+        }
+        jobs.emplace_back(file, p, q);
+        p = q;
+      }
+    }
+    file->nchunks_ = static_cast<unsigned>(std::count_if(jobs.begin(), jobs.end(), [file](const ParseJob& job) { return job.file_ == file; }));
+  }
+
+  const std::size_t nworkers = std::max(1u, std::thread::hardware_concurrency());
+
+  for (std::size_t first = 0; first < jobs.size(); first += nworkers) {
+    const std::size_t last = std::min(jobs.size(), first + nworkers);
+    std::atomic<std::size_t> next {first};
+
+    auto worker = [&jobs, &next, last]() {
+      for (std::size_t i = next++; i < last; i = next++) {
+        jobs[i].run();
+      }
+    };
+
+    std::vector<std::thread> threads;
+    for (std::size_t i = first + 1; i < last; ++i) {
+      threads.emplace_back(worker);
+    }
+    worker();
+    for (auto& t : threads) {
+      t.join();
+    }
+
+    for (std::size_t i = first; i < last; ++i) {
+      InputFile * const file = jobs[i].file_;
+      if ((i == 0) || (jobs[i - 1].file_ != file)) {
+        // will be 0 for first file, #threads0 for second file, etc.
+        file->baseThread_ = static_cast<unsigned int>(known_threads.size());
+      }
+      mergeChunk(jobs[i].chunk_, file->baseThread_);
+      for (const unsigned nthread : jobs[i].chunk_.threads_) {
+        known_threads.insert(nthread + file->baseThread_);
+      }
+      ParsedChunk().events_.swap(jobs[i].chunk_.events_);
+      if (!--file->nchunks_) {
+        NThreadsPerFile.push_back(static_cast<unsigned int>(known_threads.size()) - file->baseThread_);
+      }
+    }
+  }
+
+  finishWindow();
+}
+
+int main(int argc, char **argv)
+{
+  const std::string config_str = config(argc, argv);
+
+  if (argc < 1) {
+    std::cerr << "Missing file argument";
+    exit(EXIT_FAILURE);
   }
   
-  gatherStatistics();
+  if (GenerateChromeTrace) {
+    TraceWriter = new ThreadInstrument::ChromeTraceWriter(std::cout, 0);
+  }
+
+  std::vector<InputFile *> files;
+  for (int narg = optind; narg < argc; narg++) {
+    files.push_back(new InputFile(argv[narg]));
+  }
+
+  readLogs(files);
+
+  for (InputFile * const file : files) {
+    delete file;
+  }
   
-  dump(std::cout, config_str);
+  if (GenerateChromeTrace) {
+    delete TraceWriter;
+  } else if (std::all_of(Thr2ActivityMap.begin(), Thr2ActivityMap.end(), [](const Thr2ActivityMap_t::value_type& pair) { return pair.second.empty(); })) {
+    // Normal result of a window or a selection of threads without activity
+    std::cerr << "no events in the selected window/threads\n";
+  } else {
+    gatherStatistics();
+    if (AnalysisFormat != AnalysisFormat_t::None) {
+      analyze(std::cout);
+    } else {
+      dump(std::cout, config_str);
+    }
+  }
 
   return 0;
 }
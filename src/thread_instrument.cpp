@@ -11,570 +11,4011 @@
 /// \author   Basilio B. Fraguela <basilio.fraguela@udc.es>
 ///
 
+#include <fcntl.h>
+#include <unistd.h>
+#include <time.h>
+#include <pthread.h>
+#ifdef __linux__
+#include <sys/syscall.h>
+#include <sys/mman.h>
+#include <linux/perf_event.h>
+#endif
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define THREADINSTRUMENT_HAS_TSC
+#endif
+#include <cerrno>
 #include <cstdio>
 #include <cassert>
+#include <cstddef>
 #include <csignal>
 #include <cstdlib>
 #include <cstring>
+#include <cmath>
+#include <algorithm>
 #include <iostream>
+#include <limits>
+#include <new>
 #include <thread>
+#include <system_error>
+#include <type_traits>
 #include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <queue>
+#include <memory>
+#include <vector>
 #include "thread_instrument/thread_instrument.h"
+#include "thread_instrument/binary_log.h"
+#include "thread_instrument/live_metrics.h"
+#include "thread_instrument/chrome_trace.h"
+
+#ifndef THREADINSTRUMENT_MAX_DENSE_EVENT
+/// Activities numbered below this value are kept in a dense per-thread table. Defining it as 0 disables the table
+#define THREADINSTRUMENT_MAX_DENSE_EVENT 1024
+#endif
+
+#ifndef THREADINSTRUMENT_CLOCK
+/// Default source of the timestamps as a ::TickSource. The environment variable THREADINSTRUMENT_CLOCK overrides it
+#define THREADINSTRUMENT_CLOCK 0
+#endif
 
 namespace {
+
+  /// Size of the cache lines assumed for alignment purposes
+  constexpr std::size_t CacheLineSize = 64;
+
+  /// Sources of the timestamps taken by the library
+  enum TickSource : int {
+    ChronoTicks = 0,  ///< ThreadInstrument::clock_t in nanoseconds
+    TSCTicks = 1,     ///< Time stamp counter of the processor, calibrated at startup. Assumes it is invariant and synchronized among cores
+    CoarseTicks = 2   ///< CLOCK_MONOTONIC_COARSE in nanoseconds. Cheaper, but its resolution is of some milliseconds
+  };
+
+  /// Source of the timestamps in use
+  /** @internal It is constant-initialized, so it is valid during the static initialization. ::TheTickClock
+   *  applies the THREADINSTRUMENT_CLOCK environment variable when it is built. */
+  TickSource ActiveTickSource = static_cast<TickSource>(THREADINSTRUMENT_CLOCK);
+
+  /// Timestamp in the units of ::ActiveTickSource. They are only converted into seconds by ::TickClock when reported
+  using ticks_t = std::int64_t;
+
+  /// Current timestamp
+  inline ticks_t now() noexcept
+  {
+    switch (ActiveTickSource) {
+#ifdef THREADINSTRUMENT_HAS_TSC
+      case TSCTicks:
+        return static_cast<ticks_t>(__rdtsc());
+#endif
+#ifdef CLOCK_MONOTONIC_COARSE
+      case CoarseTicks:
+      { struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC_COARSE, &ts);
+        return static_cast<ticks_t>(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+      }
+#endif
+      default:
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(ThreadInstrument::clock_t::now().time_since_epoch()).count();
+    }
+  }
+
+  /// Records the beginning of the execution of the program
+  const ThreadInstrument::time_point_t StartExecutionTimePoint = ThreadInstrument::clock_t::now();
+
+  /// Selects the source of the timestamps and converts them into seconds
+  class TickClock {
+
+    /// Seconds spent measuring the frequency of the time stamp counter
+    static constexpr double CalibrationTime = 0.01;
+
+    ticks_t start_;                 ///< Ticks at the beginning of the program
+    std::int64_t startWallTime_;    ///< Nanoseconds since the Unix epoch of the system clock at start_
+    std::uint64_t ticksPerSecond_;
+    double secondsPerTick_;
+
+    static TickSource sourceFromEnvironment() noexcept
+    {
+      const char * const env = getenv("THREADINSTRUMENT_CLOCK");
+      if (env == nullptr) {
+        return ActiveTickSource;
+      }
+      if (!strcmp(env, "chrono")) {
+        return ChronoTicks;
+      }
+      if (!strcmp(env, "tsc")) {
+#ifdef THREADINSTRUMENT_HAS_TSC
+        return TSCTicks;
+#else
+        std::cerr << "ThreadInstrument: no time stamp counter in this processor. Using chrono clock\n";
+        return ChronoTicks;
+#endif
+      }
+      if (!strcmp(env, "coarse")) {
+#ifdef CLOCK_MONOTONIC_COARSE
+        return CoarseTicks;
+#else
+        std::cerr << "ThreadInstrument: no coarse clock in this system. Using chrono clock\n";
+        return ChronoTicks;
+#endif
+      }
+      std::cerr << "ThreadInstrument: unknown THREADINSTRUMENT_CLOCK " << env << ". Valid values are chrono, tsc and coarse\n";
+      return ActiveTickSource;
+    }
+
+  public:
+
+    TickClock()
+    {
+      ActiveTickSource = sourceFromEnvironment();
+      start_ = now();
+      startWallTime_ = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+
+      if (ActiveTickSource == TSCTicks) {
+        std::chrono::duration<double> elapsed;
+        const auto t0 = std::chrono::steady_clock::now();
+        const ticks_t ticks0 = now();
+        do {
+          elapsed = std::chrono::steady_clock::now() - t0;
+        } while (elapsed.count() < CalibrationTime);
+        ticksPerSecond_ = static_cast<std::uint64_t>((now() - ticks0) / elapsed.count());
+      } else {
+        ticksPerSecond_ = std::nano::den;
+      }
+
+      secondsPerTick_ = 1.0 / static_cast<double>(ticksPerSecond_);
+    }
+
+    std::uint64_t ticksPerSecond() const noexcept { return ticksPerSecond_; }
+
+    /// Ticks elapsed since the beginning of the program until \c t
+    ticks_t sinceStart(ticks_t t) const noexcept { return t - start_; }
+
+    /// Seconds in \c ticks
+    double seconds(ticks_t ticks) const noexcept { return static_cast<double>(ticks) * secondsPerTick_; }
+
+    std::int64_t startWallTime() const noexcept { return startWallTime_; }
+
+    /// Nanoseconds since the Unix epoch at \c t, measured by the ticks elapsed since start_ so that they agree with the moments logged
+    std::int64_t wallTime(ticks_t t) const noexcept { return startWallTime_ + static_cast<std::int64_t>(seconds(sinceStart(t)) * 1e9); }
+
+    /// Ticks corresponding to \c ns nanoseconds since the Unix epoch, being the inverse of ::wallTime
+    ticks_t fromWallTime(std::int64_t ns) const noexcept { return start_ + static_cast<ticks_t>(static_cast<double>(ns - startWallTime_) * 1e-9 / secondsPerTick_); }
+
+    /// Moment of ThreadInstrument::clock_t corresponding to \c t
+    ThreadInstrument::time_point_t timePoint(ticks_t t) const
+    {
+      const std::chrono::duration<double> since_start(seconds(sinceStart(t)));
+      return StartExecutionTimePoint + std::chrono::duration_cast<ThreadInstrument::clock_t::duration>(since_start);
+    }
+
+  };
+
+  const TickClock TheTickClock;
+
+  using ThreadInstrument::NPerfCounters;
+
+  /// Whether the hardware events are counted, set by ThreadInstrument::enablePerfCounters
+  std::atomic<bool> PerfCountersEnabled {false};
+
+  /// Bit \c i is set if the ThreadInstrument::PerfCounter \c i could be opened when the counters were enabled
+  std::atomic<unsigned> PerfCountersMask {0};
+
+  /// Number of times that the counters were enabled, so that the threads open them again after each time
+  std::atomic<unsigned> PerfCountersGeneration {0};
+
+  /// Group of hardware counters of a thread, opened by means of \c perf_event_open
+  class PerfCounterGroup {
+
+    int fds_[NPerfCounters];      ///< Descriptors of the counters, -1 for those not available
+    void *pages_[NPerfCounters];  ///< Pages of the counters mapped by the kernel for their reading in user space or nullptr
+    unsigned generation_;         ///< Value of ::PerfCountersGeneration when the opening of the counters was last attempted
+
+#ifdef __linux__
+    /// Estimates the events of the \c enabled nanoseconds of a counter that only counted \c value during \c running of them
+    /** @internal The kernel multiplexes the counters when there are more than those of the hardware */
+    static std::uint64_t scale(std::uint64_t value, std::uint64_t enabled, std::uint64_t running) noexcept
+    {
+      return ((running == enabled) || !running) ? value :
+             static_cast<std::uint64_t>(static_cast<double>(value) * static_cast<double>(enabled) / static_cast<double>(running));
+    }
+
+    /// Reads counter \c i with \c rdpmc if the kernel allows it, or with a system call otherwise
+    /** @internal The readings are scaled as explained in ::scale, following the method described in linux/perf_event.h */
+    std::uint64_t readCounter(unsigned i) const noexcept
+    { std::uint64_t value;
+
+#ifdef THREADINSTRUMENT_HAS_TSC
+      const volatile perf_event_mmap_page * const pc = static_cast<const volatile perf_event_mmap_page *>(pages_[i]);
+      if (pc != nullptr) {
+        std::uint64_t enabled, running, cycles, time_offset;
+        std::uint32_t seq, time_mult, time_shift;
+        bool user_read;
+        do {
+          seq = pc->lock;
+          std::atomic_signal_fence(std::memory_order_seq_cst);
+          enabled = pc->time_enabled;
+          running = pc->time_running;
+          cycles = 0;
+          if (pc->cap_user_time && (enabled != running)) {
+            cycles = __rdtsc();
+            time_offset = pc->time_offset;
+            time_mult = pc->time_mult;
+            time_shift = pc->time_shift;
+          }
+          const std::uint32_t index = pc->index;
+          user_read = pc->cap_user_rdpmc && index;
+          value = pc->offset;
+          if (user_read) {
+            // The counter has pmc_width significant bits and must be sign extended
+            const unsigned shift = 64 - pc->pmc_width;
+            value += static_cast<std::uint64_t>(static_cast<std::int64_t>(__rdpmc(index - 1) << shift) >> shift);
+          }
+          std::atomic_signal_fence(std::memory_order_seq_cst);
+        } while (pc->lock != seq);
+        if (user_read) {
+          if (cycles) {
+            // Time elapsed since the kernel last updated time_enabled and time_running, during which the counter ran
+            const std::uint64_t quot = cycles >> time_shift, rem = cycles & ((std::uint64_t(1) << time_shift) - 1);
+            const std::uint64_t delta = time_offset + quot * time_mult + ((rem * time_mult) >> time_shift);
+            enabled += delta;
+            running += delta;
+          }
+          return scale(value, enabled, running);
+        }
+      }
+#endif
+
+      std::uint64_t data[3]; // Value, time enabled and time running
+      return (::read(fds_[i], data, sizeof(data)) == sizeof(data)) ? scale(data[0], data[1], data[2]) : 0;
+    }
+#endif
+
+  public:
+
+    PerfCounterGroup() noexcept :
+    generation_(0)
+    {
+      std::fill(fds_, fds_ + NPerfCounters, -1);
+      std::fill(pages_, pages_ + NPerfCounters, nullptr);
+    }
+
+    PerfCounterGroup(const PerfCounterGroup&) = delete;
+    PerfCounterGroup& operator=(const PerfCounterGroup&) = delete;
+
+    ~PerfCounterGroup()
+    {
+      close();
+    }
+
+    /// Opens the counters in \c mask for the calling thread when the counters are enabled for the \c generation -th time. Returns the mask of those opened
+    unsigned open(unsigned mask, unsigned generation) noexcept
+    { unsigned opened = 0;
+
+      close();
+      generation_ = generation;
+#ifdef __linux__
+      static const std::uint64_t Configs[NPerfCounters] = {
+        PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS, PERF_COUNT_HW_CACHE_MISSES, PERF_COUNT_HW_BRANCH_MISSES
+      };
+      const long page_size = sysconf(_SC_PAGESIZE);
+      int leader = -1;
+      for (unsigned i = 0; i < NPerfCounters; ++i) {
+        if (!((mask >> i) & 1)) {
+          continue;
+        }
+        perf_event_attr attr;
+        memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.type = PERF_TYPE_HARDWARE;
+        attr.config = Configs[i];
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+        const int fd = static_cast<int>(syscall(SYS_perf_event_open, &attr, 0, -1, leader, PERF_FLAG_FD_CLOEXEC));
+        if (fd < 0) {
+          continue;
+        }
+        if (leader < 0) {
+          leader = fd;
+        }
+        fds_[i] = fd;
+        void * const page = mmap(nullptr, page_size, PROT_READ, MAP_SHARED, fd, 0);
+        pages_[i] = (page != MAP_FAILED) ? page : nullptr;
+        opened |= 1u << i;
+      }
+#endif
+      return opened;
+    }
+
+    void close() noexcept
+    {
+#ifdef __linux__
+      const long page_size = sysconf(_SC_PAGESIZE);
+      for (unsigned i = 0; i < NPerfCounters; ++i) {
+        if (pages_[i] != nullptr) {
+          munmap(pages_[i], page_size);
+          pages_[i] = nullptr;
+        }
+        if (fds_[i] >= 0) {
+          ::close(fds_[i]);
+          fds_[i] = -1;
+        }
+      }
+#endif
+    }
+
+    /// Whether some counter is open, attempting to open those in ::PerfCountersMask the first time after each enabling of the counters
+    bool ready() noexcept
+    {
+      const unsigned generation = PerfCountersGeneration.load(std::memory_order_acquire);
+      if (generation_ != generation) {
+        open(PerfCountersMask.load(std::memory_order_relaxed), generation);
+      }
+      return std::any_of(fds_, fds_ + NPerfCounters, [](int fd) { return fd >= 0; });
+    }
+
+    /// Stores in \c values the current value of each counter, 0 for those not available
+    void read(std::uint64_t *values) const noexcept
+    {
+      for (unsigned i = 0; i < NPerfCounters; ++i) {
+#ifdef __linux__
+        values[i] = (fds_[i] >= 0) ? readCounter(i) : 0;
+#else
+        values[i] = 0;
+#endif
+      }
+    }
+
+  };
+
+  /// Hardware counters of the calling thread
+  thread_local PerfCounterGroup MyPerfCounters;
+
+  /// Value of type \c T accessed with relaxed atomic operations
+  /** @internal Used for the data protected by a SeqCounter, which the readers copy while its single writer may be
+   *  updating it. As there is a single writer, the updates are loads followed by stores, which cost the same as
+   *  those of a plain \c T in the usual architectures. */
+  template<typename T>
+  class Relaxed {
+
+    std::atomic<T> v_;
+
+  public:
+
+    Relaxed() noexcept :
+    v_{T()}
+    { }
+
+    Relaxed(T v) noexcept :
+    v_{v}
+    { }
+
+    Relaxed(const Relaxed& other) noexcept :
+    v_{other.load()}
+    { }
+
+    Relaxed& operator=(const Relaxed& other) noexcept { store(other.load()); return *this; }
+
+    Relaxed& operator=(T v) noexcept { store(v); return *this; }
+
+    T load() const noexcept { return v_.load(std::memory_order_relaxed); }
+
+    void store(T v) noexcept { v_.store(v, std::memory_order_relaxed); }
+
+    operator T() const noexcept { return load(); }
+
+    Relaxed& operator+=(T v) noexcept { store(load() + v); return *this; }
+
+    /// Prefix increment
+    T operator++() noexcept { const T v = load() + 1; store(v); return v; }
+
+    /// Postfix increment
+    T operator++(int) noexcept { const T v = load(); store(v + 1); return v; }
+
+    /// Prefix decrement
+    T operator--() noexcept { const T v = load() - 1; store(v); return v; }
+
+    /// Postfix decrement
+    T operator--(int) noexcept { const T v = load(); store(v - 1); return v; }
+
+  };
+
+  /// Owner of an object, or of an array if \c T is an array type, whose address the readers of a SeqCounter can read while the writer allocates it
+  template<typename T>
+  class RelaxedPtr {
+
+    using Element_t = typename std::remove_extent<T>::type;
+
+    std::atomic<Element_t *> p_;
+
+    static void destroy(Element_t *p) noexcept
+    {
+      if (std::is_array<T>::value) {
+        delete [] p;
+      } else {
+        delete p;
+      }
+    }
+
+  public:
+
+    RelaxedPtr() noexcept :
+    p_{nullptr}
+    { }
+
+    RelaxedPtr(RelaxedPtr&& other) noexcept :
+    p_{other.p_.exchange(nullptr, std::memory_order_relaxed)}
+    { }
+
+    RelaxedPtr(const RelaxedPtr&) = delete;
+    RelaxedPtr& operator=(const RelaxedPtr&) = delete;
+
+    ~RelaxedPtr() { destroy(p_.load(std::memory_order_relaxed)); }
+
+    /// Address of the object, allocated before it was published, or nullptr
+    Element_t *get() const noexcept { return p_.load(std::memory_order_acquire); }
+
+    /// Replaces the object by \c p. Only to be used by the writer
+    void reset(Element_t *p) noexcept { destroy(p_.exchange(p, std::memory_order_acq_rel)); }
+
+    explicit operator bool() const noexcept { return get() != nullptr; }
+
+    Element_t& operator*() const noexcept { return *get(); }
+
+    Element_t *operator->() const noexcept { return get(); }
+
+    Element_t& operator[](std::size_t i) const noexcept { return get()[i]; }
+
+  };
+
+  /// Hardware events counted for an activity, allocated under ThreadInstrument::enablePerfCounters
+  struct PerfCounts {
+
+    Relaxed<std::uint64_t> start_[NPerfCounters];  ///< Values of the counters when the outermost invocation running began
+    Relaxed<std::uint64_t> counts_[NPerfCounters]; ///< Events counted in the ::samples_
+    Relaxed<unsigned> samples_;                    ///< Outermost invocations counted
+    Relaxed<bool> counting_;                       ///< Whether the outermost invocation running is being counted
+
+    PerfCounts() noexcept
+    : samples_(0u), counting_(false)
+    {}
+
+    /// Begins counting an outermost invocation, the counters now having the \c values provided
+    void start(const std::uint64_t *values) noexcept
+    {
+      for (unsigned i = 0; i < NPerfCounters; ++i) {
+        start_[i] = values[i];
+      }
+      counting_ = true;
+    }
+
+    /// Clears the events counted, keeping the state of the invocation running
+    void clear() noexcept
+    {
+      for (unsigned i = 0; i < NPerfCounters; ++i) {
+        counts_[i] = 0u;
+      }
+      samples_ = 0u;
+    }
+
+    /// Adds the events counted since the beginning of the invocation, the counters now having the \c values provided
+    void stop(const std::uint64_t *values) noexcept
+    {
+      for (unsigned i = 0; i < NPerfCounters; ++i) {
+        // The readings of multiplexed counters are estimations that might not grow
+        if (values[i] > start_[i]) {
+          counts_[i] += values[i] - start_[i];
+        }
+      }
+      samples_++;
+      counting_ = false;
+    }
+
+  };
+
+  /// Growable array aligned to a cache line whose positions are default constructed when added
+  template<typename T>
+  class DenseTable {
+
+    T *data_;
+    unsigned size_;
+
+    /// Destroys the positions and frees the storage, leaving the members dangling
+    void release() noexcept
+    {
+      for (unsigned i = 0; i < size_; ++i) {
+        data_[i].~T();
+      }
+      free(data_);
+    }
+
+  public:
+
+    DenseTable() noexcept :
+    data_(nullptr), size_(0)
+    { }
+
+    DenseTable(DenseTable&& other) noexcept :
+    data_(other.data_), size_(other.size_)
+    {
+      other.data_ = nullptr;
+      other.size_ = 0;
+    }
+
+    DenseTable(const DenseTable&) = delete;
+    DenseTable& operator=(const DenseTable&) = delete;
+
+    ~DenseTable()
+    {
+      release();
+    }
+
+    unsigned size() const noexcept { return size_; }
+
+    /// Destroys the positions and releases the storage
+    void reset() noexcept
+    {
+      release();
+      data_ = nullptr;
+      size_ = 0;
+    }
+
+    T& operator[](unsigned i) noexcept { return data_[i]; }
+
+    const T& operator[](unsigned i) const noexcept { return data_[i]; }
+
+    /// Makes sure the table has at least \c n positions
+    void grow(unsigned n)
+    { void *p;
+
+      if (n <= size_) {
+        return;
+      }
+
+      const unsigned new_size = std::max(n, std::max(2 * size_, 16u));
+      if (posix_memalign(&p, CacheLineSize, new_size * sizeof(T))) {
+        throw std::bad_alloc();
+      }
+
+      T * const new_data = static_cast<T *>(p);
+      for (unsigned i = 0; i < size_; ++i) {
+        new (new_data + i) T(std::move(data_[i]));
+        data_[i].~T();
+      }
+      for (unsigned i = size_; i < new_size; ++i) {
+        new (new_data + i) T();
+      }
+
+      free(data_);
+      data_ = new_data;
+      size_ = new_size;
+    }
+
+  };
+
+  /// Sequence counter of a seqlock with a single writer
+  /** @internal The writer brackets its updates of the protected data between beginWrite() and endWrite(),
+   *  while the readers copy the data between beginRead() and retryRead(), retrying the copy until the
+   *  counter did not change. Copies of the counter take its value, so that it can be part of objects
+   *  that are moved while no reader can access them. */
+  class SeqCounter {
+
+    std::atomic<unsigned> seq_;   ///< Odd while the data is being updated
+
+  public:
+
+    SeqCounter() noexcept :
+    seq_{0}
+    { }
+
+    SeqCounter(const SeqCounter& other) noexcept :
+    seq_{other.seq_.load(std::memory_order_relaxed)}
+    { }
+
+    SeqCounter& operator=(const SeqCounter& other) noexcept
+    {
+      seq_.store(other.seq_.load(std::memory_order_relaxed), std::memory_order_relaxed);
+      return *this;
+    }
+
+    void beginWrite() noexcept
+    {
+      seq_.store(seq_.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+      std::atomic_thread_fence(std::memory_order_release);
+    }
+
+    void endWrite() noexcept
+    {
+      seq_.store(seq_.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+    }
+
+    unsigned beginRead() const noexcept
+    { unsigned seq;
+
+      while ((seq = seq_.load(std::memory_order_acquire)) & 1) {
+        std::this_thread::yield();
+      }
+      return seq;
+    }
+
+    /// Whether the data read since beginRead() returned \c seq may be inconsistent
+    bool retryRead(unsigned seq) const noexcept
+    {
+      std::atomic_thread_fence(std::memory_order_acquire);
+      return seq_.load(std::memory_order_relaxed) != seq;
+    }
+
+  };
+
+  /// Entry of the log
+  struct LogEvent {
+
+    ticks_t when_;                        ///< Moment of the event. Also taken for untimed entries, as it is used to merge the logs of the threads
+    union {
+      void *data_;
+      unsigned char payload_[ThreadInstrument::LogPayloadSize];  ///< Copy of the typed payload if payloadSize_ > 0
+    };
+    unsigned event_id_;
+    bool timed_;                          ///< Whether the moment is reported
+    std::uint8_t payloadSize_;            ///< Bytes of payload_ in use, 0 meaning that data_ holds the data of the entry
+
+    LogEvent(ticks_t when, unsigned event_id, void *data, bool timed) noexcept
+    : when_(when), data_(data), event_id_(event_id), timed_(timed), payloadSize_(0)
+    { }
+
+    LogEvent(ticks_t when, unsigned event_id, const void *payload, std::size_t size, bool timed) noexcept
+    : when_(when), event_id_(event_id), timed_(timed), payloadSize_(static_cast<std::uint8_t>(size))
+    {
+      memcpy(payload_, payload, size);
+    }
+
+    LogEvent()
+    {}
+
+  };
+
+  /// Number of entries of each chunk of a ThreadLog
+  constexpr unsigned LogChunkEntries = 4096;
+
+  /// Number of chunks allocated together by the LogChunkPool, i.e., 64K entries
+  constexpr unsigned LogSlabChunks = 16;
+
+  /// Chunk of entries of a ThreadLog
+  struct LogChunk {
+    std::atomic<unsigned> size_;  ///< Number of entries published
+    std::atomic<LogChunk *> next_;
+    LogEvent entries_[LogChunkEntries];
+
+    LogChunk() noexcept :
+    size_{0}, next_{nullptr}
+    { }
+  };
+
+  /// Bytes of the storage of the logs, i.e., the slabs of the LogChunkPool and the rings of the flight recorder
+  std::atomic<std::size_t> LogBytes {0};
+
+  /// Bytes of the activity statistics of the threads
+  std::atomic<std::size_t> ActivityBytes {0};
+
+  /// Bytes of the registry of threads and event names
+  std::atomic<std::size_t> RegistryBytes {0};
+
+  /// Maximum bytes of memory used by the library set by ThreadInstrument::setMemoryBudget, 0 meaning that there is no limit
+  std::atomic<std::size_t> MemoryBudget {0};
+
+  /// Log entries discarded because their storage would exceed the ::MemoryBudget
+  std::atomic<std::uint64_t> DroppedLogEntries {0};
+
+  /// Whether \c bytes more of storage for the logs fit in the ::MemoryBudget
+  bool logStorageFits(std::size_t bytes) noexcept
+  {
+    const std::size_t budget = MemoryBudget.load(std::memory_order_relaxed);
+    return !budget || (LogBytes.load(std::memory_order_relaxed) + ActivityBytes.load(std::memory_order_relaxed) +
+                       RegistryBytes.load(std::memory_order_relaxed) + bytes <= budget);
+  }
+
+  /// Reusable storage for the LogChunk's of all the threads
+  /** @internal Chunks are allocated in slabs of ::LogSlabChunks chunks that are never returned
+   *  to the system, the consumed chunks being kept for later reuse. */
+  class LogChunkPool {
+
+    std::mutex mutex_;
+    std::vector<LogChunk *> free_;
+    std::vector<std::unique_ptr<LogChunk[]>> slabs_;
+
+    /// @internal Must be called with mutex_ taken
+    void addSlab()
+    {
+      LogChunk * const slab = new LogChunk[LogSlabChunks];
+      LogBytes.fetch_add(LogSlabChunks * sizeof(LogChunk), std::memory_order_relaxed);
+      slabs_.emplace_back(slab);
+      for (unsigned i = 0; i < LogSlabChunks; ++i) {
+        free_.push_back(slab + i);
+      }
+    }
+
+  public:
+
+    LogChunkPool() = default;
+
+    /// Provides an empty chunk, or nullptr if a new slab is needed and it does not fit in the ::MemoryBudget
+    LogChunk *get()
+    {
+      std::lock_guard<std::mutex> guard(mutex_);
+      if (free_.empty()) {
+        if (!logStorageFits(LogSlabChunks * sizeof(LogChunk))) {
+          return nullptr;
+        }
+        addSlab();
+      }
+      LogChunk * const ret = free_.back();
+      free_.pop_back();
+      return ret;
+    }
+
+    /// Returns a chunk to the pool
+    void put(LogChunk *chunk)
+    {
+      chunk->size_.store(0, std::memory_order_relaxed);
+      chunk->next_.store(nullptr, std::memory_order_relaxed);
+      std::lock_guard<std::mutex> guard(mutex_);
+      free_.push_back(chunk);
+    }
+
+    /// Makes sure that at least \c nchunks chunks are available without new allocations, even beyond the ::MemoryBudget
+    void reserve(std::size_t nchunks)
+    {
+      std::lock_guard<std::mutex> guard(mutex_);
+      while (free_.size() < nchunks) {
+        addSlab();
+      }
+    }
+
+  };
+
+  LogChunkPool& TheLogChunkPool()
+  { static LogChunkPool LCP;
+
+    return LCP;
+  }
+
+  /// Number of chunks filled by the threads and not returned to the pool yet
+  std::atomic<unsigned> FilledLogChunks {0};
+
+  /// When nonzero, value of ::FilledLogChunks that triggers a flush of the log flusher
+  std::atomic<unsigned> LogFlusherWakeUp {0};
+
+  void wakeUpLogFlusher();
+
+  /// 0 while ::signalDumper is not started, 1 while it is being started and 2 when it runs
+  std::atomic<int> SignalDumperState {0};
+
+  /// Starts, if it is not running, the thread that dumps the log when a SIGUSR1 is received
+  /** @internal It is started by the first entry logged and by ThreadInstrument::registerInspector, so that
+   *  the processes that do not log have no additional thread */
+  void startSignalDumper() noexcept;
+
+  /// Entries of the ring of each thread under ThreadInstrument::flightRecorder, 0 meaning that the log is unbounded
+  std::atomic<unsigned> FlightRecorderEntries {0};
+
+  /// Append-only log of a thread built as a list of chunks of entries
+  /** @internal It is a single-producer single-consumer queue. The producer is the thread that owns
+   *  the log, while the consumers must be serialized by means of ::LogConsumerMutex.
+   *  The consumer only returns chunks to the LogChunkPool after the producer has moved to a new one.
+   *  Under ThreadInstrument::flightRecorder the entries are instead stored in a ring of fixed capacity
+   *  allocated by the producer the first time it logs, in which the oldest entries are overwritten. */
+  class ThreadLog {
+
+    std::atomic<LogChunk *> head_;  ///< First chunk with entries not consumed (consumer side)
+    unsigned read_;                 ///< Position of the first entry not consumed in head_
+    LogChunk *tail_;                ///< Chunk where new entries are stored (producer side)
+    std::atomic<LogEvent *> ring_;  ///< Ring of the flight recorder, published after ::ringCapacity_
+    unsigned ringCapacity_;
+    std::atomic<std::uint64_t> ringWritten_;  ///< Entries stored in ring_ since it was allocated
+    std::uint64_t ringRead_;                  ///< Position of the first entry of ring_ not consumed (consumer side)
+    std::atomic<std::size_t> bytes_;          ///< Bytes of the chunks and the ring held
+    std::atomic<std::uint64_t> dropped_;      ///< Entries discarded because of the ::MemoryBudget
+
+    /// Allocates the ring of the flight recorder, or returns nullptr if it does not fit in the ::MemoryBudget. Only to be used by the producer
+    LogEvent *allocateRing(unsigned capacity)
+    {
+      const std::size_t bytes = capacity * sizeof(LogEvent);
+      if (!logStorageFits(bytes)) {
+        return nullptr;
+      }
+      LogEvent * const ring = new LogEvent[capacity];
+      LogBytes.fetch_add(bytes, std::memory_order_relaxed);
+      bytes_.fetch_add(bytes, std::memory_order_relaxed);
+      ringCapacity_ = capacity;
+      ringWritten_.store(0, std::memory_order_relaxed);
+      ringRead_ = 0;
+      ring_.store(ring, std::memory_order_release);
+      return ring;
+    }
+
+    /// Oldest entry of the ring not overwritten yet
+    std::uint64_t ringBegin() const noexcept
+    {
+      const std::uint64_t written = ringWritten_.load(std::memory_order_acquire);
+      return (written > ringCapacity_) ? (written - ringCapacity_) : 0;
+    }
+
+    /// Moves head_ to the next chunk if it has been fully consumed and the producer has left it
+    /** @return the chunk with the next entry to consume or nullptr */
+    LogChunk *consumerChunk()
+    {
+      LogChunk *c = head_.load(std::memory_order_acquire);
+      if ((c != nullptr) && (read_ == LogChunkEntries)) {
+        LogChunk * const next = c->next_.load(std::memory_order_acquire);
+        if (next != nullptr) {
+          head_.store(next, std::memory_order_relaxed);
+          read_ = 0;
+          TheLogChunkPool().put(c);
+          bytes_.fetch_sub(sizeof(LogChunk), std::memory_order_relaxed);
+          FilledLogChunks.fetch_sub(1, std::memory_order_relaxed);
+          c = next;
+        }
+      }
+      return c;
+    }
+
+  public:
+
+    ThreadLog() noexcept :
+    head_{nullptr}, read_(0), tail_(nullptr), ring_{nullptr}, ringCapacity_(0), ringWritten_{0}, ringRead_(0), bytes_{0}, dropped_{0}
+    { }
+
+    /// Only logs without entries can be moved
+    ThreadLog(ThreadLog&& other) noexcept :
+    ThreadLog()
+    {
+      assert((other.tail_ == nullptr) && (other.ring_.load(std::memory_order_relaxed) == nullptr));
+      (void)other;
+    }
+
+    ~ThreadLog()
+    {
+      LogChunk *q;
+      for (LogChunk *p = head_.load(std::memory_order_relaxed); p != nullptr; p = q) {
+        q = p->next_.load(std::memory_order_relaxed);
+        TheLogChunkPool().put(p);
+      }
+      releaseRing();
+    }
+
+    /// Frees the ring of the flight recorder, so that the producer allocates a new one in its next entry if needed
+    /** @internal Only to be used while the producer does not log and with ::LogConsumerMutex taken */
+    void releaseRing() noexcept
+    {
+      LogEvent * const ring = ring_.exchange(nullptr, std::memory_order_relaxed);
+      if (ring != nullptr) {
+        delete [] ring;
+        LogBytes.fetch_sub(ringCapacity_ * sizeof(LogEvent), std::memory_order_relaxed);
+        bytes_.fetch_sub(ringCapacity_ * sizeof(LogEvent), std::memory_order_relaxed);
+      }
+      ringCapacity_ = 0;
+    }
+
+    /// Bytes of the storage held by the log
+    std::size_t bytes() const noexcept { return bytes_.load(std::memory_order_relaxed); }
+
+    /// Entries discarded because their storage would exceed the ::MemoryBudget
+    std::uint64_t dropped() const noexcept { return dropped_.load(std::memory_order_relaxed); }
+
+    /// Records that the producer discarded an entry
+    void drop() noexcept
+    {
+      dropped_.fetch_add(1, std::memory_order_relaxed);
+      DroppedLogEntries.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    /// Only to be used by the producer
+    void push(const LogEvent& ev)
+    {
+      LogEvent *ring = ring_.load(std::memory_order_relaxed);
+      if (ring == nullptr) {
+        const unsigned ring_capacity = FlightRecorderEntries.load(std::memory_order_relaxed);
+        if (ring_capacity) {
+          ring = allocateRing(ring_capacity);
+          if (ring == nullptr) {
+            drop();
+            return;
+          }
+        }
+      }
+      if (ring != nullptr) {
+        const std::uint64_t written = ringWritten_.load(std::memory_order_relaxed);
+        ring[written % ringCapacity_] = ev;
+        ringWritten_.store(written + 1, std::memory_order_release);
+        return;
+      }
+
+      // Checked in every entry, as the dumper must be started again in the child of a fork
+      if (SignalDumperState.load(std::memory_order_relaxed) != 2) {
+        startSignalDumper();
+      }
+
+      LogChunk *c = tail_;
+      unsigned n = (c == nullptr) ? LogChunkEntries : c->size_.load(std::memory_order_relaxed);
+
+      if (n == LogChunkEntries) {
+        LogChunk * const new_chunk = TheLogChunkPool().get();
+        if (new_chunk == nullptr) {
+          drop();
+          return;
+        }
+        bytes_.fetch_add(sizeof(LogChunk), std::memory_order_relaxed);
+        if (c == nullptr) {
+          head_.store(new_chunk, std::memory_order_release);
+        } else {
+          c->next_.store(new_chunk, std::memory_order_release);
+          const unsigned wake_up = LogFlusherWakeUp.load(std::memory_order_relaxed);
+          if ((FilledLogChunks.fetch_add(1, std::memory_order_relaxed) >= wake_up) && wake_up) {
+            wakeUpLogFlusher();
+          }
+        }
+        tail_ = c = new_chunk;
+        n = 0;
+      }
+
+      c->entries_[n] = ev;
+      c->size_.store(n + 1, std::memory_order_release);
+    }
+
+    /// Number of entries available to the consumer
+    /** Under the flight recorder the entries overwritten are skipped. As they are overwritten in place,
+     *  the oldest entries read may be replaced by newer ones if the producer logs meanwhile. */
+    std::size_t available()
+    { std::size_t sz = 0;
+
+      if (ring_.load(std::memory_order_acquire) != nullptr) {
+        ringRead_ = std::max(ringRead_, ringBegin());
+        return static_cast<std::size_t>(ringWritten_.load(std::memory_order_acquire) - ringRead_);
+      }
+
+      LogChunk *c = consumerChunk();
+      if (c != nullptr) {
+        sz = c->size_.load(std::memory_order_acquire) - read_;
+        for (c = c->next_.load(std::memory_order_acquire); c != nullptr; c = c->next_.load(std::memory_order_acquire)) {
+          sz += c->size_.load(std::memory_order_acquire);
+        }
+      }
+      return sz;
+    }
+
+    /// Oldest entry not consumed. Only valid if available() > 0
+    const LogEvent& front()
+    {
+      LogEvent * const ring = ring_.load(std::memory_order_acquire);
+      if (ring != nullptr) {
+        return ring[ringRead_ % ringCapacity_];
+      }
+
+      LogChunk * const c = consumerChunk();
+      assert((c != nullptr) && (read_ < c->size_.load(std::memory_order_acquire)));
+      return c->entries_[read_];
+    }
+
+    /// Consumes the oldest entry. Only valid if available() > 0
+    void pop()
+    {
+      if (ring_.load(std::memory_order_relaxed) != nullptr) {
+        ringRead_++;
+        return;
+      }
+
+      consumerChunk();
+      read_++;
+    }
+
+    /// Consumes the \c n oldest entries moving the cursor chunk by chunk. Only valid if available() >= n
+    void discard(std::size_t n)
+    {
+      if (ring_.load(std::memory_order_relaxed) != nullptr) {
+        ringRead_ += n;
+        return;
+      }
+
+      while (n) {
+        LogChunk * const c = consumerChunk();
+        const std::size_t in_chunk = std::min<std::size_t>(n, c->size_.load(std::memory_order_acquire) - read_);
+        read_ += static_cast<unsigned>(in_chunk);
+        n -= in_chunk;
+      }
+      consumerChunk();
+    }
+
+    /// Applies \c f to the entries of the ring of the flight recorder, from the oldest one, without consuming them
+    /** @internal It is async-signal-safe, so that it can be used by signal handlers */
+    template<typename F>
+    void forEachRingEntry(F f) const noexcept
+    {
+      LogEvent * const ring = ring_.load(std::memory_order_acquire);
+      if (ring != nullptr) {
+        const std::uint64_t end = ringWritten_.load(std::memory_order_acquire);
+        for (std::uint64_t i = ringBegin(); i < end; ++i) {
+          f(ring[i % ringCapacity_]);
+        }
+      }
+    }
+
+  };
+
+  /// Records that the calling thread allocated (or freed if negative) \c bytes for its activity statistics
+  void accountActivityMemory(std::ptrdiff_t bytes) noexcept;
+
+  /// Activity data of an event kept by its thread, reported as a ThreadInstrument::EventData
+  struct RawEventData {
+
+    Relaxed<ticks_t> time_;
+    Relaxed<ticks_t> exclusiveTime_;
+    Relaxed<ticks_t> lastInvocation_;
+    Relaxed<unsigned> invocations_;
+    Relaxed<unsigned> depth_;
+    unsigned category_;           ///< Category of the outermost running invocation
+    unsigned epoch_;              ///< Value of ::CategoryEpochs for ::category_ when the outermost running invocation began
+    Relaxed<unsigned> sampledInvocations_; ///< Invocations timed
+    Relaxed<unsigned> samples_;   ///< Outermost invocations timed that finished
+    Relaxed<double> squaredTime_; ///< Sum of the squares of the times of the ::samples_, in ticks^2
+    unsigned samplingPeriod_;     ///< One of each samplingPeriod_ outermost invocations is timed. 0 and 1 mean all
+    unsigned countdown_;          ///< Outermost invocations until the next one timed
+    unsigned samplingVersion_;    ///< Value of ::SamplingVersion when ::samplingPeriod_ was read
+    bool sampled_;                ///< Whether the outermost invocation running is timed
+    Relaxed<ticks_t> minTime_;    ///< Shortest of the ::samples_
+    Relaxed<ticks_t> maxTime_;    ///< Longest of the ::samples_
+    RelaxedPtr<Relaxed<std::uint32_t>[]> histogram_; ///< ThreadInstrument::LatencyHistogram::NBuckets counters of the ::samples_, allocated under ThreadInstrument::enableHistograms
+    RelaxedPtr<PerfCounts> perf_;                    ///< Hardware events counted, allocated under ThreadInstrument::enablePerfCounters
+    SeqCounter seq_;              ///< Protects the statistics, which are Relaxed so that the readers in other threads can copy them safely
+
+    RawEventData() noexcept
+    : time_(0), exclusiveTime_(0), lastInvocation_(0), invocations_(0), depth_(0), category_(0), epoch_(0),
+      sampledInvocations_(0), samples_(0), squaredTime_(0.0), samplingPeriod_(0), countdown_(0),
+      samplingVersion_(0), sampled_(false), minTime_(std::numeric_limits<ticks_t>::max()), maxTime_(0)
+    {}
+
+    /// Copies the statistics of \c other, but not its histogram nor its hardware events
+    void copyStatistics(const RawEventData& other) noexcept
+    {
+      time_ = other.time_;
+      exclusiveTime_ = other.exclusiveTime_;
+      lastInvocation_ = other.lastInvocation_;
+      invocations_ = other.invocations_;
+      depth_ = other.depth_;
+      sampledInvocations_ = other.sampledInvocations_;
+      samples_ = other.samples_;
+      squaredTime_ = other.squaredTime_;
+      minTime_ = other.minTime_;
+      maxTime_ = other.maxTime_;
+    }
+
+    /// Records the duration \c elapsed of an outermost invocation timed
+    void addSample(ticks_t elapsed, bool histogram)
+    {
+      time_ += elapsed;
+      samples_++;
+      squaredTime_ += static_cast<double>(elapsed) * static_cast<double>(elapsed);
+      minTime_ = std::min(minTime_.load(), elapsed);
+      maxTime_ = std::max(maxTime_.load(), elapsed);
+      if (histogram) {
+        if (!histogram_) {
+          histogram_.reset(new Relaxed<std::uint32_t>[ThreadInstrument::LatencyHistogram::NBuckets]());
+          accountActivityMemory(ThreadInstrument::LatencyHistogram::NBuckets * sizeof(std::uint32_t));
+        }
+        histogram_[ThreadInstrument::LatencyHistogram::bucket(static_cast<std::uint64_t>(std::max(elapsed, ticks_t(0))))]++;
+      }
+    }
+
+    /// Begins counting the hardware events of the outermost invocation that is beginning, if the thread has counters
+    void startCounting()
+    {
+      if (MyPerfCounters.ready()) {
+        if (!perf_) {
+          perf_.reset(new PerfCounts());
+          accountActivityMemory(sizeof(PerfCounts));
+        }
+        std::uint64_t values[NPerfCounters];
+        MyPerfCounters.read(values);
+        perf_->start(values);
+      }
+    }
+
+    /// Clears the statistics keeping the sampling configuration and the storage of the histogram and the hardware events
+    /** The state of the invocations running (::depth_, ::lastInvocation_, ::category_, ::epoch_ and ::sampled_) is kept,
+        so that their ends are still timed and pop their frames of the nested profiling.
+        Those invocations are counted again, as their time will be accounted when they end.
+        @internal Only to be used by the thread that owns the data */
+    void clear() noexcept
+    {
+      seq_.beginWrite();
+      time_ = 0;
+      exclusiveTime_ = 0;
+      invocations_ = depth_.load();
+      sampledInvocations_ = sampled_ ? depth_.load() : 0u;
+      samples_ = 0u;
+      squaredTime_ = 0.0;
+      minTime_ = std::numeric_limits<ticks_t>::max();
+      maxTime_ = 0;
+      if (histogram_) {
+        for (unsigned i = 0; i < ThreadInstrument::LatencyHistogram::NBuckets; ++i) {
+          histogram_[i] = 0u;
+        }
+      }
+      if (perf_) {
+        perf_->clear();
+      }
+      seq_.endWrite();
+    }
+
+  };
+
+  /// Activity data of a call path kept by its thread, reported as a ThreadInstrument::CallPathData
+  struct RawCallPathData {
+
+    Relaxed<ticks_t> time_;
+    Relaxed<ticks_t> exclusiveTime_;
+    Relaxed<unsigned> invocations_;
+
+    RawCallPathData() noexcept
+    : time_(0), exclusiveTime_(0), invocations_(0)
+    {}
+
+  };
+
+  /// Node of the calling-context tree of a thread
+  struct CallPathNode {
+
+    RawCallPathData data_;
+    SeqCounter seq_;        ///< Protects ::data_ from the readers in other threads
+    int activity_;          ///< Last activity of the call path
+    unsigned firstChild_;   ///< Position of the first child in the tree or 0 if there are none
+    unsigned nextSibling_;  ///< Position of the next child of the same parent or 0 if there are none
+
+    CallPathNode(int activity, unsigned next_sibling) noexcept
+    : activity_(activity), firstChild_(0), nextSibling_(next_sibling)
+    {}
+
+  };
+
+  /// Number of times that each category was disabled
+  /** @internal The activities of a category that began before it was last disabled are no longer measured, as their end might have been disregarded */
+  std::atomic<unsigned> CategoryEpochs[ThreadInstrument::NCategories];
+
+  /// Number of times that some category was disabled, so that the threads detect cheaply the changes of ::CategoryEpochs
+  std::atomic<unsigned> CategoriesEpoch {0};
+
+  /// Records that the categories of the bits set in \c mask were disabled. It is async-signal-safe
+  void categoriesDisabled(std::uint64_t mask) noexcept
+  {
+    if (mask) {
+      for (unsigned i = 0; i < ThreadInstrument::NCategories; i++) {
+        if ((mask >> i) & 1) {
+          CategoryEpochs[i].fetch_add(1, std::memory_order_relaxed);
+        }
+      }
+      CategoriesEpoch.fetch_add(1, std::memory_order_relaxed);
+    }
+  }
+
+  /// Activity running in a thread under nested profiling
+  struct ActivityFrame {
+
+    ticks_t start_;
+    ticks_t childrenTime_;  ///< Time spent in the activities nested in this one
+    unsigned node_;         ///< Position of the call path of the activity in the calling-context tree
+    unsigned category_;     ///< Category of the activity
+    unsigned epoch_;        ///< Value of ::CategoryEpochs for ::category_ when the activity began
+    int activity_;
+
+    ActivityFrame(ticks_t start, unsigned node, unsigned category, unsigned epoch, int activity) noexcept
+    : start_(start), childrenTime_(0), node_(node), category_(category), epoch_(epoch), activity_(activity)
+    {}
+
+  };
+
+  /// Protects ::SamplingPeriods
+  std::mutex SamplingMutex;
+
+  /// Sampling periods set by ThreadInstrument::setSampling for each event
+  std::map<int, unsigned> SamplingPeriods;
+
+  /// Number of changes of ::SamplingPeriods. The threads read the period of an event when they find a new version
+  std::atomic<unsigned> SamplingVersion {0};
+
+  /// Whether some log event is sampled
+  std::atomic<bool> LogSampling {false};
+
+  /// Estimation of the bytes of an entry of IdentifiedEventData::sparseEvents_, including the node of the tree
+  constexpr std::size_t SparseEventBytes = sizeof(std::pair<const int, RawEventData>) + 4 * sizeof(void *);
+
+  /// Nesting of the pairs of log entries of an event whose sampling decisions are remembered
+  constexpr unsigned LogPairDecisions = 64;
+
+  /// Sampling of the log entries of an event in a thread
+  /** @internal The entries with data 0 and 1, as those of ::THREADINSTRUMENT_TIMED_LOG, are the beginning and the end
+   *  of a pair, which is sampled when it begins. The end follows the decision taken for its beginning. */
+  struct LogSamplingState {
+
+    unsigned period_;           ///< One of each period_ pairs or single entries is recorded. 0 once the event is no longer sampled
+    unsigned countdown_;        ///< Pairs or single entries until the next one recorded
+    unsigned depth_;            ///< Pairs begun whose end was not logged yet
+    std::uint64_t decisions_;   ///< Bit \c i is set if the pair begun at depth \c i is recorded
+
+    LogSamplingState() noexcept
+    : period_(0), countdown_(0), depth_(0), decisions_(0)
+    {}
+  };
+
+  /// Estimation of the bytes of an entry of IdentifiedEventData::logSampling_
+  constexpr std::size_t LogSamplingBytes = sizeof(std::pair<const int, LogSamplingState>) + 4 * sizeof(void *);
+
+  struct IdentifiedEventData {
+    
+    const unsigned id_;   ///< # of the thread associated
+    std::atomic<std::uint64_t> systemId_; ///< Identifier of the thread in the operating system
+    DenseTable<RawEventData> denseEvents_;                  ///< Data of activities below THREADINSTRUMENT_MAX_DENSE_EVENT
+    std::map<int, RawEventData> sparseEvents_;              ///< Data of the remaining activities
+    ThreadLog log_;                                         ///< Log entries generated by the thread
+    std::vector<ActivityFrame> activityStack_;              ///< Activities running under nested profiling
+    unsigned framesEpoch_;                                  ///< Value of ::CategoriesEpoch when ::activityStack_ was last checked
+    std::vector<CallPathNode> callPathTree_;                ///< Calling-context tree, whose root is at position 0
+    std::uint32_t rngState_;                                ///< State of the generator of the sampling intervals
+    std::map<int, LogSamplingState> logSampling_;           ///< Sampling of the log entries of the events sampled. Only used by the owner
+    unsigned logSamplingVersion_;                           ///< Value of ::SamplingVersion when ::logSampling_ was built
+    std::mutex structureMutex_;                             ///< Taken by the owner to add entries to the tables and the tree and by the readers of other threads
+    std::atomic<unsigned> clearRequests_;                   ///< Number of times that the clearing of the data has been requested
+    std::atomic<unsigned> clearsApplied_;                   ///< Value of ::clearRequests_ when the owner last cleared the data
+    std::atomic<std::thread::id> owner_;                    ///< Thread that owns the data, which changes when the data of an exited thread is reused
+    std::atomic<bool> exited_;                              ///< Whether the owner exited under ThreadInstrument::reclaimExitedThreads
+    std::atomic<std::size_t> activityBytes_;                ///< Bytes of the activity statistics
+    std::string name_;                                      ///< Set by ThreadInstrument::setThreadName, protected by ::structureMutex_
+    std::string role_;                                      ///< Set by ThreadInstrument::setThreadRole, protected by ::structureMutex_
+    int roleIndex_;                                         ///< Position of the thread in its role, protected by ::structureMutex_
+
+    IdentifiedEventData(unsigned in_id, std::uint64_t system_id, std::thread::id owner) noexcept
+    : id_(in_id), systemId_{system_id}, framesEpoch_(0), rngState_(2654435761u * (in_id + 1)), logSamplingVersion_(0), clearRequests_{0}, clearsApplied_{0},
+      owner_{owner}, exited_{false}, activityBytes_{0}, roleIndex_(-1)
+    {}
+
+    /// Only used to store the data of a thread that just registered, when no other thread can access it
+    IdentifiedEventData(IdentifiedEventData&& other) noexcept
+    : id_(other.id_), systemId_{other.systemId_.load()}, denseEvents_(std::move(other.denseEvents_)),
+      sparseEvents_(std::move(other.sparseEvents_)),
+      log_(std::move(other.log_)), activityStack_(std::move(other.activityStack_)), framesEpoch_(other.framesEpoch_), callPathTree_(std::move(other.callPathTree_)),
+      rngState_(other.rngState_), logSampling_(std::move(other.logSampling_)), logSamplingVersion_(other.logSamplingVersion_),
+      clearRequests_{other.clearRequests_.load()}, clearsApplied_{other.clearsApplied_.load()},
+      owner_{other.owner_.load()}, exited_{other.exited_.load()}, activityBytes_{other.activityBytes_.load()},
+      name_(std::move(other.name_)), role_(std::move(other.role_)), roleIndex_(other.roleIndex_)
+    {}
+
+    /// Identification of the thread. It can be used by any thread
+    ThreadInstrument::ThreadInfo info()
+    { ThreadInstrument::ThreadInfo ret;
+
+      ret.thread = id_;
+      std::lock_guard<std::mutex> guard(structureMutex_);
+      ret.name = name_;
+      ret.role = role_;
+      ret.roleIndex = roleIndex_;
+      return ret;
+    }
+
+    /// Records that the owner allocated (or freed if negative) \c bytes for the activity statistics
+    void account(std::ptrdiff_t bytes) noexcept
+    {
+      activityBytes_.fetch_add(static_cast<std::size_t>(bytes), std::memory_order_relaxed);
+      ActivityBytes.fetch_add(static_cast<std::size_t>(bytes), std::memory_order_relaxed);
+    }
+
+    /// Number of outermost invocations until the next one that is timed, chosen at random with mean \c period
+    /** @internal The randomization avoids the aliasing with periodic behaviors of the application */
+    unsigned nextCountdown(unsigned period) noexcept
+    {
+      // xorshift32
+      rngState_ ^= rngState_ << 13;
+      rngState_ ^= rngState_ >> 17;
+      rngState_ ^= rngState_ << 5;
+      return 1 + rngState_ % (2 * period - 1);
+    }
+
+    /// Decides whether the outermost invocation of \c event, whose data is \c ed, that is beginning is timed
+    bool sample(RawEventData& ed, int event)
+    {
+      const unsigned version = SamplingVersion.load(std::memory_order_acquire);
+      if (ed.samplingVersion_ != version) {
+        std::lock_guard<std::mutex> guard(SamplingMutex);
+        const std::map<int, unsigned>::const_iterator it = SamplingPeriods.find(event);
+        ed.samplingPeriod_ = (it != SamplingPeriods.end()) ? it->second : 0;
+        ed.countdown_ = (ed.samplingPeriod_ > 1) ? nextCountdown(ed.samplingPeriod_) : 0;
+        ed.samplingVersion_ = version;
+      }
+
+      if (ed.samplingPeriod_ <= 1) {
+        return true;
+      }
+
+      if (--ed.countdown_) {
+        return false;
+      }
+
+      ed.countdown_ = nextCountdown(ed.samplingPeriod_);
+      return true;
+    }
+
+    /// Updates ::logSampling_ with the periods of ::SamplingPeriods of version \c version
+    /** The events no longer sampled are kept until the ends of their pairs begun are logged, so that they follow their beginnings */
+    void updateLogSampling(unsigned version)
+    {
+      const std::size_t old_size = logSampling_.size();
+      {
+        std::lock_guard<std::mutex> guard(SamplingMutex);
+        for (const auto& event_period : SamplingPeriods) {
+          LogSamplingState& state = logSampling_[event_period.first];
+          if (state.period_ != event_period.second) {
+            state.period_ = event_period.second;
+            state.countdown_ = nextCountdown(state.period_);
+          }
+        }
+        for (auto it = logSampling_.begin(); it != logSampling_.end(); ) {
+          if (!SamplingPeriods.count(it->first)) {
+            it->second.period_ = 0;
+            if (!it->second.depth_) {
+              it = logSampling_.erase(it);
+              continue;
+            }
+          }
+          ++it;
+        }
+      }
+      account((static_cast<std::ptrdiff_t>(logSampling_.size()) - static_cast<std::ptrdiff_t>(old_size)) * static_cast<std::ptrdiff_t>(LogSamplingBytes));
+      logSamplingVersion_ = version;
+    }
+
+    /// Decides whether a log entry of \c event with \c data is recorded
+    /** The entries with data 0 begin a pair that is sampled as a whole, the entry with data 1 that ends it
+     *  being recorded if and only if its beginning was. The pairs nested more than ::LogPairDecisions levels
+     *  within others of the same event are always recorded. The other entries are sampled individually.
+     *  @internal It does not allocate memory unless ::setSampling changed the periods. */
+    bool sampleLog(unsigned event, std::intptr_t data)
+    {
+      if (logSampling_.empty() && !LogSampling.load(std::memory_order_relaxed)) {
+        return true;
+      }
+      const unsigned version = SamplingVersion.load(std::memory_order_acquire);
+      if (logSamplingVersion_ != version) {
+        updateLogSampling(version);
+      }
+      const std::map<int, LogSamplingState>::iterator it = logSampling_.find(static_cast<int>(event));
+      if (it == logSampling_.end()) {
+        return true;
+      }
+
+      LogSamplingState& state = it->second;
+      if ((data == 1) && state.depth_) {
+        const unsigned depth = --state.depth_;
+        return (depth >= LogPairDecisions) || ((state.decisions_ >> depth) & 1);
+      }
+
+      bool recorded = true;
+      if ((state.period_ > 1) && (state.depth_ < LogPairDecisions)) {
+        recorded = !--state.countdown_;
+        if (recorded) {
+          state.countdown_ = nextCountdown(state.period_);
+        }
+      }
+
+      if (data == 0) {
+        if (state.depth_ < LogPairDecisions) {
+          const std::uint64_t bit = std::uint64_t(1) << state.depth_;
+          state.decisions_ = recorded ? (state.decisions_ | bit) : (state.decisions_ & ~bit);
+        }
+        state.depth_++;
+      }
+      return recorded;
+    }
+
+    /// Get the data of an activity, creating it if it does not exist
+    RawEventData& eventData(int activity)
+    {
+      const unsigned pos = static_cast<unsigned>(activity);
+      if (pos < denseEvents_.size()) {
+        return denseEvents_[pos];
+      }
+      if (pos >= THREADINSTRUMENT_MAX_DENSE_EVENT) {
+        const std::map<int, RawEventData>::iterator it = sparseEvents_.find(activity);
+        if (it != sparseEvents_.end()) {
+          return it->second;
+        }
+      }
+      std::lock_guard<std::mutex> guard(structureMutex_);
+      if (pos < THREADINSTRUMENT_MAX_DENSE_EVENT) {
+        const unsigned old_size = denseEvents_.size();
+        denseEvents_.grow(pos + 1);
+        account(static_cast<std::ptrdiff_t>(denseEvents_.size() - old_size) * sizeof(RawEventData));
+        return denseEvents_[pos];
+      }
+      account(SparseEventBytes);
+      return sparseEvents_[activity];
+    }
+
+    /// Get the data of an activity, or nullptr if it does not exist
+    RawEventData *findEventData(int activity)
+    {
+      const unsigned pos = static_cast<unsigned>(activity);
+      if (pos < denseEvents_.size()) {
+        return &denseEvents_[pos];
+      }
+      std::map<int, RawEventData>::iterator it = sparseEvents_.find(activity);
+      return (it != sparseEvents_.end()) ? &(it->second) : nullptr;
+    }
+
+    /// Whether a clearing requested by another thread has not been applied yet by the owner
+    bool clearPending() const noexcept
+    {
+      return clearRequests_.load(std::memory_order_acquire) != clearsApplied_.load(std::memory_order_acquire);
+    }
+
+    /// Clears the statistics. Only to be used by the owner
+    /** The calling-context tree keeps its structure, as it may be in use by ::activityStack_ */
+    void clear()
+    {
+      const unsigned requests = clearRequests_.load(std::memory_order_acquire);
+      for (unsigned i = 0; i < denseEvents_.size(); ++i) {
+        denseEvents_[i].clear();
+      }
+      for (auto& activity_data : sparseEvents_) {
+        activity_data.second.clear();
+      }
+      for (CallPathNode& node : callPathTree_) {
+        node.seq_.beginWrite();
+        node.data_ = RawCallPathData();
+        node.seq_.endWrite();
+      }
+      clearsApplied_.store(requests, std::memory_order_release);
+    }
+
+    /// Makes the data look empty until the owner clears it in its next activity
+    void requestClear() noexcept
+    {
+      clearRequests_.fetch_add(1, std::memory_order_acq_rel);
+    }
+
+    /// Releases the activity statistics so that the data can be reused by another thread. Only to be used by the owner
+    /** @internal The log is kept, so that its pending entries are consumed as usual */
+    void releaseActivity() noexcept
+    {
+      std::lock_guard<std::mutex> guard(structureMutex_);
+      denseEvents_.reset();
+      sparseEvents_.clear();
+      std::vector<ActivityFrame>().swap(activityStack_);
+      std::vector<CallPathNode>().swap(callPathTree_);
+      logSampling_.clear();
+      logSamplingVersion_ = 0;
+      name_.clear();
+      role_.clear();
+      roleIndex_ = -1;
+      account(-static_cast<std::ptrdiff_t>(activityBytes_.load(std::memory_order_relaxed)));
+      clearsApplied_.store(clearRequests_.load(std::memory_order_acquire), std::memory_order_release);
+    }
+
+    /// Applies to \c f(activity, data) the ThreadInstrument::EventData of each activity of the thread
+    /** @internal It can be used by any thread, as the data is read by means of the seqlocks of the activities */
+    template<typename F>
+    void forEachActivity(F f)
+    {
+      std::lock_guard<std::mutex> guard(structureMutex_);
+      readActivities(f, true);
+    }
+
+    /// Same as ::forEachActivity but without the histograms, and returning false without reading the data if ::structureMutex_ is taken
+    /** @internal Used by the threads that must not wait for the owner. As the copies of the statistics do not allocate memory,
+     *  an owner that adds an activity while they are read is only delayed for a short time if \c f does not allocate either */
+    template<typename F>
+    bool tryForEachActivity(F f)
+    {
+      std::unique_lock<std::mutex> lock(structureMutex_, std::try_to_lock);
+      if (!lock.owns_lock()) {
+        return false;
+      }
+      readActivities(f, false);
+      return true;
+    }
+
+    /// Implementation of ::forEachActivity, reading the histograms if \c histograms is true. Only to be used with ::structureMutex_ taken
+    template<typename F>
+    void readActivities(F& f, bool histograms)
+    { RawEventData copy;
+      unsigned seq;
+
+      if (clearPending()) {
+        return;
+      }
+
+      auto read = [&](int activity, const RawEventData& ed) {
+        const Relaxed<std::uint32_t> *histogram;
+        PerfCounts perf;
+        do {
+          seq = ed.seq_.beginRead();
+          copy.copyStatistics(ed);
+          histogram = histograms ? ed.histogram_.get() : nullptr;
+          const PerfCounts * const perf_p = ed.perf_.get();
+          perf = (perf_p != nullptr) ? *perf_p : PerfCounts();
+        } while (ed.seq_.retryRead(seq));
+        if (copy.invocations_ || copy.depth_) {
+          f(activity, toEventData(copy, histogram, perf));
+        }
+      };
+
+      for (const auto& activity_data : sparseEvents_) {
+        read(activity_data.first, activity_data.second);
+      }
+      for (unsigned i = 0; i < denseEvents_.size(); ++i) {
+        read(static_cast<int>(i), denseEvents_[i]);
+      }
+    }
+
+    /// Builds a map with the activity data from the tables
+    ThreadInstrument::Int2EventDataMap_t activityView()
+    { ThreadInstrument::Int2EventDataMap_t m;
+
+      forEachActivity([&m](int activity, const ThreadInstrument::EventData& ed) { m.emplace(activity, ed); });
+      return m;
+    }
+
+    /// Builds the public view of the statistics \c r, whose histogram is \c histogram and whose hardware events are \c perf
+    /** @internal The histogram, which can be nullptr, is read outside the seqlock, so that its counts
+     *  may not exactly match the other statistics if the activity is running */
+    static ThreadInstrument::EventData toEventData(const RawEventData& r, const Relaxed<std::uint32_t> *histogram, const PerfCounts& perf)
+    { ThreadInstrument::EventData ed;
+
+      std::copy(perf.counts_, perf.counts_ + NPerfCounters, ed.counters);
+      ed.countedSamples = perf.samples_;
+
+      // The times of the invocations not sampled are extrapolated
+      const double factor = r.sampledInvocations_ ? (static_cast<double>(r.invocations_) / r.sampledInvocations_) : 1.0;
+      ed.time = TheTickClock.seconds(r.time_) * factor;
+      ed.exclusiveTime = TheTickClock.seconds(r.exclusiveTime_) * factor;
+      ed.samples = r.samples_;
+      ed.timeError = 0.0;
+      if ((factor > 1.0) && (r.samples_ > 1)) {
+        // Standard error of the estimation of the total from a sample without replacement
+        const double m = r.samples_;
+        const double n = m * factor;
+        const double mean = static_cast<double>(r.time_) / m;
+        const double variance = std::max(0.0, (r.squaredTime_ - m * mean * mean) / (m - 1.0));
+        ed.timeError = TheTickClock.seconds(1) * n * std::sqrt(variance / m * (1.0 - m / n));
+      }
+      if (r.samples_) {
+        const double m = r.samples_;
+        const double mean = static_cast<double>(r.time_) / m;
+        ed.minTime = TheTickClock.seconds(r.minTime_);
+        ed.maxTime = TheTickClock.seconds(r.maxTime_);
+        ed.meanTime = TheTickClock.seconds(1) * mean;
+        ed.timeStdDev = TheTickClock.seconds(1) * std::sqrt(std::max(0.0, r.squaredTime_ / m - mean * mean));
+        if (histogram != nullptr) {
+          std::uint32_t counts[ThreadInstrument::LatencyHistogram::NBuckets];
+          std::copy(histogram, histogram + ThreadInstrument::LatencyHistogram::NBuckets, counts);
+          ed.histogram.assign(counts, TheTickClock.seconds(1));
+        }
+      }
+      if (r.invocations_) {
+        ed.lastInvocation = TheTickClock.timePoint(r.lastInvocation_);
+      }
+      ed.invocations = r.invocations_;
+      ed.depth = r.depth_;
+      ed.currentlyRunning = (r.depth_ != 0);
+      return ed;
+    }
+
+    /// Adds a node to ::callPathTree_ accounting its growth. Only to be used with ::structureMutex_ taken
+    void addCallPathNode(int activity, unsigned next_sibling)
+    {
+      const std::size_t old_capacity = callPathTree_.capacity();
+      callPathTree_.emplace_back(activity, next_sibling);
+      account(static_cast<std::ptrdiff_t>(callPathTree_.capacity() - old_capacity) * sizeof(CallPathNode));
+    }
+
+    /// Position in ::callPathTree_ of the child of node \c parent for \c activity, creating it if it does not exist
+    unsigned callPathChild(unsigned parent, int activity)
+    { unsigned pos;
+
+      if (callPathTree_.empty()) {
+        std::lock_guard<std::mutex> guard(structureMutex_);
+        addCallPathNode(-1, 0);
+      }
+
+      for (pos = callPathTree_[parent].firstChild_; pos; pos = callPathTree_[pos].nextSibling_) {
+        if (callPathTree_[pos].activity_ == activity) {
+          return pos;
+        }
+      }
+
+      std::lock_guard<std::mutex> guard(structureMutex_);
+      pos = static_cast<unsigned>(callPathTree_.size());
+      addCallPathNode(activity, callPathTree_[parent].firstChild_);
+      callPathTree_[parent].firstChild_ = pos;
+      return pos;
+    }
+
+    /// Pushes \c activity of \c category, which begins at \c t in the epoch \c epoch of the category, in the ::activityStack_
+    void beginNested(int activity, ticks_t t, unsigned category, unsigned epoch)
+    {
+      const unsigned parent = activityStack_.empty() ? 0 : activityStack_.back().node_;
+      const unsigned node = callPathChild(parent, activity);
+      const std::size_t old_capacity = activityStack_.capacity();
+      activityStack_.emplace_back(t, node, category, epoch, activity);
+      if (activityStack_.capacity() != old_capacity) {
+        account(static_cast<std::ptrdiff_t>(activityStack_.capacity() - old_capacity) * sizeof(ActivityFrame));
+      }
+    }
+
+    /// Removes from ::activityStack_ the activities whose category was disabled after they began
+    /** The stack is only inspected when some category was disabled since the last time */
+    void dropStaleFrames()
+    {
+      const unsigned epoch = CategoriesEpoch.load(std::memory_order_relaxed);
+      if (framesEpoch_ != epoch) {
+        framesEpoch_ = epoch;
+        activityStack_.erase(std::remove_if(activityStack_.begin(), activityStack_.end(), [](const ActivityFrame& frame) {
+          return frame.epoch_ != CategoryEpochs[frame.category_].load(std::memory_order_relaxed);
+        }), activityStack_.end());
+      }
+    }
+
+    /// Pops the activity at the top of ::activityStack_, which ends at \c t
+    /** @return the exclusive time of the activity */
+    ticks_t endNested(ticks_t t)
+    {
+      const ActivityFrame& frame = activityStack_.back();
+      const ticks_t elapsed = t - frame.start_;
+      const ticks_t exclusive = elapsed - frame.childrenTime_;
+
+      CallPathNode& node = callPathTree_[frame.node_];
+      node.seq_.beginWrite();
+      node.data_.time_ += elapsed;
+      node.data_.exclusiveTime_ += exclusive;
+      node.data_.invocations_++;
+      node.seq_.endWrite();
+
+      activityStack_.pop_back();
+      if (!activityStack_.empty()) {
+        activityStack_.back().childrenTime_ += elapsed;
+      }
+
+      return exclusive;
+    }
+
+    /// Adds to \c m the call paths below \c node, whose path is \c path
+    void addCallPaths(ThreadInstrument::CallPath2DataMap_t& m, ThreadInstrument::CallPath_t& path, unsigned node) const
+    {
+      for (unsigned pos = callPathTree_[node].firstChild_; pos; pos = callPathTree_[pos].nextSibling_) {
+        const CallPathNode& child = callPathTree_[pos];
+        RawCallPathData child_data;
+        unsigned seq;
+        do {
+          seq = child.seq_.beginRead();
+          child_data = child.data_;
+        } while (child.seq_.retryRead(seq));
+        path.push_back(child.activity_);
+        if (child_data.invocations_) {
+          ThreadInstrument::CallPathData& data = m[path];
+          data.time += TheTickClock.seconds(child_data.time_);
+          data.exclusiveTime += TheTickClock.seconds(child_data.exclusiveTime_);
+          data.invocations += child_data.invocations_;
+        }
+        addCallPaths(m, path, pos);
+        path.pop_back();
+      }
+    }
+
+    /// Adds to \c m the call paths of this thread. It can be used by any thread
+    void addCallPaths(ThreadInstrument::CallPath2DataMap_t& m)
+    { ThreadInstrument::CallPath_t path;
+
+      std::lock_guard<std::mutex> guard(structureMutex_);
+      if (!callPathTree_.empty() && !clearPending()) {
+        addCallPaths(m, path, 0);
+      }
+    }
+
+  };
+
+  
+  /// Number of threads that have registered profiling activity
+  std::atomic<unsigned> NProfiledThreads {0};
+
+  /// Incremented after each change of the threads described in the binary logs: registrations, reclamations, names and roles
+  std::atomic<unsigned> ThreadsGeneration {0};
+
+  /// Whether the threads keep track of the nesting of their activities
+  std::atomic<bool> NestedProfiling {false};
+
+  /// Whether ThreadInstrument::LatencyHistogram are recorded, set by ThreadInstrument::enableHistograms
+  std::atomic<bool> Histograms {false};
+
+  /// Categories enabled before they were disabled by ::toggle_categories
+  std::atomic<std::uint64_t> ToggledCategories {0};
+
+  /// Sets the categories enabled
+  void setCategories(std::uint64_t mask) noexcept
+  {
+    const std::uint64_t previous = ThreadInstrument::internal::EnabledCategories.exchange(mask, std::memory_order_relaxed);
+    categoriesDisabled(previous & ~mask);
+  }
+
+  /// Disables all the categories or restores the ones enabled before. Run when the signal chosen by toggleCategoriesOnSignal is received
+  void toggle_categories(int)
+  {
+    const std::uint64_t current = ThreadInstrument::internal::EnabledCategories.load(std::memory_order_relaxed);
+    if (current) {
+      ToggledCategories.store(current, std::memory_order_relaxed);
+      setCategories(0);
+    } else {
+      const std::uint64_t previous = ToggledCategories.load(std::memory_order_relaxed);
+      setCategories(previous ? previous : ~std::uint64_t(0));
+    }
+  }
+
+  
+  /// Lock-free single-linked list that only supports push at the head and pop either from the head or the bottom
+  ///plus reversals
+  template<typename T>
+  class ConcurrentSList {
+    
+    struct Node {
+      Node * next_;
+      T item_;
+    };
+    
+    std::atomic<Node*> head_;
+    
+    void push(Node * const newp) noexcept
+    {
+      newp->next_ = head_.load(std::memory_order_relaxed);
+      
+      while(!head_.compare_exchange_weak(newp->next_, newp, std::memory_order_release, std::memory_order_relaxed));
+    }
+    
+  public:
+    
+    class iterator {
+
+      Node *pos_;
+      
+      void advance() { pos_ = pos_->next_; }
+
+    public:
+      
+      iterator(Node *pos = nullptr) noexcept :
+      pos_(pos)
+      { }
+      
+      iterator(const iterator& other) noexcept :
+      pos_(other.pos_)
+      { }
+
+      bool operator==(const iterator& other) const noexcept {
+        return pos_ == other.pos_;
+      }
+
+      bool operator!=(const iterator& other) const noexcept {
+        return pos_ != other.pos_;
+      }
+      
+      /// Prefix increment
+      iterator& operator++() noexcept {
+        advance();
+        return *this;
+      }
+      
+      /// Postfix increment
+      iterator operator++(int) noexcept {
+        iterator tmp(*this);
+        advance();
+        return tmp;
+      }
+      
+      T& operator*() const noexcept {
+        return pos_->item_;
+      }
+
+      T* operator->() const noexcept {
+        return &(pos_->item_);
+      }
+
+    };
+    
+    ConcurrentSList() noexcept :
+    head_{nullptr}
+    { }
+    
+    void push(T&& val) {
+      push(new Node {nullptr, std::move(val) });
+    }
+    
+    void push(const T& val) {
+      pusn(new Node {nullptr, val });
+    }
+    
+    size_t unsafe_size() const noexcept {
+      size_t sz = 0;
+      for (Node * p = head_.load(std::memory_order_relaxed); p != nullptr; p = p->next_) {
+        sz++;
+      }
+      return sz;
+    }
+    
+    void clear() noexcept {
+      Node *q;
+      for (Node * p = head_.load(std::memory_order_relaxed); p != nullptr;  p = q) {
+        q = p->next_;
+        delete p;
+      }
+      head_ = nullptr;
+    }
+
+    /// From bottom/end of the list
+    bool try_pop(T& val) noexcept {
+      Node *q, *p = head_.load(std::memory_order_relaxed);
+      
+      if(p == nullptr) {
+        return false;
+      }
+      
+      while (p->next_ != nullptr) {
+        q = p;
+        p = p->next_;
+      }
+      
+      val = p->item_;
+      
+      if (p == head_) {
+        head_ = nullptr;
+      } else {
+        q->next_ = nullptr;
+      }
+      
+      delete p;
+      
+      return true;
+    }
+    
+    void reverse() noexcept {
+      Node *p = head_.load(std::memory_order_relaxed), *pp1, *pp2;
+      if (p != nullptr) {
+        for(pp1 = p->next_; pp1 != nullptr; pp1 = pp2) {
+          pp2 = pp1->next_;
+          pp1->next_ = p;
+          p = pp1;
+        }
+        (*head_).next_ = nullptr;
+        head_ = p;
+      }
+    }
+    
+    /// From top/begin of the list
+    bool try_head_pop(T& val) noexcept {
+      Node *p = head_.load(std::memory_order_relaxed);
+      
+      if(p == nullptr) {
+        return false;
+      }
+      
+      val = p->item_;
+      
+      head_ = p->next_;
+      
+      delete p;
+      
+      return true;
+    }
+    
+    iterator begin() const noexcept { return iterator(head_); }
+    iterator end() const noexcept { return iterator(nullptr); }
+
+  };
+
+  
+  /// Poor man's map based on a ConcurrentSList
+  template<typename Key, typename Val>
+  class ConcurrentSMap {
+
+    using value_type = typename std::pair<Key, Val>;
+    
+    ConcurrentSList<value_type> storage_;
+
+  public:
+
+    using iterator = typename ConcurrentSList<value_type>::iterator;
+
+    ConcurrentSMap() = default;
+    
+    iterator begin() const noexcept { return storage_.begin(); }
+    iterator end() const noexcept { return storage_.end(); }
+    
+    iterator find(const Key& key) noexcept {
+      iterator it = begin();
+      const iterator it_end = end();
+      while ( (it != it_end) && ((*it).first != key) ) {
+        ++it;
+      }
+      return it;
+    }
+    
+    size_t unsafe_size() const noexcept { return storage_.unsafe_size(); }
+
+    std::pair<iterator, bool> emplace(const Key& key, Val&& val) {
+      storage_.push(value_type(key, std::forward<Val>(val)));
+      return {find(key), true}; // Very inefficient for the general case, but ok here
+    }
+  };
+  
+  /// Stores the event data for each thread (one position per thread)
+  typedef ConcurrentSMap<std::thread::id, IdentifiedEventData> Thr2Ev_t;
+  
+  Thr2Ev_t GlobalEventMap;
+
+  /// Identifier of the calling thread in the operating system
+  std::uint64_t systemThreadId() noexcept
+  {
+#ifdef __linux__
+    return static_cast<std::uint64_t>(syscall(SYS_gettid));
+#else
+    return static_cast<std::uint64_t>(std::hash<std::thread::id>()(std::this_thread::get_id()));
+#endif
+  }
+
+  /// Whether the data of the threads that exit is reused by new threads, set by ThreadInstrument::reclaimExitedThreads
+  std::atomic<bool> ReclaimExitedThreads {false};
+
+  /// Thread that initialized the library, whose data is never reclaimed, as it exits with the process
+  const std::thread::id MainThreadId = std::this_thread::get_id();
+
+  /// Cached pointer to the IdentifiedEventData of the calling thread
+  /** @internal The nodes of ::GlobalEventMap are never deallocated, thus the pointer remains valid
+   *  during the whole life of the thread. This avoids the linear search in the map in the hot paths. */
+  thread_local IdentifiedEventData *MyThreadRawData = nullptr;
+
+  /// Whether the calling thread already went through the reclamation of its data at exit
+  thread_local bool ThreadExiting = false;
+
+  /// Data used by a thread whose data was reclaimed at exit, if it is instrumented later, such as in the destructor of another thread_local object
+  /** @internal Its statistics and log are discarded when the thread finishes, instead of registering a node of ::GlobalEventMap
+   *  that would never be reclaimed. Each thread has its own sink, as the data must have a single writer. Its number is the largest unsigned */
+  struct ExitedThreadSink {
+
+    IdentifiedEventData data_;
+
+    ExitedThreadSink() noexcept :
+    data_(std::numeric_limits<unsigned>::max(), systemThreadId(), std::this_thread::get_id())
+    { }
+
+    ~ExitedThreadSink()
+    {
+      data_.releaseActivity();
+    }
+
+  };
+
+  /// ExitedThreadSink of the calling thread, only allocated if the thread is instrumented after its reclamation
+  /** @internal A pointer is used so that the threads that never need the sink do not construct it when they touch the library */
+  thread_local ExitedThreadSink *MyExitedThreadSink = nullptr;
+
+  /// Frees the ExitedThreadSink of a thread when it finishes
+  void deleteExitedThreadSink(void *sink)
+  {
+    if (MyThreadRawData == &MyExitedThreadSink->data_) {
+      MyThreadRawData = nullptr;
+    }
+    MyExitedThreadSink = nullptr;
+    delete static_cast<ExitedThreadSink *>(sink);
+  }
+
+  /// Key whose destructor frees the ExitedThreadSink of each thread
+  /** @internal The destructors of the keys run after those of the thread_local objects, which is when the sinks are used */
+  pthread_key_t exitedThreadSinkKey()
+  {
+    static const pthread_key_t key = [] {
+      pthread_key_t k;
+      pthread_key_create(&k, deleteExitedThreadSink);
+      return k;
+    }();
+    return key;
+  }
+
+  /// Get the data of the thread \c this_id, registering it if needed
+  /** @internal Threads are only registered by themselves, so that systemThreadId() refers to them.
+   *  The data of threads that exited under ::ReclaimExitedThreads is reused before adding new nodes,
+   *  while the threads that already went through their reclamation get their ExitedThreadSink. */
+  IdentifiedEventData& GetThreadRawData(const std::thread::id this_id)
+  {
+    if (ThreadExiting && ReclaimExitedThreads.load(std::memory_order_relaxed)) {
+      if (MyExitedThreadSink == nullptr) {
+        MyExitedThreadSink = new ExitedThreadSink();
+        pthread_setspecific(exitedThreadSinkKey(), MyExitedThreadSink);
+      }
+      return MyExitedThreadSink->data_;
+    }
+
+    for (auto it = GlobalEventMap.begin(); it != GlobalEventMap.end(); ++it) {
+      if ((it->second.owner_.load(std::memory_order_relaxed) == this_id) && !it->second.exited_.load(std::memory_order_acquire)) {
+        return it->second;
+      }
+    }
+
+    if (ReclaimExitedThreads.load(std::memory_order_relaxed) && !ThreadExiting) {
+      for (auto it = GlobalEventMap.begin(); it != GlobalEventMap.end(); ++it) {
+        bool exited = true;
+        if (it->second.exited_.load(std::memory_order_relaxed) &&
+            it->second.exited_.compare_exchange_strong(exited, false, std::memory_order_acq_rel)) {
+          it->second.owner_.store(this_id, std::memory_order_relaxed);
+          it->second.systemId_.store(systemThreadId(), std::memory_order_relaxed);
+          ThreadsGeneration.fetch_add(1, std::memory_order_release);
+          return it->second;
+        }
+      }
+    }
+
+    auto ins_pair = GlobalEventMap.emplace(this_id, IdentifiedEventData(NProfiledThreads++, systemThreadId(), this_id));
+    assert(ins_pair.second);
+    RegistryBytes.fetch_add(sizeof(std::pair<std::thread::id, IdentifiedEventData>) + sizeof(void *), std::memory_order_relaxed);
+    ThreadsGeneration.fetch_add(1, std::memory_order_release);
+
+    return ins_pair.first->second;
+  }
+  
+  /// Protects ::ExitedActivity and ::ExitedCallPaths
+  std::mutex ExitedMutex;
+
+  /// Activity of the threads whose data was reclaimed
+  ThreadInstrument::Int2EventDataMap_t ExitedActivity;
+
+  /// Calling contexts of the threads whose data was reclaimed
+  ThreadInstrument::CallPath2DataMap_t ExitedCallPaths;
+
+  /// Reclaims the data of its thread when it exits under ::ReclaimExitedThreads
+  /** @internal Its statistics are accumulated in ::ExitedActivity and ::ExitedCallPaths and the data is left
+   *  for a new thread, which also continues its log. */
+  struct ThreadExitHook {
+
+    /// Only ensures the construction of the thread_local object
+    void arm() noexcept { }
+
+    ~ThreadExitHook()
+    { IdentifiedEventData * const data = MyThreadRawData;
+
+      ThreadExiting = true;
+      if ((data == nullptr) || !ReclaimExitedThreads.load(std::memory_order_relaxed) || (std::this_thread::get_id() == MainThreadId)) {
+        return;
+      }
+
+      {
+        std::lock_guard<std::mutex> guard(ExitedMutex);
+        data->forEachActivity([](int activity, const ThreadInstrument::EventData& ed) { ExitedActivity[activity] += ed; });
+        data->addCallPaths(ExitedCallPaths);
+      }
+      data->releaseActivity();
+      MyThreadRawData = nullptr;
+      data->exited_.store(true, std::memory_order_release);
+    }
+
+  };
+
+  thread_local ThreadExitHook MyThreadExitHook;
+
+  IdentifiedEventData& GetMyThreadRawData()
+  {
+    if (MyThreadRawData == nullptr) {
+      MyThreadRawData = &GetThreadRawData(std::this_thread::get_id());
+      if (!ThreadExiting) {
+        MyThreadExitHook.arm();
+      }
+    }
+    return *MyThreadRawData;
+  }
+
+  /// Data of the lane whose activity the calling thread is recording, which is charged with the memory allocated meanwhile
+  thread_local IdentifiedEventData *UpdatedLaneData = nullptr;
+
+  void accountActivityMemory(std::ptrdiff_t bytes) noexcept
+  {
+    if (UpdatedLaneData != nullptr) {
+      UpdatedLaneData->account(bytes);
+    } else if (MyThreadRawData != nullptr) {
+      MyThreadRawData->account(bytes);
+    } else {
+      ActivityBytes.fetch_add(static_cast<std::size_t>(bytes), std::memory_order_relaxed);
+    }
+  }
+  
+  IdentifiedEventData& getThreadDataByNumber(int id) noexcept
+  { Thr2Ev_t::iterator it;
+
+    for (it = GlobalEventMap.begin(); it != GlobalEventMap.end(); ++it) {
+      if (it->second.id_ == id) {
+        break;
+      }
+    }
+
+    assert(it != GlobalEventMap.end());
+    
+    return it->second;
+  }
+
+  /// Clears the activity data of a thread
+  /** @internal Only the owner modifies its data, so the other threads request it to clear its data in its next activity.
+   *  Meanwhile the data is reported as empty. */
+  void clearThreadData(IdentifiedEventData& thread_data) noexcept
+  {
+    thread_data.requestClear();
+    if (&thread_data == MyThreadRawData) {
+      thread_data.clear();
+    }
+  }
+
+  /// Protects ::RoleSizes
+  std::mutex RolesMutex;
+
+  /// Next index to assign to the threads of each role that do not provide one
+  std::map<std::string, int> RoleSizes;
+
+  /// Index of a thread of \c role, which is the next one of the role if \c index is negative
+  int roleIndex(const std::string& role, int index)
+  {
+    std::lock_guard<std::mutex> guard(RolesMutex);
+    int& role_size = RoleSizes[role];
+    if (index < 0) {
+      index = role_size;
+    }
+    role_size = std::max(role_size, index + 1);
+    return index;
+  }
+
+  /// Whether \c a is listed before \c b in the dumps: the threads without role first, then by role and index
+  bool threadInfoBefore(const ThreadInstrument::ThreadInfo& a, const ThreadInstrument::ThreadInfo& b) noexcept
+  {
+    if (a.role.empty() != b.role.empty()) {
+      return a.role.empty();
+    }
+    const int cmp = a.role.compare(b.role);
+    if (cmp) {
+      return cmp < 0;
+    }
+    return (a.roleIndex != b.roleIndex) ? (a.roleIndex < b.roleIndex) : (a.thread < b.thread);
+  }
+
+  /// Whether \c info has a name or a role to be reported in the dumps
+  bool isLabeled(const ThreadInstrument::ThreadInfo& info) noexcept
+  {
+    return !info.name.empty() || !info.role.empty();
+  }
+
+  /////////////////////////// LANES ///////////////////////////
+
+  /// Sequence of activities not performed by a thread of the process, such as a stream of a device, created by ThreadInstrument::createLane
+  /** @internal Its data is a node of ::GlobalEventMap without owner, so that it is numbered and reported as the threads.
+   *  The threads that record its activity are serialized by ::LanesMutex, which makes them act as its owner. */
+  struct Lane {
+    IdentifiedEventData *data_;
+    std::int64_t clockOffset_;  ///< Nanoseconds added to the moments provided to obtain those of ThreadInstrument::syncClockTime
+    ticks_t last_;              ///< Latest moment recorded, as the entries of the log of the lane must be chronological
+
+    explicit Lane(IdentifiedEventData *data) noexcept
+    : data_(data), clockOffset_(0), last_(std::numeric_limits<ticks_t>::min())
+    {}
+  };
+
+  /// Protects ::Lanes and serializes the recording of their activity
+  std::mutex LanesMutex;
+
+  /// Lanes indexed by their number
+  std::map<unsigned, Lane> Lanes;
+
+  /// Lane number \c lane. Only to be used with ::LanesMutex taken
+  Lane& getLane(unsigned lane)
+  {
+    const std::map<unsigned, Lane>::iterator it = Lanes.find(lane);
+    if (it == Lanes.end()) {
+      std::cerr << "ThreadInstrument: " << lane << " is not a lane created by createLane\n";
+      exit(EXIT_FAILURE);
+    }
+    return it->second;
+  }
+
+  /////////////////////////// LOGS ///////////////////////////
+
+  /// Maximum number of log events to dump. By default there is no limit
+  /** @internal Notice that all the event are actually logged; but only the last LogLimit ones are dumped. */
+  unsigned LogLimit = 0;
+
+  /// Serializes the threads that consume the logs
+  std::mutex LogConsumerMutex;
+
+  /// Control whether the Log is locked
+  volatile bool Locked_Log = false;
+
+  /// Position of a consumer in the log of a thread
+  struct LogCursor {
+    ThreadLog *log_;
+    unsigned thread_num_;
+    size_t pending_;      ///< Entries to consume in this log
+  };
+
+  /// Builds a cursor for the entries currently available in the log of each thread
+  /** @internal Must be called with ::LogConsumerMutex taken */
+  std::vector<LogCursor> getLogCursors()
+  { std::vector<LogCursor> cursors;
+
+    for (auto it = GlobalEventMap.begin(); it != GlobalEventMap.end(); ++it) {
+      ThreadLog& log = it->second.log_;
+      cursors.push_back({&log, it->second.id_, log.available()});
+    }
+
+    return cursors;
+  }
+
+  /// Consumes the entries currently available in the logs following their chronological order
+  /** Only the last \c limit entries (all if it is 0) are provided to \c f, which receives the number
+   *  of the thread that generated the entry and the entry.
+   *  @internal Must be called with ::LogConsumerMutex taken */
+  template<typename F>
+  void mergeLogs(F&& f, const size_t limit)
+  {
+    std::vector<LogCursor> cursors = getLogCursors();
+
+    size_t total = 0;
+    for (const auto& cursor : cursors) {
+      total += cursor.pending_;
+    }
+
+    const auto later = [](const LogCursor *a, const LogCursor *b) {
+      const LogEvent& la = a->log_->front();
+      const LogEvent& lb = b->log_->front();
+      return (la.when_ > lb.when_) || ((la.when_ == lb.when_) && (a->thread_num_ > b->thread_num_));
+    };
+
+    std::priority_queue<LogCursor *, std::vector<LogCursor *>, decltype(later)> heap(later);
+    for (auto& cursor : cursors) {
+      if (cursor.pending_) {
+        heap.push(&cursor);
+      }
+    }
+
+    while (!heap.empty()) {
+      LogCursor * const cursor = heap.top();
+      heap.pop();
+
+      if (!limit || (total <= limit)) {
+        f(cursor->thread_num_, cursor->log_->front());
+      }
+
+      total--;
+      cursor->log_->pop();
+      if (--cursor->pending_) {
+        heap.push(cursor);
+      }
+    }
+  }
+
+  /// Provides printer for each kind of event
+  std::map<unsigned, ThreadInstrument::LogPrinter_t> LogPrinters;
   
-  struct IdentifiedEventData {
+  /// User function to run when SIGUSR1 is received
+  void (*Inspector)();
+  
+  /// Generic printer for all events
+  ThreadInstrument::AllLogPrinter_t AllLogPrinter = ThreadInstrument::defaultPrinter;
+
+  /// Formatter of the typed payloads of each event, with the formatter registered by the user
+  std::map<unsigned, std::pair<ThreadInstrument::internal::LogFormatterThunk_t, void (*)()>> LogFormatters;
+
+  /// Writes in \c buf, of ThreadInstrument::LogFormatterBufferSize + 1 bytes, the representation of the typed payload of \c l followed by a 0
+  /** @internal Only the printers registered by ThreadInstrument::registerLogPrinter allocate memory */
+  void formatPayload(const LogEvent& l, char *buf)
+  { static const char hex_digits[] = "0123456789abcdef";
+    std::size_t n;
+
+    const auto it_formatter = LogFormatters.find(l.event_id_);
+    if (it_formatter != LogFormatters.end()) {
+      n = std::min(it_formatter->second.first(it_formatter->second.second, buf, ThreadInstrument::LogFormatterBufferSize, l.payload_),
+                   ThreadInstrument::LogFormatterBufferSize);
+    } else {
+      const auto it_printer = LogPrinters.find(l.event_id_);
+      if (it_printer != LogPrinters.end()) {
+        alignas(std::max_align_t) unsigned char copy[ThreadInstrument::LogPayloadSize];
+        memcpy(copy, l.payload_, l.payloadSize_);
+        const std::string representation = it_printer->second(copy);
+        n = std::min(representation.size(), ThreadInstrument::LogFormatterBufferSize);
+        memcpy(buf, representation.data(), n);
+      } else {
+        buf[0] = '0';
+        buf[1] = 'x';
+        n = 2;
+        for (unsigned i = 0; i < l.payloadSize_; i++) {
+          buf[n++] = hex_digits[l.payload_[i] >> 4];
+          buf[n++] = hex_digits[l.payload_[i] & 15];
+        }
+      }
+    }
+    buf[n] = 0;
+  }
+  
+  void writeLog(std::ostream& s);
+
+  /// Read end of the pipe written by ::catch_function to make ::signalDumper dump the log
+  int SignalPipeRead = -1;
+
+  /// Write end of the pipe of ::signalDumper, -1 while the thread is not running
+  std::atomic<int> SignalPipeWrite {-1};
+
+  /// Thread that dumps ::Log, or runs the ::Inspector, for each SIGUSR1 received
+  /** @internal The dump allocates memory and takes locks that the interrupted thread may hold, so it cannot be done by the handler */
+  void signalDumper(int fd)
+  { char c;
+
+    while (true) {
+      const ssize_t n = read(fd, &c, 1);
+      if (n <= 0) {
+        if ((n < 0) && (errno == EINTR)) {
+          continue;
+        }
+        return;
+      }
+      if (Inspector) {
+        // It is the inspector's job to dump the data if it wishes
+        (*Inspector)();
+      } else {
+        std::lock_guard<std::mutex> guard(LogConsumerMutex);
+        writeLog(std::cerr);
+      }
+    }
+  }
+
+  void startSignalDumper() noexcept
+  {
+    if (SignalDumperState.load(std::memory_order_acquire) == 2) {
+      return;
+    }
+    int expected = 0;
+    if (!SignalDumperState.compare_exchange_strong(expected, 1, std::memory_order_acq_rel)) {
+      return;
+    }
+    int fds[2];
+    if (pipe(fds)) {
+      fputs("An error occurred while creating the pipe of the signal handler.\n", stderr);
+    } else {
+      fcntl(fds[0], F_SETFD, FD_CLOEXEC);
+      fcntl(fds[1], F_SETFD, FD_CLOEXEC);
+      fcntl(fds[1], F_SETFL, O_NONBLOCK);
+      try {
+        std::thread(signalDumper, fds[0]).detach();
+        SignalPipeRead = fds[0];
+        SignalPipeWrite.store(fds[1], std::memory_order_release);
+      } catch (const std::system_error&) {
+        close(fds[0]);
+        close(fds[1]);
+      }
+    }
+    SignalDumperState.store(2, std::memory_order_release);
+  }
+
+  /// Forgets in the child of a fork the ::signalDumper, which only exists in the parent, so that it is started again
+  void signalDumperAfterFork()
+  {
+    const int fd = SignalPipeWrite.exchange(-1, std::memory_order_relaxed);
+    if (fd >= 0) {
+      close(fd);
+      close(SignalPipeRead);
+      SignalPipeRead = -1;
+    }
+    SignalDumperState.store(0, std::memory_order_relaxed);
+  }
+
+  /// Makes ::signalDumper dump ::Log when a SIGUSR1 is received
+  /** @internal Only async-signal-safe calls are made. The signal is ignored before the dumper is started, as there is
+   *  nothing logged nor an ::Inspector, and when the pipe is full, as dumps are already pending */
+  void catch_function(int)
+  {
+    const int fd = SignalPipeWrite.load(std::memory_order_acquire);
+    if (fd >= 0) {
+      const int saved_errno = errno;
+      const char c = 0;
+      if (write(fd, &c, 1) < 0) {
+        // Nothing can be done in the handler
+      }
+      errno = saved_errno;
+    }
+  }
+  
+  /// Contains code to be run statically at program initialization
+  struct RunThisStatically {
+    RunThisStatically() {
+      Inspector = nullptr;
+      pthread_atfork(nullptr, nullptr, signalDumperAfterFork);
+      if (signal(SIGUSR1, catch_function) == SIG_ERR) {
+        fputs("An error occurred while setting a signal handler.\n", stderr);
+      }
+      const char * const categories = getenv("THREADINSTRUMENT_CATEGORIES");
+      if (categories != nullptr) {
+        setCategories(strtoull(categories, nullptr, 0));
+      }
+      const char * const budget = getenv("THREADINSTRUMENT_MEMORY_BUDGET");
+      if (budget != nullptr) {
+        MemoryBudget = static_cast<std::size_t>(strtoull(budget, nullptr, 0));
+      }
+    }
+  };
+  
+  const RunThisStatically __A__;
+  
+  /// Registry of the events named by strings
+  /** @internal Lookups are lock-free. The names are found by their contents in a hash table whose
+   *  buckets are chains of nodes that are published with atomic pointers and never removed, and the
+   *  name of each event number is found in a segmented array whose segments never move. Insertions,
+   *  which only happen once per name, are serialized so that the event numbers are consecutive.
+   */
+  class SafeEventCollector {
+
+    struct Node {
+      const char * const name_;   ///< Copy of the name owned by the collector
+      const std::size_t hash_;
+      const int num_;
+      Node * const next_;
+
+      Node(const char *name, std::size_t hash, int num, Node *next) noexcept
+      : name_(name), hash_(hash), num_(num), next_(next)
+      { }
+    };
+
+    static constexpr unsigned NBuckets = 1024;
+
+    /// Size of the first segment of ::names_. Each following segment doubles the size of the previous one
+    static constexpr unsigned FirstSegmentSize = 64;
+
+    static constexpr unsigned NSegments = 26;
+
+    std::atomic<Node *> buckets_[NBuckets];
+    const char **names_[NSegments];           ///< Segments of the array that associates each event number to its name
+    std::atomic<unsigned> size_;              ///< Number of events registered, published after their name
+    std::mutex insertionMutex_;
+
+    /// FNV-1a hash of a string
+    static std::size_t hash(const char *name) noexcept
+    { std::uint64_t h = 14695981039346656037ULL;
+
+      for (; *name; ++name) {
+        h = (h ^ static_cast<unsigned char>(*name)) * 1099511628211ULL;
+      }
+      return static_cast<std::size_t>(h);
+    }
+
+    /// Finds \c name in the chain that begins at \c node. Returns -1 if it is not found
+    static int find(const Node *node, const char *name, std::size_t h) noexcept
+    {
+      for (; node != nullptr; node = node->next_) {
+        if ((node->hash_ == h) && !strcmp(node->name_, name)) {
+          return node->num_;
+        }
+      }
+      return -1;
+    }
+
+    /// Position of the name of \c event in ::names_ as a segment and an offset in it
+    static void segmentOf(unsigned event, unsigned& segment, unsigned& offset) noexcept
+    {
+      const unsigned pos = event + FirstSegmentSize;
+      const unsigned log2_pos = 31 - __builtin_clz(pos);
+      segment = log2_pos - 6; // FirstSegmentSize = 2^6
+      offset = pos - (1u << log2_pos);
+    }
+
+  public:
+
+    SafeEventCollector() noexcept :
+    size_(0)
+    {
+      static_assert(FirstSegmentSize == (1u << 6), "segmentOf assumes FirstSegmentSize = 2^6");
+      for (unsigned i = 0; i < NBuckets; ++i) {
+        buckets_[i].store(nullptr, std::memory_order_relaxed);
+      }
+      for (unsigned i = 0; i < NSegments; ++i) {
+        names_[i] = nullptr;
+      }
+    }
+
+    ~SafeEventCollector()
+    {
+      for (unsigned i = 0; i < NBuckets; ++i) {
+        for (Node *node = buckets_[i].load(std::memory_order_relaxed); node != nullptr; ) {
+          Node * const next = node->next_;
+          free(const_cast<char *>(node->name_));
+          delete node;
+          node = next;
+        }
+      }
+      for (unsigned i = 0; i < NSegments; ++i) {
+        delete [] names_[i];
+      }
+    }
+
+    /// Registers the event if not registered and returns its code
+    int registerEvent(const char *name)
+    {
+      const std::size_t h = hash(name);
+      std::atomic<Node *>& bucket = buckets_[h % NBuckets];
+
+      int num = find(bucket.load(std::memory_order_acquire), name, h);
+      if (num >= 0) {
+        return num;
+      }
+
+      std::lock_guard<std::mutex> guard(insertionMutex_);
+
+      Node * const head = bucket.load(std::memory_order_acquire);
+      num = find(head, name, h); // another thread may have inserted the name after the lock-free lookup
+      if (num >= 0) {
+        return num;
+      }
+
+      const unsigned event = size_.load(std::memory_order_relaxed);
+      unsigned segment, offset;
+      segmentOf(event, segment, offset);
+      if (segment >= NSegments) {
+        std::cerr << "Too many events registered in ThreadInstrument\n";
+        exit(EXIT_FAILURE);
+      }
+      if (names_[segment] == nullptr) {
+        names_[segment] = new const char*[FirstSegmentSize << segment];
+        RegistryBytes.fetch_add((FirstSegmentSize << segment) * sizeof(const char *), std::memory_order_relaxed);
+      }
+
+      const char * const name_copy = strdup(name);
+      if (name_copy == nullptr) {
+        throw std::bad_alloc();
+      }
+      names_[segment][offset] = name_copy;
+      num = static_cast<int>(event);
+      bucket.store(new Node(name_copy, h, num, head), std::memory_order_release);
+      RegistryBytes.fetch_add(sizeof(Node) + strlen(name_copy) + 1, std::memory_order_relaxed);
+      size_.store(event + 1, std::memory_order_release);
+
+      return num;
+    }
+
+    /// Applies \c f to each pair (name, number) registered
+    template<typename F>
+    void forEachName(F&& f)
+    {
+      const unsigned n = size();
+      for (unsigned i = 0; i < n; ++i) {
+        f(name(i), static_cast<int>(i));
+      }
+    }
+
+    /// Number of events registered
+    unsigned size() const noexcept
+    {
+      return size_.load(std::memory_order_acquire);
+    }
+
+    /// Get the string associated to an event number
+    const char *name(unsigned event) const noexcept
+    { unsigned segment, offset;
+
+      if (event >= size()) {
+        return nullptr;
+      }
+
+      segmentOf(event, segment, offset);
+      return names_[segment][offset];
+    }
+
+  };
+
+  /// Entry of the per-thread cache of event numbers indexed by the address of their names
+  struct EventNameCacheEntry {
+    const char *key_;   ///< Address provided by the user
+    const char *name_;  ///< Copy of the name kept by the SafeEventCollector, whose contents validate the entry
+    int num_;
+  };
+
+  constexpr unsigned EventNameCacheSize = 64;
+
+  /// Content-checked cache of the event numbers of the names recently used by the thread
+  /** @internal The entries are found by the address of the name, but a buffer may be reused with different
+   *  contents at the same address, so a hit is only accepted after comparing its contents with those of
+   *  ::EventNameCacheEntry::name_. This avoids hashing the name and walking the chains of the SafeEventCollector */
+  thread_local EventNameCacheEntry EventNameCache[EventNameCacheSize];
+
+  SafeEventCollector& TheSafeEventCollector()
+  { static SafeEventCollector SEC;
     
-    const unsigned id_;   ///< # of the thread associated
-    ThreadInstrument::Int2EventDataMap_t int2EventDataMap_;
+    return SEC;
+  }
+  
+  // Used by the event printers provided
+  static const std::string C_Event_Str("Event");
+
+  /// Identification of this process and of its clock stored in the binary logs
+  /** @internal The name of the host is kept in a fixed buffer so that the logs can be written in signal handlers */
+  struct ProcessInfo {
+
+    /// Environment variables that provide the rank of the process, in order of preference
+    static constexpr const char *RankVariables[] = {"THREADINSTRUMENT_RANK", "OMPI_COMM_WORLD_RANK", "PMI_RANK", "PMIX_RANK", "SLURM_PROCID"};
+
+    std::atomic<int> rank_;
+    std::atomic<std::int64_t> clockOffset_;  ///< Nanoseconds to add to the clock of this process to obtain the reference one
+    char host_[256];
+
+    ProcessInfo() noexcept :
+    rank_{-1}, clockOffset_{0}
+    {
+      for (const char *variable : RankVariables) {
+        const char * const env = getenv(variable);
+        if (env != nullptr) {
+          rank_ = atoi(env);
+          break;
+        }
+      }
+
+      if (gethostname(host_, sizeof(host_))) {
+        host_[0] = 0;
+      }
+      host_[sizeof(host_) - 1] = 0;
+    }
+
+    /// Fills the BinaryLogProcess of this process, which comprises all the threads of the log
+    void fill(ThreadInstrument::BinaryLogProcess& process) const noexcept
+    {
+      process.rank_ = rank_.load(std::memory_order_relaxed);
+      process.hostLength_ = static_cast<std::uint32_t>(strlen(host_));
+      process.pid_ = static_cast<std::uint64_t>(getpid());
+      process.startTime_ = TheTickClock.startWallTime();
+      process.clockOffset_ = clockOffset_.load(std::memory_order_relaxed);
+      process.firstThread_ = 0;
+      process.threads_ = 0;
+    }
+
+  };
+
+  constexpr const char *ProcessInfo::RankVariables[];
+
+  ProcessInfo TheProcessInfo;
+
+  /// Buffer of the typed payloads of the records of a ::BinaryLogEvents section being built
+  template<unsigned NRecords>
+  struct BinaryLogPayloadBuffer {
+    unsigned char bytes_[NRecords * ThreadInstrument::LogPayloadSize];
+    std::size_t size_;
+    std::uint32_t count_;
+
+    BinaryLogPayloadBuffer() noexcept :
+    size_(0), count_(0)
+    { }
+
+    /// Fills \c r with the entry \c l of thread \c thread_num, keeping its typed payload, if any. It is async-signal-safe
+    void fill(ThreadInstrument::BinaryLogRecord& r, unsigned thread_num, const LogEvent& l) noexcept
+    {
+      r.time_ = TheTickClock.sinceStart(l.when_);
+      r.thread_ = thread_num;
+      r.event_ = l.event_id_;
+      r.flags_ = l.timed_ ? static_cast<std::uint32_t>(ThreadInstrument::BinaryLogTimed) : 0;
+      if (l.payloadSize_) {
+        r.data_ = size_;
+        r.flags_ |= ThreadInstrument::BinaryLogPayload;
+        r.payloadSize_ = l.payloadSize_;
+        memcpy(bytes_ + size_, l.payload_, l.payloadSize_);
+        size_ += l.payloadSize_;
+        count_++;
+      } else {
+        r.data_ = static_cast<std::uint64_t>(reinterpret_cast<std::uintptr_t>(l.data_));
+        r.payloadSize_ = 0;
+      }
+    }
+
+    void clear() noexcept
+    {
+      size_ = 0;
+      count_ = 0;
+    }
+
+  };
+
+  /// Streams the contents of a binary log (see binary_log.h) to a file descriptor
+  class BinaryLogWriter {
+
+    /// Records accumulated before writing a ::BinaryLogEvents section
+    static constexpr unsigned RecordsPerSection = 2048;
+
+    const int fd_;
+    unsigned nrecords_;
+    ThreadInstrument::BinaryLogRecord records_[RecordsPerSection];
+    BinaryLogPayloadBuffer<RecordsPerSection> payloads_;
+
+    void write(const void *p, size_t n)
+    { const char *cp = static_cast<const char *>(p);
+
+      while (n) {
+        const ssize_t written = ::write(fd_, cp, n);
+        if (written < 0) {
+          if (errno == EINTR) {
+            continue;
+          }
+          perror("ThreadInstrument binary log");
+          return;
+        }
+        cp += written;
+        n -= static_cast<size_t>(written);
+      }
+    }
+
+    void writeSection(ThreadInstrument::BinaryLogSectionKind kind, std::uint32_t count, const void *p, size_t n)
+    {
+      const ThreadInstrument::BinaryLogSectionHeader header {kind, count, n};
+      write(&header, sizeof(header));
+      write(p, n);
+    }
+
+  public:
+
+    explicit BinaryLogWriter(int fd) noexcept :
+    fd_(fd), nrecords_(0)
+    { }
+
+    ~BinaryLogWriter()
+    {
+      flush();
+    }
+
+    void writeFileHeader()
+    {
+      ThreadInstrument::BinaryLogFileHeader header;
+      memcpy(header.magic_, ThreadInstrument::BinaryLogMagic, sizeof(header.magic_));
+      header.version_ = ThreadInstrument::BinaryLogVersion;
+      header.recordSize_ = sizeof(ThreadInstrument::BinaryLogRecord);
+      header.ticksPerSecond_ = TheTickClock.ticksPerSecond();
+      write(&header, sizeof(header));
+      writeProcess();
+    }
+
+    void writeProcess()
+    { ThreadInstrument::BinaryLogProcess process;
+
+      TheProcessInfo.fill(process);
+      const ThreadInstrument::BinaryLogSectionHeader header {ThreadInstrument::BinaryLogProcesses, 1, sizeof(process) + process.hostLength_};
+      write(&header, sizeof(header));
+      write(&process, sizeof(process));
+      write(TheProcessInfo.host_, process.hostLength_);
+    }
+
+    void writeEventNames()
+    { std::string buf;
+      std::uint32_t count = 0;
+
+      TheSafeEventCollector().forEachName([&](const char *name, int event) {
+        const ThreadInstrument::BinaryLogName bn {static_cast<std::uint32_t>(event), static_cast<std::uint32_t>(strlen(name))};
+        buf.append(reinterpret_cast<const char *>(&bn), sizeof(bn));
+        buf.append(name, bn.length_);
+        count++;
+      });
+
+      writeSection(ThreadInstrument::BinaryLogEventNames, count, buf.data(), buf.size());
+    }
+
+    void writeThreads()
+    { std::vector<ThreadInstrument::BinaryLogThread> threads;
+
+      for (auto it = GlobalEventMap.begin(); it != GlobalEventMap.end(); ++it) {
+        threads.push_back({it->second.id_, 0, it->second.systemId_.load(std::memory_order_relaxed)});
+      }
 
-    IdentifiedEventData(unsigned in_id) noexcept
-    : id_(in_id)
-    {}
-    
-  };
+      writeSection(ThreadInstrument::BinaryLogThreads, static_cast<std::uint32_t>(threads.size()), threads.data(), threads.size() * sizeof(ThreadInstrument::BinaryLogThread));
 
-  
-  /// Number of threads that have registered profiling activity
-  std::atomic<unsigned> NProfiledThreads {0};
+      std::string buf;
+      std::uint32_t count = 0;
+      for (auto it = GlobalEventMap.begin(); it != GlobalEventMap.end(); ++it) {
+        const ThreadInstrument::ThreadInfo info = it->second.info();
+        if (isLabeled(info)) {
+          const ThreadInstrument::BinaryLogThreadName btn {info.thread, info.roleIndex, static_cast<std::uint32_t>(info.name.size()), static_cast<std::uint32_t>(info.role.size())};
+          buf.append(reinterpret_cast<const char *>(&btn), sizeof(btn));
+          buf.append(info.name);
+          buf.append(info.role);
+          count++;
+        }
+      }
+      if (count) {
+        writeSection(ThreadInstrument::BinaryLogThreadNames, count, buf.data(), buf.size());
+      }
+    }
 
-  
-  /// Structure that supports a multiple-reader single-writer access protocol
-  struct AccessControl_t {
-    
-    std::atomic<int> readers_;
-    std::atomic<bool> writer_;
-    
-    AccessControl_t() noexcept
-    //: readers_(ATOMIC_VAR_INIT(0)),
-    //  writer_(ATOMIC_VAR_INIT(false)) //Raises warning: braces around scalar initializer
+    void writeRecord(unsigned thread_num, const LogEvent& l)
     {
-      readers_ = ATOMIC_VAR_INIT(0);
-      writer_ = ATOMIC_VAR_INIT(false);
+      payloads_.fill(records_[nrecords_++], thread_num, l);
+      if (nrecords_ == RecordsPerSection) {
+        flush();
+      }
     }
-    
-    ~AccessControl_t()
+
+    /// Writes the records accumulated
+    void flush()
     {
-      assert(readers_ == 0);
-      assert(!writer_);
+      if (nrecords_) {
+        if (payloads_.count_) {
+          writeSection(ThreadInstrument::BinaryLogPayloads, payloads_.count_, payloads_.bytes_, payloads_.size_);
+          payloads_.clear();
+        }
+        writeSection(ThreadInstrument::BinaryLogEvents, nrecords_, records_, nrecords_ * sizeof(ThreadInstrument::BinaryLogRecord));
+        nrecords_ = 0;
+      }
     }
-    
-    void reader_enter() noexcept {
-      do {
-        readers_++;
-        
-        if (writer_) {
-          readers_--;
-          while (writer_); // spin
-        } else {
-          break;
+
+  };
+
+  /// Records accumulated by ::dumpFlightRecorder before writing a ::BinaryLogEvents section
+  constexpr unsigned FlightRecorderSectionRecords = 256;
+
+  /// Buffer of the records written by ::dumpFlightRecorder, which cannot allocate memory
+  ThreadInstrument::BinaryLogRecord FlightRecorderRecords[FlightRecorderSectionRecords];
+
+  /// Buffer of the typed payloads of ::FlightRecorderRecords
+  BinaryLogPayloadBuffer<FlightRecorderSectionRecords> FlightRecorderPayloads;
+
+  /// Taken during ::dumpFlightRecorder, which may run in signal handlers and thus cannot take mutexes
+  std::atomic_flag FlightRecorderDumping = ATOMIC_FLAG_INIT;
+
+  /// File descriptor where the signal handlers installed by ThreadInstrument::installFlightRecorderHandler write
+  int FlightRecorderFd = -1;
+
+  /// Writes to \c fd \c n bytes at \c p using only async-signal-safe functions. Errors are ignored
+  void signalSafeWrite(int fd, const void *p, size_t n) noexcept
+  { const char *cp = static_cast<const char *>(p);
+
+    while (n) {
+      const ssize_t written = ::write(fd, cp, n);
+      if (written < 0) {
+        if (errno == EINTR) {
+          continue;
         }
-      } while (1);
+        return;
+      }
+      cp += written;
+      n -= static_cast<size_t>(written);
     }
-    
-    void reader_exit() noexcept {
-      readers_--;
+  }
+
+  void signalSafeWriteSection(int fd, ThreadInstrument::BinaryLogSectionKind kind, std::uint32_t count, std::uint64_t bytes) noexcept
+  {
+    const ThreadInstrument::BinaryLogSectionHeader header {kind, count, bytes};
+    signalSafeWrite(fd, &header, sizeof(header));
+  }
+
+  /// Writes the entries of the flight recorder to \c fd in binary format without allocating memory nor taking locks
+  /** @internal The records of each thread are written together, as the format only requires that
+   *  the records of each thread are in chronological order */
+  void signalSafeDumpFlightRecorder(int fd) noexcept
+  {
+    ThreadInstrument::BinaryLogFileHeader header;
+    memcpy(header.magic_, ThreadInstrument::BinaryLogMagic, sizeof(header.magic_));
+    header.version_ = ThreadInstrument::BinaryLogVersion;
+    header.recordSize_ = sizeof(ThreadInstrument::BinaryLogRecord);
+    header.ticksPerSecond_ = TheTickClock.ticksPerSecond();
+    signalSafeWrite(fd, &header, sizeof(header));
+
+    ThreadInstrument::BinaryLogProcess process;
+    TheProcessInfo.fill(process);
+    signalSafeWriteSection(fd, ThreadInstrument::BinaryLogProcesses, 1, sizeof(process) + process.hostLength_);
+    signalSafeWrite(fd, &process, sizeof(process));
+    signalSafeWrite(fd, TheProcessInfo.host_, process.hostLength_);
+
+    // The sizes of the sections are computed before writing them
+    SafeEventCollector& collector = TheSafeEventCollector();
+    const unsigned nnames = collector.size();
+    std::uint64_t bytes = 0;
+    for (unsigned i = 0; i < nnames; ++i) {
+      bytes += sizeof(ThreadInstrument::BinaryLogName) + strlen(collector.name(i));
     }
-    
-    void writer_enter() noexcept {
-      while (writer_.exchange(true)); // spin
-      while (readers_); // spin
+    signalSafeWriteSection(fd, ThreadInstrument::BinaryLogEventNames, nnames, bytes);
+    for (unsigned i = 0; i < nnames; ++i) {
+      const char * const name = collector.name(i);
+      const ThreadInstrument::BinaryLogName bn {i, static_cast<std::uint32_t>(strlen(name))};
+      signalSafeWrite(fd, &bn, sizeof(bn));
+      signalSafeWrite(fd, name, bn.length_);
     }
-    
-    void writer_exit() noexcept {
-      writer_ = false;
+
+    // The threads are pushed at the head of ::GlobalEventMap, so all the walks begin at the same node
+    // in order to write exactly the threads counted even if others register meanwhile
+    const auto first_thread = GlobalEventMap.begin();
+    std::uint32_t nthreads = 0;
+    for (auto it = first_thread; it != GlobalEventMap.end(); ++it) {
+      nthreads++;
     }
-    
-  };
+    signalSafeWriteSection(fd, ThreadInstrument::BinaryLogThreads, nthreads, nthreads * sizeof(ThreadInstrument::BinaryLogThread));
+    std::uint32_t nwritten = 0;
+    for (auto it = first_thread; (it != GlobalEventMap.end()) && (nwritten < nthreads); ++it, ++nwritten) {
+      const ThreadInstrument::BinaryLogThread thread {it->second.id_, 0, it->second.systemId_.load(std::memory_order_relaxed)};
+      signalSafeWrite(fd, &thread, sizeof(thread));
+    }
+    // The names of the threads are not dumped, as they cannot be read without taking their locks
 
-  
-  /// Lock-free single-linked list that only supports push at the head and pop either from the head or the bottom
-  ///plus reversals
-  template<typename T>
-  class ConcurrentSList {
-    
-    struct Node {
-      Node * next_;
-      T item_;
+    unsigned nrecords = 0;
+    const auto flush = [fd, &nrecords]() {
+      if (nrecords) {
+        if (FlightRecorderPayloads.count_) {
+          signalSafeWriteSection(fd, ThreadInstrument::BinaryLogPayloads, FlightRecorderPayloads.count_, FlightRecorderPayloads.size_);
+          signalSafeWrite(fd, FlightRecorderPayloads.bytes_, FlightRecorderPayloads.size_);
+          FlightRecorderPayloads.clear();
+        }
+        signalSafeWriteSection(fd, ThreadInstrument::BinaryLogEvents, nrecords, nrecords * sizeof(ThreadInstrument::BinaryLogRecord));
+        signalSafeWrite(fd, FlightRecorderRecords, nrecords * sizeof(ThreadInstrument::BinaryLogRecord));
+        nrecords = 0;
+      }
     };
-    
-    std::atomic<Node*> head_;
-    
-    void push(Node * const newp) noexcept
-    {
-      newp->next_ = head_.load(std::memory_order_relaxed);
-      
-      while(!head_.compare_exchange_weak(newp->next_, newp, std::memory_order_release, std::memory_order_relaxed));
+    nwritten = 0;
+    for (auto it = first_thread; (it != GlobalEventMap.end()) && (nwritten < nthreads); ++it, ++nwritten) {
+      const unsigned thread_num = it->second.id_;
+      it->second.log_.forEachRingEntry([&](const LogEvent& l) {
+        FlightRecorderPayloads.fill(FlightRecorderRecords[nrecords++], thread_num, l);
+        if (nrecords == FlightRecorderSectionRecords) {
+          flush();
+        }
+      });
     }
-    
-  public:
-    
-    class iterator {
+    flush();
+  }
 
-      Node *pos_;
-      
-      void advance() { pos_ = pos_->next_; }
+  /// Handler of the signals set by ThreadInstrument::installFlightRecorderHandler
+  /** @internal errno is restored, as the writes of the dump may change it while the interrupted code relies on it */
+  void flightRecorderHandler(int signal_number)
+  {
+    const int saved_errno = errno;
+    ThreadInstrument::dumpFlightRecorder(FlightRecorderFd);
+    if (signal_number != SIGUSR1) {
+      // The disposition was reset to the default one, which is applied when the handler returns
+      raise(signal_number);
+    }
+    errno = saved_errno;
+  }
 
-    public:
-      
-      iterator(Node *pos = nullptr) noexcept :
-      pos_(pos)
-      { }
-      
-      iterator(const iterator& other) noexcept :
-      pos_(other.pos_)
-      { }
+  /// Background thread that periodically appends the log to a file in binary format
+  class LogFlusher {
 
-      bool operator==(const iterator& other) const noexcept {
-        return pos_ == other.pos_;
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    bool stop_;
+    bool wakeUp_;                                 ///< Whether a flush was requested before the period expires
+    const int fd_;
+    const std::chrono::duration<double> period_;
+    size_t nNamesWritten_;
+    unsigned threadsGenerationWritten_;           ///< Value of ::ThreadsGeneration when the threads were written
+    std::thread thread_;
+
+    void flush()
+    {
+      std::lock_guard<std::mutex> guard(LogConsumerMutex);
+
+      BinaryLogWriter writer(fd_);
+
+      // Names and threads are only written again if they changed
+      const size_t nnames = TheSafeEventCollector().size();
+      if (nnames != nNamesWritten_) {
+        writer.writeEventNames();
+        nNamesWritten_ = nnames;
       }
 
-      bool operator!=(const iterator& other) const noexcept {
-        return pos_ != other.pos_;
+      const unsigned threads_generation = ThreadsGeneration.load(std::memory_order_acquire);
+      if (threads_generation != threadsGenerationWritten_) {
+        writer.writeThreads();
+        threadsGenerationWritten_ = threads_generation;
       }
-      
-      /// Prefix increment
-      iterator& operator++() noexcept {
-        advance();
-        return *this;
+
+      mergeLogs([&](const unsigned thread_num, const LogEvent& l) {
+        writer.writeRecord(thread_num, l);
+      }, 0);
+    }
+
+    void run()
+    {
+      bool stop;
+
+      std::unique_lock<std::mutex> lock(mutex_);
+      do {
+        cv_.wait_for(lock, period_, [this] { return stop_ || wakeUp_; });
+        stop = stop_;
+        wakeUp_ = false;
+        lock.unlock();
+        flush();
+        lock.lock();
+      } while (!stop);
+    }
+
+  public:
+
+    LogFlusher(int fd, double period) :
+    stop_(false), wakeUp_(false), fd_(fd), period_(period), nNamesWritten_(0), threadsGenerationWritten_(0)
+    {
+      BinaryLogWriter(fd_).writeFileHeader();
+      thread_ = std::thread(&LogFlusher::run, this);
+    }
+
+    /// Stops the thread after a final flush
+    ~LogFlusher()
+    {
+      {
+        std::lock_guard<std::mutex> guard(mutex_);
+        stop_ = true;
       }
-      
-      /// Postfix increment
-      iterator operator++(int) noexcept {
-        iterator tmp(*this);
-        advance();
-        return tmp;
+      cv_.notify_one();
+      thread_.join();
+      close(fd_);
+    }
+
+    void wakeUp()
+    {
+      {
+        std::lock_guard<std::mutex> guard(mutex_);
+        wakeUp_ = true;
       }
-      
-      T& operator*() const noexcept {
-        return pos_->item_;
+      cv_.notify_one();
+    }
+
+  };
+
+  /// Protects ::TheLogFlusher
+  std::mutex LogFlusherMutex;
+
+  /// Log flusher running, if any
+  LogFlusher *TheLogFlusher = nullptr;
+
+  void wakeUpLogFlusher()
+  {
+    std::lock_guard<std::mutex> guard(LogFlusherMutex);
+    if (TheLogFlusher != nullptr) {
+      TheLogFlusher->wakeUp();
+    }
+  }
+
+  /// Background thread that periodically publishes the activity statistics in a shared memory segment
+  /** @internal The statistics of the threads are read by means of IdentifiedEventData::tryForEachActivity,
+   *  so that the publisher never waits for the instrumented threads and they only wait for it while it copies
+   *  the statistics of one of them. The layout is described in live_metrics.h */
+  class LiveMetricsPublisher {
+
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    bool stop_;
+    const std::string name_;
+    const std::chrono::duration<double> period_;
+    ThreadInstrument::LiveMetricsHeader *header_;
+    ThreadInstrument::LiveMetricsName *names_;
+    ThreadInstrument::LiveMetricsEntry *entries_;
+    std::vector<ThreadInstrument::LiveMetricsEntry> snapshotEntries_;  ///< Entries of the next version, built outside the update
+    std::vector<ThreadInstrument::LiveMetricsEntry> previousEntries_;  ///< Entries of the last version, kept for the threads that are busy
+    std::vector<ThreadInstrument::LiveMetricsName> snapshotNames_;     ///< Names of the next version, built outside the update
+    std::thread thread_;
+
+    /// Builds in ::snapshotEntries_ and ::snapshotNames_ the next version of the segment, returning its LiveMetricsTruncated flag
+    /** @internal The entries are reserved beforehand, so that no memory is allocated while a thread cannot change its tables.
+     *  The threads whose tables are being changed keep the entries of the last version */
+    std::uint32_t takeSnapshot()
+    { std::vector<int> events;
+      std::uint32_t flags = 0;
+
+      const std::uint32_t max_entries = header_->maxEntries_;
+      previousEntries_.swap(snapshotEntries_);
+      snapshotEntries_.clear();
+      snapshotEntries_.reserve(max_entries);
+      snapshotNames_.clear();
+
+      for (auto it = GlobalEventMap.begin(); it != GlobalEventMap.end(); ++it) {
+        const std::uint32_t thread_num = it->second.id_;
+        const bool read = it->second.tryForEachActivity([&](int activity, const ThreadInstrument::EventData& ed) {
+          if (snapshotEntries_.size() == max_entries) {
+            flags |= ThreadInstrument::LiveMetricsTruncated;
+            return;
+          }
+          snapshotEntries_.emplace_back();
+          ThreadInstrument::LiveMetricsEntry& entry = snapshotEntries_.back();
+          entry.thread_ = thread_num;
+          entry.event_ = activity;
+          entry.invocations_ = ed.invocations;
+          entry.samples_ = ed.samples;
+          entry.depth_ = ed.depth;
+          entry.reserved_ = 0;
+          entry.time_ = ed.time;
+          entry.exclusiveTime_ = ed.exclusiveTime;
+          entry.timeError_ = ed.timeError;
+          entry.minTime_ = ed.minTime;
+          entry.maxTime_ = ed.maxTime;
+          entry.meanTime_ = ed.meanTime;
+          entry.timeStdDev_ = ed.timeStdDev;
+        });
+        if (!read) {
+          for (const ThreadInstrument::LiveMetricsEntry& entry : previousEntries_) {
+            if (entry.thread_ == thread_num) {
+              if (snapshotEntries_.size() == max_entries) {
+                flags |= ThreadInstrument::LiveMetricsTruncated;
+                break;
+              }
+              snapshotEntries_.push_back(entry);
+            }
+          }
+        }
       }
 
-      T* operator->() const noexcept {
-        return &(pos_->item_);
+      for (const ThreadInstrument::LiveMetricsEntry& entry : snapshotEntries_) {
+        events.push_back(entry.event_);
+      }
+      std::sort(events.begin(), events.end());
+      events.erase(std::unique(events.begin(), events.end()), events.end());
+      for (const int event : events) {
+        const char * const name = ThreadInstrument::getEventName(event);
+        if (name == nullptr) {
+          continue;
+        }
+        if (snapshotNames_.size() == header_->maxNames_) {
+          flags |= ThreadInstrument::LiveMetricsTruncated;
+          break;
+        }
+        snapshotNames_.emplace_back();
+        ThreadInstrument::LiveMetricsName& n = snapshotNames_.back();
+        n.event_ = event;
+        n.reserved_ = 0;
+        strncpy(n.name_, name, ThreadInstrument::LiveMetricsNameLength - 1);
+        n.name_[ThreadInstrument::LiveMetricsNameLength - 1] = 0;
       }
 
-    };
-    
-    ConcurrentSList() noexcept :
-    head_{nullptr}
-    { }
-    
-    void push(T&& val) {
-      push(new Node {nullptr, std::move(val) });
+      return flags;
     }
-    
-    void push(const T& val) {
-      pusn(new Node {nullptr, val });
+
+    /// Updates the segment
+    /** @internal The statistics are gathered before the update begins, so that the readers only find it in progress
+     *  while the snapshot is copied to the segment, and not while the threads are walked */
+    void publish(bool stopped)
+    {
+      const std::uint32_t flags = takeSnapshot() | (stopped ? static_cast<std::uint32_t>(ThreadInstrument::LiveMetricsStopped) : 0);
+      const double update_time = TheTickClock.seconds(TheTickClock.sinceStart(now()));
+
+      const std::uint32_t seq = header_->sequence_.load(std::memory_order_relaxed);
+      header_->sequence_.store(seq + 1, std::memory_order_relaxed);
+      std::atomic_thread_fence(std::memory_order_release);
+
+      std::copy(snapshotEntries_.begin(), snapshotEntries_.end(), entries_);
+      std::copy(snapshotNames_.begin(), snapshotNames_.end(), names_);
+      header_->nNames_ = static_cast<std::uint32_t>(snapshotNames_.size());
+      header_->nEntries_ = static_cast<std::uint32_t>(snapshotEntries_.size());
+      header_->nThreads_ = NProfiledThreads;
+      header_->flags_ = flags;
+      header_->updateTime_ = update_time;
+      header_->sequence_.store(seq + 2, std::memory_order_release);
     }
-    
-    size_t unsafe_size() const noexcept {
-      size_t sz = 0;
-      for (Node * p = head_.load(std::memory_order_relaxed); p != nullptr; p = p->next_) {
-        sz++;
+
+    void run()
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      while (!stop_) {
+        lock.unlock();
+        publish(false);
+        lock.lock();
+        cv_.wait_for(lock, period_, [this] { return stop_; });
       }
-      return sz;
     }
-    
-    void clear() noexcept {
-      Node *q;
-      for (Node * p = head_.load(std::memory_order_relaxed); p != nullptr;  p = q) {
-        q = p->next_;
-        delete p;
-      }
-      head_ = nullptr;
+
+  public:
+
+    LiveMetricsPublisher(const std::string& name, void *segment, double period, std::uint32_t max_entries) :
+    stop_(false), name_(name), period_(period)
+    {
+      header_ = static_cast<ThreadInstrument::LiveMetricsHeader *>(segment);
+      names_ = reinterpret_cast<ThreadInstrument::LiveMetricsName *>(header_ + 1);
+      entries_ = reinterpret_cast<ThreadInstrument::LiveMetricsEntry *>(names_ + max_entries);
+
+      memcpy(header_->magic_, ThreadInstrument::LiveMetricsMagic, sizeof(ThreadInstrument::LiveMetricsMagic));
+      header_->version_ = ThreadInstrument::LiveMetricsVersion;
+      header_->headerSize_ = sizeof(ThreadInstrument::LiveMetricsHeader);
+      header_->maxNames_ = max_entries;
+      header_->maxEntries_ = max_entries;
+      header_->segmentSize_ = ThreadInstrument::liveMetricsSegmentSize(max_entries, max_entries);
+      header_->sequence_.store(0, std::memory_order_relaxed);
+      header_->pid_ = getpid();
+      header_->period_ = period;
+
+      thread_ = std::thread(&LiveMetricsPublisher::run, this);
     }
 
-    /// From bottom/end of the list
-    bool try_pop(T& val) noexcept {
-      Node *q, *p = head_.load(std::memory_order_relaxed);
-      
-      if(p == nullptr) {
-        return false;
-      }
-      
-      while (p->next_ != nullptr) {
-        q = p;
-        p = p->next_;
+    /// Stops the thread after a final update and removes the segment
+    /** The processes that have mapped the segment can still read its last version */
+    ~LiveMetricsPublisher()
+    {
+      {
+        std::lock_guard<std::mutex> guard(mutex_);
+        stop_ = true;
       }
-      
-      val = p->item_;
-      
-      if (p == head_) {
-        head_ = nullptr;
-      } else {
-        q->next_ = nullptr;
+      cv_.notify_one();
+      thread_.join();
+      publish(true);
+      munmap(header_, header_->segmentSize_);
+      shm_unlink(name_.c_str());
+    }
+
+  };
+
+  /// Protects ::TheLiveMetricsPublisher
+  std::mutex LiveMetricsMutex;
+
+  /// Live metrics publisher running, if any
+  LiveMetricsPublisher *TheLiveMetricsPublisher = nullptr;
+
+  /// Name of \c activity taken from \c names if it provides it, or from the registered event names otherwise
+  const char *activityName(int activity, const std::string *names) noexcept
+  {
+    return ((names != nullptr) && (!names[activity].empty())) ? names[activity].c_str() : ThreadInstrument::getEventName(activity);
+  }
+
+  /// Number of values reported for each activity by ThreadInstrument::dumpActivityCSV and ThreadInstrument::dumpActivityJSON
+  constexpr unsigned NActivityFields = 18;
+
+  /// Names of the values reported for each activity, which are the columns of the CSV reports after \c event and \c name
+  const char * const ActivityFieldNames[NActivityFields] = {
+    "invocations", "samples", "time", "exclusive_time", "time_error", "min_time", "max_time", "mean_time", "stddev_time",
+    "p50", "p90", "p99", "p99.9", "counted_samples", "cycles", "instructions", "llc_misses", "branch_misses"
+  };
+
+  /// Fills \c values with the values reported for \c ed, those not measured being NaN
+  /** @internal The hardware events are reported per invocation counted */
+  void activityFields(const ThreadInstrument::EventData& ed, bool nested, double *values) noexcept
+  {
+    const double nan = std::numeric_limits<double>::quiet_NaN();
+    const bool timed = ed.samples != 0;
+    const bool histogram = !ed.histogram.empty();
+
+    values[0] = ed.invocations;
+    values[1] = ed.samples;
+    values[2] = ed.time;
+    values[3] = nested ? ed.exclusiveTime : nan;
+    values[4] = ed.timeError;
+    values[5] = timed ? ed.minTime : nan;
+    values[6] = timed ? ed.maxTime : nan;
+    values[7] = timed ? ed.meanTime : nan;
+    values[8] = timed ? ed.timeStdDev : nan;
+    values[9] = histogram ? ed.histogram.percentile(50.0) : nan;
+    values[10] = histogram ? ed.histogram.percentile(90.0) : nan;
+    values[11] = histogram ? ed.histogram.percentile(99.0) : nan;
+    values[12] = histogram ? ed.histogram.percentile(99.9) : nan;
+    values[13] = ed.countedSamples;
+    for (unsigned i = 0; i < ThreadInstrument::NPerfCounters; ++i) {
+      values[14 + i] = (ed.countedSamples && ThreadInstrument::perfCounterAvailable(static_cast<ThreadInstrument::PerfCounter>(i))) ?
+                       static_cast<double>(ed.counters[i]) / ed.countedSamples : nan;
+    }
+  }
+
+  /// Writes \c str in \c s as a CSV field, quoting it if it contains commas, quotes or line breaks
+  void writeCSVField(std::ostream& s, const char *str)
+  {
+    if (strpbrk(str, ",\"\r\n") == nullptr) {
+      s << str;
+      return;
+    }
+    s << '"';
+    for (const char *p = str; *p; ++p) {
+      if (*p == '"') {
+        s << '"';
       }
-      
-      delete p;
-      
-      return true;
+      s << *p;
     }
-    
-    void reverse() noexcept {
-      Node *p = head_.load(std::memory_order_relaxed), *pp1, *pp2;
-      if (p != nullptr) {
-        for(pp1 = p->next_; pp1 != nullptr; pp1 = pp2) {
-          pp2 = pp1->next_;
-          pp1->next_ = p;
-          p = pp1;
-        }
-        (*head_).next_ = nullptr;
-        head_ = p;
+    s << '"';
+  }
+
+  /// Writes \c str in \c s as a JSON string
+  void writeJSONString(std::ostream& s, const char *str)
+  { char buf[8];
+
+    s << '"';
+    for (const char *p = str; *p; ++p) {
+      const unsigned char c = static_cast<unsigned char>(*p);
+      if ((c == '"') || (c == '\\')) {
+        s << '\\' << *p;
+      } else if (c < 0x20) {
+        snprintf(buf, sizeof(buf), "\\u%04x", c);
+        s << buf;
+      } else {
+        s << *p;
       }
     }
-    
-    /// From top/begin of the list
-    bool try_head_pop(T& val) noexcept {
-      Node *p = head_.load(std::memory_order_relaxed);
-      
-      if(p == nullptr) {
-        return false;
+    s << '"';
+  }
+
+  /// Prints and consumes the log in \c s
+  /** @internal Must be called with ::LogConsumerMutex taken */
+  void writeLog(std::ostream& s)
+  { char buf_final[256];
+    char payload_buf[ThreadInstrument::LogFormatterBufferSize + 1];
+
+    const std::map<unsigned, ThreadInstrument::LogPrinter_t>::const_iterator itend = LogPrinters.end();
+
+    // The threads with name or role are listed in comments, which pictureTime ignores
+    for (const ThreadInstrument::ThreadInfo& info : ThreadInstrument::getThreadsInfo()) {
+      if (isLabeled(info)) {
+        sprintf(buf_final, "# Th%3u ", info.thread);
+        s << buf_final << info.label() << '\n';
       }
-      
-      val = p->item_;
-      
-      head_ = p->next_;
-      
-      delete p;
-      
-      return true;
     }
-    
-    iterator begin() const noexcept { return iterator(head_); }
-    iterator end() const noexcept { return iterator(nullptr); }
 
-  };
+    //s << "*** DUMPING ThreadInstrument LOG ***\n";
+    mergeLogs([&](const unsigned thread_num, const LogEvent& l) {
+      if (l.payloadSize_) {
+        const char * const name = ThreadInstrument::getEventName(l.event_id_);
+        formatPayload(l, payload_buf);
+        const int n = sprintf(buf_final, "Th%3u ", thread_num);
+        if (l.timed_) {
+          sprintf(buf_final + n, "%lf ", TheTickClock.seconds(TheTickClock.sinceStart(l.when_)));
+        }
+        s << buf_final;
+        if (name != nullptr) {
+          s << name;
+        } else {
+          s << C_Event_Str << l.event_id_;
+        }
+        s << ' ' << payload_buf << '\n';
+        return;
+      }
 
-  
-  /// Poor man's map based on a ConcurrentSList
-  template<typename Key, typename Val>
-  class ConcurrentSMap {
+      const std::map<unsigned, ThreadInstrument::LogPrinter_t>::const_iterator it = LogPrinters.find(l.event_id_);
+      std::string event_representation = (it != itend) ? ((*it).second)(l.data_) : AllLogPrinter(l.event_id_, l.data_);
 
-    using value_type = typename std::pair<Key, Val>;
-    
-    ConcurrentSList<value_type> storage_;
+      if (l.timed_) {
+        const double when = TheTickClock.seconds(TheTickClock.sinceStart(l.when_));
+        sprintf(buf_final, "Th%3u %lf %s\n", thread_num, when, event_representation.c_str());
+      } else {
+        sprintf(buf_final, "Th%3u %s\n", thread_num, event_representation.c_str());
+      }
 
-  public:
+      s << buf_final;
+    }, LogLimit);
+    //s << "*** END ThreadInstrument LOG ***\n";
+  }
 
-    using iterator = typename ConcurrentSList<value_type>::iterator;
+} // anonymous namespace
 
-    ConcurrentSMap() = default;
-    
-    iterator begin() const noexcept { return storage_.begin(); }
-    iterator end() const noexcept { return storage_.end(); }
-    
-    iterator find(const Key& key) noexcept {
-      iterator it = begin();
-      const iterator it_end = end();
-      while ( (it != it_end) && ((*it).first != key) ) {
-        ++it;
+
+namespace ThreadInstrument {
+
+  EventData& EventData::operator+= (const EventData& other) {
+    time += other.time;
+    exclusiveTime += other.exclusiveTime;
+    timeError = std::sqrt(timeError * timeError + other.timeError * other.timeError);
+    if (other.invocations && (!invocations || (other.lastInvocation > lastInvocation))) {
+      lastInvocation = other.lastInvocation;
+    }
+    invocations += other.invocations;
+    if (other.samples) {
+      if (samples) {
+        // Combination of the means and variances of both sets of samples
+        const double n1 = samples, n2 = other.samples, n = n1 + n2;
+        const double delta = other.meanTime - meanTime;
+        const double variance = (n1 * timeStdDev * timeStdDev + n2 * other.timeStdDev * other.timeStdDev) / n + delta * delta * n1 * n2 / (n * n);
+        meanTime += delta * n2 / n;
+        timeStdDev = std::sqrt(std::max(0.0, variance));
+        minTime = std::min(minTime, other.minTime);
+        maxTime = std::max(maxTime, other.maxTime);
+      } else {
+        minTime = other.minTime;
+        maxTime = other.maxTime;
+        meanTime = other.meanTime;
+        timeStdDev = other.timeStdDev;
       }
-      return it;
     }
-    
-    size_t unsafe_size() const noexcept { return storage_.unsafe_size(); }
-
-    std::pair<iterator, bool> emplace(const Key& key, Val&& val) {
-      storage_.push(value_type(key, std::forward<Val>(val)));
-      return {find(key), true}; // Very inefficient for the general case, but ok here
+    samples += other.samples;
+    depth += other.depth;
+    currentlyRunning = currentlyRunning || other.currentlyRunning;
+    histogram += other.histogram;
+    for (unsigned i = 0; i < NPerfCounters; ++i) {
+      counters[i] += other.counters[i];
     }
-  };
-  
-  /// Stores the event data for each thread (one position per thread)
-  typedef ConcurrentSMap<std::thread::id, IdentifiedEventData> Thr2Ev_t;
-  
-  Thr2Ev_t GlobalEventMap;
+    countedSamples += other.countedSamples;
+    return *this;
+  }
 
-  IdentifiedEventData& GetThreadRawData(const std::thread::id this_id)
-  {
+  constexpr unsigned LatencyHistogram::SubBucketBits;
+  constexpr unsigned LatencyHistogram::NSubBuckets;
+  constexpr unsigned LatencyHistogram::MaxExponent;
+  constexpr unsigned LatencyHistogram::NBuckets;
 
-    auto it = GlobalEventMap.find(this_id);
-    if (it == GlobalEventMap.end()) {
-      auto ins_pair = GlobalEventMap.emplace(this_id, IdentifiedEventData(NProfiledThreads++));
-      assert(ins_pair.second);
-      it = ins_pair.first;
+  unsigned LatencyHistogram::bucket(std::uint64_t value) noexcept
+  {
+    if (value < NSubBuckets) {
+      return static_cast<unsigned>(value);
     }
-    
-    IdentifiedEventData& ret= it->second;
-
-    return ret;
+    const unsigned exponent = 63 - __builtin_clzll(value);
+    if (exponent > MaxExponent) {
+      return NBuckets - 1;
+    }
+    const unsigned shift = exponent - SubBucketBits;
+    return (shift + 1) * NSubBuckets + static_cast<unsigned>(value >> shift) - NSubBuckets;
   }
-  
-  IdentifiedEventData& GetMyThreadRawData()
+
+  double LatencyHistogram::bucketValue(unsigned b) noexcept
   {
-    return GetThreadRawData(std::this_thread::get_id());
+    if (b < NSubBuckets) {
+      return b;
+    }
+    const unsigned shift = b / NSubBuckets - 1;
+    const double low = std::ldexp(static_cast<double>(b % NSubBuckets + NSubBuckets), shift);
+    return low + std::ldexp(0.5, shift) - 0.5;
   }
-  
-  ThreadInstrument::Int2EventDataMap_t& getMyThreadData()
+
+  void LatencyHistogram::assign(const std::uint32_t *counts, double unit)
   {
-    return GetMyThreadRawData().int2EventDataMap_;
+    counts_.assign(counts, counts + NBuckets);
+    unit_ = unit;
+    total_ = 0;
+    for (const std::uint64_t c : counts_) {
+      total_ += c;
+    }
+    if (!total_) {
+      counts_.clear();
+    }
   }
-  
-  ThreadInstrument::Int2EventDataMap_t& getThreadDataByNumber(int id) noexcept
-  { Thr2Ev_t::iterator it;
 
-    for (it = GlobalEventMap.begin(); it != GlobalEventMap.end(); ++it) {
-      if (it->second.id_ == id) {
-        break;
+  double LatencyHistogram::percentile(double p) const noexcept
+  {
+    if (!total_) {
+      return 0.0;
+    }
+    const double target = std::max(1.0, std::ceil(std::min(p, 100.0) / 100.0 * total_));
+    std::uint64_t accumulated = 0;
+    for (unsigned b = 0; b < NBuckets; ++b) {
+      accumulated += counts_[b];
+      if (accumulated >= target) {
+        return bucketValue(b) * unit_;
       }
     }
+    return bucketValue(NBuckets - 1) * unit_;
+  }
 
-    assert(it != GlobalEventMap.end());
-    
-    ThreadInstrument::Int2EventDataMap_t& ret = it->second.int2EventDataMap_;
+  LatencyHistogram& LatencyHistogram::operator+= (const LatencyHistogram& other)
+  {
+    if (other.total_) {
+      if (total_) {
+        for (unsigned b = 0; b < NBuckets; ++b) {
+          counts_[b] += other.counts_[b];
+        }
+        total_ += other.total_;
+      } else {
+        *this = other;
+      }
+    }
+    return *this;
+  }
 
-    return ret;
+  CallPathData& CallPathData::operator+= (const CallPathData& other) noexcept {
+    time += other.time;
+    exclusiveTime += other.exclusiveTime;
+    invocations += other.invocations;
+    return *this;
   }
 
-  /////////////////////////// LOGS ///////////////////////////
+namespace internal {
 
-  /// Records the beginning of the execution of the program
-  const ThreadInstrument::time_point_t StartExecutionTimePoint = ThreadInstrument::clock_t::now();
+  std::atomic<std::uint64_t> EnabledCategories {~std::uint64_t(0)};
 
-  struct LogEvent {
+  void begin_activity_inner(int activity, unsigned category)
+  {
+    IdentifiedEventData& thread_data = GetMyThreadRawData();
+    if (thread_data.clearRequests_.load(std::memory_order_relaxed) != thread_data.clearsApplied_.load(std::memory_order_relaxed)) {
+      thread_data.clear();
+    }
 
-    std::thread::id id_;
-    ThreadInstrument::time_point_t when_;
-    void *data_;
-    unsigned event_id_;
+    RawEventData& ed = thread_data.eventData(activity);
+    const unsigned epoch = CategoryEpochs[category].load(std::memory_order_relaxed);
 
-    LogEvent(ThreadInstrument::time_point_t when, unsigned event_id, void *data) noexcept
-    : id_(std::this_thread::get_id()), when_(when), data_(data), event_id_(event_id)
-    { }
+    ed.seq_.beginWrite();
 
-    LogEvent(unsigned event_id, void *data) noexcept
-    : id_(std::this_thread::get_id()), data_(data), event_id_(event_id)
-    { }
+    if (ed.depth_ && (ed.epoch_ != CategoryEpochs[ed.category_].load(std::memory_order_relaxed))) {
+      // It was running when its category was disabled, so its end may have been disregarded
+      ed.depth_ = 0;
+    }
 
-    LogEvent()
-    {}
+    ed.invocations_++;
+    // Under recursion only the outermost invocation is timed
+    if (!ed.depth_++) {
+      ed.category_ = category;
+      ed.epoch_ = epoch;
+      ed.sampled_ = thread_data.sample(ed, activity);
+    }
 
-  };
+    // The invocations nested in one that is not sampled are not sampled either
+    if (!ed.sampled_) {
+      ed.seq_.endWrite();
+      return;
+    }
 
-  /// Maximum number of log events to dump. By default there is no limit
-  /** @internal Notice that all the event are actually logged; but only the last LogLimit ones are dumped. */
-  unsigned LogLimit = 0;
+    ed.sampledInvocations_++;
+    const ticks_t t = now();
+    if (ed.depth_ == 1) {
+      ed.lastInvocation_ = t;
+      // The counters are read after the clock and before it at the end, so that it is not counted
+      if (PerfCountersEnabled.load(std::memory_order_relaxed)) {
+        ed.startCounting();
+      }
+    }
+    ed.seq_.endWrite();
+
+    if (NestedProfiling.load(std::memory_order_relaxed)) {
+      thread_data.dropStaleFrames();
+      thread_data.beginNested(activity, t, category, epoch);
+    }
+  }
+  
+  void end_activity_inner(int activity)
+  {
+    IdentifiedEventData& thread_data = GetMyThreadRawData();
+    RawEventData * const ed_p = thread_data.findEventData(activity);
 
-  /// Log storage
-  ConcurrentSList<LogEvent> Log;
+    // The activity may have begun while its category was disabled
+    if ((ed_p == nullptr) || !ed_p->depth_) {
+      return;
+    }
 
-  /// Control whether the Log is locked
-  volatile bool Locked_Log = false;
+    RawEventData& ed = *ed_p;
 
-  /// Provides printer for each kind of event
-  std::map<unsigned, ThreadInstrument::LogPrinter_t> LogPrinters;
-  
-  /// User function to run when SIGUSR1 is received
-  void (*Inspector)();
-  
-  /// Generic printer for all events
-  ThreadInstrument::AllLogPrinter_t AllLogPrinter = ThreadInstrument::defaultPrinter;
-  
-  /// Dumps ::Log when a SIGUSR1 is received 
-  void catch_function(int signal)
-  { 
-    //fprintf(stderr, "Signal %d catched by ThreadInstrument\n", signal);
-  
-    if(Inspector) {
-      // It is the inspector's job to dump the data if it wishes
-      (*Inspector)();
+    // The stack is checked even if nested profiling was disabled while this activity was running
+    thread_data.dropStaleFrames();
+
+    ed.seq_.beginWrite();
+
+    if (ed.epoch_ != CategoryEpochs[ed.category_].load(std::memory_order_relaxed)) {
+      ed.depth_ = 0;
+    } else if (!ed.sampled_) {
+      ed.depth_--;
     } else {
-      ThreadInstrument::dumpLog();
+      std::uint64_t counters[NPerfCounters];
+      PerfCounts * const perf = ((ed.depth_ == 1) && ed.perf_ && ed.perf_->counting_) ? ed.perf_.get() : nullptr;
+      if (perf != nullptr) {
+        MyPerfCounters.read(counters);
+      }
+
+      const ticks_t t = now();
+
+      if (!thread_data.activityStack_.empty() && (thread_data.activityStack_.back().activity_ == activity)) {
+        ed.exclusiveTime_ += thread_data.endNested(t);
+      }
+
+      if (!--ed.depth_) {
+        ed.addSample(t - ed.lastInvocation_, Histograms.load(std::memory_order_relaxed));
+        ed.lastInvocation_ = t;
+        if (perf != nullptr) {
+          perf->stop(counters);
+        }
+      }
     }
+
+    ed.seq_.endWrite();
   }
-  
-  /// Contains code to be run statically at program initialization
-  struct RunThisStatically {
-    RunThisStatically() {
-      Inspector = nullptr;
-      if (signal(SIGUSR1, catch_function) == SIG_ERR) {
-	fputs("An error occurred while setting a signal handler.\n", stderr);
+
+  void lane_activity_inner(unsigned lane, int activity, std::int64_t ns, bool begin)
+  {
+    std::lock_guard<std::mutex> guard(LanesMutex);
+    Lane& l = getLane(lane);
+    IdentifiedEventData& lane_data = *l.data_;
+
+    // The moments older than those already recorded are delayed, so that the log of the lane is chronological
+    const ticks_t t = std::max(l.last_, TheTickClock.fromWallTime(ns + l.clockOffset_));
+    l.last_ = t;
+
+    UpdatedLaneData = &lane_data;
+    if (lane_data.clearPending()) {
+      lane_data.clear();
+    }
+
+    RawEventData& ed = lane_data.eventData(activity);
+    ed.seq_.beginWrite();
+    if (begin) {
+      ed.invocations_++;
+      ed.sampledInvocations_++;
+      if (!ed.depth_++) {
+        ed.lastInvocation_ = t;
       }
+    } else if (ed.depth_ && !--ed.depth_) {
+      ed.addSample(t - ed.lastInvocation_, Histograms.load(std::memory_order_relaxed));
+      ed.lastInvocation_ = t;
     }
-  };
-  
-  const RunThisStatically __A__;
+    ed.seq_.endWrite();
+    UpdatedLaneData = nullptr;
+
+    // As ::THREADINSTRUMENT_TIMED_LOG, so that the activity is shown as the beginning and the end of a slice
+    if (!Locked_Log) {
+      lane_data.log_.push(LogEvent(t, static_cast<unsigned>(activity), reinterpret_cast<void *>(static_cast<std::intptr_t>(begin ? 0 : 1)), true));
+    }
+  }
+
+}; // internal
+
+  unsigned nThreadsWithActivity() noexcept
+  {
+    return GlobalEventMap.unsafe_size();
+  }
   
-  /// Collects and numbers event names in a thread safe way
-  /// \internal the names are not copied, thus the object does not ownn them
-  class SafeEventCollector {
-    
-    struct ltstr {
-      bool operator()(const char* s1, const char* s2) const noexcept
-      {
-        return strcmp(s1, s2) < 0;
-      }
-    };
-    
-    AccessControl_t access_control_;  ///< Controls parallel accesses to the map
-    std::map<const char *, int, ltstr> eventNames_;
-    
-  public:
-    
-    SafeEventCollector() = default;
-    
-    /// Registers the event if not registered and returns its code
-    int registerEvent(const char *name)
-    { int num;
-      
-      access_control_.reader_enter();
+  unsigned getMyThreadNumber()
+  {
+    return GetMyThreadRawData().id_;
+  }
 
-      auto it = eventNames_.find(name);
-      const bool found = (it != eventNames_.end());
-      
-      access_control_.reader_exit();
+  void setThreadName(const std::string& name)
+  {
+    IdentifiedEventData& thread_data = GetMyThreadRawData();
+    {
+      std::lock_guard<std::mutex> guard(thread_data.structureMutex_);
+      thread_data.name_ = name;
+    }
+    ThreadsGeneration.fetch_add(1, std::memory_order_release);
+  }
 
-      if (found) {
-        num = it->second;
-      } else {
-        access_control_.writer_enter();
-        it = eventNames_.find(name); // may be the name was inserted in the meantime
-        if(it != eventNames_.end()) {
-          num = it->second;
-        } else {
-          num = eventNames_.size();
-          eventNames_.insert({name, num});
-        }
-        access_control_.writer_exit();
-      }
-      //fprintf(stderr, "%s->%d %p\n", name, num);
-      return num;
+  void setThreadRole(const std::string& role, int index)
+  {
+    index = roleIndex(role, index);
+
+    IdentifiedEventData& thread_data = GetMyThreadRawData();
+    {
+      std::lock_guard<std::mutex> guard(thread_data.structureMutex_);
+      thread_data.role_ = role;
+      thread_data.roleIndex_ = index;
     }
+    ThreadsGeneration.fetch_add(1, std::memory_order_release);
+  }
 
-    /// Get the string associated to an event number
-    const char *name(unsigned event) const noexcept
+  unsigned createLane(const std::string& name, const std::string& role, int index)
+  {
+    const int role_index = role.empty() ? -1 : roleIndex(role, index);
+
+    std::lock_guard<std::mutex> guard(LanesMutex);
+    // No thread has the default std::thread::id, and emplace finds the node just pushed because the lanes are added under the mutex
+    auto ins_pair = GlobalEventMap.emplace(std::thread::id(), IdentifiedEventData(NProfiledThreads++, 0, std::thread::id()));
+    IdentifiedEventData& lane_data = ins_pair.first->second;
+    RegistryBytes.fetch_add(sizeof(std::pair<std::thread::id, IdentifiedEventData>) + sizeof(void *) + sizeof(std::pair<const unsigned, Lane>),
+                            std::memory_order_relaxed);
     {
-      for(const auto& pairs : eventNames_) {
-        if (pairs.second == event) {
-          return pairs.first;
-        }
-      }
-      
-      return nullptr;
+      std::lock_guard<std::mutex> structure_guard(lane_data.structureMutex_);
+      lane_data.name_ = name;
+      lane_data.role_ = role;
+      lane_data.roleIndex_ = role_index;
     }
+    Lanes.emplace(lane_data.id_, Lane(&lane_data));
+    ThreadsGeneration.fetch_add(1, std::memory_order_release);
 
-  };
+    return lane_data.id_;
+  }
+
+  void setLaneClockOffset(unsigned lane, std::int64_t ns)
+  {
+    std::lock_guard<std::mutex> guard(LanesMutex);
+    getLane(lane).clockOffset_ = ns;
+  }
+
+  std::string ThreadInfo::label() const
+  {
+    if (!name.empty()) {
+      return name;
+    }
+    if (!role.empty()) {
+      return role + '.' + std::to_string(roleIndex);
+    }
+    return 'T' + std::to_string(thread);
+  }
+
+  std::vector<ThreadInfo> getThreadsInfo()
+  { std::vector<ThreadInfo> threads;
+
+    for (auto it = GlobalEventMap.begin(); it != GlobalEventMap.end(); ++it) {
+      threads.push_back(it->second.info());
+    }
+    std::sort(threads.begin(), threads.end(), threadInfoBefore);
+
+    return threads;
+  }
   
-  SafeEventCollector& TheSafeEventCollector()
-  { static SafeEventCollector SEC;
-    
-    return SEC;
+  Int2EventDataMap_t getActivity(unsigned n)
+  {
+    assert(n < nThreadsWithActivity());
+    return getThreadDataByNumber(n).activityView();
   }
   
-  // Used by the event printers provided
-  static const std::string C_Event_Str("Event");
+  Int2EventDataMap_t getAllActivity()
+  {
+    Int2EventDataMap_t m;
 
-} // anonymous namespace
+    for (Thr2Ev_t::iterator it = GlobalEventMap.begin(); it != GlobalEventMap.end(); ++it) {
+      it->second.forEachActivity([&m](int activity, const EventData& ed) { m[activity] += ed; });
+    }
 
+    std::lock_guard<std::mutex> guard(ExitedMutex);
+    for (const auto& activity_data : ExitedActivity) {
+      m[activity_data.first] += activity_data.second;
+    }
 
-namespace ThreadInstrument {
+    return m;
+  }
+  
+  void clearAllActivity() noexcept
+  {
+    for (Thr2Ev_t::iterator it = GlobalEventMap.begin(); it != GlobalEventMap.end(); ++it) {
+      clearThreadData(it->second);
+    }
+
+    std::lock_guard<std::mutex> guard(ExitedMutex);
+    ExitedActivity.clear();
+    ExitedCallPaths.clear();
+  }
 
-  EventData& EventData::operator+= (const EventData& other) noexcept {
-    time += other.time;
-    invocations += other.invocations;
-    currentlyRunning = currentlyRunning || other.currentlyRunning;
-    return *this;
+  void clearActivity(unsigned n)
+  {
+    assert(n < nThreadsWithActivity());
+    clearThreadData(getThreadDataByNumber(n));
   }
 
-namespace internal {
+  void enableCategory(Category c, bool enable) noexcept
+  {
+    if (c.id >= NCategories) {
+      return;
+    }
+    const std::uint64_t bit = std::uint64_t(1) << c.id;
+    if (enable) {
+      internal::EnabledCategories.fetch_or(bit, std::memory_order_relaxed);
+    } else {
+      categoriesDisabled(internal::EnabledCategories.fetch_and(~bit, std::memory_order_relaxed) & bit);
+    }
+  }
 
-  void begin_activity_inner(int activity)
+  void setEnabledCategories(std::uint64_t mask) noexcept
   {
-    Int2EventDataMap_t& m = getMyThreadData();
-    EventData& ed = m[activity];
-    
-    assert(!ed.currentlyRunning);
-    
-    ed.invocations++;
-    ed.lastInvocation = clock_t::now();
-    ed.currentlyRunning = true;
+    setCategories(mask);
   }
-  
-  void end_activity_inner(int activity)
+
+  std::uint64_t enabledCategories() noexcept
   {
-    const auto t = clock_t::now();
-    Int2EventDataMap_t& m = getMyThreadData();
-    Int2EventDataMap_t::iterator it = m.find(activity);
-    assert(it != m.end());
-    EventData& ed = (*it).second;
-    
-    assert(ed.currentlyRunning);
-    
-    ed.time += std::chrono::duration<double>(t - ed.lastInvocation).count();
-    ed.lastInvocation = t;
-    ed.currentlyRunning = false;
+    return internal::EnabledCategories.load(std::memory_order_relaxed);
   }
 
-}; // internal
+  void toggleCategoriesOnSignal(int signum)
+  {
+    if (signal(signum, toggle_categories) == SIG_ERR) {
+      fputs("An error occurred while setting a signal handler.\n", stderr);
+    }
+  }
 
-  unsigned nThreadsWithActivity() noexcept
+  void setSampling(int event, unsigned period)
   {
-    return GlobalEventMap.unsafe_size();
+    std::lock_guard<std::mutex> guard(SamplingMutex);
+    if (period > 1) {
+      SamplingPeriods[event] = std::min(period, 1u << 30);
+      LogSampling = true;
+    } else {
+      SamplingPeriods.erase(event);
+      LogSampling = !SamplingPeriods.empty();
+    }
+    SamplingVersion.fetch_add(1, std::memory_order_release);
   }
-  
-  unsigned getMyThreadNumber()
+
+  void setSampling(const char *event, unsigned period)
   {
-    return GetMyThreadRawData().id_;
+    setSampling(getEventNumber(event), period);
   }
-  
-  Int2EventDataMap_t& getActivity(unsigned n)
+
+  void enableNestedProfiling(bool enable) noexcept
   {
-    assert(n < nThreadsWithActivity());
-    return getThreadDataByNumber(n);
+    NestedProfiling = enable;
   }
-  
-  Int2EventDataMap_t getAllActivity()
+
+  bool enablePerfCounters(bool enable) noexcept
   {
-    const unsigned n = nThreadsWithActivity();
-    if(!n) return Int2EventDataMap_t();
-    
-    Int2EventDataMap_t m(getThreadDataByNumber(0));
-    
-    for(unsigned i = 1; i < n; ++i) {
-      const Int2EventDataMap_t& m2 = getThreadDataByNumber(i);
-      Int2EventDataMap_t::const_iterator itend = m2.end();
-      for(Int2EventDataMap_t::const_iterator it = m2.begin(); it != itend; ++it) {
-	EventData& r = m[(*it).first];
-	r += (*it).second;
-      }
+    if (enable) {
+      // The generation is published after the mask, so that the threads that see it open the counters in the mask
+      const unsigned generation = PerfCountersGeneration.load(std::memory_order_relaxed) + 1;
+      const unsigned mask = MyPerfCounters.open((1u << NPerfCounters) - 1, generation);
+      PerfCountersMask.store(mask, std::memory_order_relaxed);
+      PerfCountersGeneration.store(generation, std::memory_order_release);
+      enable = (mask != 0);
     }
+    PerfCountersEnabled = enable;
+    return enable;
+  }
 
-    return m;
+  bool perfCounterAvailable(PerfCounter c) noexcept
+  {
+    return (PerfCountersMask.load(std::memory_order_relaxed) >> c) & 1;
   }
-  
-  void clearAllActivity() noexcept
+
+  void enableHistograms(bool enable) noexcept
   {
+    Histograms = enable;
+  }
+
+  CallPath2DataMap_t getCallPaths(unsigned n)
+  { CallPath2DataMap_t m;
+
+    assert(n < nThreadsWithActivity());
+    getThreadDataByNumber(n).addCallPaths(m);
+    return m;
+  }
+
+  CallPath2DataMap_t getAllCallPaths()
+  { CallPath2DataMap_t m;
+
     for (Thr2Ev_t::iterator it = GlobalEventMap.begin(); it != GlobalEventMap.end(); ++it) {
-      it->second.int2EventDataMap_.clear();
+      it->second.addCallPaths(m);
+    }
+
+    std::lock_guard<std::mutex> guard(ExitedMutex);
+    for (const auto& path_data : ExitedCallPaths) {
+      m[path_data.first] += path_data.second;
     }
+    return m;
   }
 
   void dumpActivity(const Int2EventDataMap_t& m, const std::string *names, std::ostream& s)
-  { char buf_final[256];
+  { char buf_final[320], buf_exclusive[64], buf_sampled[64], buf_counter[64];
 
+    const bool nested = NestedProfiling;
     const Int2EventDataMap_t::const_iterator itend = m.end();
     for(Int2EventDataMap_t::const_iterator it = m.begin(); it != itend; ++it) {
       int activity = (*it).first;
-      const char * const activity_name = ((names != nullptr) && (!names[activity].empty())) ? names[activity].c_str() : getEventName(activity);
+      const char * const activity_name = activityName(activity, names);
+      if (nested)
+        sprintf(buf_exclusive, " (%lf exclusive)", (*it).second.exclusiveTime);
+      else
+        buf_exclusive[0] = 0;
+      if ((*it).second.timeError > 0.0)
+        sprintf(buf_sampled, " (%u sampled, error %lf seconds)", (*it).second.samples, (*it).second.timeError);
+      else
+        buf_sampled[0] = 0;
       if(activity_name != nullptr)
-	sprintf(buf_final, "Event %16s : %lf seconds %u invocations\n", activity_name, (*it).second.time, (*it).second.invocations);
+	sprintf(buf_final, "Event %16s : %lf seconds%s %u invocations%s\n", activity_name, (*it).second.time, buf_exclusive, (*it).second.invocations, buf_sampled);
+      else
+	sprintf(buf_final, "Event %u : %lf seconds%s %u invocations%s\n", activity, (*it).second.time, buf_exclusive, (*it).second.invocations, buf_sampled);
+      s << buf_final;
+      const EventData& ed = (*it).second;
+      if (!ed.histogram.empty()) {
+        sprintf(buf_final, "      min %lf max %lf mean %lf stddev %lf p50 %lf p90 %lf p99 %lf p99.9 %lf\n",
+                ed.minTime, ed.maxTime, ed.meanTime, ed.timeStdDev,
+                ed.histogram.percentile(50.0), ed.histogram.percentile(90.0), ed.histogram.percentile(99.0), ed.histogram.percentile(99.9));
+        s << buf_final;
+      }
+      if (ed.countedSamples) {
+        const double n = ed.countedSamples;
+        buf_final[0] = 0;
+        if (perfCounterAvailable(PerfCycles) && perfCounterAvailable(PerfInstructions)) {
+          snprintf(buf_counter, sizeof(buf_counter), " IPC %.3lf", ed.counters[PerfCycles] ? static_cast<double>(ed.counters[PerfInstructions]) / ed.counters[PerfCycles] : 0.0);
+          strcat(buf_final, buf_counter);
+        }
+        static const char * const CounterNames[NPerfCounters] = {"cycles", "instructions", "LLC misses", "branch misses"};
+        for (unsigned i = 0; i < NPerfCounters; ++i) {
+          if (perfCounterAvailable(static_cast<PerfCounter>(i))) {
+            snprintf(buf_counter, sizeof(buf_counter), " %.1lf %s", ed.counters[i] / n, CounterNames[i]);
+            strcat(buf_final, buf_counter);
+          }
+        }
+        s << "     " << buf_final << " per invocation (" << ed.countedSamples << " counted)\n";
+      }
+    }
+  }
+
+  void dumpCallPaths(const CallPath2DataMap_t& m, const std::string *names, std::ostream& s)
+  { char buf_final[256];
+
+    for (const auto& path_data : m) {
+      const CallPath_t& path = path_data.first;
+      const CallPathData& data = path_data.second;
+      const int activity = path.back();
+      const int indent = 2 * static_cast<int>(path.size() - 1);
+      const char * const activity_name = activityName(activity, names);
+      if (activity_name != nullptr)
+        snprintf(buf_final, sizeof(buf_final), "%*s%s : %lf seconds (%lf exclusive) %u invocations\n", indent, "", activity_name, data.time, data.exclusiveTime, data.invocations);
       else
-	sprintf(buf_final, "Event %u : %lf seconds %u invocations\n", activity, (*it).second.time, (*it).second.invocations);
+        snprintf(buf_final, sizeof(buf_final), "%*sEvent %d : %lf seconds (%lf exclusive) %u invocations\n", indent, "", activity, data.time, data.exclusiveTime, data.invocations);
       s << buf_final;
     }
   }
 
+  void dumpThreadsActivity(std::ostream& s)
+  {
+    for (const ThreadInfo& info : getThreadsInfo()) {
+      Int2EventDataMap_t m;
+      getThreadDataByNumber(info.thread).forEachActivity([&m](int activity, const EventData& ed) { m[activity] += ed; });
+      if (!m.empty()) {
+        s << "Thread " << info.label() << " (" << info.thread << ")\n";
+        dumpActivity(m, nullptr, s);
+      }
+    }
+  }
+
   void dumpActivity(const Int2EventDataMap_t& m, const std::string *names, const std::string& filename)
   {
     std::ofstream outfile(filename.c_str(), std::ios_base::out | std::ios_base::app);
     dumpActivity(m, names, outfile);
     outfile.close();
   }
+
+  void dumpActivityCSV(const Int2EventDataMap_t& m, const std::string *names, std::ostream& s)
+  { double values[NActivityFields];
+    char buf[32];
+
+    s << "event,name";
+    for (const char * const field : ActivityFieldNames) {
+      s << ',' << field;
+    }
+    s << '\n';
+
+    const bool nested = NestedProfiling;
+    for (const auto& activity_data : m) {
+      const char * const activity_name = activityName(activity_data.first, names);
+      s << activity_data.first << ',';
+      writeCSVField(s, (activity_name != nullptr) ? activity_name : (C_Event_Str + std::to_string(activity_data.first)).c_str());
+      activityFields(activity_data.second, nested, values);
+      for (const double value : values) {
+        s << ',';
+        if (!std::isnan(value)) {
+          snprintf(buf, sizeof(buf), "%.10g", value);
+          s << buf;
+        }
+      }
+      s << '\n';
+    }
+  }
+
+  void dumpActivityCSV(const Int2EventDataMap_t& m, const std::string *names, const std::string& filename)
+  {
+    std::ofstream outfile(filename.c_str());
+    dumpActivityCSV(m, names, outfile);
+  }
+
+  void dumpActivityJSON(const Int2EventDataMap_t& m, const std::string *names, std::ostream& s)
+  { double values[NActivityFields];
+    char buf[32];
+
+    s << "{\"activities\":[";
+
+    const bool nested = NestedProfiling;
+    const char *separator = "\n";
+    for (const auto& activity_data : m) {
+      const char * const activity_name = activityName(activity_data.first, names);
+      s << separator << "{\"event\":" << activity_data.first << ",\"name\":";
+      writeJSONString(s, (activity_name != nullptr) ? activity_name : (C_Event_Str + std::to_string(activity_data.first)).c_str());
+      activityFields(activity_data.second, nested, values);
+      for (unsigned i = 0; i < NActivityFields; ++i) {
+        s << ",\"" << ActivityFieldNames[i] << "\":";
+        if (std::isnan(values[i])) {
+          s << "null";
+        } else {
+          snprintf(buf, sizeof(buf), "%.10g", values[i]);
+          s << buf;
+        }
+      }
+      s << '}';
+      separator = ",\n";
+    }
+
+    s << "\n]}\n";
+  }
+
+  void dumpActivityJSON(const Int2EventDataMap_t& m, const std::string *names, const std::string& filename)
+  {
+    std::ofstream outfile(filename.c_str());
+    dumpActivityJSON(m, names, outfile);
+  }
   
   int getEventNumber(const char *event)
   {
-    return TheSafeEventCollector().registerEvent(event);
+    const std::uintptr_t addr = reinterpret_cast<std::uintptr_t>(event);
+    EventNameCacheEntry& entry = EventNameCache[(addr ^ (addr >> 6)) % EventNameCacheSize];
+
+    if ((entry.key_ == event) && !strcmp(entry.name_, event)) {
+      return entry.num_;
+    }
+
+    const int num = TheSafeEventCollector().registerEvent(event);
+    entry.key_ = event;
+    entry.name_ = TheSafeEventCollector().name(num);
+    entry.num_ = num;
+    return num;
   }
   
   const char *getEventName(const int event) noexcept
@@ -589,83 +4030,239 @@ namespace internal {
   void log_inner(unsigned event, void *data)
   {
     if (!Locked_Log) {
-      Log.push(LogEvent(event, data));
+      IdentifiedEventData& thread_data = GetMyThreadRawData();
+      if (thread_data.sampleLog(event, reinterpret_cast<std::intptr_t>(data))) {
+        thread_data.log_.push(LogEvent(now(), event, data, false));
+      }
     }
   }
 
   void log_inner(unsigned event, int data)
   {
     if (!Locked_Log) {
-      Log.push(LogEvent(event, reinterpret_cast<void*>(data)));
+      IdentifiedEventData& thread_data = GetMyThreadRawData();
+      if (thread_data.sampleLog(event, data)) {
+        thread_data.log_.push(LogEvent(now(), event, reinterpret_cast<void*>(data), false));
+      }
     }
   }
 
   void timed_log_inner(unsigned event, void *data)
   {
     if (!Locked_Log) {
-      Log.push(LogEvent(ThreadInstrument::clock_t::now(), event, data));
+      IdentifiedEventData& thread_data = GetMyThreadRawData();
+      if (thread_data.sampleLog(event, reinterpret_cast<std::intptr_t>(data))) {
+        thread_data.log_.push(LogEvent(now(), event, data, true));
+      }
     }
   }
 
   void timed_log_inner(unsigned event, int data)
   {
     if (!Locked_Log) {
-      Log.push(LogEvent(ThreadInstrument::clock_t::now(), event, reinterpret_cast<void*>(data)));
+      IdentifiedEventData& thread_data = GetMyThreadRawData();
+      if (thread_data.sampleLog(event, data)) {
+        thread_data.log_.push(LogEvent(now(), event, reinterpret_cast<void*>(data), true));
+      }
+    }
+  }
+
+  void payload_log_inner(unsigned event, const void *payload, std::size_t size, bool is_timed)
+  {
+    if (!Locked_Log) {
+      IdentifiedEventData& thread_data = GetMyThreadRawData();
+      // The typed payloads are not pairs
+      if (thread_data.sampleLog(event, -1)) {
+        thread_data.log_.push(LogEvent(now(), event, payload, size, is_timed));
+      }
     }
   }
 
+  void registerLogFormatter(int event, LogFormatterThunk_t thunk, void (*formatter)())
+  {
+    LogFormatters[event] = std::make_pair(thunk, formatter);
+  }
+
 }; // internal
 
 
   void dumpLog(std::ostream& s)
-  { char buf_final[256];
-    LogEvent l;
+  {
+    std::lock_guard<std::mutex> guard(LogConsumerMutex);
+    writeLog(s);
+  }
+  
+  void dumpLog(const std::string& filename, std::ios_base::openmode mode)
+  {
+    std::ofstream myfile(filename.c_str(), mode);
+    if(!myfile.is_open()) {
+      std::cerr << "Unable to open file " << filename << '\n';
+      exit(EXIT_FAILURE);
+    }
+    dumpLog(myfile);
+  }
+  
+  void dumpLogChromeTrace(std::ostream& s)
+  { char payload_buf[LogFormatterBufferSize + 1];
 
     const std::map<unsigned, LogPrinter_t>::const_iterator itend = LogPrinters.end();
-    
-    Log.reverse();
 
-    if (LogLimit) {
-      const size_t cur_size= Log.unsafe_size();
-      while (LogLimit < cur_size) {
-	unsigned how_many = cur_size - LogLimit;
-	//s << "Removing " << how_many << " log entries\n";
-	while(how_many--)
-	  Log.try_head_pop(l);
-      } 
+    std::lock_guard<std::mutex> guard(LogConsumerMutex);
+
+    ChromeTraceWriter writer(s, getpid());
+
+    const std::vector<ThreadInfo> threads = getThreadsInfo();
+    const bool sort = std::any_of(threads.begin(), threads.end(), [](const ThreadInfo& info) { return !info.role.empty(); });
+    for (std::size_t i = 0; i < threads.size(); ++i) {
+      writer.threadName(threads[i].thread, threads[i].label().c_str());
+      if (sort) {
+        writer.threadSortIndex(threads[i].thread, static_cast<int>(i));
+      }
     }
 
-    //s << "*** DUMPING ThreadInstrument LOG ***\n";
-    while (Log.try_head_pop(l)) {
-      const unsigned thread_num = GetThreadRawData(l.id_).id_;
-      const double when = std::chrono::duration<double>(l.when_ - StartExecutionTimePoint).count();
+    std::string event_name;
+    mergeLogs([&](const unsigned thread_num, const LogEvent& l) {
+      const char *name = getEventName(l.event_id_);
+      if (name == nullptr) {
+        event_name = C_Event_Str + std::to_string(l.event_id_);
+        name = event_name.c_str();
+      }
+      const double when = TheTickClock.seconds(TheTickClock.sinceStart(l.when_));
+      const unsigned long long data = static_cast<unsigned long long>(reinterpret_cast<std::uintptr_t>(l.data_));
       const std::map<unsigned, LogPrinter_t>::const_iterator it = LogPrinters.find(l.event_id_);
-      std::string event_representation = (it != itend) ? ((*it).second)(l.data_) : AllLogPrinter(l.event_id_, l.data_);
 
-      if (when > 0.) {
-        sprintf(buf_final, "Th%3u %lf %s\n", thread_num, when, event_representation.c_str());
+      if (l.payloadSize_) {
+        formatPayload(l, payload_buf);
+        writer.instant(thread_num, when, name, payload_buf);
+      } else if (it != itend) {
+        writer.instant(thread_num, when, name, ((*it).second)(l.data_).c_str());
+      } else if (data == 0) {
+        writer.begin(thread_num, when, name);
+      } else if (data == 1) {
+        writer.end(thread_num, when, name);
       } else {
-        sprintf(buf_final, "Th%3u %s\n", thread_num, event_representation.c_str());
+        writer.instant(thread_num, when, name, data);
       }
-    
-      s << buf_final;
-    }
-    //s << "*** END ThreadInstrument LOG ***\n";
+    }, LogLimit);
   }
-  
-  void dumpLog(const std::string& filename, std::ios_base::openmode mode)
+
+  void dumpLogChromeTrace(const std::string& filename)
   {
-    std::ofstream myfile(filename.c_str(), mode);
+    std::ofstream myfile(filename.c_str());
     if(!myfile.is_open()) {
       std::cerr << "Unable to open file " << filename << '\n';
       exit(EXIT_FAILURE);
     }
-    dumpLog(myfile);
+    dumpLogChromeTrace(myfile);
   }
-  
+
+  void dumpLogBinary(int fd)
+  {
+    std::lock_guard<std::mutex> guard(LogConsumerMutex);
+
+    BinaryLogWriter writer(fd);
+
+    writer.writeFileHeader();
+    writer.writeEventNames();
+    writer.writeThreads();
+
+    mergeLogs([&](const unsigned thread_num, const LogEvent& l) {
+      writer.writeRecord(thread_num, l);
+    }, LogLimit);
+  }
+
+  void dumpLogBinary(const std::string& filename, bool append)
+  {
+    const int fd = open(filename.c_str(), O_WRONLY | O_CREAT | (append ? O_APPEND : O_TRUNC), 0644);
+    if (fd < 0) {
+      std::cerr << "Unable to open file " << filename << '\n';
+      exit(EXIT_FAILURE);
+    }
+    dumpLogBinary(fd);
+    close(fd);
+  }
+
+  void startLogFlusher(const std::string& filename, double period, unsigned max_filled_chunks)
+  {
+    stopLogFlusher();
+
+    const int fd = open(filename.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+      std::cerr << "Unable to open file " << filename << '\n';
+      exit(EXIT_FAILURE);
+    }
+
+    // The pool and the event names must outlive the flusher, which is stopped at exit
+    TheLogChunkPool();
+    TheSafeEventCollector();
+    static const int AtExitRegistered = atexit(stopLogFlusher);
+    (void)AtExitRegistered;
+
+    std::lock_guard<std::mutex> guard(LogFlusherMutex);
+    TheLogFlusher = new LogFlusher(fd, period);
+    LogFlusherWakeUp = max_filled_chunks;
+  }
+
+  void stopLogFlusher()
+  { LogFlusher *flusher;
+
+    {
+      std::lock_guard<std::mutex> guard(LogFlusherMutex);
+      LogFlusherWakeUp = 0;
+      flusher = TheLogFlusher;
+      TheLogFlusher = nullptr;
+    }
+
+    delete flusher;
+  }
+
+  void startLiveMetrics(const std::string& name, double period, unsigned max_entries)
+  {
+    stopLiveMetrics();
+
+    const std::string segment_name = name.empty() ? defaultLiveMetricsName(getpid()) : name;
+    const std::size_t size = liveMetricsSegmentSize(max_entries, max_entries);
+
+    const int fd = shm_open(segment_name.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if ((fd < 0) || ftruncate(fd, static_cast<off_t>(size))) {
+      std::cerr << "Unable to create shared memory segment " << segment_name << '\n';
+      exit(EXIT_FAILURE);
+    }
+    void * const segment = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (segment == MAP_FAILED) {
+      std::cerr << "Unable to map shared memory segment " << segment_name << '\n';
+      exit(EXIT_FAILURE);
+    }
+
+    // The data read by the publisher must outlive it, as it is stopped at exit
+    TheSafeEventCollector();
+    static const int AtExitRegistered = atexit(stopLiveMetrics);
+    (void)AtExitRegistered;
+
+    std::lock_guard<std::mutex> guard(LiveMetricsMutex);
+    TheLiveMetricsPublisher = new LiveMetricsPublisher(segment_name, segment, period, max_entries);
+  }
+
+  void stopLiveMetrics()
+  { LiveMetricsPublisher *publisher;
+
+    {
+      std::lock_guard<std::mutex> guard(LiveMetricsMutex);
+      publisher = TheLiveMetricsPublisher;
+      TheLiveMetricsPublisher = nullptr;
+    }
+
+    delete publisher;
+  }
+
   void clearLog()
   {
-    Log.clear();
+    std::lock_guard<std::mutex> guard(LogConsumerMutex);
+
+    for (auto& cursor : getLogCursors()) {
+      cursor.log_->discard(cursor.pending_);
+    }
   }
   
   void LockLog()
@@ -682,6 +4279,152 @@ namespace internal {
   {
     LogLimit = nlogs;
   }
+
+  void flightRecorder(unsigned nlogs)
+  {
+    std::lock_guard<std::mutex> guard(LogConsumerMutex);
+
+    for (auto it = GlobalEventMap.begin(); it != GlobalEventMap.end(); ++it) {
+      ThreadLog& log = it->second.log_;
+      log.discard(log.available());
+      log.releaseRing();
+    }
+
+    FlightRecorderEntries.store(nlogs, std::memory_order_relaxed);
+  }
+
+  void dumpFlightRecorder(int fd) noexcept
+  {
+    // A dump interrupted by a signal whose handler dumps again would produce an invalid file
+    if (!FlightRecorderDumping.test_and_set(std::memory_order_acquire)) {
+      signalSafeDumpFlightRecorder(fd);
+      FlightRecorderDumping.clear(std::memory_order_release);
+    }
+  }
+
+  void installFlightRecorderHandler(const std::string& filename, bool crashes)
+  { struct sigaction action;
+
+    const int fd = open(filename.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+      std::cerr << "Unable to open file " << filename << '\n';
+      exit(EXIT_FAILURE);
+    }
+    if (FlightRecorderFd >= 0) {
+      close(FlightRecorderFd);
+    }
+    FlightRecorderFd = fd;
+
+    // The names must outlive the handlers
+    TheSafeEventCollector();
+
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = flightRecorderHandler;
+    sigemptyset(&action.sa_mask);
+    action.sa_flags = SA_RESTART | SA_ONSTACK;
+    sigaction(SIGUSR1, &action, nullptr);
+
+    if (crashes) {
+      action.sa_flags = SA_RESETHAND | SA_ONSTACK;
+      for (const int signal_number : {SIGSEGV, SIGBUS, SIGFPE, SIGILL, SIGABRT}) {
+        sigaction(signal_number, &action, nullptr);
+      }
+    }
+  }
+
+  void setProcessInfo(int rank, const std::string& host)
+  {
+    TheProcessInfo.rank_ = rank;
+    if (!host.empty()) {
+      const std::size_t length = std::min(host.size(), sizeof(TheProcessInfo.host_) - 1);
+      memcpy(TheProcessInfo.host_, host.data(), length);
+      TheProcessInfo.host_[length] = 0;
+    }
+  }
+
+  int processRank() noexcept
+  {
+    return TheProcessInfo.rank_.load(std::memory_order_relaxed);
+  }
+
+  std::int64_t syncClockTime() noexcept
+  {
+    return TheTickClock.wallTime(now());
+  }
+
+  std::int64_t synchronizeClock(const std::function<std::int64_t()>& reference_time, unsigned rounds)
+  { std::int64_t best_round_trip = std::numeric_limits<std::int64_t>::max();
+    std::int64_t offset = 0;
+
+    for (unsigned i = 0; i < std::max(rounds, 1u); i++) {
+      const std::int64_t t0 = syncClockTime();
+      const std::int64_t reference = reference_time();
+      const std::int64_t t1 = syncClockTime();
+      // The exchange with the shortest round trip bounds best the moment in which the reference was taken
+      if ((t1 - t0) < best_round_trip) {
+        best_round_trip = t1 - t0;
+        offset = reference - (t0 + (t1 - t0) / 2);
+      }
+    }
+
+    setClockOffset(offset);
+    return offset;
+  }
+
+  void setClockOffset(std::int64_t ns) noexcept
+  {
+    TheProcessInfo.clockOffset_.store(ns, std::memory_order_relaxed);
+  }
+
+  std::int64_t clockOffset() noexcept
+  {
+    return TheProcessInfo.clockOffset_.load(std::memory_order_relaxed);
+  }
+
+  MemoryUsage memoryUsage()
+  { MemoryUsage usage;
+
+    {
+      std::lock_guard<std::mutex> guard(LogConsumerMutex);
+      for (auto it = GlobalEventMap.begin(); it != GlobalEventMap.end(); ++it) {
+        ThreadMemoryUsage thread_usage;
+        thread_usage.thread = it->second.id_;
+        thread_usage.exited = it->second.exited_.load(std::memory_order_acquire);
+        thread_usage.activityBytes = it->second.activityBytes_.load(std::memory_order_relaxed);
+        thread_usage.logBytes = it->second.log_.bytes();
+        thread_usage.logEntries = it->second.log_.available();
+        thread_usage.droppedLogEntries = it->second.log_.dropped();
+        usage.logEntries += thread_usage.logEntries;
+        usage.threads.push_back(thread_usage);
+      }
+    }
+
+    std::sort(usage.threads.begin(), usage.threads.end(),
+              [](const ThreadMemoryUsage& a, const ThreadMemoryUsage& b) { return a.thread < b.thread; });
+    usage.logBytes = LogBytes.load(std::memory_order_relaxed);
+    usage.activityBytes = ActivityBytes.load(std::memory_order_relaxed);
+    usage.registryBytes = RegistryBytes.load(std::memory_order_relaxed);
+    usage.totalBytes = usage.logBytes + usage.activityBytes + usage.registryBytes;
+    usage.droppedLogEntries = DroppedLogEntries.load(std::memory_order_relaxed);
+    usage.budget = MemoryBudget.load(std::memory_order_relaxed);
+
+    return usage;
+  }
+
+  void setMemoryBudget(std::size_t bytes)
+  {
+    MemoryBudget = bytes;
+  }
+
+  void reclaimExitedThreads(bool enable) noexcept
+  {
+    ReclaimExitedThreads = enable;
+  }
+
+  void reserveLog(std::size_t nlogs)
+  {
+    TheLogChunkPool().reserve((nlogs + LogChunkEntries - 1) / LogChunkEntries);
+  }
   
   void registerLogPrinter(int event, const LogPrinter_t& printer)
   {
@@ -720,6 +4463,7 @@ namespace internal {
   void registerInspector(void (*inspector)())
   {
     Inspector = inspector;
+    startSignalDumper();
   }
 
 } //namespace ThreadInstrument
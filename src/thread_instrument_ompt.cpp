@@ -0,0 +1,272 @@
+/*
+ ThreadInstrument: Library to monitor thread activity
+ Copyright (C) 2012-2022 Basilio B. Fraguela. Universidade da Coruna
+
+ Distributed under the MIT License. (See accompanying file LICENSE)
+*/
+
+///
+/// \file     thread_instrument_ompt.cpp
+/// \brief    OMPT tool that records the activity of the OpenMP runtime
+/// \author   Basilio B. Fraguela <basilio.fraguela@udc.es>
+///
+
+#include <atomic>
+#include <omp-tools.h>
+#include "thread_instrument/thread_instrument.h"
+#include "thread_instrument/ompt_tool.h"
+
+namespace {
+
+  using namespace ThreadInstrument;
+
+  /// Whether the runtime initialized the tool and has not finalized it yet
+  std::atomic<bool> Active {false};
+
+  /// Category of the activities recorded
+  std::atomic<unsigned> TheCategory {DefaultCategory.id};
+
+  /// Numbers of the events of the activities recorded, obtained when the tool is initialized
+  int IdleId, ParallelId, ImplicitTaskId, BarrierId, TaskwaitId, WaitId, LoopId, SectionsId, SingleId, TaskloopId, TaskId;
+
+  /// Values of the ompt_data_t of the explicit tasks
+  enum TaskState : std::uint64_t {
+    TaskCreated = 1,   ///< It has not begun yet
+    TaskRunning = 2    ///< It began, although it may be suspended
+  };
+
+  /// Whether this thread is a worker thread of the OpenMP runtime
+  thread_local bool IsWorker = false;
+
+  /// Whether this thread is running a single region whose end has not been reported
+  thread_local bool InSingle = false;
+
+  inline void begin(int activity)
+  {
+    beginActivity(Category(TheCategory.load(std::memory_order_relaxed)), activity);
+  }
+
+  inline void end(int activity)
+  {
+    endActivity(Category(TheCategory.load(std::memory_order_relaxed)), activity);
+  }
+
+  /// Begins or ends \c activity depending on \c endpoint
+  inline void scope(ompt_scope_endpoint_t endpoint, int activity)
+  {
+    if (endpoint == ompt_scope_begin) {
+      begin(activity);
+    } else if (endpoint == ompt_scope_end) {
+      end(activity);
+    }
+  }
+
+  /// Ends the single region of this thread if it is running one
+  /** The runtimes do not report the end of the single regions of the programs compiled for the GNU OpenMP ABI,
+   *  so they are closed at the next barrier or at the end of the implicit task, whatever happens first.
+   */
+  inline void endSingle()
+  {
+    if (InSingle) {
+      InSingle = false;
+      end(SingleId);
+    }
+  }
+
+  void on_thread_begin(ompt_thread_t thread_type, ompt_data_t *)
+  {
+    if (thread_type == ompt_thread_worker) {
+      IsWorker = true;
+      begin(IdleId);
+    }
+  }
+
+  void on_thread_end(ompt_data_t *)
+  {
+    if (IsWorker) {
+      end(IdleId);
+    }
+  }
+
+  void on_parallel_begin(ompt_data_t *, const ompt_frame_t *, ompt_data_t *, unsigned int, int, const void *)
+  {
+    begin(ParallelId);
+  }
+
+  void on_parallel_end(ompt_data_t *, ompt_data_t *, int, const void *)
+  {
+    end(ParallelId);
+  }
+
+  void on_implicit_task(ompt_scope_endpoint_t endpoint, ompt_data_t *, ompt_data_t *, unsigned int, unsigned int, int flags)
+  {
+    // The initial task of each thread is not part of a parallel region
+    if (flags & ompt_task_initial) {
+      return;
+    }
+
+    if (endpoint == ompt_scope_begin) {
+      if (IsWorker) {
+        end(IdleId);
+      }
+      begin(ImplicitTaskId);
+    } else if (endpoint == ompt_scope_end) {
+      endSingle();
+      end(ImplicitTaskId);
+      if (IsWorker) {
+        begin(IdleId);
+      }
+    }
+  }
+
+  void on_sync_region(ompt_sync_region_t kind, ompt_scope_endpoint_t endpoint, ompt_data_t *, ompt_data_t *, const void *)
+  {
+    switch (kind) {
+      case ompt_sync_region_taskwait:
+      case ompt_sync_region_taskgroup:
+        scope(endpoint, TaskwaitId);
+        break;
+      case ompt_sync_region_reduction:
+        break;
+      default:
+        if (endpoint == ompt_scope_begin) {
+          endSingle();
+        }
+        scope(endpoint, BarrierId);
+    }
+  }
+
+  void on_sync_region_wait(ompt_sync_region_t kind, ompt_scope_endpoint_t endpoint, ompt_data_t *, ompt_data_t *, const void *)
+  {
+    if (kind != ompt_sync_region_reduction) {
+      scope(endpoint, WaitId);
+    }
+  }
+
+  void on_work(ompt_work_t wstype, ompt_scope_endpoint_t endpoint, ompt_data_t *, ompt_data_t *, uint64_t, const void *)
+  {
+    switch (wstype) {
+      case ompt_work_loop:
+        scope(endpoint, LoopId);
+        break;
+      case ompt_work_sections:
+        scope(endpoint, SectionsId);
+        break;
+      case ompt_work_single_executor:
+        if (endpoint == ompt_scope_begin) {
+          endSingle();
+          InSingle = true;
+          begin(SingleId);
+        } else if (endpoint == ompt_scope_end) {
+          endSingle();
+        }
+        break;
+      case ompt_work_taskloop:
+        scope(endpoint, TaskloopId);
+        break;
+      default:
+        break;
+    }
+  }
+
+  void on_task_create(ompt_data_t *, const ompt_frame_t *, ompt_data_t *new_task_data, int flags, int, const void *)
+  {
+    new_task_data->value = (flags & ompt_task_explicit) ? static_cast<std::uint64_t>(TaskCreated) : 0;
+  }
+
+  /// A task that is suspended keeps running for ThreadInstrument, so that the tasks it runs meanwhile are nested in it
+  void on_task_schedule(ompt_data_t *prior_task_data, ompt_task_status_t prior_task_status, ompt_data_t *next_task_data)
+  {
+    if ((prior_task_data != nullptr) && (prior_task_data->value == TaskRunning)) {
+      switch (prior_task_status) {
+        case ompt_task_complete:
+        case ompt_task_cancel:
+        case ompt_task_detach:
+          prior_task_data->value = 0;
+          end(TaskId);
+          break;
+        default:
+          break;
+      }
+    }
+
+    if ((next_task_data != nullptr) && (next_task_data->value == TaskCreated)) {
+      next_task_data->value = TaskRunning;
+      begin(TaskId);
+    }
+  }
+
+  /// Registers \c callback for \c event. The events the runtime does not support are simply not recorded
+  template<typename T>
+  void registerCallback(ompt_set_callback_t set_callback, ompt_callbacks_t event, T callback)
+  {
+    set_callback(event, reinterpret_cast<ompt_callback_t>(callback));
+  }
+
+  int ompt_initialize(ompt_function_lookup_t lookup, int, ompt_data_t *)
+  {
+    const ompt_set_callback_t set_callback = reinterpret_cast<ompt_set_callback_t>(lookup("ompt_set_callback"));
+
+    if (set_callback == nullptr) {
+      return 0;
+    }
+
+    IdleId = getEventNumber(OMPT::Idle);
+    ParallelId = getEventNumber(OMPT::Parallel);
+    ImplicitTaskId = getEventNumber(OMPT::ImplicitTask);
+    BarrierId = getEventNumber(OMPT::Barrier);
+    TaskwaitId = getEventNumber(OMPT::Taskwait);
+    WaitId = getEventNumber(OMPT::Wait);
+    LoopId = getEventNumber(OMPT::Loop);
+    SectionsId = getEventNumber(OMPT::Sections);
+    SingleId = getEventNumber(OMPT::Single);
+    TaskloopId = getEventNumber(OMPT::Taskloop);
+    TaskId = getEventNumber(OMPT::Task);
+
+    registerCallback(set_callback, ompt_callback_thread_begin, on_thread_begin);
+    registerCallback(set_callback, ompt_callback_thread_end, on_thread_end);
+    registerCallback(set_callback, ompt_callback_parallel_begin, on_parallel_begin);
+    registerCallback(set_callback, ompt_callback_parallel_end, on_parallel_end);
+    registerCallback(set_callback, ompt_callback_implicit_task, on_implicit_task);
+    registerCallback(set_callback, ompt_callback_sync_region, on_sync_region);
+    registerCallback(set_callback, ompt_callback_sync_region_wait, on_sync_region_wait);
+    registerCallback(set_callback, ompt_callback_work, on_work);
+    registerCallback(set_callback, ompt_callback_task_create, on_task_create);
+    registerCallback(set_callback, ompt_callback_task_schedule, on_task_schedule);
+
+    Active.store(true, std::memory_order_relaxed);
+
+    return 1;
+  }
+
+  void ompt_finalize(ompt_data_t *)
+  {
+    Active.store(false, std::memory_order_relaxed);
+  }
+
+  ompt_start_tool_result_t StartToolResult = {&ompt_initialize, &ompt_finalize, {0}};
+
+} // anonymous namespace
+
+extern "C" ompt_start_tool_result_t *ompt_start_tool(unsigned int, const char *)
+{
+  return &StartToolResult;
+}
+
+namespace ThreadInstrument {
+
+  namespace OMPT {
+
+    bool active() noexcept
+    {
+      return Active.load(std::memory_order_relaxed);
+    }
+
+    void setCategory(Category c) noexcept
+    {
+      TheCategory.store(c.id, std::memory_order_relaxed);
+    }
+
+  } // OMPT
+
+} //namespace ThreadInstrument
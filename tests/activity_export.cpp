@@ -0,0 +1,108 @@
+/*
+ ThreadInstrument: Library to monitor thread activity
+ Copyright (C) 2012-2022 Basilio B. Fraguela. Universidade da Coruna
+
+ Distributed under the MIT License. (See accompanying file LICENSE)
+*/
+
+///
+/// \file     activity_export.cpp
+/// \brief    Tests the dumps of the activity in CSV and JSON formats
+/// \author   Basilio B. Fraguela <basilio.fraguela@udc.es>
+///
+
+#include <cstdlib>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include "thread_instrument/thread_instrument.h"
+#include "check.h"
+
+constexpr int NReps = 20;
+
+/// Field \c n of the CSV line \c line without quoted fields
+std::string field(const std::string& line, int n)
+{ std::string::size_type begin = 0;
+
+  for (int i = 0; (i < n) && (begin != std::string::npos); i++) {
+    begin = line.find(',', begin);
+    if (begin != std::string::npos) {
+      begin++;
+    }
+  }
+  if (begin == std::string::npos) {
+    return "<missing>";
+  }
+  const std::string::size_type end = line.find(',', begin);
+  return line.substr(begin, (end == std::string::npos) ? std::string::npos : end - begin);
+}
+
+/// Line of \c text that begins with \c prefix
+std::string lineOf(const std::string& text, const std::string& prefix)
+{
+  const std::string::size_type pos = (text.compare(0, prefix.size(), prefix) == 0) ? 0 : text.find('\n' + prefix);
+  if (pos == std::string::npos) {
+    return std::string();
+  }
+  const std::string::size_type begin = pos ? pos + 1 : 0;
+  return text.substr(begin, text.find('\n', begin) - begin);
+}
+
+int main()
+{
+  ThreadInstrument::enableHistograms();
+  for (int i = 0; i < NReps; i++) {
+    ThreadInstrument::beginActivity("KERNEL");
+    std::this_thread::sleep_for(std::chrono::microseconds(100));
+    ThreadInstrument::endActivity("KERNEL");
+  }
+
+  const ThreadInstrument::Int2EventDataMap_t m = ThreadInstrument::getAllActivity();
+  const int kernel = ThreadInstrument::getEventNumber("KERNEL");
+
+  std::ostringstream os_csv;
+  ThreadInstrument::dumpActivityCSV(m, nullptr, os_csv);
+  const std::string csv = os_csv.str();
+  const std::string header = csv.substr(0, csv.find('\n'));
+  check(header.compare(0, 31, "event,name,invocations,samples,") == 0, "CSV header");
+  check(field(header, 13) == "p99", "Percentiles in the CSV header");
+
+  const std::string kernel_line = lineOf(csv, std::to_string(kernel) + ",KERNEL,");
+  check(!kernel_line.empty(), "Line of the activity");
+  check(field(kernel_line, 2) == std::to_string(NReps), "Invocations in CSV");
+  check(strtod(field(kernel_line, 4).c_str(), nullptr) >= NReps * 100e-6, "Time in CSV");
+  check(field(kernel_line, 5).empty(), "Exclusive time not measured without nested profiling");
+  check(strtod(field(kernel_line, 11).c_str(), nullptr) > 0., "Median of the histogram in CSV");
+  check(field(kernel_line, 16).empty(), "Hardware events not counted");
+
+  // Names with the CSV and JSON special characters, and activities without samples
+  ThreadInstrument::Int2EventDataMap_t m2;
+  m2[0].invocations = 3;
+  m2[0].time = 0.5;
+  m2[1].invocations = 1;
+  const std::string names[] = {"copy, \"fast\"", "a\\b"};
+
+  std::ostringstream os_csv2;
+  ThreadInstrument::dumpActivityCSV(m2, names, os_csv2);
+  const std::string csv2 = os_csv2.str();
+  check(csv2.find("\n0,\"copy, \"\"fast\"\"\",3,0,0.5,,0,,,,,,,,,0,,,,\n") != std::string::npos, "CSV quoting and empty fields");
+  check(csv2.find("\n1,a\\b,1,0,0,") != std::string::npos, "Name without quotes");
+
+  std::ostringstream os_json;
+  ThreadInstrument::dumpActivityJSON(m2, names, os_json);
+  const std::string json = os_json.str();
+  check(json.compare(0, 15, "{\"activities\":[") == 0, "JSON object");
+  check(json.find("{\"event\":0,\"name\":\"copy, \\\"fast\\\"\",\"invocations\":3,\"samples\":0,\"time\":0.5,\"exclusive_time\":null,") != std::string::npos, "JSON strings and nulls");
+  check(json.find("\"name\":\"a\\\\b\"") != std::string::npos, "JSON escapes");
+  check(json.find("\"p50\":null") != std::string::npos, "Percentiles not measured");
+
+  ThreadInstrument::dumpActivityCSV(m, nullptr, "activity_export.csv");
+  std::ifstream in("activity_export.csv");
+  std::string line;
+  check(std::getline(in, line) && (line == header), "CSV file");
+
+  return testResult();
+}
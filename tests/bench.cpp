@@ -55,6 +55,14 @@ void f(unsigned level)
         }
         break;
         
+      case 3:
+        for(unsigned i = 0; i < NReps; i++) {
+          ThreadInstrument::beginActivity(THREADINSTRUMENT_EVENT("MYTASK"));
+          f(level + 1);
+          ThreadInstrument::endActivity(THREADINSTRUMENT_EVENT("MYTASK"));
+        }
+        break;
+
       default:
         std::cerr << "Unknown test " << Case << '\n';
         exit(EXIT_FAILURE);
@@ -148,6 +156,20 @@ int main(int argc, char **argv)
     }
   }
   
+  std::cout << "=================\nCost per activity period as the number of threads grows:\n";
+
+  const unsigned max_threads = NThreads;
+  for (NThreads = 1; NThreads <= max_threads; NThreads *= 2) {
+    const double t = runtest(0);
+    std::cout << "NThreads=" << NThreads << " Profiling Time=" << t << "s. or " << (t / (double(NReps) * NActivities)) << "s. per activity period\n";
+  }
+  NThreads = max_threads;
+
+  ThreadInstrument::enableNestedProfiling();
+  const double time_nested = runtest(0);
+  ThreadInstrument::enableNestedProfiling(false);
+  std::cout << "Nested Profiling Time=" << time_nested << "s. or " << (time_nested/(total_activities / NThreads)) << "s. per activity period\n";
+
   std::cout << "=================\nCompare performance of profiling APIs:\n";
   
   NReps      *= NActivities;
@@ -157,6 +179,12 @@ int main(int argc, char **argv)
   std::cout << "Profiling Time using int   =" << runtest(0) << '\n';
   std::cout << "Profiling Time using char *=" << runtest(1) << '\n';
   std::cout << "Profiling Time using macro =" << runtest(2) << '\n';
+  std::cout << "Profiling Time using event =" << runtest(3) << '\n';
+
+  if (THREADINSTRUMENT_EVENT("MYTASK") != ThreadInstrument::getEventNumber("MYTASK")) {
+    std::cerr << "THREADINSTRUMENT_EVENT(\"MYTASK\") != getEventNumber(\"MYTASK\")!\n";
+    return EXIT_FAILURE;
+  }
 
   return 0;
 }
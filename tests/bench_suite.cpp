@@ -0,0 +1,446 @@
+/*
+ ThreadInstrument: Library to monitor thread activity
+ Copyright (C) 2012-2022 Basilio B. Fraguela. Universidade da Coruna
+
+ Distributed under the MIT License. (See accompanying file LICENSE)
+*/
+
+///
+/// \file     bench_suite.cpp
+/// \brief    Measures the overhead of the profiling and logging APIs sweeping their main parameters
+/// \author   Basilio B. Fraguela <basilio.fraguela@udc.es>
+///
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <cstdio>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <mutex>
+#include <streambuf>
+#include <string>
+#include <thread>
+#include <vector>
+#include "thread_instrument/thread_instrument.h"
+
+/* Each measurement is printed as a CSV line with the columns
+   benchmark   : activity, log, timed_log, dumpLog, dumpLogBinary or getAllActivity
+   ids         : int, string or macro (::THREADINSTRUMENT_EVENT), the way the events are named
+   threads     : threads running the benchmark simultaneously
+   activities  : different activities or events used by each thread (activities per level for the activity benchmark)
+   depth       : nesting depth of the activities
+   nested      : whether ::enableNestedProfiling was enabled
+   ops         : operations measured in each thread
+   baseline_ns : nanoseconds per operation of the same code without calling the library
+   ns_per_op   : nanoseconds per operation, begin/end pair or entry, averaged over the threads
+   overhead_ns : ns_per_op - baseline_ns
+   Each configuration is run several times, keeping the fastest run.
+*/
+
+using bench_clock_t = std::chrono::steady_clock;
+
+constexpr unsigned MaxActivities = 64;
+constexpr unsigned MaxDepth = 8;
+
+unsigned MaxThreads, NOps = 100000, NReps = 3;
+
+std::ostream *Out = &std::cout;
+
+/// Names of the activities and events used, numbered by getEventNumber
+std::vector<std::string> Names;
+std::vector<const char *> NamePtrs;
+std::vector<int> Ids;
+
+/// Keeps the compiler from removing the work of the baseline
+std::atomic<unsigned> Sink {0};
+
+inline void opaque(unsigned v)
+{
+  Sink.store(v, std::memory_order_relaxed);
+}
+
+/// Policy that calls the library
+struct Instrumented {
+  static void begin(int id) { ThreadInstrument::beginActivity(id); }
+  static void end(int id) { ThreadInstrument::endActivity(id); }
+  static void begin(const char *name) { ThreadInstrument::beginActivity(name); }
+  static void end(const char *name) { ThreadInstrument::endActivity(name); }
+  static void log(int id, int data, bool timed) { ThreadInstrument::log(id, data, timed); }
+  static void log(const char *name, int data, bool timed) { ThreadInstrument::log(name, data, timed); }
+};
+
+/// Policy that runs the same code without the library
+struct Baseline {
+  static void begin(int id) { opaque(id); }
+  static void end(int id) { opaque(id); }
+  static void begin(const char *name) { opaque(static_cast<unsigned>(reinterpret_cast<std::uintptr_t>(name))); }
+  static void end(const char *name) { opaque(static_cast<unsigned>(reinterpret_cast<std::uintptr_t>(name))); }
+  static void log(int id, int data, bool) { opaque(id + data); }
+  static void log(const char *name, int data, bool) { opaque(static_cast<unsigned>(reinterpret_cast<std::uintptr_t>(name)) + data); }
+};
+
+/// Pool of threads, so that the threads only register once in the library
+class ThreadPool {
+
+  std::vector<std::thread> threads_;
+  std::mutex mutex_;
+  std::condition_variable cv_;
+  std::function<void(unsigned)> job_;
+  unsigned generation_, active_, pending_;
+  bool finish_;
+
+  void work(unsigned index)
+  { unsigned generation = 0;
+
+    while (true) {
+      std::unique_lock<std::mutex> lock(mutex_);
+      cv_.wait(lock, [&] { return finish_ || (generation_ != generation); });
+      if (finish_) {
+        return;
+      }
+      generation = generation_;
+      if (index < active_) {
+        lock.unlock();
+        job_(index);
+        lock.lock();
+        if (!--pending_) {
+          cv_.notify_all();
+        }
+      }
+    }
+  }
+
+public:
+
+  explicit ThreadPool(unsigned nthreads) :
+  generation_(0), active_(0), pending_(0), finish_(false)
+  {
+    for (unsigned i = 0; i < nthreads; i++) {
+      threads_.emplace_back(&ThreadPool::work, this, i);
+    }
+  }
+
+  ~ThreadPool()
+  {
+    {
+      std::lock_guard<std::mutex> guard(mutex_);
+      finish_ = true;
+    }
+    cv_.notify_all();
+    for (auto& t : threads_) {
+      t.join();
+    }
+  }
+
+  /// Runs job(i) in the first \c nthreads threads of the pool, waiting for them to finish
+  void run(unsigned nthreads, std::function<void(unsigned)> job)
+  {
+    std::unique_lock<std::mutex> lock(mutex_);
+    job_ = std::move(job);
+    active_ = pending_ = nthreads;
+    generation_++;
+    cv_.notify_all();
+    cv_.wait(lock, [&] { return !pending_; });
+  }
+
+};
+
+ThreadPool *Pool;
+
+/// Runs \c f(thread) in \c nthreads threads that start simultaneously. Returns the mean of the seconds taken by each thread
+double timeThreads(unsigned nthreads, const std::function<void(unsigned)>& f)
+{ std::atomic<unsigned> ready {0};
+  std::vector<double> seconds(nthreads);
+
+  Pool->run(nthreads, [&](unsigned thread) {
+    ready.fetch_add(1);
+    while (ready.load() < nthreads) {
+      std::this_thread::yield();
+    }
+    const bench_clock_t::time_point t0 = bench_clock_t::now();
+    f(thread);
+    seconds[thread] = std::chrono::duration<double>(bench_clock_t::now() - t0).count();
+  });
+
+  double total = 0.0;
+  for (double s : seconds) {
+    total += s;
+  }
+  return total / nthreads;
+}
+
+/// Fastest of ::NReps runs of \c f, in nanoseconds per each of the \c ops operations of each thread
+double bestNs(unsigned nthreads, unsigned ops, const std::function<void(unsigned)>& f)
+{ double best = 1e300;
+
+  for (unsigned rep = 0; rep < NReps; rep++) {
+    best = std::min(best, timeThreads(nthreads, f));
+  }
+  return best * 1e9 / ops;
+}
+
+void printResult(const char *benchmark, const char *ids, unsigned nthreads, unsigned activities, unsigned depth,
+                 bool nested, unsigned ops, double baseline_ns, double ns)
+{ char buf[256];
+
+  snprintf(buf, sizeof(buf), "%s,%s,%u,%u,%u,%d,%u,%.3f,%.3f,%.3f\n", benchmark, ids, nthreads, activities, depth,
+           nested ? 1 : 0, ops, baseline_ns, ns, ns - baseline_ns);
+  *Out << buf;
+  Out->flush();
+}
+
+/// Nests \c depth activities, the outermost one named by ids[0]
+template<typename P, typename Id>
+void nest(const Id *ids, unsigned depth)
+{
+  if (depth) {
+    P::begin(ids[0]);
+    nest<P>(ids + 1, depth - 1);
+    P::end(ids[0]);
+  }
+}
+
+/// Runs ::NOps nests of \c depth activities rotating among \c activities nests of different activities
+template<typename P, typename Id>
+void activityKernel(const Id *ids, unsigned activities, unsigned depth)
+{
+  for (unsigned i = 0, a = 0; i < NOps; i++) {
+    nest<P>(ids + a * depth, depth);
+    if (++a == activities) {
+      a = 0;
+    }
+  }
+}
+
+template<typename P>
+void macroKernel()
+{
+  for (unsigned i = 0; i < NOps; i++) {
+    P::begin(THREADINSTRUMENT_EVENT("bench_macro"));
+    P::end(THREADINSTRUMENT_EVENT("bench_macro"));
+  }
+}
+
+/// Measures the begin/end pairs of activities named as \c ids says
+void benchActivity(const char *ids, unsigned nthreads, unsigned activities, unsigned depth, bool nested)
+{ std::function<void(unsigned)> baseline, instrumented;
+
+  if (!strcmp(ids, "int")) {
+    baseline = [=](unsigned) { activityKernel<Baseline>(Ids.data(), activities, depth); };
+    instrumented = [=](unsigned) { activityKernel<Instrumented>(Ids.data(), activities, depth); };
+  } else if (!strcmp(ids, "string")) {
+    baseline = [=](unsigned) { activityKernel<Baseline>(NamePtrs.data(), activities, depth); };
+    instrumented = [=](unsigned) { activityKernel<Instrumented>(NamePtrs.data(), activities, depth); };
+  } else {
+    baseline = [](unsigned) { macroKernel<Baseline>(); };
+    instrumented = [](unsigned) { macroKernel<Instrumented>(); };
+  }
+
+  ThreadInstrument::enableNestedProfiling(nested);
+  const unsigned ops = NOps * depth;
+  const double baseline_ns = bestNs(nthreads, ops, baseline);
+  const double ns = bestNs(nthreads, ops, instrumented);
+  ThreadInstrument::enableNestedProfiling(false);
+  ThreadInstrument::clearAllActivity();
+
+  printResult("activity", ids, nthreads, activities, depth, nested, ops, baseline_ns, ns);
+}
+
+template<typename P>
+void logKernel(const char *ids, unsigned activities, bool timed)
+{
+  if (!strcmp(ids, "int")) {
+    for (unsigned i = 0; i < NOps; i++) {
+      P::log(Ids[i % activities], static_cast<int>(i), timed);
+    }
+  } else if (!strcmp(ids, "string")) {
+    for (unsigned i = 0; i < NOps; i++) {
+      P::log(NamePtrs[i % activities], static_cast<int>(i), timed);
+    }
+  } else {
+    for (unsigned i = 0; i < NOps; i++) {
+      P::log(THREADINSTRUMENT_EVENT("bench_macro"), static_cast<int>(i), timed);
+    }
+  }
+}
+
+/// Measures the untimed or timed log entries of events named as \c ids says
+void benchLog(const char *ids, unsigned nthreads, unsigned activities, bool timed)
+{ double baseline_ns = 1e300, ns = 1e300;
+
+  for (unsigned rep = 0; rep < NReps; rep++) {
+    baseline_ns = std::min(baseline_ns, timeThreads(nthreads, [=](unsigned) { logKernel<Baseline>(ids, activities, timed); }));
+    ns = std::min(ns, timeThreads(nthreads, [=](unsigned) { logKernel<Instrumented>(ids, activities, timed); }));
+    ThreadInstrument::clearLog();
+  }
+
+  printResult(timed ? "timed_log" : "log", ids, nthreads, activities, 1, false, NOps, baseline_ns * 1e9 / NOps, ns * 1e9 / NOps);
+}
+
+/// Discards what is written in it
+struct NullBuffer : public std::streambuf {
+  int overflow(int c) override { return c; }
+  std::streamsize xsputn(const char *, std::streamsize n) override { return n; }
+};
+
+/// Measures the dumping of the entries logged by \c nthreads threads, in nanoseconds per entry
+void benchDumpLog(unsigned nthreads)
+{ NullBuffer null_buffer;
+  std::ostream null_stream(&null_buffer);
+  double text_ns = 1e300, binary_ns = 1e300;
+
+  const int null_fd = open("/dev/null", O_WRONLY);
+  if (null_fd < 0) {
+    std::cerr << "Unable to open /dev/null\n";
+    exit(EXIT_FAILURE);
+  }
+
+  const double entries = static_cast<double>(NOps) * nthreads;
+  for (unsigned rep = 0; rep < NReps; rep++) {
+    timeThreads(nthreads, [](unsigned) { logKernel<Instrumented>("int", MaxActivities, true); });
+    bench_clock_t::time_point t0 = bench_clock_t::now();
+    ThreadInstrument::dumpLog(null_stream);
+    text_ns = std::min(text_ns, std::chrono::duration<double>(bench_clock_t::now() - t0).count() * 1e9 / entries);
+    ThreadInstrument::clearLog();
+
+    timeThreads(nthreads, [](unsigned) { logKernel<Instrumented>("int", MaxActivities, true); });
+    t0 = bench_clock_t::now();
+    ThreadInstrument::dumpLogBinary(null_fd);
+    binary_ns = std::min(binary_ns, std::chrono::duration<double>(bench_clock_t::now() - t0).count() * 1e9 / entries);
+    ThreadInstrument::clearLog();
+  }
+  close(null_fd);
+
+  const unsigned total = static_cast<unsigned>(entries);
+  printResult("dumpLog", "int", nthreads, MaxActivities, 1, false, total, 0.0, text_ns);
+  printResult("dumpLogBinary", "int", nthreads, MaxActivities, 1, false, total, 0.0, binary_ns);
+}
+
+/// Measures getAllActivity when \c nthreads threads have run \c activities activities each, in nanoseconds per call
+void benchGetAllActivity(unsigned nthreads, unsigned activities)
+{ std::size_t size = 0;
+
+  ThreadInstrument::clearAllActivity();
+  timeThreads(nthreads, [=](unsigned) {
+    for (unsigned a = 0; a < activities; a++) {
+      Instrumented::begin(Ids[a]);
+      Instrumented::end(Ids[a]);
+    }
+  });
+
+  const unsigned calls = std::max(10u, NOps / 1000);
+  double best = 1e300;
+  for (unsigned rep = 0; rep < NReps; rep++) {
+    const bench_clock_t::time_point t0 = bench_clock_t::now();
+    for (unsigned i = 0; i < calls; i++) {
+      size += ThreadInstrument::getAllActivity().size();
+    }
+    best = std::min(best, std::chrono::duration<double>(bench_clock_t::now() - t0).count() * 1e9 / calls);
+  }
+  opaque(static_cast<unsigned>(size));
+  ThreadInstrument::clearAllActivity();
+
+  printResult("getAllActivity", "int", nthreads, activities, 1, false, calls, 0.0, best);
+}
+
+void usage(const char *name)
+{
+  std::cerr << "Usage: " << name << " [-t max_threads] [-n ops] [-r reps] [-o file.csv]\n";
+  std::cerr << " -t max_threads : the thread counts run are the powers of 2 up to max_threads and max_threads. Default: hardware threads\n";
+  std::cerr << " -n ops         : operations measured per thread in each run. Default: " << NOps << '\n';
+  std::cerr << " -r reps        : runs of each configuration, the fastest one being reported. Default: " << NReps << '\n';
+  std::cerr << " -o file.csv    : file for the results. Default: standard output\n";
+  exit(EXIT_FAILURE);
+}
+
+int main(int argc, char **argv)
+{ int c;
+  std::ofstream outfile;
+
+  MaxThreads = std::max(1u, std::thread::hardware_concurrency());
+
+  while ((c = getopt(argc, argv, "t:n:r:o:")) != -1) {
+    switch (c) {
+      case 't':
+        MaxThreads = static_cast<unsigned>(atoi(optarg));
+        break;
+      case 'n':
+        NOps = static_cast<unsigned>(atoi(optarg));
+        break;
+      case 'r':
+        NReps = static_cast<unsigned>(atoi(optarg));
+        break;
+      case 'o':
+        outfile.open(optarg);
+        if (!outfile) {
+          std::cerr << "Unable to open " << optarg << '\n';
+          return EXIT_FAILURE;
+        }
+        Out = &outfile;
+        break;
+      default:
+        usage(argv[0]);
+    }
+  }
+
+  if (!MaxThreads || !NOps || !NReps || (optind != argc)) {
+    usage(argv[0]);
+  }
+
+  for (unsigned i = 0; i < MaxActivities * MaxDepth; i++) {
+    Names.push_back("bench_" + std::to_string(i));
+  }
+  for (const std::string& name : Names) {
+    NamePtrs.push_back(name.c_str());
+    Ids.push_back(ThreadInstrument::getEventNumber(name.c_str()));
+  }
+
+  std::vector<unsigned> thread_counts;
+  for (unsigned n = 1; n < MaxThreads; n *= 2) {
+    thread_counts.push_back(n);
+  }
+  thread_counts.push_back(MaxThreads);
+
+  ThreadInstrument::reserveLog(static_cast<std::size_t>(NOps) * MaxThreads);
+
+  ThreadPool pool(MaxThreads);
+  Pool = &pool;
+
+  *Out << "benchmark,ids,threads,activities,depth,nested,ops,baseline_ns,ns_per_op,overhead_ns\n";
+
+  for (unsigned nthreads : thread_counts) {
+    for (const char *ids : {"int", "string", "macro"}) {
+      for (bool nested : {false, true}) {
+        benchActivity(ids, nthreads, 1, 1, nested);
+      }
+    }
+    for (const char *ids : {"int", "string"}) {
+      for (unsigned activities : {16u, MaxActivities}) {
+        for (unsigned depth : {1u, 4u, MaxDepth}) {
+          for (bool nested : {false, true}) {
+            benchActivity(ids, nthreads, activities, depth, nested);
+          }
+        }
+      }
+    }
+    for (const char *ids : {"int", "string", "macro"}) {
+      for (bool timed : {false, true}) {
+        benchLog(ids, nthreads, (strcmp(ids, "macro") ? MaxActivities : 1), timed);
+      }
+    }
+    benchDumpLog(nthreads);
+    for (unsigned activities : {1u, 16u, MaxActivities}) {
+      benchGetAllActivity(nthreads, activities);
+    }
+  }
+
+  return EXIT_SUCCESS;
+}
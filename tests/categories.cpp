@@ -0,0 +1,156 @@
+/*
+ ThreadInstrument: Library to monitor thread activity
+ Copyright (C) 2012-2022 Basilio B. Fraguela. Universidade da Coruna
+
+ Distributed under the MIT License. (See accompanying file LICENSE)
+*/
+
+///
+/// \file     categories.cpp
+/// \brief    Tests enabling and disabling categories of activities and log events at runtime
+/// \author   Basilio B. Fraguela <basilio.fraguela@udc.es>
+///
+
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include "thread_instrument/thread_instrument.h"
+#include "check.h"
+
+const ThreadInstrument::Category Compute(1);
+const ThreadInstrument::Category IO(2);
+
+unsigned invocations(const char *activity)
+{
+  ThreadInstrument::Int2EventDataMap_t activity_data = ThreadInstrument::getAllActivity();
+  return activity_data[ThreadInstrument::getEventNumber(activity)].invocations;
+}
+
+/// Profiles an activity whose name is only known at runtime
+void profile_named(const char *name)
+{
+  THREADINSTRUMENT_PROF(name, );
+}
+
+/// Number of the event of a name of constant characters given by reference
+template<std::size_t N>
+int fixed_event(const char (&name)[N])
+{
+  return THREADINSTRUMENT_EVENT(name);
+}
+
+/// Number of lines in the log
+unsigned log_lines()
+{ std::ostringstream s;
+
+  ThreadInstrument::dumpLog(s);
+  const std::string log = s.str();
+  unsigned n = 0;
+  for (char c : log) {
+    n += (c == '\n');
+  }
+  return n;
+}
+
+int main()
+{
+  check(ThreadInstrument::isEnabled(ThreadInstrument::DefaultCategory) && ThreadInstrument::isEnabled(Compute), "All categories enabled by default");
+
+  ThreadInstrument::enableCategory(IO, false);
+  check(!ThreadInstrument::isEnabled(IO) && ThreadInstrument::isEnabled(Compute), "Only IO disabled");
+
+  const ThreadInstrument::Category invalid(ThreadInstrument::NCategories + 1);
+  ThreadInstrument::enableCategory(invalid);
+  check(!ThreadInstrument::isEnabled(invalid) && (invalid.id == ThreadInstrument::NCategories), "Categories beyond the supported ones are never enabled");
+  THREADINSTRUMENT_PROF_IN(invalid, "invalid", );
+  check(invocations("invalid") == 0, "invalid invocations");
+
+  for (int i = 0; i < 10; i++) {
+    THREADINSTRUMENT_PROF_IN(Compute, "compute", );
+    THREADINSTRUMENT_PROF_IN(IO, "io", );
+    ThreadInstrument::beginActivity(IO, "io2");
+    ThreadInstrument::endActivity(IO, "io2");
+    THREADINSTRUMENT_PROF("default", );
+    ThreadInstrument::log(Compute, "compute_log", i, true);
+    ThreadInstrument::log(IO, "io_log", i, true);
+  }
+
+  check(invocations("compute") == 10, "compute invocations");
+  check(invocations("io") == 0, "io invocations");
+  check(invocations("io2") == 0, "io2 invocations");
+  check(invocations("default") == 10, "default invocations");
+  check(log_lines() == 10, "Only the Compute entries are logged");
+
+  // The log macros also accept the number of the category
+  THREADINSTRUMENT_LOG_IN(1, "compute_block", );
+  THREADINSTRUMENT_TIMED_LOG_IN(2u, "io_block", );
+  THREADINSTRUMENT_TIMED_LOG_IN(1u, "compute_block", );
+  check(log_lines() == 4, "Numeric categories in the log macros");
+
+  // The names given by pointers are looked up in every evaluation of the macro
+  for (const std::string& name : {std::string("runtime_a"), std::string("runtime_b"), std::string("runtime_a")}) {
+    profile_named(name.c_str());
+  }
+  check((invocations("runtime_a") == 2) && (invocations("runtime_b") == 1), "Activities named at runtime");
+
+  // So are those in buffers that can be modified, even if the buffer is always the same
+  char buf[16];
+  for (int i = 0; i < 3; i++) {
+    snprintf(buf, sizeof(buf), "task%d", i);
+    THREADINSTRUMENT_PROF(buf, );
+  }
+  check((invocations("task0") == 1) && (invocations("task1") == 1) && (invocations("task2") == 1), "Activities named in a reused buffer");
+
+  // The arrays of constant characters can be different in each evaluation of the macro
+  static const char Stages[3][8] = {"LOAD", "COMPUTE", "STORE"};
+  for (int i = 0; i < 3; i++) {
+    check(THREADINSTRUMENT_EVENT(Stages[i]) == ThreadInstrument::getEventNumber(Stages[i]), "Fixed names selected at runtime");
+  }
+  check((fixed_event("lit_a") == ThreadInstrument::getEventNumber("lit_a")) &&
+        (fixed_event("lit_b") == ThreadInstrument::getEventNumber("lit_b")) &&
+        (fixed_event("lit_a") == ThreadInstrument::getEventNumber("lit_a")), "Literals of the same length given by reference");
+
+  // An activity that begins while disabled is not measured
+  ThreadInstrument::beginActivity(IO, "late");
+  ThreadInstrument::enableCategory(IO);
+  ThreadInstrument::endActivity(IO, "late");
+  check(invocations("late") == 0, "late invocations");
+
+  // An activity that is running when the categories change is not measured
+  ThreadInstrument::beginActivity(IO, "interrupted");
+  ThreadInstrument::enableCategory(IO, false);
+  ThreadInstrument::endActivity(IO, "interrupted");
+  ThreadInstrument::enableCategory(IO);
+  ThreadInstrument::beginActivity(IO, "interrupted");
+  ThreadInstrument::endActivity(IO, "interrupted");
+  const ThreadInstrument::EventData interrupted = ThreadInstrument::getAllActivity()[ThreadInstrument::getEventNumber("interrupted")];
+  check(interrupted.invocations == 2, "interrupted invocations");
+  check(!interrupted.currentlyRunning, "interrupted is not running");
+
+  // Changing other categories does not affect the activities running
+  ThreadInstrument::beginActivity(Compute, "unaffected");
+  ThreadInstrument::enableCategory(IO, false);
+  ThreadInstrument::enableCategory(IO);
+  ThreadInstrument::setEnabledCategories(ThreadInstrument::enabledCategories() & ~(std::uint64_t(1) << IO.id));
+  ThreadInstrument::endActivity(Compute, "unaffected");
+  ThreadInstrument::enableCategory(IO);
+  check(ThreadInstrument::getAllActivity()[ThreadInstrument::getEventNumber("unaffected")].samples == 1, "Activity measured while other categories change");
+
+  ThreadInstrument::toggleCategoriesOnSignal();
+  const std::uint64_t mask = ThreadInstrument::enabledCategories();
+  raise(SIGUSR2);
+  check(ThreadInstrument::enabledCategories() == 0, "Signal disables all the categories");
+  THREADINSTRUMENT_PROF("default", );
+  check(invocations("default") == 10, "default invocations while disabled");
+  raise(SIGUSR2);
+  check(ThreadInstrument::enabledCategories() == mask, "Signal restores the categories");
+
+  ThreadInstrument::setEnabledCategories(0);
+  THREADINSTRUMENT_TIMED_LOG_IN(Compute, "compute_block", );
+  check(log_lines() == 0, "Nothing logged with all the categories disabled");
+
+  return testResult();
+}
@@ -0,0 +1,40 @@
+/*
+ ThreadInstrument: Library to monitor thread activity
+ Copyright (C) 2012-2022 Basilio B. Fraguela. Universidade da Coruna
+
+ Distributed under the MIT License. (See accompanying file LICENSE)
+*/
+
+///
+/// \file     check.h
+/// \brief    Checks shared by the tests, which report their result with testResult()
+/// \author   Basilio B. Fraguela <basilio.fraguela@udc.es>
+///
+
+#ifndef THREAD_INSTRUMENT_TESTS_CHECK_H
+#define THREAD_INSTRUMENT_TESTS_CHECK_H
+
+#include <cstdlib>
+#include <iostream>
+
+/// Whether all the checks of the test succeeded
+static bool Ok = true;
+
+/// Reports \c msg and makes the test fail if \c cond does not hold
+inline void check(bool cond, const char *msg)
+{
+  if (!cond) {
+    std::cerr << "Check failed: " << msg << '\n';
+    Ok = false;
+  }
+}
+
+/// Prints the result of the test and provides the exit status of the program
+inline int testResult()
+{
+  std::cout << (Ok ? "TEST SUCCESSFUL\n" : "TEST FAILED\n");
+
+  return Ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+#endif
@@ -0,0 +1,115 @@
+/*
+ ThreadInstrument: Library to monitor thread activity
+ Copyright (C) 2012-2022 Basilio B. Fraguela. Universidade da Coruna
+
+ Distributed under the MIT License. (See accompanying file LICENSE)
+*/
+
+///
+/// \file     chrome_trace.cpp
+/// \brief    Tests the traces in Chrome Trace Event JSON format generated by dumpLogChromeTrace
+/// \author   Basilio B. Fraguela <basilio.fraguela@udc.es>
+///
+
+#include <cstdlib>
+#include <cstdio>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <map>
+#include <vector>
+#include <thread>
+#include "thread_instrument/thread_instrument.h"
+#include "check.h"
+
+constexpr int NReps = 100;
+
+void thread_func()
+{
+  for (int i = 0; i < NReps; i++) {
+    THREADINSTRUMENT_TIMED_LOG("outer \"quoted\"",
+                               THREADINSTRUMENT_TIMED_LOG("inner", ThreadInstrument::log("value", i + 2, true));
+                               );
+  }
+}
+
+/// Value of the field \c field of the event in \c line
+std::string field(const std::string& line, const std::string& field)
+{
+  const std::string key = "\"" + field + "\":";
+  const std::string::size_type pos = line.find(key);
+  if (pos == std::string::npos) {
+    return std::string();
+  }
+  std::string::size_type begin = pos + key.size(), end;
+  if (line[begin] == '"') {
+    for (end = ++begin; (end < line.size()) && (line[end] != '"'); end++) {
+      if (line[end] == '\\') {
+        end++;
+      }
+    }
+  } else {
+    end = line.find_first_of(",}", begin);
+  }
+  return line.substr(begin, end - begin);
+}
+
+int main(int argc, char **argv)
+{ std::map<std::string, std::vector<std::string>> open_slices;
+  std::map<std::string, double> last_ts;
+  std::map<std::string, unsigned> phases;
+  std::string line;
+
+  const int nthreads = (argc == 1) ? 2 : atoi(argv[1]);
+
+  std::vector<std::thread> threads;
+  for (int i = 0; i < nthreads; i++) {
+    threads.emplace_back(thread_func);
+  }
+  for (auto& t : threads) {
+    t.join();
+  }
+
+  std::ostringstream os;
+  ThreadInstrument::dumpLogChromeTrace(os);
+  const std::string trace = os.str();
+
+  check(trace.compare(0, 15, "{\"displayTimeUn") == 0, "Trace header");
+  check(trace.compare(trace.size() - 4, 4, "\n]}\n") == 0, "Trace end");
+
+  std::istringstream is(trace);
+  std::getline(is, line);
+  while (std::getline(is, line) && (line != "]}")) {
+    const std::string ph = field(line, "ph");
+    const std::string tid = field(line, "tid");
+    const std::string name = field(line, "name");
+    const double ts = atof(field(line, "ts").c_str());
+    phases[ph]++;
+    if (ph != "M") {
+      check(ts >= last_ts[tid], "Chronological order");
+      last_ts[tid] = ts;
+    }
+    if (ph == "B") {
+      open_slices[tid].push_back(name);
+    } else if (ph == "E") {
+      check(!open_slices[tid].empty() && (open_slices[tid].back() == name), "Nesting of slices");
+      if (!open_slices[tid].empty()) {
+        open_slices[tid].pop_back();
+      }
+    } else if (ph == "i") {
+      const int data = atoi(field(line, "data").c_str());
+      check((name == "value") && (data >= 2) && (data < NReps + 2), "Data of instantaneous events");
+    }
+  }
+
+  const unsigned n = nthreads * NReps;
+  check(phases["M"] == static_cast<unsigned>(nthreads), "Thread names");
+  check((phases["B"] == 2 * n) && (phases["E"] == 2 * n), "Slices");
+  check(phases["i"] == n, "Instantaneous events");
+  check(trace.find("outer \\\"quoted\\\"") != std::string::npos, "Escaping");
+  for (const auto& slices : open_slices) {
+    check(slices.second.empty(), "Closed slices");
+  }
+
+  return testResult();
+}
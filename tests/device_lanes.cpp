@@ -0,0 +1,120 @@
+/*
+ ThreadInstrument: Library to monitor thread activity
+ Copyright (C) 2012-2022 Basilio B. Fraguela. Universidade da Coruna
+
+ Distributed under the MIT License. (See accompanying file LICENSE)
+*/
+
+///
+/// \file     device_lanes.cpp
+/// \brief    Tests the lanes with the activity of devices recorded with moments provided by the application
+/// \author   Basilio B. Fraguela <basilio.fraguela@udc.es>
+///
+
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include "thread_instrument/thread_instrument.h"
+#include "check.h"
+
+/// Simulated kernels run in each stream
+constexpr int NKernels = 10;
+
+/// Duration and separation of the kernels in nanoseconds
+constexpr std::int64_t KernelNs = 1000000;
+
+/// Offset of the simulated clock of the device with respect to that of the host
+constexpr std::int64_t DeviceOffsetNs = 5000000000LL;
+
+/// Reports the kernels of a stream whose timestamps in the device clock begin at \c t0, as a tracing callback would do
+void report_stream(unsigned lane, std::int64_t t0)
+{
+  for (int i = 0; i < NKernels; i++) {
+    const std::int64_t begin = t0 + 2 * i * KernelNs;
+    ThreadInstrument::laneActivity(lane, "KERNEL", begin, begin + KernelNs);
+  }
+}
+
+int main()
+{
+  check(ThreadInstrument::getMyThreadNumber() == 0, "Main thread numbered first");
+
+  const unsigned gpu0 = ThreadInstrument::createLane("gpu0.stream0");
+  const unsigned gpu1 = ThreadInstrument::createLane(std::string());
+  check((gpu0 == 1) && (gpu1 == 2), "Lanes numbered as threads");
+  check(ThreadInstrument::nThreadsWithActivity() == 3, "Lanes counted as threads");
+  ThreadInstrument::setLaneClockOffset(gpu1, -DeviceOffsetNs);
+
+  // The host launches the kernels, whose device moments follow the launch
+  ThreadInstrument::log("LAUNCH", 0, true);
+  const std::int64_t t0 = ThreadInstrument::syncClockTime() + KernelNs;
+  ThreadInstrument::log("LAUNCH", 1, true);
+  std::thread t_report(report_stream, gpu1, t0 + DeviceOffsetNs);
+  report_stream(gpu0, t0);
+  t_report.join();
+
+  for (const unsigned lane : {gpu0, gpu1}) {
+    const ThreadInstrument::Int2EventDataMap_t& m = ThreadInstrument::getActivity(lane);
+    const auto it = m.find(ThreadInstrument::getEventNumber("KERNEL"));
+    check(it != m.end(), "Activity of the lane");
+    if (it != m.end()) {
+      const ThreadInstrument::EventData& ed = it->second;
+      check((ed.invocations == NKernels) && (ed.samples == NKernels), "Invocations of the lane");
+      check(std::fabs(ed.time - NKernels * KernelNs * 1e-9) < 1e-6, "Time of the lane");
+      check(std::fabs(ed.meanTime - KernelNs * 1e-9) < 1e-6, "Mean time of the lane");
+      check(!ed.currentlyRunning, "Activity of the lane finished");
+    }
+  }
+
+  const ThreadInstrument::Int2EventDataMap_t all = ThreadInstrument::getAllActivity();
+  const auto it_all = all.find(ThreadInstrument::getEventNumber("KERNEL"));
+  check((it_all != all.end()) && (it_all->second.invocations == 2 * NKernels), "Lanes in the global activity");
+  check(ThreadInstrument::getActivity(0).empty(), "Main thread without activity");
+
+  const std::vector<ThreadInstrument::ThreadInfo> threads = ThreadInstrument::getThreadsInfo();
+  check(threads.size() == 3, "Lanes in the threads");
+  if (threads.size() == 3) {
+    check(threads[0].thread == 0, "Threads without role first");
+    check((threads[1].label() == "gpu0.stream0") && (threads[1].role == "device") && (threads[1].roleIndex == 0), "Named lane");
+    check((threads[2].label() == "device.1") && (threads[2].thread == gpu1), "Lane labeled by its role");
+  }
+
+  // Moments older than the latest one of the lane are delayed
+  ThreadInstrument::beginLaneActivity(gpu0, "COPY", t0 + 2 * NKernels * KernelNs);
+  ThreadInstrument::endLaneActivity(gpu0, "COPY", t0);
+  const ThreadInstrument::Int2EventDataMap_t& m_copy = ThreadInstrument::getActivity(gpu0);
+  const auto it_copy = m_copy.find(ThreadInstrument::getEventNumber("COPY"));
+  check((it_copy != m_copy.end()) && (it_copy->second.invocations == 1) && (it_copy->second.time == 0.), "Chronological order of the lane");
+
+  ThreadInstrument::registerLogPrinter(ThreadInstrument::pictureTimePrinter);
+  std::ostringstream os_log;
+  ThreadInstrument::dumpLog(os_log);
+  const std::string text = os_log.str();
+  check(text.find("# Th  1 gpu0.stream0\n") != std::string::npos, "Lane listed in the text log");
+  check(text.find("# Th  2 device.1\n") != std::string::npos, "Lane labeled in the text log");
+  const std::string::size_type launch = text.find("LAUNCH END"), kernel0 = text.find("\nTh  1 "), kernel1 = text.find("\nTh  2 ");
+  check((launch != std::string::npos) && (kernel0 != std::string::npos) && (kernel1 != std::string::npos), "Lanes in the text log");
+  check((launch < kernel0) && (launch < kernel1), "Moments of the lanes merged with those of the host");
+  check(text.find("KERNEL BEGIN") != std::string::npos, "Activities of the lanes as slices");
+
+  // Both streams run simultaneously, so their entries are interleaved
+  const std::string::size_type last_kernel0 = text.rfind("Th  1 0"), first_kernel1 = kernel1;
+  check(first_kernel1 < last_kernel0, "Clock offset of the lane");
+
+  ThreadInstrument::laneActivity(gpu0, "KERNEL", t0, t0 + KernelNs);
+  std::ostringstream os_chrome;
+  ThreadInstrument::dumpLogChromeTrace(os_chrome);
+  check(os_chrome.str().find("\"tid\":1,\"ts\":0.000,\"name\":\"thread_name\",\"args\":{\"name\":\"gpu0.stream0\"}") != std::string::npos, "Lanes in Chrome traces");
+
+  ThreadInstrument::clearAllActivity();
+  ThreadInstrument::laneActivity(gpu0, "KERNEL", t0, t0 + KernelNs);
+  const ThreadInstrument::Int2EventDataMap_t& m_cleared = ThreadInstrument::getActivity(gpu0);
+  check((m_cleared.size() == 1) && (m_cleared.begin()->second.invocations == 1), "Activity of the lanes cleared");
+
+  return testResult();
+}
@@ -0,0 +1,171 @@
+/*
+ ThreadInstrument: Library to monitor thread activity
+ Copyright (C) 2012-2022 Basilio B. Fraguela. Universidade da Coruna
+
+ Distributed under the MIT License. (See accompanying file LICENSE)
+*/
+
+///
+/// \file     flight_recorder.cpp
+/// \brief    Tests the flight recorder, which only keeps the last entries of each thread
+/// \author   Basilio B. Fraguela <basilio.fraguela@udc.es>
+///
+
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <csignal>
+#include <iostream>
+#include <map>
+#include <string>
+#include <thread>
+#include <vector>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include "thread_instrument/thread_instrument.h"
+#include "thread_instrument/binary_log.h"
+#include "check.h"
+
+constexpr int NThreads = 3;
+constexpr int NPerThread = 10000;
+constexpr unsigned NKept = 100;
+
+typedef std::map<std::uint32_t, std::vector<std::uint64_t>> Thread2Values_t;
+
+void thread_func()
+{
+  for (int i = 0; i < NPerThread; i++) {
+    ThreadInstrument::log("VALUE", i, true);
+  }
+}
+
+void run_threads()
+{ std::vector<std::thread> threads;
+
+  for (int i = 0; i < NThreads; i++) {
+    threads.emplace_back(thread_func);
+  }
+
+  for (auto& t : threads) {
+    t.join();
+  }
+}
+
+/// Values of the entries of event \c event_name of each thread in the binary log \c filename
+Thread2Values_t read(const char *filename, const char *event_name)
+{ ThreadInstrument::BinaryLogSectionHeader section;
+  ThreadInstrument::BinaryLogRecord record;
+  std::map<std::uint32_t, std::string> names;
+  Thread2Values_t values;
+  std::string name;
+  std::uint32_t event;
+
+  FILE *fin = fopen(filename, "rb");
+  ThreadInstrument::BinaryLogReader reader(fin);
+  if ((fin == nullptr) || !reader.open()) {
+    std::cerr << filename << " is not a valid binary log\n";
+    Ok = false;
+    return values;
+  }
+
+  while (reader.nextSection(section)) {
+    if (section.kind_ == ThreadInstrument::BinaryLogEventNames) {
+      while (reader.readName(event, name)) {
+        names[event] = name;
+      }
+    } else if (section.kind_ == ThreadInstrument::BinaryLogEvents) {
+      while (reader.readRecord(record)) {
+        if (names[record.event_] == event_name) {
+          values[record.thread_].push_back(record.data_);
+        }
+      }
+    }
+  }
+
+  fclose(fin);
+
+  return values;
+}
+
+/// Whether \c values holds \c nthreads threads whose entries are the last NKept values logged by thread_func
+bool keptLast(const Thread2Values_t& values, unsigned nthreads)
+{
+  if (values.size() != nthreads) {
+    return false;
+  }
+
+  for (const auto& thread_values : values) {
+    if (thread_values.second.size() != NKept) {
+      return false;
+    }
+    for (unsigned i = 0; i < NKept; i++) {
+      if (thread_values.second[i] != NPerThread - NKept + i) {
+        return false;
+      }
+    }
+  }
+
+  return true;
+}
+
+void dumpFlightRecorder(const char *filename)
+{
+  const int fd = open(filename, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  ThreadInstrument::dumpFlightRecorder(fd);
+  close(fd);
+}
+
+/// Process that logs and crashes so that its parent checks the log it leaves
+void crash()
+{
+  ThreadInstrument::installFlightRecorderHandler("flight_recorder_crash.bin");
+  for (int i = 0; i < NPerThread; i++) {
+    ThreadInstrument::log("CRASH", i, true);
+  }
+  abort();
+}
+
+int main()
+{
+  ThreadInstrument::flightRecorder(NKept);
+  run_threads();
+
+  dumpFlightRecorder("flight_recorder1.bin");
+  dumpFlightRecorder("flight_recorder2.bin");
+  const Thread2Values_t first_dump = read("flight_recorder1.bin", "VALUE");
+  check(keptLast(first_dump, NThreads), "Kept the last entries of each thread");
+  check(read("flight_recorder2.bin", "VALUE") == first_dump, "Dumping the flight recorder does not consume it");
+
+  ThreadInstrument::installFlightRecorderHandler("flight_recorder_usr1.bin", false);
+  errno = ERANGE;
+  raise(SIGUSR1);
+  check(errno == ERANGE, "The handler preserves errno");
+  check(read("flight_recorder_usr1.bin", "VALUE") == first_dump, "Dump on SIGUSR1");
+
+  ThreadInstrument::dumpLogBinary("flight_recorder_log.bin");
+  check(read("flight_recorder_log.bin", "VALUE") == first_dump, "dumpLogBinary of the flight recorder");
+  ThreadInstrument::dumpLogBinary("flight_recorder_log.bin");
+  check(read("flight_recorder_log.bin", "VALUE").empty(), "dumpLogBinary consumes the flight recorder");
+
+  const pid_t pid = fork();
+  if (!pid) {
+    crash();
+  }
+  int status;
+  waitpid(pid, &status, 0);
+  check(WIFSIGNALED(status) && (WTERMSIG(status) == SIGABRT), "The crash kills the process");
+  check(keptLast(read("flight_recorder_crash.bin", "CRASH"), 1), "Dump on crash");
+
+  ThreadInstrument::flightRecorder(0);
+  run_threads();
+  ThreadInstrument::dumpLogBinary("flight_recorder_log.bin");
+  const Thread2Values_t all = read("flight_recorder_log.bin", "VALUE");
+  bool unbounded = (all.size() == NThreads);
+  for (const auto& thread_values : all) {
+    unbounded = unbounded && (thread_values.second.size() == NPerThread);
+  }
+  check(unbounded, "Unbounded log after disabling the flight recorder");
+
+  return testResult();
+}
@@ -0,0 +1,120 @@
+/*
+ ThreadInstrument: Library to monitor thread activity
+ Copyright (C) 2012-2022 Basilio B. Fraguela. Universidade da Coruna
+
+ Distributed under the MIT License. (See accompanying file LICENSE)
+*/
+
+///
+/// \file     flush_log.cpp
+/// \brief    Tests the binary logs generated by dumpLogBinary and by the background log flusher
+/// \author   Basilio B. Fraguela <basilio.fraguela@udc.es>
+///
+
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+#include <thread>
+#include <string>
+#include <map>
+#include "thread_instrument/thread_instrument.h"
+#include "thread_instrument/binary_log.h"
+
+constexpr int NPerThread = 50000;
+
+int NThreads;
+
+void thread_func()
+{
+  for (int i = 0; i < NPerThread; i++) {
+    ThreadInstrument::log("VALUE", i, true);
+  }
+}
+
+void run_threads()
+{ std::vector<std::thread> threads;
+
+  for (int i = 0; i < NThreads; i++) {
+    threads.emplace_back(thread_func);
+  }
+
+  for (auto& t : threads) {
+    t.join();
+  }
+}
+
+/// Checks that the binary log \c filename contains NPerThread entries per thread in order
+bool check(const char *filename)
+{ ThreadInstrument::BinaryLogSectionHeader section;
+  ThreadInstrument::BinaryLogRecord record;
+  std::map<std::uint32_t, std::string> names;
+  std::map<std::uint32_t, std::uint64_t> next_value;
+  std::map<std::uint32_t, std::int64_t> last_time;
+  std::string name;
+  std::uint32_t event;
+  bool ok = true;
+
+  FILE *fin = fopen(filename, "rb");
+  ThreadInstrument::BinaryLogReader reader(fin);
+  if ((fin == nullptr) || !reader.open()) {
+    fprintf(stderr, "%s is not a valid binary log\n", filename);
+    return false;
+  }
+
+  while (reader.nextSection(section)) {
+    if (section.kind_ == ThreadInstrument::BinaryLogEventNames) {
+      while (reader.readName(event, name)) {
+        names[event] = name;
+      }
+    } else if (section.kind_ == ThreadInstrument::BinaryLogEvents) {
+      while (reader.readRecord(record)) {
+        if ((names[record.event_] != "VALUE") || (record.data_ != next_value[record.thread_]) || (record.time_ < last_time[record.thread_])) {
+          ok = false;
+        }
+        next_value[record.thread_]++;
+        last_time[record.thread_] = record.time_;
+      }
+    }
+  }
+
+  fclose(fin);
+
+  if (next_value.size() != static_cast<size_t>(NThreads)) {
+    fprintf(stderr, "%s: %zu threads found instead of %d\n", filename, next_value.size(), NThreads);
+    ok = false;
+  }
+
+  for (const auto& thread_values : next_value) {
+    if (thread_values.second != NPerThread) {
+      fprintf(stderr, "%s: thread %u logged %llu entries\n", filename, thread_values.first, (unsigned long long)thread_values.second);
+      ok = false;
+    }
+  }
+
+  printf("%s %s\n", filename, ok ? "OK" : "FAILED");
+
+  return ok;
+}
+
+int main(int argc, char **argv)
+{
+  NThreads = (argc == 1) ? std::thread::hardware_concurrency() : atoi(argv[1]);
+
+  printf("Using %d threads. %d values/thread\n", NThreads, NPerThread);
+
+  run_threads();
+  ThreadInstrument::dumpLogBinary("/tmp/flush_log_dump.bin");
+
+  ThreadInstrument::startLogFlusher("/tmp/flush_log_flusher.bin", 0.01, 4);
+  run_threads();
+  ThreadInstrument::stopLogFlusher();
+
+  // Both logs are checked even if the first one fails
+  const bool dump_ok = check("/tmp/flush_log_dump.bin");
+  const bool flusher_ok = check("/tmp/flush_log_flusher.bin");
+
+  std::remove("/tmp/flush_log_dump.bin");
+  std::remove("/tmp/flush_log_flusher.bin");
+
+  return (dump_ok && flusher_ok) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
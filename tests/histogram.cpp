@@ -0,0 +1,112 @@
+/*
+ ThreadInstrument: Library to monitor thread activity
+ Copyright (C) 2012-2022 Basilio B. Fraguela. Universidade da Coruna
+
+ Distributed under the MIT License. (See accompanying file LICENSE)
+*/
+
+///
+/// \file     histogram.cpp
+/// \brief    Tests the latency histograms and the distribution statistics of the activities
+/// \author   Basilio B. Fraguela <basilio.fraguela@udc.es>
+///
+
+#include <cstdlib>
+#include <cmath>
+#include <cstdint>
+#include <iostream>
+#include <algorithm>
+#include <chrono>
+#include <vector>
+#include <thread>
+#include "thread_instrument/thread_instrument.h"
+#include "check.h"
+
+constexpr int NShort = 90;
+constexpr int NLong = 10;
+
+/// Time that the library may add to the duration of a sample measured inside the activity, in seconds
+constexpr double Slack = 1e-3;
+
+/// Durations of the invocations of each thread measured inside the activity
+std::vector<std::vector<double>> Samples;
+
+void wait_ms(int ms)
+{
+  std::this_thread::sleep_for(std::chrono::milliseconds(ms));
+}
+
+void thread_func(int thread)
+{
+  for (int i = 0; i < NShort + NLong; i++) {
+    THREADINSTRUMENT_PROF("task",
+                          const auto begin = std::chrono::steady_clock::now();
+                          wait_ms((i % 10) ? 1 : 10);
+                          Samples[thread].push_back(std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count());
+                          );
+  }
+}
+
+/// Whether the time \c t reported by the library matches the \c sample measured inside the activities, \c t having a relative \c error
+/** The checks do not depend on the precision of the sleeps, which can last much longer in loaded machines */
+bool matches(double t, double sample, double error = 0.0)
+{
+  return (t >= sample * (1.0 - error) - 1e-5) && (t <= (sample + Slack) * (1.0 + error));
+}
+
+int main(int argc, char **argv)
+{
+  const int nthreads = (argc == 1) ? 2 : atoi(argv[1]);
+
+  using ThreadInstrument::LatencyHistogram;
+  for (std::uint64_t v = 1; v < (std::uint64_t(1) << 40); v = v * 3 + 1) {
+    const double repr = LatencyHistogram::bucketValue(LatencyHistogram::bucket(v));
+    check(std::abs(repr - v) <= v / static_cast<double>(LatencyHistogram::NSubBuckets), "Bucket precision");
+  }
+  check(LatencyHistogram::bucket(~std::uint64_t(0)) == LatencyHistogram::NBuckets - 1, "Last bucket");
+
+  ThreadInstrument::enableHistograms();
+
+  Samples.resize(nthreads);
+  std::vector<std::thread> threads;
+  for (int i = 0; i < nthreads; i++) {
+    threads.emplace_back(thread_func, i);
+  }
+  for (auto& t : threads) {
+    t.join();
+  }
+
+  ThreadInstrument::Int2EventDataMap_t activity = ThreadInstrument::getAllActivity();
+  ThreadInstrument::dumpActivity(activity);
+
+  const ThreadInstrument::EventData& task = activity[ThreadInstrument::getEventNumber("task")];
+  const unsigned n = nthreads * (NShort + NLong);
+
+  std::vector<double> samples;
+  for (const std::vector<double>& thread_samples : Samples) {
+    samples.insert(samples.end(), thread_samples.begin(), thread_samples.end());
+  }
+  std::sort(samples.begin(), samples.end());
+  double sum = 0.0, squared_sum = 0.0;
+  for (double sample : samples) {
+    sum += sample;
+    squared_sum += sample * sample;
+  }
+  const double mean = sum / n;
+  const double std_dev = std::sqrt(std::max(0.0, squared_sum / n - mean * mean));
+  auto percentile = [&samples](double p) {
+    return samples[static_cast<std::size_t>(std::max(1.0, std::ceil(p / 100.0 * samples.size()))) - 1];
+  };
+
+  check((samples.size() == n) && (task.histogram.count() == n), "Values in the histogram");
+  check(matches(task.minTime, samples.front()), "Minimum");
+  check(matches(task.maxTime, samples.back()), "Maximum");
+  check(matches(task.meanTime, mean), "Mean");
+  check(std::abs(task.meanTime * n - task.time) < 1e-6 * n, "Mean of the time");
+  check(std::abs(task.timeStdDev - std_dev) <= 0.05 * std_dev + Slack, "Standard deviation");
+  const double bucket_error = 1.0 / LatencyHistogram::NSubBuckets;
+  check(matches(task.histogram.percentile(50.0), percentile(50.0), bucket_error), "Median");
+  check(matches(task.histogram.percentile(95.0), percentile(95.0), bucket_error), "95th percentile");
+
+  return testResult();
+}
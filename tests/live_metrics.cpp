@@ -0,0 +1,132 @@
+/*
+ ThreadInstrument: Library to monitor thread activity
+ Copyright (C) 2012-2022 Basilio B. Fraguela. Universidade da Coruna
+
+ Distributed under the MIT License. (See accompanying file LICENSE)
+*/
+
+///
+/// \file     live_metrics.cpp
+/// \brief    Tests the activity statistics published in shared memory by startLiveMetrics
+/// \author   Basilio B. Fraguela <basilio.fraguela@udc.es>
+///
+
+#include <unistd.h>
+#include <cstdlib>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+#include <map>
+#include <string>
+#include <vector>
+#include <thread>
+#include "thread_instrument/thread_instrument.h"
+#include "thread_instrument/live_metrics.h"
+#include "check.h"
+
+constexpr int NReps = 20;
+
+void thread_func()
+{
+  for (int i = 0; i < NReps; i++) {
+    THREADINSTRUMENT_PROF("live", std::this_thread::sleep_for(std::chrono::milliseconds(1)));
+  }
+}
+
+/// Whether a reader gives up on a segment whose update never finishes, as when its publisher dies during it
+bool gives_up_on_stale_segment()
+{ ThreadInstrument::LiveMetricsHeader header;
+  std::vector<ThreadInstrument::LiveMetricsName> names;
+  std::vector<ThreadInstrument::LiveMetricsEntry> entries;
+  ThreadInstrument::LiveMetricsReader reader;
+
+  const std::string name = "/threadinstrument.stale." + std::to_string(getpid());
+  const std::size_t size = ThreadInstrument::liveMetricsSegmentSize(1, 1);
+  const int fd = shm_open(name.c_str(), O_CREAT | O_RDWR, 0600);
+  if ((fd < 0) || ftruncate(fd, size)) {
+    return false;
+  }
+  void * const p = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  close(fd);
+  if (p == MAP_FAILED) {
+    shm_unlink(name.c_str());
+    return false;
+  }
+
+  ThreadInstrument::LiveMetricsHeader * const h = static_cast<ThreadInstrument::LiveMetricsHeader *>(p);
+  memcpy(h->magic_, ThreadInstrument::LiveMetricsMagic, sizeof(ThreadInstrument::LiveMetricsMagic));
+  h->version_ = ThreadInstrument::LiveMetricsVersion;
+  h->headerSize_ = sizeof(ThreadInstrument::LiveMetricsHeader);
+  h->maxNames_ = h->maxEntries_ = 1;
+  h->segmentSize_ = size;
+  h->sequence_.store(1);
+
+  const bool result = reader.open(name) && !reader.read(header, names, entries, 0.01);
+  reader.close();
+  munmap(p, size);
+  shm_unlink(name.c_str());
+  return result;
+}
+
+int main(int argc, char **argv)
+{ ThreadInstrument::LiveMetricsHeader header;
+  std::vector<ThreadInstrument::LiveMetricsName> names;
+  std::vector<ThreadInstrument::LiveMetricsEntry> entries;
+  ThreadInstrument::LiveMetricsReader reader;
+
+  const int nthreads = (argc == 1) ? 2 : atoi(argv[1]);
+  const std::string segment_name = ThreadInstrument::defaultLiveMetricsName(getpid());
+
+  ThreadInstrument::startLiveMetrics(std::string(), 0.005);
+  check(reader.open(segment_name), "Open segment");
+
+  std::vector<std::thread> threads;
+  for (int i = 0; i < nthreads; i++) {
+    threads.emplace_back(thread_func);
+  }
+
+  // Reads while the threads run
+  std::uint32_t last_sequence = 0;
+  for (int i = 0; i < 10; i++) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(3));
+    check(reader.read(header, names, entries), "Read segment");
+    check(!(header.sequence_.load() & 1) && (header.sequence_.load() >= last_sequence), "Sequence");
+    last_sequence = header.sequence_.load();
+  }
+
+  for (auto& t : threads) {
+    t.join();
+  }
+
+  // Makes sure that an update took place after the threads finished
+  std::this_thread::sleep_for(std::chrono::milliseconds(50));
+  check(reader.read(header, names, entries), "Final read");
+
+  const int live = ThreadInstrument::getEventNumber("live");
+  const ThreadInstrument::EventData& ed = ThreadInstrument::getAllActivity()[live];
+
+  std::map<std::uint32_t, unsigned> invocations;
+  double time = 0.0;
+  for (const auto& entry : entries) {
+    if (entry.event_ == live) {
+      invocations[entry.thread_] += entry.invocations_;
+      time += entry.time_;
+    }
+  }
+
+  check(header.pid_ == getpid(), "Process");
+  check(invocations.size() == static_cast<size_t>(nthreads), "Threads published");
+  for (const auto& thread_invocations : invocations) {
+    check(thread_invocations.second == NReps, "Invocations published");
+  }
+  check(std::abs(time - ed.time) < 1e-9, "Time published");
+  check((names.size() == 1) && (names[0].event_ == live) && !strcmp(names[0].name_, "live"), "Names published");
+
+  ThreadInstrument::stopLiveMetrics();
+  check(reader.read(header, names, entries) && (header.flags_ & ThreadInstrument::LiveMetricsStopped), "Stopped");
+  reader.close();
+  check(!reader.open(segment_name), "Segment removed");
+  check(gives_up_on_stale_segment(), "Stale segment");
+
+  return testResult();
+}
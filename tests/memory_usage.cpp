@@ -0,0 +1,157 @@
+/*
+ ThreadInstrument: Library to monitor thread activity
+ Copyright (C) 2012-2022 Basilio B. Fraguela. Universidade da Coruna
+
+ Distributed under the MIT License. (See accompanying file LICENSE)
+*/
+
+///
+/// \file     memory_usage.cpp
+/// \brief    Tests the accounting of the memory used by the library, its budget and the reclamation of exited threads
+/// \author   Basilio B. Fraguela <basilio.fraguela@udc.es>
+///
+
+#include <cstdlib>
+#include <atomic>
+#include <iostream>
+#include <thread>
+#include <vector>
+#include "thread_instrument/thread_instrument.h"
+#include "check.h"
+
+constexpr int NThreads = 4;
+constexpr int NWaves = 10;
+constexpr int NLogs = 1000;
+constexpr int NActivities = 100;
+
+/// Threads of the current wave that did not finish their activities yet, so that all of them coexist
+std::atomic<int> NWaiting {0};
+
+void log_func(int n)
+{
+  for (int i = 0; i < n; i++) {
+    ThreadInstrument::log("VALUE", i);
+  }
+}
+
+void activity_func()
+{
+  for (int i = 0; i < NActivities; i++) {
+    ThreadInstrument::beginActivity("WORK");
+    ThreadInstrument::endActivity("WORK");
+  }
+  NWaiting--;
+  while (NWaiting.load()) {
+    std::this_thread::yield();
+  }
+}
+
+/// Records an activity when destroyed, which happens after the reclamation of the data of its thread if it was built before
+struct LateActivity {
+
+  /// Only ensures the construction of the thread_local object
+  void touch() noexcept { }
+
+  ~LateActivity()
+  {
+    ThreadInstrument::beginActivity("LATE");
+    ThreadInstrument::endActivity("LATE");
+  }
+
+};
+
+thread_local LateActivity MyLateActivity;
+
+void late_activity_func()
+{
+  MyLateActivity.touch();
+  activity_func();
+}
+
+void run_threads(void (*f)())
+{ std::vector<std::thread> threads;
+
+  NWaiting = NThreads;
+  for (int i = 0; i < NThreads; i++) {
+    threads.emplace_back(f);
+  }
+  for (auto& t : threads) {
+    t.join();
+  }
+}
+
+int main()
+{
+  // Per-thread accounting
+  log_func(NLogs);
+  std::thread t(log_func, 2 * NLogs);
+  t.join();
+
+  ThreadInstrument::MemoryUsage usage = ThreadInstrument::memoryUsage();
+  check(usage.threads.size() == 2, "Usage of each thread");
+  check(usage.logEntries == 3 * NLogs, "Log entries pending");
+  if (usage.threads.size() == 2) {
+    check(usage.threads[0].logEntries == NLogs, "Log entries of the main thread");
+    check(usage.threads[1].logEntries == 2 * NLogs, "Log entries of the second thread");
+    check(usage.threads[0].logBytes > 0 && usage.threads[1].logBytes > 0, "Log bytes of each thread");
+  }
+  check(usage.logBytes >= usage.threads[0].logBytes + usage.threads[1].logBytes, "Log bytes");
+  check(usage.registryBytes > 0, "Registry bytes");
+  check(usage.totalBytes == usage.logBytes + usage.activityBytes + usage.registryBytes, "Total bytes");
+  check(usage.droppedLogEntries == 0, "No entries dropped without budget");
+
+  NWaiting = 1;
+  activity_func();
+  const std::size_t activity_bytes = ThreadInstrument::memoryUsage().activityBytes;
+  check(activity_bytes > usage.activityBytes, "Activity bytes");
+
+  // Budget: once the storage available is used, the new entries are dropped
+  ThreadInstrument::clearLog();
+  usage = ThreadInstrument::memoryUsage();
+  check(usage.logEntries == 0, "Log consumed");
+  ThreadInstrument::setMemoryBudget(usage.totalBytes);
+  const int nbudget_logs = 100 * NLogs;
+  std::thread t_budget(log_func, nbudget_logs);
+  t_budget.join();
+  usage = ThreadInstrument::memoryUsage();
+  check(usage.budget == usage.totalBytes, "Budget reported");
+  check(usage.droppedLogEntries > 0, "Entries dropped beyond the budget");
+  check(usage.logEntries + usage.droppedLogEntries == nbudget_logs, "Entries kept or dropped");
+  check(usage.threads.back().droppedLogEntries == usage.droppedLogEntries, "Entries dropped by the thread");
+  ThreadInstrument::setMemoryBudget(0);
+  ThreadInstrument::clearLog();
+
+  // Reclamation of the data of the threads that exit
+  ThreadInstrument::reclaimExitedThreads();
+  const unsigned nthreads = ThreadInstrument::nThreadsWithActivity();
+  for (int i = 0; i < NWaves; i++) {
+    run_threads(activity_func);
+  }
+  check(ThreadInstrument::nThreadsWithActivity() <= nthreads + NThreads, "Number of threads bounded");
+
+  const ThreadInstrument::Int2EventDataMap_t m = ThreadInstrument::getAllActivity();
+  const auto it = m.find(ThreadInstrument::getEventNumber("WORK"));
+  check((it != m.end()) && (it->second.invocations == (NWaves * NThreads + 1) * NActivities), "Activity of the exited threads");
+
+  // The activity recorded after the reclamation, as in the destructors of other thread_local objects, is discarded
+  for (int i = 0; i < NWaves; i++) {
+    run_threads(late_activity_func);
+  }
+  check(ThreadInstrument::nThreadsWithActivity() <= nthreads + NThreads, "No threads registered after their reclamation");
+  check(!ThreadInstrument::getAllActivity().count(ThreadInstrument::getEventNumber("LATE")), "Activity after the reclamation discarded");
+
+  usage = ThreadInstrument::memoryUsage();
+  unsigned nexited = 0;
+  for (const ThreadInstrument::ThreadMemoryUsage& thread_usage : usage.threads) {
+    if (thread_usage.exited) {
+      nexited++;
+      check(thread_usage.activityBytes == 0, "Activity of the exited threads released");
+    }
+  }
+  check(nexited >= NThreads, "Exited threads");
+
+  ThreadInstrument::clearAllActivity();
+  check(!ThreadInstrument::getAllActivity().count(ThreadInstrument::getEventNumber("WORK")), "Activity of the exited threads cleared");
+
+  return testResult();
+}
@@ -0,0 +1,117 @@
+/*
+ ThreadInstrument: Library to monitor thread activity
+ Copyright (C) 2012-2022 Basilio B. Fraguela. Universidade da Coruna
+
+ Distributed under the MIT License. (See accompanying file LICENSE)
+*/
+
+///
+/// \file     nested_prof.cpp
+/// \brief    Tests the exclusive times and call paths measured under nested profiling
+/// \author   Basilio B. Fraguela <basilio.fraguela@udc.es>
+///
+
+#include <cstdlib>
+#include <cmath>
+#include <iostream>
+#include <vector>
+#include <thread>
+#include "thread_instrument/thread_instrument.h"
+#include "check.h"
+
+constexpr int NReps = 3;
+constexpr int RecursionDepth = 3;
+
+void wait_ms(int ms)
+{
+  std::this_thread::sleep_for(std::chrono::milliseconds(ms));
+}
+
+void recursive(int level)
+{
+  THREADINSTRUMENT_PROF("Recursive",
+                        wait_ms(5);
+                        if (level + 1 < RecursionDepth) {
+                          recursive(level + 1);
+                        }
+                        );
+}
+
+void thread_func()
+{
+  for (int i = 0; i < NReps; i++) {
+    THREADINSTRUMENT_PROF("Outer",
+                          wait_ms(10);
+                          THREADINSTRUMENT_PROF("Inner", wait_ms(20));
+                          );
+    recursive(0);
+  }
+}
+
+/// Whether \c t is close to the \c ms milliseconds expected given that sleeps can only last longer
+bool about(double t, unsigned ms)
+{
+  return (t >= ms * 1e-3 * 0.99) && (t < ms * 1e-3 * 1.5 + 0.01);
+}
+
+int main(int argc, char **argv)
+{
+  const int nthreads = (argc == 1) ? 2 : atoi(argv[1]);
+
+  ThreadInstrument::enableNestedProfiling();
+
+  std::vector<std::thread> threads;
+  for (int i = 0; i < nthreads; i++) {
+    threads.emplace_back(thread_func);
+  }
+  for (auto& t : threads) {
+    t.join();
+  }
+
+  const int outer = ThreadInstrument::getEventNumber("Outer");
+  const int inner = ThreadInstrument::getEventNumber("Inner");
+  const int rec = ThreadInstrument::getEventNumber("Recursive");
+
+  ThreadInstrument::Int2EventDataMap_t activity = ThreadInstrument::getAllActivity();
+  ThreadInstrument::dumpActivity(activity);
+
+  const unsigned n = nthreads * NReps;
+  check(activity[outer].invocations == n, "Outer invocations");
+  check(about(activity[outer].time, n * 30), "Outer inclusive time");
+  check(about(activity[outer].exclusiveTime, n * 10), "Outer exclusive time");
+  check(about(activity[inner].exclusiveTime, n * 20), "Inner exclusive time");
+  check(activity[rec].invocations == n * RecursionDepth, "Recursive invocations");
+  check(about(activity[rec].time, n * 5 * RecursionDepth), "Recursive time counted once");
+  check(std::abs(activity[rec].time - activity[rec].exclusiveTime) < 1e-6, "Recursive exclusive time");
+  check(!activity[rec].currentlyRunning && !activity[rec].depth, "Recursive not running");
+
+  ThreadInstrument::CallPath2DataMap_t paths = ThreadInstrument::getAllCallPaths();
+  ThreadInstrument::dumpCallPaths(paths);
+
+  check(paths.size() == static_cast<size_t>(2 + RecursionDepth), "Number of call paths");
+  check(paths[{outer, inner}].invocations == n, "Outer/Inner invocations");
+  check(about(paths[{outer, inner}].time, n * 20), "Outer/Inner time");
+  ThreadInstrument::CallPath_t path;
+  for (int i = 0; i < RecursionDepth; i++) {
+    path.push_back(rec);
+    check(paths[path].invocations == n, "Recursive path invocations");
+    check(about(paths[path].exclusiveTime, n * 5), "Recursive path exclusive time");
+  }
+
+  // Clearing the statistics while an activity runs keeps its frame, so that its end pops it
+  ThreadInstrument::beginActivity(outer);
+  ThreadInstrument::clearAllActivity();
+  wait_ms(5);
+  ThreadInstrument::endActivity(outer);
+  ThreadInstrument::beginActivity(inner);
+  ThreadInstrument::endActivity(inner);
+
+  activity = ThreadInstrument::getAllActivity();
+  check((activity[outer].invocations == 1u) && about(activity[outer].time, 5), "Activity running when cleared");
+  check(!activity[outer].currentlyRunning, "Activity running when cleared ended");
+  paths = ThreadInstrument::getAllCallPaths();
+  check(paths.size() == 2, "Call paths after clearing");
+  check(!paths.count({outer, inner}) && (paths[{inner}].invocations == 1u), "No dead parent after clearing");
+
+  return testResult();
+}
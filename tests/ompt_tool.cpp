@@ -0,0 +1,88 @@
+/*
+ ThreadInstrument: Library to monitor thread activity
+ Copyright (C) 2012-2022 Basilio B. Fraguela. Universidade da Coruna
+
+ Distributed under the MIT License. (See accompanying file LICENSE)
+*/
+
+///
+/// \file     ompt_tool.cpp
+/// \brief    Tests the activities recorded by the OMPT tool without instrumenting the OpenMP code
+/// \author   Basilio B. Fraguela <basilio.fraguela@udc.es>
+///
+
+#include <cstdlib>
+#include <iostream>
+#include <chrono>
+#include <thread>
+#include <omp.h>
+#include "thread_instrument/ompt_tool.h"
+#include "check.h"
+
+constexpr int NThreads = 4;
+constexpr int NRegions = 3;
+constexpr int NTasks = 16;
+
+void wait_ms(int ms)
+{
+  std::this_thread::sleep_for(std::chrono::milliseconds(ms));
+}
+
+ThreadInstrument::EventData& activity(ThreadInstrument::Int2EventDataMap_t& m, const char *name)
+{
+  return m[ThreadInstrument::getEventNumber(name)];
+}
+
+int main()
+{
+  ThreadInstrument::enableNestedProfiling();
+
+  for (int r = 0; r < NRegions; r++) {
+#pragma omp parallel num_threads(NThreads)
+    {
+      // Imbalanced loop, so that the threads wait in its barrier. GCC runs static schedules without calling the runtime
+#pragma omp for schedule(dynamic, 1)
+      for (int i = 0; i < NThreads; i++) {
+        wait_ms(5 * (i + 1));
+      }
+
+#pragma omp single
+      {
+        for (int i = 0; i < NTasks; i++) {
+#pragma omp task
+          wait_ms(1);
+        }
+#pragma omp taskwait
+      }
+    }
+    wait_ms(10);
+  }
+
+  check(ThreadInstrument::OMPT::active(), "OMPT tool started by the runtime");
+
+  ThreadInstrument::Int2EventDataMap_t activities = ThreadInstrument::getAllActivity();
+  ThreadInstrument::dumpActivity(activities);
+
+  check(activity(activities, ThreadInstrument::OMPT::Parallel).invocations == NRegions, "Parallel regions");
+  check(activity(activities, ThreadInstrument::OMPT::ImplicitTask).invocations == NThreads * NRegions, "Implicit tasks");
+  check(activity(activities, ThreadInstrument::OMPT::Loop).invocations == NThreads * NRegions, "Worksharing loops");
+  check(activity(activities, ThreadInstrument::OMPT::Single).invocations == NRegions, "Single regions run");
+  check(activity(activities, ThreadInstrument::OMPT::Taskwait).invocations == NRegions, "Taskwaits");
+  check(activity(activities, ThreadInstrument::OMPT::Task).invocations == NTasks * NRegions, "Explicit tasks");
+  check(activity(activities, ThreadInstrument::OMPT::Task).time >= NTasks * NRegions * 1e-3, "Explicit tasks time");
+  check(activity(activities, ThreadInstrument::OMPT::Barrier).invocations >= 2 * NThreads * NRegions, "Barriers");
+  // Threads 0 to 2 wait for thread 3 in the loop barrier
+  check(activity(activities, ThreadInstrument::OMPT::Wait).time >= NRegions * (15 + 10 + 5) * 1e-3, "Time waiting in barriers");
+  // The workers are idle at least while the initial thread sleeps between the regions
+  check(activity(activities, ThreadInstrument::OMPT::Idle).time >= (NThreads - 1) * (NRegions - 1) * 10e-3, "Idle time of the workers");
+
+  ThreadInstrument::CallPath2DataMap_t paths = ThreadInstrument::getAllCallPaths();
+  ThreadInstrument::dumpCallPaths(paths);
+  const int implicit_task = ThreadInstrument::getEventNumber(ThreadInstrument::OMPT::ImplicitTask);
+  const int loop = ThreadInstrument::getEventNumber(ThreadInstrument::OMPT::Loop);
+  const int parallel = ThreadInstrument::getEventNumber(ThreadInstrument::OMPT::Parallel);
+  check(paths[{implicit_task, loop}].invocations == (NThreads - 1) * NRegions, "Loops in the implicit tasks of the workers");
+  check(paths[{parallel, implicit_task, loop}].invocations == NRegions, "Loops in the implicit tasks of the initial thread");
+
+  return testResult();
+}
@@ -0,0 +1,91 @@
+/*
+ ThreadInstrument: Library to monitor thread activity
+ Copyright (C) 2012-2022 Basilio B. Fraguela. Universidade da Coruna
+
+ Distributed under the MIT License. (See accompanying file LICENSE)
+*/
+
+///
+/// \file     perf_counters.cpp
+/// \brief    Tests the counting of hardware events per activity
+/// \author   Basilio B. Fraguela <basilio.fraguela@udc.es>
+///
+
+#include <cstdlib>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include "thread_instrument/thread_instrument.h"
+#include "check.h"
+
+constexpr int NThreads = 2;
+constexpr int NReps = 20;
+constexpr int NIterations = 100000;
+
+void thread_func()
+{ volatile int accum = 0;
+
+  for (int i = 0; i < NReps; i++) {
+    THREADINSTRUMENT_PROF("Compute",
+                          for (int j = 0; j < NIterations; j++) {
+                            accum = accum + j;
+                          }
+                          );
+  }
+}
+
+int main()
+{
+  const bool available = ThreadInstrument::enablePerfCounters();
+
+  if (!available) {
+    std::cout << "Hardware counters not available, only checking that nothing is counted\n";
+  }
+
+  std::vector<std::thread> threads;
+  for (int i = 0; i < NThreads; i++) {
+    threads.emplace_back(thread_func);
+  }
+  for (auto& t : threads) {
+    t.join();
+  }
+
+  ThreadInstrument::Int2EventDataMap_t activity = ThreadInstrument::getAllActivity();
+  std::ostringstream os;
+  ThreadInstrument::dumpActivity(activity, nullptr, os);
+  std::cout << os.str();
+
+  const ThreadInstrument::EventData& ed = activity[ThreadInstrument::getEventNumber("Compute")];
+  check(ed.invocations == NThreads * NReps, "Invocations");
+
+  if (available) {
+    check(ed.countedSamples == NThreads * NReps, "All the invocations counted");
+    if (ThreadInstrument::perfCounterAvailable(ThreadInstrument::PerfInstructions)) {
+      // Each iteration runs at least a load, an addition and a store
+      check(ed.counters[ThreadInstrument::PerfInstructions] >= 3ull * NIterations * NThreads * NReps, "Instructions");
+    }
+    if (ThreadInstrument::perfCounterAvailable(ThreadInstrument::PerfCycles)) {
+      check(ed.counters[ThreadInstrument::PerfCycles] > 0, "Cycles");
+    }
+    check(os.str().find("per invocation") != std::string::npos, "Counters dumped");
+
+    ThreadInstrument::enablePerfCounters(false);
+    thread_func();
+    const ThreadInstrument::EventData ed2 = ThreadInstrument::getAllActivity()[ThreadInstrument::getEventNumber("Compute")];
+    check(ed2.countedSamples == NThreads * NReps, "Nothing counted after disabling the counters");
+
+    // The threads open their counters again after each enabling
+    check(ThreadInstrument::enablePerfCounters(), "Counters enabled again");
+    std::thread t(thread_func);
+    t.join();
+    const ThreadInstrument::EventData ed3 = ThreadInstrument::getAllActivity()[ThreadInstrument::getEventNumber("Compute")];
+    check(ed3.countedSamples == (NThreads + 1) * NReps, "Counted after enabling the counters again");
+  } else {
+    check(!ed.countedSamples, "Nothing counted");
+    check(os.str().find("per invocation") == std::string::npos, "No counters dumped");
+  }
+
+  return testResult();
+}
@@ -0,0 +1,59 @@
+/*
+ ThreadInstrument: Library to monitor thread activity
+ Copyright (C) 2012-2022 Basilio B. Fraguela. Universidade da Coruna
+
+ Distributed under the MIT License. (See accompanying file LICENSE)
+*/
+
+///
+/// \file     picture_time.cpp
+/// \brief    Tests the pictureTime application on the log of two threads, including selections without events
+/// \author   Basilio B. Fraguela <basilio.fraguela@udc.es>
+///
+
+#include <cstdlib>
+#include <cstdio>
+#include <iostream>
+#include <string>
+#include <thread>
+#include "thread_instrument/thread_instrument.h"
+#include "check.h"
+
+constexpr int NReps = 10;
+
+const char * const LogFile = "picture_time_log.txt";
+
+void thread_func()
+{
+  for (int i = 0; i < NReps; i++) {
+    THREADINSTRUMENT_TIMED_LOG("work", );
+  }
+}
+
+/// Whether pictureTime run with the \c options on ::LogFile finishes successfully
+bool picture_time(const std::string& options)
+{
+  const std::string command = std::string(PICTURETIME_PATH) + ' ' + options + ' ' + LogFile + " > /dev/null";
+  return std::system(command.c_str()) == 0;
+}
+
+int main()
+{
+  std::thread t(thread_func);
+  thread_func();
+  t.join();
+
+  ThreadInstrument::registerLogPrinter(ThreadInstrument::pictureTimePrinter);
+  ThreadInstrument::dumpLog(LogFile);
+
+  check(picture_time(""), "Whole log");
+  check(picture_time("--threads 1"), "Selected thread");
+  // The selections without events are normal results
+  check(picture_time("--from 1000"), "Empty window");
+  check(picture_time("--threads 7"), "Threads without events");
+  check(picture_time("-a json --from 1000"), "Analysis of an empty window");
+
+  std::remove(LogFile);
+
+  return testResult();
+}
@@ -0,0 +1,98 @@
+/*
+ ThreadInstrument: Library to monitor thread activity
+ Copyright (C) 2012-2022 Basilio B. Fraguela. Universidade da Coruna
+
+ Distributed under the MIT License. (See accompanying file LICENSE)
+*/
+
+///
+/// \file     process_info.cpp
+/// \brief    Tests the process information and the clock synchronization stored in the binary logs
+/// \author   Basilio B. Fraguela <basilio.fraguela@udc.es>
+///
+
+#include <cstdio>
+#include <cstdlib>
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <unistd.h>
+#include "thread_instrument/thread_instrument.h"
+#include "thread_instrument/binary_log.h"
+#include "check.h"
+
+/// Offset of the clock of the simulated reference process
+constexpr std::int64_t ReferenceOffset = 5000000000;
+
+/// Error allowed in the estimation of the offset, in nanoseconds
+constexpr std::int64_t MaxError = 1000000;
+
+std::int64_t systemClockTime()
+{
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+/// Simulates an exchange of messages with a process whose clock is ReferenceOffset ahead
+std::int64_t referenceTime()
+{
+  std::this_thread::sleep_for(std::chrono::microseconds(100));
+  const std::int64_t t = ThreadInstrument::syncClockTime() + ReferenceOffset;
+  std::this_thread::sleep_for(std::chrono::microseconds(100));
+  return t;
+}
+
+int main()
+{
+  check(std::llabs(ThreadInstrument::syncClockTime() - systemClockTime()) < 1000000000, "Synchronization clock close to the system clock");
+
+  ThreadInstrument::setProcessInfo(3, "node7");
+  check(ThreadInstrument::processRank() == 3, "Rank");
+
+  const std::int64_t offset = ThreadInstrument::synchronizeClock(referenceTime);
+  std::cout << "Offset estimated: " << offset << "ns\n";
+  check(std::llabs(offset - ReferenceOffset) < MaxError, "Offset estimated");
+  check(ThreadInstrument::clockOffset() == offset, "Offset set");
+
+  ThreadInstrument::log("EVENT", 1, true);
+  const std::int64_t log_time = ThreadInstrument::syncClockTime();
+  ThreadInstrument::dumpLogBinary("process_info.bin");
+
+  ThreadInstrument::BinaryLogSectionHeader section;
+  ThreadInstrument::BinaryLogProcess process;
+  ThreadInstrument::BinaryLogRecord record;
+  std::string host;
+  int nprocesses = 0, nrecords = 0;
+
+  FILE *fin = fopen("process_info.bin", "rb");
+  ThreadInstrument::BinaryLogReader reader(fin);
+  check((fin != nullptr) && reader.open(), "Valid binary log");
+
+  while (reader.nextSection(section)) {
+    if (section.kind_ == ThreadInstrument::BinaryLogProcesses) {
+      while (reader.readProcess(process, host)) {
+        nprocesses++;
+        check(process.rank_ == 3, "Rank stored");
+        check(host == "node7", "Host stored");
+        check(process.pid_ == static_cast<std::uint64_t>(getpid()), "Process identifier stored");
+        check(process.clockOffset_ == offset, "Offset stored");
+        check((process.firstThread_ == 0) && (process.threads_ == 0), "All the threads belong to the process");
+      }
+    } else if (section.kind_ == ThreadInstrument::BinaryLogEvents) {
+      while (reader.readRecord(record)) {
+        nrecords++;
+        // The record is placed in the clock of the process by the start time
+        const std::int64_t record_time = process.startTime_ + record.time_ * 1000000000 / static_cast<std::int64_t>(reader.header().ticksPerSecond_);
+        check((record_time <= log_time) && (log_time - record_time < MaxError), "Start time of the process");
+      }
+    }
+  }
+
+  if (fin != nullptr) {
+    fclose(fin);
+  }
+  check(nprocesses == 1, "One process");
+  check(nrecords == 1, "One record");
+
+  return testResult();
+}
@@ -0,0 +1,137 @@
+/*
+ ThreadInstrument: Library to monitor thread activity
+ Copyright (C) 2012-2022 Basilio B. Fraguela. Universidade da Coruna
+
+ Distributed under the MIT License. (See accompanying file LICENSE)
+*/
+
+///
+/// \file     sampling.cpp
+/// \brief    Tests the sampling of activities and log entries
+/// \author   Basilio B. Fraguela <basilio.fraguela@udc.es>
+///
+
+#include <cstdlib>
+#include <cmath>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <thread>
+#include "thread_instrument/thread_instrument.h"
+#include "check.h"
+
+constexpr int NReps = 200000;
+constexpr int NLogs = 100000;
+constexpr int NPairs = 20000;
+constexpr unsigned Period = 10;
+
+volatile double Sink = 0.0;
+
+/// Busy work whose duration is roughly constant
+void work()
+{ double d = Sink;
+
+  for (int i = 0; i < 200; i++) {
+    d = d * 0.999 + 1.0;
+  }
+  Sink = d;
+}
+
+void thread_func()
+{
+  for (int i = 0; i < NReps; i++) {
+    THREADINSTRUMENT_PROF("hot", work());
+    THREADINSTRUMENT_PROF("full", work());
+  }
+  for (int i = 0; i < NLogs; i++) {
+    ThreadInstrument::log("sampled_log", i);
+    ThreadInstrument::log("full_log", i);
+  }
+  for (int i = 0; i < NPairs; i++) {
+    THREADINSTRUMENT_TIMED_LOG("sampled_pair", THREADINSTRUMENT_TIMED_LOG("sampled_pair", work()));
+  }
+}
+
+/// Counts the lines of the log dumped that contain \c event
+unsigned count_log(const std::string& log, const std::string& event)
+{ std::istringstream is(log);
+  std::string line;
+  unsigned n = 0;
+
+  while (std::getline(is, line)) {
+    n += (line.find(event) != std::string::npos);
+  }
+  return n;
+}
+
+/// Checks that each beginning of \c event in \c log has its end in the same thread, returning the number of pairs
+unsigned count_pairs(const std::string& log, const std::string& event)
+{ std::istringstream is(log);
+  std::string line;
+  std::map<std::string, int> depth;
+  unsigned n = 0;
+
+  while (std::getline(is, line)) {
+    if (line.find(' ' + event) != std::string::npos) {
+      int& thread_depth = depth[line.substr(0, 5)];
+      if (line.back() == '0') {
+        thread_depth++;
+        n++;
+      } else {
+        check(--thread_depth >= 0, "End of a pair without beginning");
+      }
+    }
+  }
+  for (const auto& thread_depth : depth) {
+    check(thread_depth.second == 0, "Beginning of a pair without end");
+  }
+  return n;
+}
+
+int main(int argc, char **argv)
+{
+  const int nthreads = (argc == 1) ? 2 : atoi(argv[1]);
+
+  ThreadInstrument::setSampling("hot", Period);
+  ThreadInstrument::setSampling("sampled_log", Period);
+  ThreadInstrument::setSampling("sampled_pair", Period);
+
+  std::vector<std::thread> threads;
+  for (int i = 0; i < nthreads; i++) {
+    threads.emplace_back(thread_func);
+  }
+  for (auto& t : threads) {
+    t.join();
+  }
+
+  ThreadInstrument::Int2EventDataMap_t activity = ThreadInstrument::getAllActivity();
+  ThreadInstrument::dumpActivity(activity);
+
+  const ThreadInstrument::EventData& hot = activity[ThreadInstrument::getEventNumber("hot")];
+  const ThreadInstrument::EventData& full = activity[ThreadInstrument::getEventNumber("full")];
+  const unsigned n = nthreads * NReps;
+
+  check(hot.invocations == n, "Exact invocations of sampled activity");
+  check(full.invocations == n && full.samples == n, "Invocations of full activity");
+  check(std::abs(static_cast<double>(hot.samples) - n / Period) < 0.1 * n / Period, "Number of samples");
+  check(hot.timeError > 0.0 && full.timeError == 0.0, "Error estimate");
+  check(std::abs(hot.time - full.time) < 0.3 * full.time, "Extrapolated time");
+
+  std::ostringstream os;
+  ThreadInstrument::dumpLog(os);
+  const std::string log = os.str();
+  const unsigned full_logs = count_log(log, "full_log");
+  const unsigned sampled_logs = count_log(log, "sampled_log");
+  std::cout << full_logs << " full log entries, " << sampled_logs << " sampled log entries\n";
+
+  check(full_logs == static_cast<unsigned>(nthreads * NLogs), "Log entries of full event");
+  check(std::abs(static_cast<double>(sampled_logs) - nthreads * NLogs / Period) < 0.1 * nthreads * NLogs / Period, "Log entries of sampled event");
+
+  const unsigned sampled_pairs = count_pairs(log, "sampled_pair");
+  std::cout << sampled_pairs << " sampled pairs of log entries\n";
+  check(std::abs(static_cast<double>(sampled_pairs) - 2. * nthreads * NPairs / Period) < 0.1 * 2. * nthreads * NPairs / Period, "Pairs of log entries sampled");
+
+  return testResult();
+}
@@ -0,0 +1,137 @@
+/*
+ ThreadInstrument: Library to monitor thread activity
+ Copyright (C) 2012-2022 Basilio B. Fraguela. Universidade da Coruna
+
+ Distributed under the MIT License. (See accompanying file LICENSE)
+*/
+
+///
+/// \file     snapshot.cpp
+/// \brief    Tests the consistency of the activity statistics read while the threads update them
+/// \author   Basilio B. Fraguela <basilio.fraguela@udc.es>
+///
+
+#include <cstdlib>
+#include <iostream>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include "thread_instrument/thread_instrument.h"
+#include "check.h"
+
+constexpr int NPolls = 200;
+
+std::atomic<bool> Stop {false};
+
+volatile double Sink = 0.0;
+
+void work()
+{ double d = Sink;
+
+  for (int i = 0; i < 100; i++) {
+    d = d * 0.999 + 1.0;
+  }
+  Sink = d;
+}
+
+void thread_func()
+{
+  while (!Stop) {
+    THREADINSTRUMENT_PROF("outer",
+                          work();
+                          THREADINSTRUMENT_PROF("inner", work());
+                          );
+  }
+}
+
+std::atomic<int> Step {0};
+
+/// Waits until ::Step reaches \c step
+void wait_step(int step)
+{
+  while (Step.load() < step) {
+    std::this_thread::yield();
+  }
+}
+
+/// Runs "cleared" with "nested" inside it, the statistics being cleared by another thread meanwhile
+void cleared_thread_func()
+{
+  ThreadInstrument::beginActivity("cleared");
+  Step = 1;
+  wait_step(2);
+  // The clearing is applied here, when "cleared" is still running
+  THREADINSTRUMENT_PROF("nested", work());
+  ThreadInstrument::endActivity("cleared");
+  THREADINSTRUMENT_PROF("after", work());
+}
+
+/// Checks the invariants of the statistics of an activity whose running invocations are at most \c nthreads
+void check_activity(const ThreadInstrument::EventData& ed, unsigned nthreads)
+{
+  check((ed.samples <= ed.invocations) && (ed.invocations - ed.samples <= nthreads), "Samples of the invocations");
+  check(ed.depth <= nthreads, "Depth");
+  check(!ed.samples || ((ed.minTime <= ed.meanTime) && (ed.meanTime <= ed.maxTime)), "Distribution");
+  check(ed.time >= 0.0, "Time");
+}
+
+int main(int argc, char **argv)
+{
+  const unsigned nthreads = (argc == 1) ? 2 : atoi(argv[1]);
+  unsigned last_invocations = 0;
+
+  const int outer = ThreadInstrument::getEventNumber("outer");
+  const int inner = ThreadInstrument::getEventNumber("inner");
+
+  std::vector<std::thread> threads;
+  for (unsigned i = 0; i < nthreads; i++) {
+    threads.emplace_back(thread_func);
+  }
+
+  for (int i = 0; i < NPolls; i++) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    ThreadInstrument::Int2EventDataMap_t activity = ThreadInstrument::getAllActivity();
+    check_activity(activity[outer], nthreads);
+    check_activity(activity[inner], nthreads);
+    check(activity[inner].invocations + nthreads >= activity[outer].invocations, "Nesting");
+    if (i == NPolls / 2) {
+      ThreadInstrument::clearAllActivity();
+      activity = ThreadInstrument::getAllActivity();
+      check(activity.empty(), "Clearing");
+    } else if (i != NPolls / 2 + 1) {
+      check(activity[outer].invocations >= last_invocations, "Monotonic invocations");
+    }
+    last_invocations = activity[outer].invocations;
+  }
+
+  Stop = true;
+  for (auto& t : threads) {
+    t.join();
+  }
+
+  ThreadInstrument::Int2EventDataMap_t activity = ThreadInstrument::getAllActivity();
+  ThreadInstrument::dumpActivity(activity);
+  // The invocations of outer running when the activity was cleared are kept, but their inner may have already finished
+  check((activity[outer].invocations <= activity[inner].invocations + nthreads) && (activity[inner].invocations <= activity[outer].invocations + nthreads), "Final invocations");
+  check(activity[outer].invocations >= last_invocations, "Final monotonic invocations");
+
+  // Another thread clears the statistics while a nested activity is running
+  ThreadInstrument::enableNestedProfiling();
+  std::thread cleared_thread(cleared_thread_func);
+  wait_step(1);
+  ThreadInstrument::clearAllActivity();
+  Step = 2;
+  cleared_thread.join();
+
+  const int cleared = ThreadInstrument::getEventNumber("cleared");
+  const int nested = ThreadInstrument::getEventNumber("nested");
+  const int after = ThreadInstrument::getEventNumber("after");
+  activity = ThreadInstrument::getAllActivity();
+  check((activity[cleared].invocations == 1u) && (activity[cleared].samples == 1u), "Activity running when cleared");
+  ThreadInstrument::CallPath2DataMap_t paths = ThreadInstrument::getAllCallPaths();
+  ThreadInstrument::dumpCallPaths(paths);
+  check(paths[{cleared, nested}].invocations == 1u, "Path of the activity nested after the clearing");
+  check(!paths.count({cleared, after}) && (paths[{after}].invocations == 1u), "Path of the activity after the clearing");
+
+  return testResult();
+}
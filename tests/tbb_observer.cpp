@@ -0,0 +1,76 @@
+/*
+ ThreadInstrument: Library to monitor thread activity
+ Copyright (C) 2012-2022 Basilio B. Fraguela. Universidade da Coruna
+
+ Distributed under the MIT License. (See accompanying file LICENSE)
+*/
+
+///
+/// \file     tbb_observer.cpp
+/// \brief    Tests the recording of the activity of the TBB workers and tasks
+/// \author   Basilio B. Fraguela <basilio.fraguela@udc.es>
+///
+
+#include <cstdlib>
+#include <iostream>
+#include <chrono>
+#include <thread>
+#include <tbb/blocked_range.h>
+#include <tbb/parallel_for.h>
+#include <tbb/task_group.h>
+#include "thread_instrument/tbb_observer.h"
+#include "check.h"
+
+constexpr int NThreads = 4;
+constexpr int NChunks = 64;
+constexpr int NTasks = 8;
+
+void wait_ms(int ms)
+{
+  std::this_thread::sleep_for(std::chrono::milliseconds(ms));
+}
+
+int main()
+{
+  ThreadInstrument::enableNestedProfiling();
+
+  tbb::task_arena arena(NThreads);
+  {
+    ThreadInstrument::TBB::Observer observer(arena);
+
+    arena.execute([] {
+      tbb::parallel_for(tbb::blocked_range<int>(0, NChunks, 1),
+                        ThreadInstrument::TBB::task("Chunk", [](const tbb::blocked_range<int>&) { wait_ms(1); }),
+                        tbb::simple_partitioner());
+
+      tbb::task_group g;
+      for (int i = 0; i < NTasks; i++) {
+        g.run(ThreadInstrument::TBB::task([] { wait_ms(2); }));
+      }
+      g.wait();
+    });
+  }
+
+  const int chunk = ThreadInstrument::getEventNumber("Chunk");
+  const int task = ThreadInstrument::getEventNumber(ThreadInstrument::TBB::Task);
+  const int arena_activity = ThreadInstrument::getEventNumber(ThreadInstrument::TBB::Arena);
+
+  ThreadInstrument::Int2EventDataMap_t activities = ThreadInstrument::getAllActivity();
+  ThreadInstrument::dumpActivity(activities);
+
+  check(activities[chunk].invocations == NChunks, "Chunks of the parallel_for");
+  check(activities[chunk].time >= NChunks * 1e-3, "Time of the chunks");
+  check(activities[task].invocations == NTasks, "Tasks of the task_group");
+  check(activities[task].time >= NTasks * 2e-3, "Time of the tasks");
+
+  // A single hardware thread may not let the workers join the arena
+  if (activities[arena_activity].invocations) {
+    ThreadInstrument::CallPath2DataMap_t paths = ThreadInstrument::getAllCallPaths();
+    ThreadInstrument::dumpCallPaths(paths);
+    const unsigned in_workers = paths[{arena_activity, chunk}].invocations + paths[{arena_activity, task}].invocations;
+    check(in_workers > 0, "Work run by the workers in the arena");
+    check(activities[arena_activity].exclusiveTime <= activities[arena_activity].time, "Exclusive time of the workers in the arena");
+  }
+
+  return testResult();
+}
@@ -0,0 +1,155 @@
+/*
+ ThreadInstrument: Library to monitor thread activity
+ Copyright (C) 2012-2022 Basilio B. Fraguela. Universidade da Coruna
+
+ Distributed under the MIT License. (See accompanying file LICENSE)
+*/
+
+///
+/// \file     thread_names.cpp
+/// \brief    Tests the names and roles of the threads and their ordering in the dumps
+/// \author   Basilio B. Fraguela <basilio.fraguela@udc.es>
+///
+
+#include <cstdio>
+#include <cstdlib>
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include "thread_instrument/thread_instrument.h"
+#include "thread_instrument/binary_log.h"
+#include "check.h"
+
+constexpr int NWorkers = 4;
+
+/// Threads registered so far, so that they are numbered in their order of creation
+std::atomic<int> NRegistered {0};
+
+/// Makes the threads finish together, so that they do not reuse the identifiers of the previous ones
+std::atomic<bool> Finish {false};
+
+/// Worker of a pool, whose index in the pool is the reverse of the order in which it is registered
+void worker(int index)
+{
+  ThreadInstrument::setThreadRole("worker", index);
+  THREADINSTRUMENT_TIMED_LOG("WORK", ThreadInstrument::beginActivity("WORK"); ThreadInstrument::endActivity("WORK"));
+  NRegistered++;
+  while (!Finish) {
+    std::this_thread::yield();
+  }
+}
+
+void io_thread()
+{
+  ThreadInstrument::setThreadRole("io");
+  ThreadInstrument::setThreadName("disk");
+  ThreadInstrument::log("READ", 1);
+  NRegistered++;
+}
+
+/// Label name/role/index of each thread in the binary log \c filename, the last section of names prevailing
+std::map<std::uint32_t, std::string> read_labels(const char *filename)
+{ ThreadInstrument::BinaryLogSectionHeader section;
+  ThreadInstrument::BinaryLogThreadName thread_name;
+  std::map<std::uint32_t, std::string> labels;
+  std::string name, role;
+
+  FILE *fin = fopen(filename, "rb");
+  ThreadInstrument::BinaryLogReader reader(fin);
+  check((fin != nullptr) && reader.open(), "Valid binary log");
+  while (reader.nextSection(section)) {
+    if (section.kind_ == ThreadInstrument::BinaryLogThreadNames) {
+      while (reader.readThreadName(thread_name, name, role)) {
+        labels[thread_name.thread_] = name + '/' + role + '/' + std::to_string(thread_name.roleIndex_);
+      }
+    }
+  }
+  if (fin != nullptr) {
+    fclose(fin);
+  }
+  return labels;
+}
+
+int main()
+{
+  ThreadInstrument::setThreadName("main");
+
+  // Each thread is created once the previous one registered so that their numbers follow their creation
+  std::vector<std::thread> pool;
+  for (int i = NWorkers - 1; i >= 0; i--) {
+    pool.emplace_back(worker, i);
+    while (NRegistered != NWorkers - i) {
+      std::this_thread::yield();
+    }
+  }
+  std::thread t_io(io_thread);
+  t_io.join();
+  Finish = true;
+  for (auto& t : pool) {
+    t.join();
+  }
+
+  const std::vector<ThreadInstrument::ThreadInfo> threads = ThreadInstrument::getThreadsInfo();
+  check(threads.size() == NWorkers + 2, "All the threads");
+  if (threads.size() == NWorkers + 2) {
+    check(threads[0].thread == 0 && threads[0].label() == "main" && threads[0].roleIndex == -1, "Named thread without role first");
+    check(threads[1].label() == "disk" && threads[1].role == "io" && threads[1].roleIndex == 0, "Roles in alphabetical order");
+    for (int i = 0; i < NWorkers; i++) {
+      const ThreadInstrument::ThreadInfo& info = threads[2 + i];
+      check(info.role == "worker" && info.roleIndex == i, "Workers ordered by their index");
+      check(info.thread == static_cast<unsigned>(NWorkers - i), "Thread numbers follow the registration");
+      check(info.label() == "worker." + std::to_string(i), "Label built from the role");
+    }
+  }
+
+  std::ostringstream os_activity;
+  ThreadInstrument::dumpThreadsActivity(os_activity);
+  const std::string activity = os_activity.str();
+  const std::string::size_type pos0 = activity.find("Thread worker.0 (4)"), pos3 = activity.find("Thread worker.3 (1)");
+  check((pos0 != std::string::npos) && (pos3 != std::string::npos) && (pos0 < pos3), "Activity of each thread ordered by role");
+
+  std::ostringstream os_chrome;
+  ThreadInstrument::dumpLogChromeTrace(os_chrome);
+  const std::string trace = os_chrome.str();
+  check(trace.find("\"tid\":4,\"ts\":0.000,\"name\":\"thread_name\",\"args\":{\"name\":\"worker.0\"}") != std::string::npos, "Names in Chrome traces");
+  check(trace.find("\"tid\":4,\"ts\":0.000,\"name\":\"thread_sort_index\",\"args\":{\"sort_index\":2}") != std::string::npos, "Order in Chrome traces");
+
+  ThreadInstrument::log("MAIN", 1);
+  std::ostringstream os_log;
+  ThreadInstrument::dumpLog(os_log);
+  check(os_log.str().find("# Th  4 worker.0\n") != std::string::npos, "Threads listed in the text log");
+
+  ThreadInstrument::setThreadRole("worker", NWorkers);
+  ThreadInstrument::dumpLogBinary("thread_names.bin");
+
+  std::map<std::uint32_t, std::string> labels = read_labels("thread_names.bin");
+  check(labels.size() == NWorkers + 2, "Names in binary logs");
+  check(labels[0] == "main/worker/" + std::to_string(NWorkers), "Role set by the main thread");
+  check(labels[1] == "/worker/3", "Role of a worker in binary logs");
+  check(labels[NWorkers + 1] == "disk/io/0", "Name and role in binary logs");
+
+  // A name set after the first flush of the thread reaches the log of the flusher
+  ThreadInstrument::startLogFlusher("thread_names_flusher.bin", 0.01);
+  unsigned late_number = 0;
+  std::thread late([&late_number] {
+    ThreadInstrument::log("LATE", 1);
+    late_number = ThreadInstrument::getMyThreadNumber();
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    ThreadInstrument::setThreadName("late");
+    ThreadInstrument::log("LATE", 2);
+  });
+  late.join();
+  ThreadInstrument::stopLogFlusher();
+  labels = read_labels("thread_names_flusher.bin");
+  check(labels[late_number].compare(0, 5, "late/") == 0, "Name set after a flush");
+
+  std::remove("thread_names.bin");
+  std::remove("thread_names_flusher.bin");
+
+  return testResult();
+}
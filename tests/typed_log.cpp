@@ -0,0 +1,171 @@
+/*
+ ThreadInstrument: Library to monitor thread activity
+ Copyright (C) 2012-2022 Basilio B. Fraguela. Universidade da Coruna
+
+ Distributed under the MIT License. (See accompanying file LICENSE)
+*/
+
+///
+/// \file     typed_log.cpp
+/// \brief    Tests the log entries with typed payloads and their formatters
+/// \author   Basilio B. Fraguela <basilio.fraguela@udc.es>
+///
+
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+#include <atomic>
+#include <iostream>
+#include <new>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include "thread_instrument/thread_instrument.h"
+#include "thread_instrument/binary_log.h"
+#include "check.h"
+
+constexpr int NThreads = 2;
+constexpr int NReps = 100;
+
+struct Point {
+  int x, y;
+};
+
+/// Payload without formatter, printed in hexadecimal
+struct Raw {
+  unsigned char bytes[3];
+};
+
+/// Payload printed by a LogPrinter_t
+struct Message {
+  char text[12];
+};
+
+/// Memory allocations performed by the program
+std::atomic<unsigned> NAllocations {0};
+
+void *operator new(std::size_t size)
+{
+  NAllocations++;
+  void * const p = malloc(size ? size : 1);
+  if (p == nullptr) {
+    throw std::bad_alloc();
+  }
+  return p;
+}
+
+void operator delete(void *p) noexcept
+{
+  free(p);
+}
+
+std::size_t formatPoint(char *buf, std::size_t size, const Point& p)
+{
+  return std::min<std::size_t>(size - 1, snprintf(buf, size, "x=%d y=%d", p.x, p.y));
+}
+
+void thread_func()
+{
+  for (int i = 0; i < NReps; i++) {
+    // The payload is copied, so it need not outlive the entry
+    const Point p {i, -i};
+    ThreadInstrument::log("POINT", p, true);
+  }
+}
+
+/// Number of occurrences of \c s in \c text
+unsigned count(const std::string& text, const std::string& s)
+{ unsigned n = 0;
+
+  for (std::string::size_type pos = text.find(s); pos != std::string::npos; pos = text.find(s, pos + 1)) {
+    n++;
+  }
+
+  return n;
+}
+
+int main()
+{
+  ThreadInstrument::registerLogFormatter<Point>("POINT", formatPoint);
+  ThreadInstrument::registerLogPrinter("MESSAGE", [](void *p) {
+    return std::string(static_cast<Message *>(p)->text);
+  });
+
+  std::vector<std::thread> threads;
+  for (int i = 0; i < NThreads; i++) {
+    threads.emplace_back(thread_func);
+  }
+  for (auto& t : threads) {
+    t.join();
+  }
+
+  const Raw raw {{0x01, 0xab, 0xff}};
+  Message message;
+  strcpy(message.text, "hello");
+  ThreadInstrument::log("RAW", raw);
+  ThreadInstrument::log("MESSAGE", message);
+  ThreadInstrument::log("VALUE", 5);
+
+  std::ostringstream os;
+  ThreadInstrument::dumpLog(os);
+  const std::string text = os.str();
+  check(count(text, "POINT x=") == NThreads * NReps, "Formatted payloads");
+  check(count(text, "POINT x=7 y=-7\n") == NThreads, "Contents of the formatted payloads");
+  check(text.find("RAW 0x01abff\n") != std::string::npos, "Payload without formatter");
+  check(text.find("MESSAGE hello\n") != std::string::npos, "Payload printed by a printer");
+  check(text.find("VALUE5\n") != std::string::npos, "Integer data");
+
+  // Logging the payloads does not allocate memory once the log has storage
+  ThreadInstrument::reserveLog(4 * NReps);
+  ThreadInstrument::log("POINT", Point {0, 0});
+  const unsigned allocations = NAllocations;
+  for (int i = 0; i < NReps; i++) {
+    ThreadInstrument::log("POINT", Point {i, i}, true);
+  }
+  check(NAllocations == allocations, "No allocations when logging");
+
+  std::ostringstream os_chrome;
+  ThreadInstrument::dumpLogChromeTrace(os_chrome);
+  check(os_chrome.str().find("\"x=7 y=7\"") != std::string::npos, "Formatted payloads in Chrome traces");
+
+  thread_func();
+  ThreadInstrument::dumpLogBinary("typed_log.bin");
+
+  ThreadInstrument::BinaryLogSectionHeader section;
+  ThreadInstrument::BinaryLogRecord record;
+  int npoints = 0;
+  bool payloads_ok = true;
+  FILE *fin = fopen("typed_log.bin", "rb");
+  ThreadInstrument::BinaryLogReader reader(fin);
+  check((fin != nullptr) && reader.open(), "Valid binary log");
+  while (reader.nextSection(section)) {
+    while (reader.readRecord(record)) {
+      const void * const payload = reader.payload(record);
+      if ((payload != nullptr) && (record.payloadSize_ == sizeof(Point))) {
+        Point p;
+        memcpy(&p, payload, sizeof(p));
+        payloads_ok = payloads_ok && (p.x == npoints) && (p.y == -npoints);
+        npoints++;
+      }
+    }
+  }
+  if (fin != nullptr) {
+    fclose(fin);
+  }
+  check(payloads_ok && (npoints == NReps), "Payloads in binary logs");
+
+  // A SIGUSR1 received while the log is being dumped skips its own dump instead of deadlocking
+  ThreadInstrument::registerLogPrinter("INTERRUPTED", [](void *) {
+    raise(SIGUSR1);
+    return std::string("interrupted");
+  });
+  ThreadInstrument::log("INTERRUPTED", 0);
+  std::ostringstream os_interrupted;
+  ThreadInstrument::dumpLog(os_interrupted);
+  check(os_interrupted.str().find("interrupted\n") != std::string::npos, "SIGUSR1 during a dump");
+
+  return testResult();
+}